@@ -0,0 +1,500 @@
+/*++
+    Module Name:
+
+        rmibench.c
+
+    Abstract:
+
+        Benchmarks the touch report hot path routines of the RMI4 core,
+        started against the simulated controller with 32 object slots:
+
+            rmibench [iterations]
+
+        Each routine runs on frames of 0 to 32 contacts, after a warm up,
+        in several timed runs of the given iterations. The median run is
+        reported, with the allocations the routine made per call, as
+        comma separated lines:
+
+            routine,contacts,iterations,ns_per_call,allocs_per_call
+
+        pipeline    - a touch frame from interrupt to HID reports, through
+                      the simulated bus (TchServiceInterrupts)
+        decode      - F12 object decode (RmiDecodeTouchFrame)
+        filter      - the 1-euro filter (RmiFilterContacts), alternating
+                      between two frames so every contact moves
+        cache       - RmiUpdateLocalFingerCache, alternating between two
+                      frames so every contact moves
+        fill        - RmiFillNextHidReportFromCache, every report a frame
+                      takes
+        translate   - TchTranslateToDisplayCoordinates for every contact
+        descriptor  - RmiReadRegisterDescriptor of the F12 data registers,
+                      contacts is the number of object slots described
+        weight      - bitmap_weight of a slot map with contacts bits set
+        hweight32   - hweight32 of the same map
+        hweight64   - hweight64 of the map in both halves of a word, so
+                      twice the contacts bits set
+        findbit     - for_each_set_bit (find_next_bit) over the same map
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RMI_BENCH_RUNS                      5
+#define RMI_BENCH_SLOTS                     RMI4_MAX_TOUCHES
+
+typedef struct _RMI_BENCH
+{
+    RMI_SIM_HOST Host;
+    RMI4_CONTROLLER_CONTEXT* Controller;
+    ULONG Contacts;
+
+    RMI_SIM_FRAME Frames[2];
+    RMI4_F11_DATA_REGISTERS Data[2];
+    RMI4_F11_DATA_REGISTERS Scratch;
+    RMI4_FINGER_CACHE Cache;
+    PTP_REPORT Report;
+    unsigned long Map[BITS_TO_LONGS(RMI_BENCH_SLOTS)];
+    RMI_REGISTER_DESCRIPTOR Descriptor;
+    BYTE DescriptorAddress;
+
+    volatile ULONG Sink;
+} RMI_BENCH;
+
+typedef VOID (*PRMI_BENCH_ROUTINE)(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    );
+
+static
+ULONG64
+RmiBenchNow(
+    VOID
+    )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG64) now.tv_sec * 1000000000ULL + (ULONG64) now.tv_nsec;
+}
+
+static
+VOID
+RmiBenchPipeline(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    Bench->Host.ReportCount = 0;
+    RmiSimPostFrame(Bench->Host.Device, &Bench->Frames[Iteration & 1]);
+    RmiSimHostService(&Bench->Host);
+}
+
+static
+VOID
+RmiBenchDecode(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    UNREFERENCED_PARAMETER(Iteration);
+
+    Bench->Controller->FrameReady = TRUE;
+    RmiDecodeTouchFrame(Bench->Controller, &Bench->Scratch);
+}
+
+static
+VOID
+RmiBenchFilter(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    RMI4_FILTER_SETTINGS_LOGICAL* settings;
+
+    //
+    // The filter is off by default, it is only turned on for its own row
+    //
+    settings = &Bench->Controller->Config.FilterSettings;
+    settings->OneEuroFilter = 1;
+
+    Bench->Scratch = Bench->Data[Iteration & 1];
+    RmiFilterContacts(Bench->Controller, &Bench->Scratch);
+
+    settings->OneEuroFilter = 0;
+}
+
+static
+VOID
+RmiBenchCache(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    RmiUpdateLocalFingerCache(&Bench->Data[Iteration & 1], &Bench->Cache, 0);
+}
+
+static
+VOID
+RmiBenchFill(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    int reported;
+
+    UNREFERENCED_PARAMETER(Iteration);
+
+    reported = 0;
+
+    while (reported < Bench->Cache.FingerDownCount)
+    {
+        RmiFillNextHidReportFromCache(
+            &Bench->Report,
+            &Bench->Cache,
+            &Bench->Controller->Props,
+            &Bench->Controller->Config.PredictionSettings,
+            &reported,
+            Bench->Cache.FingerDownCount);
+    }
+}
+
+static
+VOID
+RmiBenchTranslate(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    USHORT x, y;
+    ULONG i;
+
+    for (i = 0; i < Bench->Contacts; i++)
+    {
+        x = (USHORT) Bench->Data[Iteration & 1].Finger[i].X;
+        y = (USHORT) Bench->Data[Iteration & 1].Finger[i].Y;
+        TchTranslateToDisplayCoordinates(&x, &y, &Bench->Controller->Props);
+        Bench->Sink += x + y;
+    }
+}
+
+static
+VOID
+RmiBenchDescriptor(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    UNREFERENCED_PARAMETER(Iteration);
+
+    RmiReadRegisterDescriptor(
+        &Bench->Host.Spb,
+        Bench->DescriptorAddress,
+        &Bench->Descriptor);
+}
+
+static
+VOID
+RmiBenchWeight(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    UNREFERENCED_PARAMETER(Iteration);
+
+    Bench->Sink += bitmap_weight(Bench->Map, RMI_BENCH_SLOTS);
+}
+
+static
+VOID
+RmiBenchHweight32(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    UNREFERENCED_PARAMETER(Iteration);
+
+    Bench->Sink += hweight32((unsigned int) Bench->Map[0]);
+}
+
+static
+VOID
+RmiBenchHweight64(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    ULONGLONG word;
+
+    UNREFERENCED_PARAMETER(Iteration);
+
+    word = (ULONGLONG) (unsigned int) Bench->Map[0];
+
+    Bench->Sink += (ULONG) hweight64(word << 32 | word);
+}
+
+static
+VOID
+RmiBenchFindBit(
+    IN RMI_BENCH *Bench,
+    IN ULONG Iteration
+    )
+{
+    unsigned long bit;
+
+    UNREFERENCED_PARAMETER(Iteration);
+
+    for_each_set_bit(bit, Bench->Map, RMI_BENCH_SLOTS)
+    {
+        Bench->Sink += (ULONG) bit;
+    }
+}
+
+static
+int
+RmiBenchCompare(
+    const void *A,
+    const void *B
+    )
+{
+    ULONG64 a = *(const ULONG64*) A;
+    ULONG64 b = *(const ULONG64*) B;
+
+    return (a > b) - (a < b);
+}
+
+static
+VOID
+RmiBenchRun(
+    IN RMI_BENCH *Bench,
+    IN const char *Name,
+    IN PRMI_BENCH_ROUTINE Routine,
+    IN ULONG Iterations,
+    IN BOOLEAN PerContact
+    )
+/*++
+
+Routine Description:
+
+    Times Routine over RMI_BENCH_RUNS runs of Iterations calls each, after
+    a warm up, and prints the median run per call with the allocations
+    made per call over all runs.
+
+--*/
+{
+    RMI_HOST_ALLOCATIONS before;
+    RMI_HOST_ALLOCATIONS after;
+    ULONG64 runs[RMI_BENCH_RUNS];
+    ULONG64 start;
+    ULONG run;
+    ULONG i;
+
+    for (i = 0; i < Iterations / 10 + 1; i++)
+    {
+        Routine(Bench, i);
+    }
+
+    RmiHostGetAllocations(&before);
+
+    for (run = 0; run < RMI_BENCH_RUNS; run++)
+    {
+        start = RmiBenchNow();
+
+        for (i = 0; i < Iterations; i++)
+        {
+            Routine(Bench, i);
+        }
+
+        runs[run] = RmiBenchNow() - start;
+    }
+
+    RmiHostGetAllocations(&after);
+
+    qsort(runs, RMI_BENCH_RUNS, sizeof(runs[0]), RmiBenchCompare);
+
+    printf("%s,", Name);
+
+    if (PerContact)
+    {
+        printf("%u", Bench->Contacts);
+    }
+
+    printf(",%u,%.1f,%.3f\n",
+        Iterations,
+        (double) runs[RMI_BENCH_RUNS / 2] / Iterations,
+        (double) (after.Allocations - before.Allocations) /
+            ((double) Iterations * RMI_BENCH_RUNS));
+}
+
+static
+VOID
+RmiBenchPrepare(
+    IN RMI_BENCH *Bench,
+    IN ULONG Contacts
+    )
+/*++
+
+Routine Description:
+
+    Builds two frames of Contacts fingers, the second moved from the
+    first, as simulator frames and decoded, and leaves the cache holding
+    the first. Contacts are spread over the object slots.
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_OBJECT* object;
+    BYTE* data1;
+    ULONG frame;
+    ULONG slot;
+    ULONG i;
+
+    controller = Bench->Controller;
+    Bench->Contacts = Contacts;
+
+    RtlZeroMemory(Bench->Frames, sizeof(Bench->Frames));
+    RtlZeroMemory(Bench->Map, sizeof(Bench->Map));
+
+    for (frame = 0; frame < 2; frame++)
+    {
+        Bench->Frames[frame].Event = RMI_SIM_EVENT_TOUCH;
+
+        for (i = 0; i < Contacts; i++)
+        {
+            slot = i * RMI_BENCH_SLOTS / Contacts;
+            object = &Bench->Frames[frame].Objects[slot];
+            object->Type = RMI_F12_OBJECT_FINGER;
+            object->X = (USHORT) (100 + slot * 30 + frame * 8);
+            object->Y = (USHORT) (200 + slot * 40 + frame * 8);
+            object->Z = 40;
+            object->wX = 4;
+            object->wY = 4;
+
+            bitmap_set(Bench->Map, slot, 1);
+        }
+
+        //
+        // The same packet the controller would send, decoded
+        //
+        RtlZeroMemory(controller->Frame.Packet, controller->PacketSize);
+        data1 = &controller->Frame.Packet[controller->Data1Offset];
+
+        for (slot = 0; slot < controller->MaxFingers; slot++)
+        {
+            object = &Bench->Frames[frame].Objects[slot];
+            data1[0] = object->Type;
+            data1[1] = (BYTE) object->X;
+            data1[2] = (BYTE) (object->X >> 8);
+            data1[3] = (BYTE) object->Y;
+            data1[4] = (BYTE) (object->Y >> 8);
+            data1[5] = object->Z;
+            data1[6] = object->wX;
+            data1[7] = object->wY;
+            data1 += F12_DATA1_BYTES_PER_OBJ;
+        }
+
+        RtlZeroMemory(&Bench->Data[frame], sizeof(Bench->Data[frame]));
+        controller->Frame.Empty = FALSE;
+        controller->FrameReady = TRUE;
+        RmiDecodeTouchFrame(controller, &Bench->Data[frame]);
+    }
+
+    RtlZeroMemory(&Bench->Cache, sizeof(Bench->Cache));
+    RmiUpdateLocalFingerCache(&Bench->Data[0], &Bench->Cache, 0);
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static const struct
+    {
+        const char* Name;
+        PRMI_BENCH_ROUTINE Routine;
+    } routines[] =
+    {
+        { "pipeline", RmiBenchPipeline },
+        { "decode", RmiBenchDecode },
+        { "filter", RmiBenchFilter },
+        { "cache", RmiBenchCache },
+        { "fill", RmiBenchFill },
+        { "translate", RmiBenchTranslate },
+        { "weight", RmiBenchWeight },
+        { "hweight32", RmiBenchHweight32 },
+        { "hweight64", RmiBenchHweight64 },
+        { "findbit", RmiBenchFindBit },
+    };
+    static RMI_BENCH bench;
+    RMI_SIM_LAYOUT layout;
+    RMI4_FUNCTION_DESCRIPTOR f12;
+    ULONG iterations;
+    ULONG contacts;
+    ULONG i;
+
+    iterations = 10000;
+
+    if (argc > 1)
+    {
+        iterations = strtoul(argv[1], NULL, 0);
+    }
+
+    if (iterations == 0)
+    {
+        fprintf(stderr, "usage: %s [iterations]\n", argv[0]);
+        return 2;
+    }
+
+    RmiSimDefaultLayout(&layout, RMI_BENCH_SLOTS);
+
+    if (!NT_SUCCESS(RmiSimHostStart(&bench.Host, &layout)))
+    {
+        fprintf(stderr, "%s: could not start the simulated controller\n", argv[0]);
+        return 1;
+    }
+
+    bench.Controller = (RMI4_CONTROLLER_CONTEXT*) bench.Host.Controller;
+
+    printf("routine,contacts,iterations,ns_per_call,allocs_per_call\n");
+
+    for (i = 0; i < RTL_NUMBER_OF(routines); i++)
+    {
+        for (contacts = 0; contacts <= RMI_BENCH_SLOTS; contacts++)
+        {
+            RmiBenchPrepare(&bench, contacts);
+            RmiBenchRun(&bench, routines[i].Name, routines[i].Routine, iterations, TRUE);
+        }
+    }
+
+    //
+    // The F12 data register descriptor follows the query and control ones,
+    // F12 is on the page the controller was left on
+    //
+    RmiSimFindFunction(bench.Host.Device, RMI4_F12_2D_TOUCHPAD_SENSOR, &f12);
+    bench.DescriptorAddress = (BYTE) (f12.QueryBase + 1 + 2 * 3);
+    bench.Contacts = bench.Controller->MaxFingers;
+    RmiBenchRun(&bench, "descriptor", RmiBenchDescriptor, iterations, TRUE);
+
+    if (bench.Descriptor.Registers != NULL)
+    {
+        RmiFree(bench.Descriptor.Registers, TOUCH_POOL_TAG_F12);
+    }
+
+    RmiSimHostStop(&bench.Host);
+
+    return 0;
+}
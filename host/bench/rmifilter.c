@@ -0,0 +1,362 @@
+/*++
+    Module Name:
+
+        rmifilter.c
+
+    Abstract:
+
+        Compares the positions the driver reports with and without the
+        1-euro filter against the true path of recorded gestures:
+
+            rmifilter [noise [frames]]
+
+        Every gesture is scanned at 120Hz with uniform noise of up to the
+        given sensor units (4 by default) on both axes, recorded as a
+        touch trace, and the trace is replayed with the filter off and on
+        (see RmiReplayTrace). The gestures are a held finger, a slow and
+        a fast swipe and a circle.
+
+        Output is comma separated, one line per gesture and filter state:
+
+            gesture,filter,frames,rms_error,max_error,jitter
+
+        Errors are the distance of the reported position from the true
+        one, in sensor units. jitter is the RMS difference between the
+        reported and the true motion from one frame to the next. The
+        filter should bring jitter down on every gesture. On the moving
+        ones it trades that for lag, which shows up as error.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#define RMI_FILTER_MAX_FRAMES               1024
+#define RMI_FILTER_PERIOD                   83333   // 120Hz, in 100ns units
+
+#define RMI_FILTER_HOLD                     0
+#define RMI_FILTER_SLOW_SWIPE               1
+#define RMI_FILTER_FAST_SWIPE               2
+#define RMI_FILTER_CIRCLE                   3
+
+typedef struct _RMI_FILTER_PATH
+{
+    ULONG Frames;
+    double X[RMI_FILTER_MAX_FRAMES];
+    double Y[RMI_FILTER_MAX_FRAMES];
+} RMI_FILTER_PATH;
+
+typedef struct _RMI_FILTER_RESULT
+{
+    const RMI_FILTER_PATH* Truth;
+    ULONG Frames;
+    double SquaredError;
+    double MaxError;
+    double SquaredJitter;
+    double LastX;
+    double LastY;
+} RMI_FILTER_RESULT;
+
+static ULONG gSeed = 1;
+
+static
+double
+RmiFilterNoise(
+    IN ULONG Noise
+    )
+{
+    gSeed = gSeed * 1103515245 + 12345;
+
+    return ((double) ((gSeed >> 16) & 0x7fff) / 0x7fff * 2.0 - 1.0) * Noise;
+}
+
+static
+VOID
+RmiFilterGesture(
+    IN ULONG Gesture,
+    IN ULONG Frames,
+    OUT RMI_FILTER_PATH *Path
+    )
+/*++
+
+Routine Description:
+
+    Lays out the true path of a gesture, one point per scan.
+
+--*/
+{
+    double t;
+    ULONG i;
+
+    Path->Frames = Frames;
+
+    for (i = 0; i < Frames; i++)
+    {
+        t = (double) i / Frames;
+
+        switch (Gesture)
+        {
+        case RMI_FILTER_HOLD:
+            Path->X[i] = 600.0;
+            Path->Y[i] = 600.0;
+            break;
+
+        case RMI_FILTER_SLOW_SWIPE:
+            Path->X[i] = 500.0 + 200.0 * t;
+            Path->Y[i] = 600.0;
+            break;
+
+        case RMI_FILTER_FAST_SWIPE:
+            Path->X[i] = 100.0 + 1000.0 * t;
+            Path->Y[i] = 300.0 + 500.0 * t;
+            break;
+
+        default:
+            Path->X[i] = 600.0 + 300.0 * cos(2.0 * M_PI * t);
+            Path->Y[i] = 600.0 + 300.0 * sin(2.0 * M_PI * t);
+            break;
+        }
+    }
+}
+
+static
+VOID
+RmiFilterRecord(
+    IN const RMI_FILTER_PATH *Path,
+    IN ULONG Noise
+    )
+/*++
+
+Routine Description:
+
+    Scans the gesture with noise on the simulated controller, with touch
+    trace capture on, and lifts the finger after the last point.
+
+--*/
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frame;
+    RMI_SIM_OBJECT* object;
+    ULONG i;
+
+    RmiHostSetSetting(L"TouchTraceSize", 256);
+
+    RmiSimDefaultLayout(&layout, 10);
+
+    if (!NT_SUCCESS(RmiSimHostStart(&host, &layout)))
+    {
+        RmiHostClearSettings();
+        return;
+    }
+
+    RmiHostClearSettings();
+
+    for (i = 0; i <= Path->Frames; i++)
+    {
+        RtlZeroMemory(&frame, sizeof(frame));
+
+        if (i < Path->Frames)
+        {
+            object = &frame.Objects[0];
+            object->Type = RMI_F12_OBJECT_FINGER;
+            object->X = (USHORT) lround(Path->X[i] + RmiFilterNoise(Noise));
+            object->Y = (USHORT) lround(Path->Y[i] + RmiFilterNoise(Noise));
+            object->Z = 50;
+            object->wX = 4;
+            object->wY = 4;
+        }
+
+        RmiSimAdvanceClock(host.Device, RMI_FILTER_PERIOD);
+        RmiSimPostFrame(host.Device, &frame);
+        RmiSimHostService(&host);
+    }
+
+    //
+    // Stopping writes the capture out
+    //
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+RmiFilterCompare(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    )
+{
+    RMI_FILTER_RESULT* result;
+    double dx, dy;
+    double error;
+    ULONG frame;
+
+    UNREFERENCED_PARAMETER(Timestamp);
+
+    result = (RMI_FILTER_RESULT*) Context;
+
+    if (Report->ContactCount == 0 || !Report->Contacts[0].TipSwitch)
+    {
+        return;
+    }
+
+    frame = result->Frames;
+
+    if (frame >= result->Truth->Frames)
+    {
+        return;
+    }
+
+    dx = Report->Contacts[0].X - result->Truth->X[frame];
+    dy = Report->Contacts[0].Y - result->Truth->Y[frame];
+    error = sqrt(dx * dx + dy * dy);
+
+    result->SquaredError += error * error;
+    result->MaxError = max(result->MaxError, error);
+
+    if (frame != 0)
+    {
+        dx = (Report->Contacts[0].X - result->LastX) -
+            (result->Truth->X[frame] - result->Truth->X[frame - 1]);
+        dy = (Report->Contacts[0].Y - result->LastY) -
+            (result->Truth->Y[frame] - result->Truth->Y[frame - 1]);
+        result->SquaredJitter += dx * dx + dy * dy;
+    }
+
+    result->LastX = Report->Contacts[0].X;
+    result->LastY = Report->Contacts[0].Y;
+    result->Frames++;
+}
+
+static
+NTSTATUS
+RmiFilterReplay(
+    IN const char *Trace,
+    IN const char *Gesture,
+    IN const RMI_FILTER_PATH *Path,
+    IN BOOLEAN Filter
+    )
+{
+    RMI_REPLAY_STATISTICS statistics;
+    RMI_FILTER_RESULT result;
+    NTSTATUS status;
+
+    RtlZeroMemory(&result, sizeof(result));
+    result.Truth = Path;
+
+    RmiHostSetSetting(L"OneEuroFilter", Filter);
+
+    status = RmiReplayTrace(
+        Trace,
+        RMI_REPLAY_MAX_SPEED,
+        RmiFilterCompare,
+        &result,
+        &statistics);
+
+    RmiHostClearSettings();
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    if (result.Frames != Path->Frames)
+    {
+        return STATUS_UNSUCCESSFUL;
+    }
+
+    printf("%s,%s,%u,%.2f,%.2f,%.2f\n",
+        Gesture,
+        Filter ? "on" : "off",
+        result.Frames,
+        sqrt(result.SquaredError / result.Frames),
+        result.MaxError,
+        result.Frames < 2 ? 0.0 : sqrt(result.SquaredJitter / (result.Frames - 1)));
+
+    return STATUS_SUCCESS;
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static const char* gestures[] =
+    {
+        "hold",
+        "slow_swipe",
+        "fast_swipe",
+        "circle",
+    };
+    static RMI_FILTER_PATH path;
+    char trace[64];
+    ULONG noise;
+    ULONG frames;
+    ULONG i;
+    NTSTATUS status;
+
+    noise = 4;
+    frames = 120;
+
+    if (argc > 1)
+    {
+        noise = strtoul(argv[1], NULL, 0);
+    }
+
+    if (argc > 2)
+    {
+        frames = strtoul(argv[2], NULL, 0);
+    }
+
+    if (noise > 100 || frames < 2 || frames > RMI_FILTER_MAX_FRAMES)
+    {
+        fprintf(stderr, "usage: %s [noise (0-100) [frames (2-%u)]]\n",
+            argv[0], RMI_FILTER_MAX_FRAMES);
+        return 2;
+    }
+
+    wcstombs(trace, RMI_TRACE_FILE_PATH, sizeof(trace));
+
+    printf("gesture,filter,frames,rms_error,max_error,jitter\n");
+
+    for (i = 0; i < RTL_NUMBER_OF(gestures); i++)
+    {
+        unlink(trace);
+
+        RmiFilterGesture(i, frames, &path);
+        RmiFilterRecord(&path, noise);
+
+        status = RmiFilterReplay(trace, gestures[i], &path, FALSE);
+
+        if (NT_SUCCESS(status))
+        {
+            status = RmiFilterReplay(trace, gestures[i], &path, TRUE);
+        }
+
+        if (!NT_SUCCESS(status))
+        {
+            fprintf(stderr, "%s: replaying %s failed - 0x%08x\n",
+                argv[0], gestures[i], (unsigned int) status);
+            unlink(trace);
+            return 1;
+        }
+    }
+
+    unlink(trace);
+
+    return 0;
+}
@@ -0,0 +1,241 @@
+/*++
+    Module Name:
+
+        rmiload.c
+
+    Abstract:
+
+        Measures the throughput of the report pipeline under the synthetic
+        workloads of rmisynth.c, started against the simulated controller
+        with 32 object slots:
+
+            rmiload [frames [scan rate]]
+
+        For every model and contact count from 1 to 32, the harness raises
+        synthetic frames the way the synthetic frame timer does, back to
+        back, and times every servicing pass. Synthetic frames take no bus
+        time, so this is the cost of the pipeline alone: decode, rejection
+        and filtering, the finger cache and HID report building.
+
+        Output is comma separated:
+
+            model,contacts,frames,reports_per_frame,p50_ns,p99_ns,frames_per_s,load_percent
+
+        frames_per_s is the rate the pipeline sustained back to back,
+        load_percent the share of the frame period at the scan rate
+        (SyntheticRate, 120Hz by default) the mean pass takes.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RMI_LOAD_SLOTS                      RMI4_MAX_TOUCHES
+
+static
+ULONG64
+RmiLoadNow(
+    VOID
+    )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG64) now.tv_sec * 1000000000ULL + (ULONG64) now.tv_nsec;
+}
+
+static
+int
+RmiLoadCompare(
+    const void *A,
+    const void *B
+    )
+{
+    ULONG64 a = *(const ULONG64*) A;
+    ULONG64 b = *(const ULONG64*) B;
+
+    return (a > b) - (a < b);
+}
+
+static
+NTSTATUS
+RmiLoadRun(
+    IN const char *Model,
+    IN ULONG Workload,
+    IN ULONG Contacts,
+    IN ULONG Frames,
+    IN ULONG Rate,
+    IN ULONG64 *Latency
+    )
+/*++
+
+Routine Description:
+
+    Starts the driver with a synthetic workload, services Frames frames
+    of it and prints the pass times and rates.
+
+--*/
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    ULONG64 period;
+    ULONG64 total;
+    ULONG64 start;
+    ULONG64 reports;
+    ULONG frame;
+    NTSTATUS status;
+
+    RmiHostSetSetting(L"SyntheticWorkload", Workload);
+    RmiHostSetSetting(L"SyntheticContacts", Contacts);
+    RmiHostSetSetting(L"SyntheticRate", Rate);
+
+    RmiSimDefaultLayout(&layout, RMI_LOAD_SLOTS);
+    status = RmiSimHostStart(&host, &layout);
+
+    RmiHostClearSettings();
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    //
+    // The driver sees the frames arrive at the scan rate
+    //
+    period = 10000000ULL / Rate;
+    reports = 0;
+    total = 0;
+
+    for (frame = 0; frame < Frames; frame++)
+    {
+        RmiSimAdvanceClock(host.Device, period);
+        host.ReportCount = 0;
+
+        start = RmiLoadNow();
+        status = RmiSimHostServiceSynthetic(&host);
+        Latency[frame] = RmiLoadNow() - start;
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        total += Latency[frame];
+        reports += host.ReportCount;
+    }
+
+    RmiSimHostStop(&host);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    qsort(Latency, Frames, sizeof(Latency[0]), RmiLoadCompare);
+
+    printf("%s,%u,%u,%.2f,%llu,%llu,%.0f,%.3f\n",
+        Model,
+        Contacts,
+        Frames,
+        (double) reports / Frames,
+        (unsigned long long) Latency[(Frames - 1) * 50 / 100],
+        (unsigned long long) Latency[(Frames - 1) * 99 / 100],
+        total == 0 ? 0.0 : (double) Frames * 1000000000.0 / (double) total,
+        (double) total / Frames * Rate / 10000000.0);
+
+    return STATUS_SUCCESS;
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static const struct
+    {
+        const char* Name;
+        ULONG Workload;
+    } models[] =
+    {
+        { "tap", RMI4_SYNTHETIC_TAP },
+        { "fling", RMI4_SYNTHETIC_FLING },
+        { "pinch", RMI4_SYNTHETIC_PINCH },
+        { "drum", RMI4_SYNTHETIC_DRUM },
+        { "palm", RMI4_SYNTHETIC_PALM },
+        { "edge", RMI4_SYNTHETIC_EDGE },
+    };
+    ULONG64* latency;
+    ULONG frames;
+    ULONG rate;
+    ULONG contacts;
+    ULONG i;
+    NTSTATUS status;
+
+    frames = 1000;
+    rate = 120;
+
+    if (argc > 1)
+    {
+        frames = strtoul(argv[1], NULL, 0);
+    }
+
+    if (argc > 2)
+    {
+        rate = strtoul(argv[2], NULL, 0);
+    }
+
+    if (frames == 0 || rate == 0 || rate > 1000)
+    {
+        fprintf(stderr, "usage: %s [frames [scan rate (1-1000Hz)]]\n", argv[0]);
+        return 2;
+    }
+
+    latency = calloc(frames, sizeof(ULONG64));
+
+    if (latency == NULL)
+    {
+        return 1;
+    }
+
+    printf("model,contacts,frames,reports_per_frame,p50_ns,p99_ns,frames_per_s,load_percent\n");
+
+    for (i = 0; i < RTL_NUMBER_OF(models); i++)
+    {
+        for (contacts = 1; contacts <= RMI_LOAD_SLOTS; contacts++)
+        {
+            status = RmiLoadRun(
+                models[i].Name,
+                models[i].Workload,
+                contacts,
+                frames,
+                rate,
+                latency);
+
+            if (!NT_SUCCESS(status))
+            {
+                fprintf(stderr, "%s: %s with %u contacts failed - 0x%08x\n",
+                    argv[0], models[i].Name, contacts, (unsigned int) status);
+                free(latency);
+                return 1;
+            }
+        }
+    }
+
+    free(latency);
+
+    return 0;
+}
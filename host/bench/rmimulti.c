@@ -0,0 +1,339 @@
+/*++
+    Module Name:
+
+        rmimulti.c
+
+    Abstract:
+
+        Runs several controller instances side by side, the way systems
+        with more than one digitizer do, each on its own simulated
+        controller and bus, serviced from its own thread through the full
+        interrupt-to-report pipeline:
+
+            rmimulti [instances [frames]]
+
+        The instances are run alone first, one at a time, and then all at
+        once. Per instance latency percentiles of the servicing passes
+        are reported for both, as measured around each pass, and as kept
+        by the driver's own latency histogram, which runs on the simulated
+        clock and so holds the modeled bus time. The frame rate each
+        instance sustained is reported too. Instances that serialize on
+        shared state lose rate and gain latency when run together.
+
+        Output is comma separated:
+
+            run,instance,frames,p50_ns,p90_ns,p99_ns,driver_p50_ns,driver_p90_ns,driver_p99_ns,frames_per_s
+            scaling,<instances>,<frames/s together>,<frames/s alone>,<percent>
+
+        Writable globals of the core, which instances would share, are
+        checked at build time by rmiglobals.cmake.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RMI_MULTI_MAX_INSTANCES             16
+#define RMI_MULTI_SCENARIO_FRAMES           64
+#define RMI_MULTI_CONTACTS                  10
+
+typedef struct _RMI_MULTI_INSTANCE
+{
+    RMI_SIM_HOST Host;
+    pthread_t Thread;
+    pthread_barrier_t* Start;
+    ULONG Frames;
+    ULONG64* Latency;
+    ULONG64 WallTime;
+    ULONG Reports;
+    NTSTATUS Status;
+} RMI_MULTI_INSTANCE;
+
+static RMI_SIM_FRAME gScenario[RMI_MULTI_SCENARIO_FRAMES];
+
+static
+ULONG64
+RmiMultiNow(
+    VOID
+    )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG64) now.tv_sec * 1000000000ULL + (ULONG64) now.tv_nsec;
+}
+
+static
+int
+RmiMultiCompare(
+    const void *A,
+    const void *B
+    )
+{
+    ULONG64 a = *(const ULONG64*) A;
+    ULONG64 b = *(const ULONG64*) B;
+
+    return (a > b) - (a < b);
+}
+
+static
+void*
+RmiMultiService(
+    void *Context
+    )
+/*++
+
+Routine Description:
+
+    Instance thread, plays the swipe scenario over and over for the given
+    number of frames and times every servicing pass.
+
+--*/
+{
+    RMI_MULTI_INSTANCE* instance;
+    ULONG64 start;
+    ULONG64 pass;
+    ULONG frame;
+
+    instance = (RMI_MULTI_INSTANCE*) Context;
+
+    //
+    // The driver's clock is the instance's simulated one on this thread
+    //
+    RmiHostUseVirtualClock(RmiSimGetClock(instance->Host.Device));
+
+    if (instance->Start != NULL)
+    {
+        pthread_barrier_wait(instance->Start);
+    }
+
+    start = RmiMultiNow();
+
+    for (frame = 0; frame < instance->Frames; frame++)
+    {
+        instance->Host.ReportCount = 0;
+        RmiSimPostFrame(
+            instance->Host.Device,
+            &gScenario[frame % RMI_MULTI_SCENARIO_FRAMES]);
+
+        pass = RmiMultiNow();
+        instance->Status = RmiSimHostService(&instance->Host);
+        instance->Latency[frame] = RmiMultiNow() - pass;
+
+        if (!NT_SUCCESS(instance->Status))
+        {
+            break;
+        }
+
+        instance->Reports += instance->Host.ReportCount;
+    }
+
+    instance->WallTime = RmiMultiNow() - start;
+
+    return NULL;
+}
+
+static
+BOOLEAN
+RmiMultiStart(
+    IN RMI_MULTI_INSTANCE *Instance,
+    IN ULONG Frames
+    )
+{
+    RMI_SIM_LAYOUT layout;
+
+    RtlZeroMemory(Instance, sizeof(*Instance));
+
+    RmiSimDefaultLayout(&layout, RMI_MULTI_CONTACTS);
+    Instance->Frames = Frames;
+    Instance->Latency = calloc(Frames, sizeof(ULONG64));
+
+    return Instance->Latency != NULL &&
+        NT_SUCCESS(RmiSimHostStart(&Instance->Host, &layout));
+}
+
+static
+VOID
+RmiMultiStop(
+    IN RMI_MULTI_INSTANCE *Instance
+    )
+{
+    RmiSimHostStop(&Instance->Host);
+    free(Instance->Latency);
+}
+
+static
+double
+RmiMultiReport(
+    IN const char *Run,
+    IN ULONG Index,
+    IN RMI_MULTI_INSTANCE *Instance
+    )
+/*++
+
+Routine Description:
+
+    Prints the latency percentiles and frame rate of an instance run.
+
+Return Value:
+
+    Frames per second the instance sustained
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    ULONG64* latency;
+    ULONG frames;
+    double rate;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) Instance->Host.Controller;
+    latency = Instance->Latency;
+    frames = Instance->Frames;
+
+    qsort(latency, frames, sizeof(latency[0]), RmiMultiCompare);
+
+    rate = Instance->WallTime == 0 ? 0.0 :
+        (double) frames * 1000000000.0 / (double) Instance->WallTime;
+
+    printf("%s,%u,%u,%llu,%llu,%llu,%llu,%llu,%llu,%.0f\n",
+        Run,
+        Index,
+        frames,
+        (unsigned long long) latency[(frames - 1) * 50 / 100],
+        (unsigned long long) latency[(frames - 1) * 90 / 100],
+        (unsigned long long) latency[(frames - 1) * 99 / 100],
+        (unsigned long long) RmiServiceLatencyPercentile(controller, 50) * 100,
+        (unsigned long long) RmiServiceLatencyPercentile(controller, 90) * 100,
+        (unsigned long long) RmiServiceLatencyPercentile(controller, 99) * 100,
+        rate);
+
+    return rate;
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static RMI_MULTI_INSTANCE instances[RMI_MULTI_MAX_INSTANCES];
+    pthread_barrier_t start;
+    double alone;
+    double together;
+    ULONG count;
+    ULONG frames;
+    ULONG i;
+    int failed;
+
+    count = 4;
+    frames = 20000;
+    failed = 0;
+
+    if (argc > 1)
+    {
+        count = strtoul(argv[1], NULL, 0);
+    }
+
+    if (argc > 2)
+    {
+        frames = strtoul(argv[2], NULL, 0);
+    }
+
+    if (count == 0 || count > RMI_MULTI_MAX_INSTANCES || frames == 0)
+    {
+        fprintf(stderr, "usage: %s [instances (1-%u) [frames]]\n",
+            argv[0], RMI_MULTI_MAX_INSTANCES);
+        return 2;
+    }
+
+    RmiSimSwipeScenario(
+        RMI_MULTI_CONTACTS,
+        RMI_MULTI_SCENARIO_FRAMES,
+        0,
+        gScenario);
+
+    printf("run,instance,frames,p50_ns,p90_ns,p99_ns,"
+        "driver_p50_ns,driver_p90_ns,driver_p99_ns,frames_per_s\n");
+
+    //
+    // Every instance alone, for the baseline
+    //
+    alone = 0.0;
+
+    for (i = 0; i < count; i++)
+    {
+        if (!RmiMultiStart(&instances[i], frames))
+        {
+            fprintf(stderr, "%s: could not start instance %u\n", argv[0], i);
+            return 1;
+        }
+
+        RmiMultiService(&instances[i]);
+        failed |= !NT_SUCCESS(instances[i].Status) || instances[i].Reports == 0;
+        alone += RmiMultiReport("alone", i, &instances[i]);
+        RmiMultiStop(&instances[i]);
+    }
+
+    alone /= count;
+
+    //
+    // All instances at once, released together
+    //
+    pthread_barrier_init(&start, NULL, count);
+
+    for (i = 0; i < count; i++)
+    {
+        if (!RmiMultiStart(&instances[i], frames))
+        {
+            fprintf(stderr, "%s: could not start instance %u\n", argv[0], i);
+            return 1;
+        }
+
+        instances[i].Start = &start;
+    }
+
+    for (i = 0; i < count; i++)
+    {
+        pthread_create(&instances[i].Thread, NULL, RmiMultiService, &instances[i]);
+    }
+
+    together = 0.0;
+
+    for (i = 0; i < count; i++)
+    {
+        pthread_join(instances[i].Thread, NULL);
+        failed |= !NT_SUCCESS(instances[i].Status) || instances[i].Reports == 0;
+        together += RmiMultiReport("together", i, &instances[i]);
+        RmiMultiStop(&instances[i]);
+    }
+
+    pthread_barrier_destroy(&start);
+
+    printf("scaling,%u,%.0f,%.0f,%.0f\n",
+        count,
+        together,
+        alone * count,
+        alone == 0.0 ? 0.0 : together * 100.0 / (alone * count));
+
+    if (failed)
+    {
+        fprintf(stderr, "%s: an instance failed to service its frames\n", argv[0]);
+        return 1;
+    }
+
+    return 0;
+}
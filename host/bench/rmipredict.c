@@ -0,0 +1,477 @@
+/*++
+    Module Name:
+
+        rmipredict.c
+
+    Abstract:
+
+        Measures how far motion prediction lands from where contacts
+        really went, by replaying a touch trace at several prediction
+        horizons:
+
+            rmipredict [trace|- [max distance]]
+
+        The trace is replayed once with prediction off. Positions
+        reported there are the ground truth. It is then replayed with
+        PredictionHorizon set to each horizon in turn, and every
+        predicted position is compared with the true position of the
+        same contact one horizon later, interpolated between the scans
+        around it. Positions no longer down one horizon later are left
+        out. Without a trace, or with -, a swipe that speeds up, a fling
+        that slows down, a circle and a pinch are recorded with one
+        sensor unit of noise and replayed. PredictionMaxDistance is the
+        driver default unless given.
+
+        Output is comma separated, one line per horizon:
+
+            horizon_ms,max_distance,samples,rms_error,p95_error,max_error,unpredicted_rms_error
+
+        Errors are in sensor units. unpredicted_rms_error is the error of
+        the position reported without prediction against the same true
+        positions, the lag prediction is meant to take out.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <math.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#define RMI_PREDICT_PERIOD                  83333   // 120Hz, in 100ns units
+#define RMI_PREDICT_GESTURE_FRAMES          120
+#define RMI_PREDICT_GESTURES                4
+#define RMI_PREDICT_NOISE                   1
+
+typedef struct _RMI_PREDICT_SAMPLE
+{
+    ULONG64 Time;
+    BYTE Id;
+    BOOLEAN Tip;
+    USHORT X;
+    USHORT Y;
+} RMI_PREDICT_SAMPLE;
+
+typedef struct _RMI_PREDICT_RUN
+{
+    ULONG Count;
+    ULONG Size;
+    RMI_PREDICT_SAMPLE* Samples;
+} RMI_PREDICT_RUN;
+
+static ULONG gSeed = 1;
+
+static
+double
+RmiPredictNoise(
+    VOID
+    )
+{
+    gSeed = gSeed * 1103515245 + 12345;
+
+    return ((double) ((gSeed >> 16) & 0x7fff) / 0x7fff * 2.0 - 1.0) * RMI_PREDICT_NOISE;
+}
+
+static
+VOID
+RmiPredictPlace(
+    OUT RMI_SIM_OBJECT *Object,
+    IN double X,
+    IN double Y
+    )
+{
+    Object->Type = RMI_F12_OBJECT_FINGER;
+    Object->X = (USHORT) lround(X + RmiPredictNoise());
+    Object->Y = (USHORT) lround(Y + RmiPredictNoise());
+    Object->Z = 50;
+    Object->wX = 4;
+    Object->wY = 4;
+}
+
+static
+BOOLEAN
+RmiPredictRecord(
+    VOID
+    )
+/*++
+
+Routine Description:
+
+    Scans the built-in gestures on the simulated controller with touch
+    trace capture on, lifting every contact between them.
+
+--*/
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frame;
+    double t, s;
+    ULONG gesture;
+    ULONG i;
+
+    RmiHostSetSetting(L"TouchTraceSize", 256);
+
+    RmiSimDefaultLayout(&layout, 10);
+
+    if (!NT_SUCCESS(RmiSimHostStart(&host, &layout)))
+    {
+        RmiHostClearSettings();
+        return FALSE;
+    }
+
+    RmiHostClearSettings();
+
+    for (gesture = 0; gesture < RMI_PREDICT_GESTURES; gesture++)
+    {
+        for (i = 0; i <= RMI_PREDICT_GESTURE_FRAMES; i++)
+        {
+            RtlZeroMemory(&frame, sizeof(frame));
+            t = (double) i / RMI_PREDICT_GESTURE_FRAMES;
+
+            if (i < RMI_PREDICT_GESTURE_FRAMES)
+            {
+                switch (gesture)
+                {
+                case 0:
+                    RmiPredictPlace(&frame.Objects[0], 100.0 + 900.0 * t * t, 400.0);
+                    break;
+
+                case 1:
+                    s = 1.0 - (1.0 - t) * (1.0 - t);
+                    RmiPredictPlace(&frame.Objects[0], 1000.0 - 900.0 * s, 300.0 + 500.0 * s);
+                    break;
+
+                case 2:
+                    RmiPredictPlace(
+                        &frame.Objects[0],
+                        600.0 + 300.0 * cos(2.0 * M_PI * t),
+                        600.0 + 300.0 * sin(2.0 * M_PI * t));
+                    break;
+
+                default:
+                    RmiPredictPlace(&frame.Objects[0], 500.0 - 300.0 * t, 500.0 - 300.0 * t);
+                    RmiPredictPlace(&frame.Objects[1], 700.0 + 300.0 * t, 700.0 + 300.0 * t);
+                    break;
+                }
+            }
+
+            RmiSimAdvanceClock(host.Device, RMI_PREDICT_PERIOD);
+            RmiSimPostFrame(host.Device, &frame);
+            RmiSimHostService(&host);
+        }
+    }
+
+    //
+    // Stopping writes the capture out
+    //
+    RmiSimHostStop(&host);
+
+    return TRUE;
+}
+
+static
+VOID
+RmiPredictCollect(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    )
+{
+    RMI_PREDICT_RUN* run;
+    RMI_PREDICT_SAMPLE* samples;
+    RMI_PREDICT_SAMPLE* sample;
+    const PTP_CONTACT* contact;
+    ULONG i;
+
+    run = (RMI_PREDICT_RUN*) Context;
+
+    for (i = 0; i < RTL_NUMBER_OF(Report->Contacts); i++)
+    {
+        contact = &Report->Contacts[i];
+
+        if (!contact->TipSwitch && contact->X == 0 && contact->Y == 0)
+        {
+            continue;
+        }
+
+        if (run->Count == run->Size)
+        {
+            samples = realloc(
+                run->Samples,
+                (run->Size * 2 + 256) * sizeof(RMI_PREDICT_SAMPLE));
+
+            if (samples == NULL)
+            {
+                return;
+            }
+
+            run->Samples = samples;
+            run->Size = run->Size * 2 + 256;
+        }
+
+        sample = &run->Samples[run->Count++];
+        sample->Time = Timestamp;
+        sample->Id = contact->ContactID;
+        sample->Tip = contact->TipSwitch;
+        sample->X = contact->X;
+        sample->Y = contact->Y;
+    }
+}
+
+static
+BOOLEAN
+RmiPredictTruth(
+    IN const RMI_PREDICT_RUN *Truth,
+    IN ULONG Index,
+    IN ULONG64 Horizon,
+    OUT double *X,
+    OUT double *Y
+    )
+/*++
+
+Routine Description:
+
+    Finds where the contact of sample Index really was Horizon later,
+    interpolating between the two scans of it around that time.
+
+Return Value:
+
+    FALSE if the contact lifted, or the trace ended, before then
+
+--*/
+{
+    const RMI_PREDICT_SAMPLE* previous;
+    const RMI_PREDICT_SAMPLE* sample;
+    ULONG64 target;
+    double f;
+    ULONG i;
+
+    previous = &Truth->Samples[Index];
+    target = previous->Time + Horizon;
+
+    for (i = Index + 1; i < Truth->Count; i++)
+    {
+        sample = &Truth->Samples[i];
+
+        if (sample->Id != previous->Id)
+        {
+            continue;
+        }
+
+        if (!sample->Tip)
+        {
+            return FALSE;
+        }
+
+        if (sample->Time >= target)
+        {
+            f = sample->Time == previous->Time ? 1.0 :
+                (double) (target - previous->Time) /
+                (double) (sample->Time - previous->Time);
+
+            *X = previous->X + (sample->X - previous->X) * f;
+            *Y = previous->Y + (sample->Y - previous->Y) * f;
+
+            return TRUE;
+        }
+
+        previous = sample;
+    }
+
+    return FALSE;
+}
+
+static
+NTSTATUS
+RmiPredictReplay(
+    IN const char *Trace,
+    IN ULONG Horizon,
+    IN ULONG MaxDistance,
+    OUT RMI_PREDICT_RUN *Run
+    )
+{
+    RMI_REPLAY_STATISTICS statistics;
+    NTSTATUS status;
+
+    Run->Count = 0;
+
+    RmiHostSetSetting(L"PredictionHorizon", Horizon);
+    RmiHostSetSetting(L"PredictionMaxDistance", MaxDistance);
+
+    status = RmiReplayTrace(
+        Trace,
+        RMI_REPLAY_MAX_SPEED,
+        RmiPredictCollect,
+        Run,
+        &statistics);
+
+    RmiHostClearSettings();
+
+    return status;
+}
+
+static
+int
+RmiPredictCompare(
+    const void *A,
+    const void *B
+    )
+{
+    double a = *(const double*) A;
+    double b = *(const double*) B;
+
+    return (a > b) - (a < b);
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static const ULONG horizons[] = { 8, 16, 24, 32, 48, 64 };
+    static RMI_PREDICT_RUN truth;
+    static RMI_PREDICT_RUN predicted;
+    const RMI_PREDICT_SAMPLE* sample;
+    char recorded[64];
+    const char* trace;
+    double* errors;
+    double squared;
+    double unpredicted;
+    double x, y;
+    ULONG maxDistance;
+    ULONG count;
+    ULONG h;
+    ULONG i;
+    NTSTATUS status;
+    int result;
+
+    wcstombs(recorded, RMI_TRACE_FILE_PATH, sizeof(recorded));
+    trace = recorded;
+    maxDistance = 100;
+    result = 1;
+    errors = NULL;
+
+    if (argc > 1 && strcmp(argv[1], "-") != 0)
+    {
+        trace = argv[1];
+    }
+
+    if (argc > 2)
+    {
+        maxDistance = strtoul(argv[2], NULL, 0);
+    }
+
+    if (argc > 3 || maxDistance == 0)
+    {
+        fprintf(stderr, "usage: %s [trace|- [max distance]]\n", argv[0]);
+        return 2;
+    }
+
+    if (trace == recorded)
+    {
+        unlink(recorded);
+
+        if (!RmiPredictRecord())
+        {
+            fprintf(stderr, "%s: could not start the simulated controller\n", argv[0]);
+            return 1;
+        }
+    }
+
+    status = RmiPredictReplay(trace, 0, maxDistance, &truth);
+
+    if (!NT_SUCCESS(status) || truth.Count == 0)
+    {
+        fprintf(stderr, "%s: could not replay %s - 0x%08x\n",
+            argv[0], trace, (unsigned int) status);
+        goto exit;
+    }
+
+    errors = calloc(truth.Count, sizeof(double));
+
+    if (errors == NULL)
+    {
+        goto exit;
+    }
+
+    printf("horizon_ms,max_distance,samples,rms_error,p95_error,max_error,unpredicted_rms_error\n");
+
+    for (h = 0; h < RTL_NUMBER_OF(horizons); h++)
+    {
+        status = RmiPredictReplay(trace, horizons[h], maxDistance, &predicted);
+
+        //
+        // Prediction moves contacts, it never adds or drops one
+        //
+        if (!NT_SUCCESS(status) || predicted.Count != truth.Count)
+        {
+            fprintf(stderr, "%s: replay at %ums diverged - 0x%08x\n",
+                argv[0], horizons[h], (unsigned int) status);
+            goto exit;
+        }
+
+        count = 0;
+        squared = 0.0;
+        unpredicted = 0.0;
+
+        for (i = 0; i < truth.Count; i++)
+        {
+            sample = &predicted.Samples[i];
+
+            if (!sample->Tip ||
+                !RmiPredictTruth(&truth, i, horizons[h] * 10000ULL, &x, &y))
+            {
+                continue;
+            }
+
+            errors[count] = hypot(sample->X - x, sample->Y - y);
+            squared += errors[count] * errors[count];
+            unpredicted += pow(hypot(truth.Samples[i].X - x, truth.Samples[i].Y - y), 2);
+            count++;
+        }
+
+        if (count == 0)
+        {
+            printf("%u,%u,0,,,,\n", horizons[h], maxDistance);
+            continue;
+        }
+
+        qsort(errors, count, sizeof(errors[0]), RmiPredictCompare);
+
+        printf("%u,%u,%u,%.2f,%.2f,%.2f,%.2f\n",
+            horizons[h],
+            maxDistance,
+            count,
+            sqrt(squared / count),
+            errors[(count - 1) * 95 / 100],
+            errors[count - 1],
+            sqrt(unpredicted / count));
+    }
+
+    result = 0;
+
+exit:
+
+    if (trace == recorded)
+    {
+        unlink(recorded);
+    }
+
+    free(errors);
+    free(truth.Samples);
+    free(predicted.Samples);
+
+    return result;
+}
@@ -0,0 +1,417 @@
+/*++
+    Module Name:
+
+        rmihost.h
+
+    Abstract:
+
+        User-mode (POSIX) backend of the platform layer in compat.h.
+        Supplies the Windows types, status codes and annotations the
+        RMI4 core is written against, and implements the core's
+        services on pthreads, the C library and a simulated bus:
+
+        Lock      - pthread mutexes
+        Allocator - malloc, with allocation counters for benchmarks
+        Clock     - CLOCK_MONOTONIC, or a per-thread virtual clock set
+                    by RmiHostUseVirtualClock
+        Random    - a linear congruential sequence like RtlRandomEx
+        Bus       - SPB transactions through an RMI_HOST_TARGET
+        Config    - process-wide values set with RmiHostSetSetting,
+                    table defaults otherwise
+        File      - stdio, paths relative to the working directory
+        Trace     - WPP messages printed to stderr up to the level set
+                    with RmiHostSetTraceLevel or RMI_HOST_TRACE_LEVEL
+
+        Only builds with RMI_HOST defined include this header.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#pragma once
+
+#ifndef __RMIHOST_H__
+#define __RMIHOST_H__
+
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <assert.h>
+#include <wchar.h>
+
+//
+// Windows (LLP64) types
+//
+
+typedef void VOID, *PVOID;
+typedef char CHAR, *PCHAR;
+typedef unsigned char UCHAR, *PUCHAR, BYTE, *PBYTE, BOOLEAN, UINT8;
+typedef short SHORT;
+typedef unsigned short USHORT, *PUSHORT, UINT16;
+typedef int LONG, *PLONG, INT32;
+typedef unsigned int ULONG, *PULONG, UINT, UINT32;
+typedef long long LONG64, LONGLONG;
+typedef unsigned long long ULONG64, *PULONG64, ULONGLONG, UINT64;
+typedef size_t SIZE_T;
+typedef uintptr_t ULONG_PTR;
+typedef wchar_t WCHAR, *PWSTR;
+typedef const wchar_t *PCWSTR;
+typedef void *HANDLE;
+typedef LONG NTSTATUS;
+
+typedef union _LARGE_INTEGER
+{
+    struct
+    {
+        ULONG LowPart;
+        LONG HighPart;
+    };
+    LONGLONG QuadPart;
+} LARGE_INTEGER, *PLARGE_INTEGER;
+
+#define TRUE                                1
+#define FALSE                               0
+#define MAXUSHORT                           0xffff
+#define MAXLONG                             0x7fffffff
+
+#define IN
+#define OUT
+#define OPTIONAL
+#define _In_
+#define _Out_
+#define _Inout_
+#define _In_reads_bytes_(Size)
+#define _Out_writes_bytes_(Size)
+#define _IRQL_requires_max_(Irql)
+
+#define __forceinline                       static inline
+#define C_ASSERT(e)                         _Static_assert((e), #e)
+#define NT_ASSERT(e)                        assert(e)
+#define UNREFERENCED_PARAMETER(P)           ((void) (P))
+#define PAGED_CODE()
+
+#define FIELD_OFFSET(Type, Field)           ((LONG) offsetof(Type, Field))
+#define RTL_FIELD_SIZE(Type, Field)         (sizeof(((Type *) 0)->Field))
+#define RTL_NUMBER_OF(A)                    (sizeof(A) / sizeof((A)[0]))
+#define ARRAYSIZE(A)                        RTL_NUMBER_OF(A)
+
+#ifndef min
+#define min(a, b)                           (((a) < (b)) ? (a) : (b))
+#endif
+#ifndef max
+#define max(a, b)                           (((a) > (b)) ? (a) : (b))
+#endif
+
+#define RtlZeroMemory(Dest, Length)         memset((Dest), 0, (Length))
+#define RtlFillMemory(Dest, Length, Fill)   memset((Dest), (Fill), (Length))
+#define RtlCopyMemory(Dest, Src, Length)    memcpy((Dest), (Src), (Length))
+#define RtlMoveMemory(Dest, Src, Length)    memmove((Dest), (Src), (Length))
+#define RtlEqualMemory(A, B, Length)        (memcmp((A), (B), (Length)) == 0)
+
+//
+// Status codes
+//
+
+#define NT_SUCCESS(Status)                  (((NTSTATUS) (Status)) >= 0)
+
+#define STATUS_SUCCESS                      ((NTSTATUS) 0x00000000L)
+#define STATUS_TIMEOUT                      ((NTSTATUS) 0x00000102L)
+#define STATUS_PENDING                      ((NTSTATUS) 0x00000103L)
+#define STATUS_DEVICE_BUSY                  ((NTSTATUS) 0x80000011L)
+#define STATUS_NO_DATA_DETECTED             ((NTSTATUS) 0x80000022L)
+#define STATUS_UNSUCCESSFUL                 ((NTSTATUS) 0xC0000001L)
+#define STATUS_INVALID_PARAMETER            ((NTSTATUS) 0xC000000DL)
+#define STATUS_NO_SUCH_DEVICE               ((NTSTATUS) 0xC000000EL)
+#define STATUS_INVALID_DEVICE_REQUEST       ((NTSTATUS) 0xC0000010L)
+#define STATUS_BUFFER_TOO_SMALL             ((NTSTATUS) 0xC0000023L)
+#define STATUS_OBJECT_NAME_NOT_FOUND        ((NTSTATUS) 0xC0000034L)
+#define STATUS_INSUFFICIENT_RESOURCES       ((NTSTATUS) 0xC000009AL)
+#define STATUS_DEVICE_NOT_CONNECTED         ((NTSTATUS) 0xC000009DL)
+#define STATUS_NOT_SUPPORTED                ((NTSTATUS) 0xC00000BBL)
+#define STATUS_CANCELLED                    ((NTSTATUS) 0xC0000120L)
+#define STATUS_INVALID_DEVICE_STATE         ((NTSTATUS) 0xC0000184L)
+#define STATUS_IO_DEVICE_ERROR              ((NTSTATUS) 0xC0000185L)
+#define STATUS_DEVICE_PROTOCOL_ERROR        ((NTSTATUS) 0xC0000186L)
+#define STATUS_INVALID_BUFFER_SIZE          ((NTSTATUS) 0xC0000206L)
+#define STATUS_NOT_FOUND                    ((NTSTATUS) 0xC0000225L)
+
+//
+// Kernel and framework types named by the core's headers
+//
+
+typedef enum _DEVICE_POWER_STATE
+{
+    PowerDeviceUnspecified = 0,
+    PowerDeviceD0,
+    PowerDeviceD1,
+    PowerDeviceD2,
+    PowerDeviceD3,
+    PowerDeviceMaximum
+} DEVICE_POWER_STATE;
+
+typedef NTSTATUS (*PRTL_QUERY_REGISTRY_ROUTINE)(
+    PWSTR ValueName,
+    ULONG ValueType,
+    PVOID ValueData,
+    ULONG ValueLength,
+    PVOID Context,
+    PVOID EntryContext
+    );
+
+typedef struct _RTL_QUERY_REGISTRY_TABLE
+{
+    PRTL_QUERY_REGISTRY_ROUTINE QueryRoutine;
+    ULONG Flags;
+    PWSTR Name;
+    PVOID EntryContext;
+    ULONG DefaultType;
+    PVOID DefaultData;
+    ULONG DefaultLength;
+} RTL_QUERY_REGISTRY_TABLE, *PRTL_QUERY_REGISTRY_TABLE;
+
+#define RTL_QUERY_REGISTRY_DIRECT           0x00000020
+#define REG_DWORD                           4
+
+typedef struct _WDFDEVICE__ *WDFDEVICE;
+typedef struct _WDFMEMORY__ *WDFMEMORY;
+typedef struct _RMI_HOST_LOCK *WDFWAITLOCK;
+typedef struct _RMI_HOST_TARGET *WDFIOTARGET;
+
+//
+// Tracing. Levels and flags match trace.h, messages use the WPP format
+// specifiers.
+//
+
+#define TRACE_LEVEL_NONE                    0
+#define TRACE_LEVEL_CRITICAL                1
+#define TRACE_LEVEL_ERROR                   2
+#define TRACE_LEVEL_WARNING                 3
+#define TRACE_LEVEL_INFORMATION             4
+#define TRACE_LEVEL_VERBOSE                 5
+
+#define TRACE_INIT                          0x00000001
+#define TRACE_REGISTRY                      0x00000002
+#define TRACE_HID                           0x00000004
+#define TRACE_PNP                           0x00000008
+#define TRACE_POWER                         0x00000010
+#define TRACE_SPB                           0x00000020
+#define TRACE_CONFIG                        0x00000040
+#define TRACE_REPORTING                     0x00000080
+#define TRACE_INTERRUPT                     0x00000100
+#define TRACE_SAMPLES                       0x00000200
+#define TRACE_OTHER                         0x00000400
+#define TRACE_IDLE                          0x00000800
+#define TRACE_DRIVER                        0x00001000
+
+extern int RmiHostTraceLevel;
+
+void
+RmiHostTrace(
+    int Level,
+    ULONG Flags,
+    const char *Function,
+    const char *Message,
+    ...
+    );
+
+#define Trace(Level, Flags, ...) \
+    (((Level) <= RmiHostTraceLevel) ? \
+        RmiHostTrace((Level), (Flags), __func__, __VA_ARGS__) : (void) 0)
+
+VOID
+RmiHostSetTraceLevel(
+    IN int Level
+    );
+
+//
+// Lock
+//
+
+typedef WDFWAITLOCK RMI_LOCK;
+
+NTSTATUS
+RmiHostLockCreate(
+    OUT RMI_LOCK *Lock
+    );
+
+VOID
+RmiHostLockDelete(
+    IN RMI_LOCK Lock
+    );
+
+VOID
+RmiHostLockAcquire(
+    IN RMI_LOCK Lock
+    );
+
+VOID
+RmiHostLockRelease(
+    IN RMI_LOCK Lock
+    );
+
+#define RmiLockCreate(Lock)                 RmiHostLockCreate(Lock)
+#define RmiLockDelete(Lock)                 RmiHostLockDelete(Lock)
+#define RmiLockAcquire(Lock)                RmiHostLockAcquire(Lock)
+#define RmiLockRelease(Lock)                RmiHostLockRelease(Lock)
+
+//
+// Allocator
+//
+
+typedef struct _RMI_HOST_ALLOCATIONS
+{
+    ULONG64 Allocations;
+    ULONG64 Frees;
+    ULONG64 Bytes;
+} RMI_HOST_ALLOCATIONS;
+
+PVOID
+RmiHostAllocate(
+    IN SIZE_T Size,
+    IN ULONG Tag
+    );
+
+VOID
+RmiHostFree(
+    IN PVOID Buffer,
+    IN ULONG Tag
+    );
+
+VOID
+RmiHostGetAllocations(
+    OUT RMI_HOST_ALLOCATIONS *Allocations
+    );
+
+#define RmiAllocate(Size, Tag)              RmiHostAllocate((Size), (Tag))
+#define RmiFree(Buffer, Tag)                RmiHostFree((Buffer), (Tag))
+
+//
+// Clock
+//
+
+ULONG64
+RmiHostQueryTime(
+    VOID
+    );
+
+VOID
+RmiHostUseVirtualClock(
+    IN ULONG64 *Clock
+    );
+
+#define RmiQueryTime()                      RmiHostQueryTime()
+#define RmiQueryTimePrecise()               RmiHostQueryTime()
+
+//
+// Random
+//
+
+ULONG
+RmiHostRandom(
+    IN OUT PULONG Seed
+    );
+
+#define RmiRandom(Seed)                     RmiHostRandom(Seed)
+
+//
+// Bus. A target is an I2C device: a write transaction sends Length
+// bytes, a read transaction receives up to Length bytes and returns
+// how many arrived.
+//
+
+typedef NTSTATUS (*PRMI_HOST_TRANSFER)(
+    IN PVOID Context,
+    IN OUT PUCHAR Data,
+    IN ULONG Length,
+    OUT ULONG *Transferred
+    );
+
+typedef struct _RMI_HOST_TARGET
+{
+    PVOID Context;
+    PRMI_HOST_TRANSFER Write;
+    PRMI_HOST_TRANSFER Read;
+} RMI_HOST_TARGET;
+
+struct _SPB_CONTEXT;
+
+NTSTATUS
+RmiHostSpbInitialize(
+    IN struct _SPB_CONTEXT *SpbContext,
+    IN RMI_HOST_TARGET *Target
+    );
+
+VOID
+RmiHostSpbDeinitialize(
+    IN struct _SPB_CONTEXT *SpbContext
+    );
+
+//
+// Config
+//
+
+NTSTATUS
+RmiHostSetSetting(
+    IN PCWSTR Name,
+    IN ULONG Value
+    );
+
+VOID
+RmiHostClearSettings(
+    VOID
+    );
+
+NTSTATUS
+RmiHostQuerySettings(
+    IN PRTL_QUERY_REGISTRY_TABLE Table
+    );
+
+#define RmiQueryDeviceSettings(FxDevice, Table) \
+    ((VOID) (FxDevice), RmiHostQuerySettings(Table))
+#define RmiQuerySettings(Path, Table) \
+    ((VOID) (Path), RmiHostQuerySettings(Table))
+
+//
+// File
+//
+
+typedef PVOID RMI_FILE;
+
+#define RMI_TRACE_FILE_PATH                 L"SynapticsTouch.rmitrace"
+#define RMI_TRACE_OLD_FILE_PATH             L"SynapticsTouch.rmitrace.old"
+
+NTSTATUS
+RmiFileOpenAppend(
+    IN PCWSTR Path,
+    OUT RMI_FILE *File
+    );
+
+NTSTATUS
+RmiFileWrite(
+    IN RMI_FILE File,
+    IN PVOID Data,
+    IN ULONG Length
+    );
+
+NTSTATUS
+RmiFileQuerySize(
+    IN RMI_FILE File,
+    OUT ULONG64 *Size
+    );
+
+VOID
+RmiFileClose(
+    IN RMI_FILE File
+    );
+
+NTSTATUS
+RmiFileRename(
+    IN PCWSTR Path,
+    IN PCWSTR NewPath
+    );
+
+#endif
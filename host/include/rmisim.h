@@ -0,0 +1,317 @@
+/*++
+    Module Name:
+
+        rmisim.h
+
+    Abstract:
+
+        Simulated RMI4 touch controller on the I2C bus of the user-mode
+        backend. The device serves the page description table and page
+        select register, F01 query, control and data registers, F12
+        register descriptors and data packets, and F1A, F34 and F54 as
+        placeholders, from a configurable firmware layout.
+
+        Registers follow RMI4 addressing: every address is one register
+        of one or more bytes, and transfers move on to the next register
+        when one is used up. Reading the F01 interrupt status clears it.
+
+        Touch scenarios are sequences of RMI_SIM_FRAME, posted one at a
+        time or scripted (see RmiSimLoadScript), or replayed from touch
+        traces (see RmiReplayTrace). Every transaction is counted with
+        its bytes and the bus time it is modeled to take.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#pragma once
+
+#ifndef __RMISIM_H__
+#define __RMISIM_H__
+
+#include <compat.h>
+#include <rmiinternal.h>
+#include <rmiprofile.h>
+#include <spb.h>
+
+#define RMI_SIM_MAX_PAGES                   4
+#define RMI_SIM_MAX_FRAME_OBJECTS           RMI4_MAX_TOUCHES
+
+//
+// One function in the page description table, in PDT order
+//
+typedef struct _RMI_SIM_FUNCTION
+{
+    BYTE Number;
+    BYTE Page;
+    BYTE IrqCount;
+} RMI_SIM_FUNCTION;
+
+//
+// Firmware layout of a simulated controller. F12 registers are listed in
+// register order, in the same form as firmware profiles.
+//
+typedef struct _RMI_SIM_LAYOUT
+{
+    CHAR ProductId[RMI4_PRODUCT_ID_LENGTH + 1];
+
+    int FunctionCount;
+    RMI_SIM_FUNCTION Functions[RMI4_MAX_FUNCTIONS];
+
+    BOOLEAN HasDribble;
+    UINT8 QueryCount;
+    RMI4_PROFILE_REGISTER Query[RMI4_PROFILE_MAX_REGISTERS];
+    UINT8 ControlCount;
+    RMI4_PROFILE_REGISTER Control[RMI4_PROFILE_MAX_REGISTERS];
+    UINT8 DataCount;
+    RMI4_PROFILE_REGISTER Data[RMI4_PROFILE_MAX_REGISTERS];
+
+    //
+    // I2C clock and clock stretching per transaction (ns) used for the
+    // modeled bus time
+    //
+    ULONG BusSpeed;
+    ULONG ClockStretch;
+} RMI_SIM_LAYOUT;
+
+//
+// Transaction accounting. Written bytes include the register address,
+// ModeledTime is in ns.
+//
+typedef struct _RMI_SIM_STATISTICS
+{
+    ULONG64 WriteTransactions;
+    ULONG64 ReadTransactions;
+    ULONG64 BytesWritten;
+    ULONG64 BytesRead;
+    ULONG64 ModeledTime;
+} RMI_SIM_STATISTICS;
+
+typedef VOID (*PRMI_SIM_TRANSACTION_CALLBACK)(
+    IN PVOID Context,
+    IN BOOLEAN Write,
+    IN BYTE Page,
+    IN BYTE Address,
+    IN ULONG Length,
+    IN ULONG64 ModeledTime
+    );
+
+//
+// One scanned frame of a touch scenario. Objects are indexed by F12
+// object slot, Type RMI_F12_OBJECT_NONE leaves a slot empty. Events
+// other than RMI_SIM_EVENT_TOUCH carry no objects.
+//
+#define RMI_SIM_EVENT_TOUCH                 0
+#define RMI_SIM_EVENT_RESET                 1
+#define RMI_SIM_EVENT_UNCONFIGURED          2
+
+typedef struct _RMI_SIM_OBJECT
+{
+    BYTE Type;
+    USHORT X;
+    USHORT Y;
+    BYTE Z;
+    BYTE wX;
+    BYTE wY;
+} RMI_SIM_OBJECT;
+
+typedef struct _RMI_SIM_FRAME
+{
+    ULONG64 Time;                   // 100ns units from scenario start
+    ULONG Event;
+    RMI_SIM_OBJECT Objects[RMI_SIM_MAX_FRAME_OBJECTS];
+} RMI_SIM_FRAME;
+
+typedef struct _RMI_SIM_DEVICE RMI_SIM_DEVICE;
+
+VOID
+RmiSimDefaultLayout(
+    OUT RMI_SIM_LAYOUT *Layout,
+    IN BYTE MaxFingers
+    );
+
+NTSTATUS
+RmiSimCreate(
+    IN const RMI_SIM_LAYOUT *Layout,
+    OUT RMI_SIM_DEVICE **Device
+    );
+
+VOID
+RmiSimDestroy(
+    IN RMI_SIM_DEVICE *Device
+    );
+
+RMI_HOST_TARGET*
+RmiSimGetTarget(
+    IN RMI_SIM_DEVICE *Device
+    );
+
+ULONG64*
+RmiSimGetClock(
+    IN RMI_SIM_DEVICE *Device
+    );
+
+VOID
+RmiSimAdvanceClock(
+    IN RMI_SIM_DEVICE *Device,
+    IN ULONG64 Time
+    );
+
+BOOLEAN
+RmiSimAttention(
+    IN RMI_SIM_DEVICE *Device
+    );
+
+VOID
+RmiSimPostFrame(
+    IN RMI_SIM_DEVICE *Device,
+    IN const RMI_SIM_FRAME *Frame
+    );
+
+VOID
+RmiSimPostPacket(
+    IN RMI_SIM_DEVICE *Device,
+    IN const BYTE *Packet,
+    IN ULONG Length
+    );
+
+//
+// Scan timing of the controller, see RmiSimScanPeriod. DozeInterval
+// counts 10ms units.
+//
+#define RMI_SIM_SCAN_PERIOD_STANDARD        166666  // 60Hz
+#define RMI_SIM_SCAN_PERIOD_HIGH            83333   // 120Hz
+#define RMI_SIM_DOZE_INTERVAL_UNIT          100000
+
+ULONG64
+RmiSimScanPeriod(
+    IN RMI_SIM_DEVICE *Device
+    );
+
+VOID
+RmiSimGetStatistics(
+    IN RMI_SIM_DEVICE *Device,
+    OUT RMI_SIM_STATISTICS *Statistics
+    );
+
+VOID
+RmiSimSetTransactionCallback(
+    IN RMI_SIM_DEVICE *Device,
+    IN PRMI_SIM_TRANSACTION_CALLBACK Callback,
+    IN PVOID Context
+    );
+
+BOOLEAN
+RmiSimReadRegister(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN BYTE Address,
+    OUT PUCHAR Data,
+    IN ULONG Length
+    );
+
+BYTE
+RmiSimFindFunction(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Number,
+    OUT RMI4_FUNCTION_DESCRIPTOR *Descriptor
+    );
+
+//
+// Scenarios
+//
+
+NTSTATUS
+RmiSimLoadScript(
+    IN const char *Path,
+    OUT RMI_SIM_FRAME **Frames,
+    OUT ULONG *FrameCount
+    );
+
+VOID
+RmiSimSwipeScenario(
+    IN ULONG Contacts,
+    IN ULONG FrameCount,
+    IN ULONG64 Period,
+    OUT RMI_SIM_FRAME *Frames
+    );
+
+//
+// Driver harness: a controller context started against a simulated
+// device, serviced the way the ISR services it.
+//
+
+typedef struct _RMI_SIM_HOST
+{
+    RMI_SIM_DEVICE *Device;
+    SPB_CONTEXT Spb;
+    VOID *Controller;
+    BOOLEAN ReaderWaiting;
+    ULONG BuffersTaken;
+    ULONG ReportCount;
+    PTP_REPORT Reports[TCH_MAX_REPORTS_PER_FRAME * 4];
+} RMI_SIM_HOST;
+
+NTSTATUS
+RmiSimHostStart(
+    IN RMI_SIM_HOST *Host,
+    IN const RMI_SIM_LAYOUT *Layout
+    );
+
+NTSTATUS
+RmiSimHostService(
+    IN RMI_SIM_HOST *Host
+    );
+
+NTSTATUS
+RmiSimHostServiceSynthetic(
+    IN RMI_SIM_HOST *Host
+    );
+
+VOID
+RmiSimHostStop(
+    IN RMI_SIM_HOST *Host
+    );
+
+//
+// Touch trace replay (see rmitrace.h). Every segment is replayed on a
+// simulated controller with the segment's F12 data layout, through the
+// harness above, with settings from RmiHostSetSetting.
+//
+
+#define RMI_REPLAY_MAX_SPEED                0   // Back to back
+#define RMI_REPLAY_RECORDED_TIMING          1   // At the recorded intervals
+
+typedef struct _RMI_REPLAY_STATISTICS
+{
+    ULONG Segments;
+    ULONG SegmentsSkipped;          // Layout the simulator could not match
+    ULONG64 Packets;
+    ULONG64 StatusRecords;
+    ULONG64 Reports;
+    ULONG64 ElidedFrames;           // See ElideStationaryFrames
+    ULONG64 RecordsDropped;         // Lost to a full capture buffer
+    ULONG64 RecordedTime;           // 100ns units, first to last record
+    ULONG64 ReplayTime;             // Wall clock ns spent replaying
+} RMI_REPLAY_STATISTICS;
+
+typedef VOID (*PRMI_REPLAY_REPORT_CALLBACK)(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    );
+
+NTSTATUS
+RmiReplayTrace(
+    IN const char *Path,
+    IN ULONG Timing,
+    IN PRMI_REPLAY_REPORT_CALLBACK Callback,
+    IN PVOID Context,
+    OUT RMI_REPLAY_STATISTICS *Statistics
+    );
+
+#endif
@@ -0,0 +1,219 @@
+/*++
+    Module Name:
+
+        hostspb.c
+
+    Abstract:
+
+        SPB (I2C) transport of the user-mode backend. Register reads and
+        writes become transactions on an RMI_HOST_TARGET, with the same
+        framing and statistics as the KMDF transport in spb.c.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <spb.h>
+
+NTSTATUS
+RmiHostSpbInitialize(
+    IN SPB_CONTEXT *SpbContext,
+    IN RMI_HOST_TARGET *Target
+    )
+/*++
+
+Routine Description:
+
+    Binds an SPB context to a host target, in place of
+    SpbTargetInitialize.
+
+Arguments:
+
+    SpbContext - SPB context to initialize
+    Target - I2C device the context talks to
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    RtlZeroMemory(SpbContext, sizeof(SPB_CONTEXT));
+
+    SpbContext->SpbIoTarget = Target;
+
+    return RmiLockCreate(&SpbContext->SpbLock);
+}
+
+VOID
+RmiHostSpbDeinitialize(
+    IN SPB_CONTEXT *SpbContext
+    )
+{
+    if (SpbContext->SpbLock != NULL)
+    {
+        RmiLockDelete(SpbContext->SpbLock);
+        SpbContext->SpbLock = NULL;
+    }
+}
+
+static
+NTSTATUS
+SpbDoWriteDataSynchronously(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+{
+    UCHAR buffer[1 + 256];
+    ULONG transferred;
+    NTSTATUS status;
+    ULONG64 start;
+
+    if (Length + 1 > sizeof(buffer))
+    {
+        return STATUS_INVALID_BUFFER_SIZE;
+    }
+
+    //
+    // The address pointer is followed by the data payload in one
+    // write transaction
+    //
+    buffer[0] = Address;
+
+    if (Length != 0)
+    {
+        RtlCopyMemory(&buffer[1], Data, Length);
+    }
+
+    start = RmiQueryTime();
+
+    status = SpbContext->SpbIoTarget->Write(
+        SpbContext->SpbIoTarget->Context,
+        buffer,
+        Length + 1,
+        &transferred);
+
+    SpbContext->Statistics.BusTime += RmiQueryTime() - start;
+    SpbContext->Statistics.WriteTransactions++;
+
+    if (!NT_SUCCESS(status))
+    {
+        SpbContext->Statistics.Errors++;
+
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error writing to Spb - %!STATUS!",
+            status);
+
+        return status;
+    }
+
+    SpbContext->Statistics.BytesWritten += Length + 1;
+
+    return status;
+}
+
+NTSTATUS
+SpbWriteDataSynchronously(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+{
+    NTSTATUS status;
+
+    RmiLockAcquire(SpbContext->SpbLock);
+
+    status = SpbDoWriteDataSynchronously(
+        SpbContext,
+        Address,
+        Data,
+        Length);
+
+    RmiLockRelease(SpbContext->SpbLock);
+
+    return status;
+}
+
+NTSTATUS
+SpbReadDataSynchronously(
+    _In_ SPB_CONTEXT *SpbContext,
+    _In_ UCHAR Address,
+    _In_reads_bytes_(Length) PVOID Data,
+    _In_ ULONG Length
+    )
+{
+    NTSTATUS status;
+    ULONG bytesRead;
+    ULONG64 start;
+
+    RmiLockAcquire(SpbContext->SpbLock);
+
+    bytesRead = 0;
+
+    //
+    // Read transactions start by writing an address pointer
+    //
+    status = SpbDoWriteDataSynchronously(
+        SpbContext,
+        Address,
+        NULL,
+        0);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error setting address pointer for Spb read - %!STATUS!",
+            status);
+        goto exit;
+    }
+
+    start = RmiQueryTime();
+
+    status = SpbContext->SpbIoTarget->Read(
+        SpbContext->SpbIoTarget->Context,
+        Data,
+        Length,
+        &bytesRead);
+
+    SpbContext->Statistics.BusTime += RmiQueryTime() - start;
+    SpbContext->Statistics.ReadTransactions++;
+    SpbContext->Statistics.BytesRead += bytesRead;
+
+    //
+    // A short read leaves the caller's buffer stale, fail it like any
+    // other transfer error
+    //
+    if (NT_SUCCESS(status) && bytesRead != Length)
+    {
+        status = STATUS_DEVICE_PROTOCOL_ERROR;
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        SpbContext->Statistics.Errors++;
+
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_SPB,
+            "Error reading from Spb - %!STATUS!",
+            status);
+    }
+
+exit:
+
+    RmiLockRelease(SpbContext->SpbLock);
+
+    return status;
+}
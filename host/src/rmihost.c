@@ -0,0 +1,579 @@
+/*++
+    Module Name:
+
+        rmihost.c
+
+    Abstract:
+
+        User-mode (POSIX) implementation of the platform services in
+        rmihost.h: locks, allocation, clock, random numbers, settings,
+        files and trace output.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#define _GNU_SOURCE
+
+#include <compat.h>
+
+#include <pthread.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define RMI_HOST_MAX_SETTINGS               128
+#define RMI_HOST_MAX_SETTING_NAME           64
+#define RMI_HOST_MAX_MESSAGE                512
+
+struct _RMI_HOST_LOCK
+{
+    pthread_mutex_t Mutex;
+};
+
+typedef struct _RMI_HOST_SETTING
+{
+    WCHAR Name[RMI_HOST_MAX_SETTING_NAME];
+    ULONG Value;
+} RMI_HOST_SETTING;
+
+int RmiHostTraceLevel = TRACE_LEVEL_NONE;
+
+static RMI_HOST_ALLOCATIONS gAllocations;
+
+static __thread ULONG64 *gVirtualClock;
+
+static pthread_mutex_t gSettingsLock = PTHREAD_MUTEX_INITIALIZER;
+static RMI_HOST_SETTING gSettings[RMI_HOST_MAX_SETTINGS];
+static ULONG gSettingCount;
+
+__attribute__((constructor))
+static
+void
+RmiHostReadTraceLevel(
+    void
+    )
+{
+    const char *level;
+
+    level = getenv("RMI_HOST_TRACE_LEVEL");
+
+    if (level != NULL)
+    {
+        RmiHostTraceLevel = atoi(level);
+    }
+}
+
+VOID
+RmiHostSetTraceLevel(
+    IN int Level
+    )
+{
+    RmiHostTraceLevel = Level;
+}
+
+static
+size_t
+RmiHostTranslateFormat(
+    const char *Function,
+    const char *Message,
+    char *Format,
+    size_t Size
+    )
+/*++
+
+Routine Description:
+
+    Rewrites a WPP trace message into a printf format. %!STATUS! prints
+    the status in hex, %!FUNC! the function name. The I64 size prefix
+    becomes ll and a lone l is dropped, as LONG and ULONG are 32 bits
+    wide on both platforms.
+
+Arguments:
+
+    Function - Name of the tracing function
+    Message - WPP trace message
+    Format - Receives the printf format
+    Size - Size of Format in bytes
+
+Return Value:
+
+    Length of the format.
+
+--*/
+{
+    size_t out;
+    const char *in;
+    const char *f;
+
+    out = 0;
+    in = Message;
+
+    while (*in != '\0' && out + 8 < Size)
+    {
+        if (*in != '%')
+        {
+            Format[out++] = *in++;
+            continue;
+        }
+
+        if (strncmp(in, "%!STATUS!", 9) == 0)
+        {
+            memcpy(&Format[out], "%#x", 3);
+            out += 3;
+            in += 9;
+            continue;
+        }
+
+        if (strncmp(in, "%!FUNC!", 7) == 0)
+        {
+            for (f = Function; *f != '\0' && out + 8 < Size; f++)
+            {
+                if (*f == '%')
+                {
+                    Format[out++] = '%';
+                }
+                Format[out++] = *f;
+            }
+            in += 7;
+            continue;
+        }
+
+        //
+        // Copy the flags, width and precision, then fix up the size
+        //
+        Format[out++] = *in++;
+
+        while (*in != '\0' && strchr("-+ #0123456789.*", *in) != NULL &&
+            out + 8 < Size)
+        {
+            Format[out++] = *in++;
+        }
+
+        if (strncmp(in, "I64", 3) == 0)
+        {
+            memcpy(&Format[out], "ll", 2);
+            out += 2;
+            in += 3;
+        }
+        else if (*in == 'l' && in[1] != 'l')
+        {
+            in++;
+        }
+        else if (*in == '\0')
+        {
+            //
+            // A message ending in a lone %
+            //
+            Format[out++] = '%';
+        }
+
+        if (*in != '\0')
+        {
+            Format[out++] = *in++;
+        }
+    }
+
+    Format[out] = '\0';
+
+    return out;
+}
+
+void
+RmiHostTrace(
+    int Level,
+    ULONG Flags,
+    const char *Function,
+    const char *Message,
+    ...
+    )
+{
+    static const char *levelNames[] =
+    {
+        "", "CRITICAL", "ERROR", "WARNING", "INFO", "VERBOSE"
+    };
+    char format[RMI_HOST_MAX_MESSAGE];
+    va_list arguments;
+
+    if (Level > RmiHostTraceLevel)
+    {
+        return;
+    }
+
+    UNREFERENCED_PARAMETER(Flags);
+
+    RmiHostTranslateFormat(Function, Message, format, sizeof(format));
+
+    fprintf(
+        stderr,
+        "[%s] %s: ",
+        (Level >= 0 && Level < (int) RTL_NUMBER_OF(levelNames)) ?
+            levelNames[Level] : "?",
+        Function);
+
+    va_start(arguments, Message);
+    vfprintf(stderr, format, arguments);
+    va_end(arguments);
+
+    fputc('\n', stderr);
+}
+
+NTSTATUS
+RmiHostLockCreate(
+    OUT RMI_LOCK *Lock
+    )
+{
+    RMI_LOCK lock;
+
+    lock = malloc(sizeof(*lock));
+
+    if (lock == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    pthread_mutex_init(&lock->Mutex, NULL);
+    *Lock = lock;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+RmiHostLockDelete(
+    IN RMI_LOCK Lock
+    )
+{
+    pthread_mutex_destroy(&Lock->Mutex);
+    free(Lock);
+}
+
+VOID
+RmiHostLockAcquire(
+    IN RMI_LOCK Lock
+    )
+{
+    pthread_mutex_lock(&Lock->Mutex);
+}
+
+VOID
+RmiHostLockRelease(
+    IN RMI_LOCK Lock
+    )
+{
+    pthread_mutex_unlock(&Lock->Mutex);
+}
+
+PVOID
+RmiHostAllocate(
+    IN SIZE_T Size,
+    IN ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    __atomic_add_fetch(&gAllocations.Allocations, 1, __ATOMIC_RELAXED);
+    __atomic_add_fetch(&gAllocations.Bytes, Size, __ATOMIC_RELAXED);
+
+    return malloc(Size);
+}
+
+VOID
+RmiHostFree(
+    IN PVOID Buffer,
+    IN ULONG Tag
+    )
+{
+    UNREFERENCED_PARAMETER(Tag);
+
+    __atomic_add_fetch(&gAllocations.Frees, 1, __ATOMIC_RELAXED);
+
+    free(Buffer);
+}
+
+VOID
+RmiHostGetAllocations(
+    OUT RMI_HOST_ALLOCATIONS *Allocations
+    )
+{
+    Allocations->Allocations =
+        __atomic_load_n(&gAllocations.Allocations, __ATOMIC_RELAXED);
+    Allocations->Frees =
+        __atomic_load_n(&gAllocations.Frees, __ATOMIC_RELAXED);
+    Allocations->Bytes =
+        __atomic_load_n(&gAllocations.Bytes, __ATOMIC_RELAXED);
+}
+
+ULONG64
+RmiHostQueryTime(
+    VOID
+    )
+/*++
+
+Routine Description:
+
+    Returns the calling thread's virtual clock if one is in use, the
+    monotonic clock otherwise, in 100ns units.
+
+--*/
+{
+    struct timespec now;
+
+    if (gVirtualClock != NULL)
+    {
+        return *gVirtualClock;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG64) now.tv_sec * 10000000ULL + (ULONG64) now.tv_nsec / 100;
+}
+
+VOID
+RmiHostUseVirtualClock(
+    IN ULONG64 *Clock
+    )
+/*++
+
+Routine Description:
+
+    Makes RmiQueryTime on the calling thread return *Clock, so time
+    only passes as a simulation advances it. NULL goes back to the
+    monotonic clock.
+
+--*/
+{
+    gVirtualClock = Clock;
+}
+
+ULONG
+RmiHostRandom(
+    IN OUT PULONG Seed
+    )
+{
+    *Seed = *Seed * 1103515245U + 12345U;
+
+    return (*Seed >> 1) % MAXLONG;
+}
+
+static
+RMI_HOST_SETTING*
+RmiHostFindSetting(
+    IN PCWSTR Name
+    )
+{
+    ULONG i;
+
+    for (i = 0; i < gSettingCount; i++)
+    {
+        if (wcscmp(gSettings[i].Name, Name) == 0)
+        {
+            return &gSettings[i];
+        }
+    }
+
+    return NULL;
+}
+
+NTSTATUS
+RmiHostSetSetting(
+    IN PCWSTR Name,
+    IN ULONG Value
+    )
+/*++
+
+Routine Description:
+
+    Sets the value every RmiQueryDeviceSettings and RmiQuerySettings
+    call returns for Name, in place of the table default.
+
+--*/
+{
+    RMI_HOST_SETTING* setting;
+    NTSTATUS status;
+
+    if (wcslen(Name) >= RMI_HOST_MAX_SETTING_NAME)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    status = STATUS_SUCCESS;
+
+    pthread_mutex_lock(&gSettingsLock);
+
+    setting = RmiHostFindSetting(Name);
+
+    if (setting == NULL)
+    {
+        if (gSettingCount == RMI_HOST_MAX_SETTINGS)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            goto exit;
+        }
+
+        setting = &gSettings[gSettingCount++];
+        wcscpy(setting->Name, Name);
+    }
+
+    setting->Value = Value;
+
+exit:
+
+    pthread_mutex_unlock(&gSettingsLock);
+
+    return status;
+}
+
+VOID
+RmiHostClearSettings(
+    VOID
+    )
+{
+    pthread_mutex_lock(&gSettingsLock);
+    gSettingCount = 0;
+    pthread_mutex_unlock(&gSettingsLock);
+}
+
+NTSTATUS
+RmiHostQuerySettings(
+    IN PRTL_QUERY_REGISTRY_TABLE Table
+    )
+/*++
+
+Routine Description:
+
+    Walks a RTL_QUERY_REGISTRY_DIRECT table of REG_DWORD values like
+    RtlQueryRegistryValues, taking values set with RmiHostSetSetting and
+    table defaults for the rest.
+
+--*/
+{
+    RMI_HOST_SETTING* setting;
+    PRTL_QUERY_REGISTRY_TABLE entry;
+
+    pthread_mutex_lock(&gSettingsLock);
+
+    for (entry = Table; entry->QueryRoutine != NULL || entry->Name != NULL; entry++)
+    {
+        if ((entry->Flags & RTL_QUERY_REGISTRY_DIRECT) == 0 ||
+            entry->DefaultType != REG_DWORD)
+        {
+            continue;
+        }
+
+        setting = RmiHostFindSetting(entry->Name);
+
+        if (setting != NULL)
+        {
+            *(ULONG*) entry->EntryContext = setting->Value;
+        }
+        else if (entry->DefaultData != NULL)
+        {
+            RtlCopyMemory(
+                entry->EntryContext,
+                entry->DefaultData,
+                entry->DefaultLength);
+        }
+    }
+
+    pthread_mutex_unlock(&gSettingsLock);
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RmiFileOpenAppend(
+    IN PCWSTR Path,
+    OUT RMI_FILE *File
+    )
+{
+    char path[256];
+    FILE* file;
+
+    if (wcstombs(path, Path, sizeof(path)) >= sizeof(path))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    file = fopen(path, "ab");
+
+    if (file == NULL)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    *File = file;
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RmiFileWrite(
+    IN RMI_FILE File,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+{
+    if (fwrite(Data, 1, Length, (FILE*) File) != Length)
+    {
+        return STATUS_IO_DEVICE_ERROR;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+NTSTATUS
+RmiFileQuerySize(
+    IN RMI_FILE File,
+    OUT ULONG64 *Size
+    )
+{
+    long end;
+
+    *Size = 0;
+
+    if (fseek((FILE*) File, 0, SEEK_END) != 0 ||
+        (end = ftell((FILE*) File)) < 0)
+    {
+        return STATUS_IO_DEVICE_ERROR;
+    }
+
+    *Size = (ULONG64) end;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+RmiFileClose(
+    IN RMI_FILE File
+    )
+{
+    fclose((FILE*) File);
+}
+
+NTSTATUS
+RmiFileRename(
+    IN PCWSTR Path,
+    IN PCWSTR NewPath
+    )
+{
+    char path[256];
+    char newPath[256];
+
+    if (wcstombs(path, Path, sizeof(path)) >= sizeof(path) ||
+        wcstombs(newPath, NewPath, sizeof(newPath)) >= sizeof(newPath))
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    if (rename(path, newPath) != 0)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    return STATUS_SUCCESS;
+}
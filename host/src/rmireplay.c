@@ -0,0 +1,405 @@
+/*++
+    Module Name:
+
+        rmireplay.c
+
+    Abstract:
+
+        Replays touch traces captured by rmitrace.c through the report
+        pipeline. Each segment of the trace gets a simulated controller
+        with the F12 data layout of its header, and the harness services
+        it like the ISR would: F12 packets are posted to the controller
+        as read, and F01 status records that show a reset or a lost
+        configuration raise the same event on it.
+
+        Records are replayed back to back, or at the intervals they were
+        captured at. Either way the controller clock follows the recorded
+        timestamps, so time based processing (report rate, pacing, lift
+        timeouts) sees the recorded session.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmisim.h>
+#include <rmitrace.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+static
+ULONG64
+RmiReplayNow(
+    VOID
+    )
+{
+    struct timespec now;
+
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (ULONG64) now.tv_sec * 1000000000ULL + (ULONG64) now.tv_nsec;
+}
+
+static
+VOID
+RmiReplayWait(
+    IN ULONG64 Due
+    )
+{
+    struct timespec due;
+
+    due.tv_sec = (time_t) (Due / 1000000000ULL);
+    due.tv_nsec = (long) (Due % 1000000000ULL);
+
+    while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &due, NULL) != 0)
+    {
+    }
+}
+
+static
+NTSTATUS
+RmiReplayStart(
+    IN RMI_SIM_HOST *Host,
+    IN const RMI_TRACE_SEGMENT_HEADER *Header,
+    IN const RMI_TRACE_REGISTER *Registers
+    )
+/*++
+
+Routine Description:
+
+    Starts the harness on a simulated controller with the segment's F12
+    data registers.
+
+Return Value:
+
+    STATUS_NOT_SUPPORTED if the driver does not decode the controller's
+    packets with the segment's layout
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_LAYOUT layout;
+    NTSTATUS status;
+    int i;
+
+    if (Header->RegisterCount == 0 ||
+        Header->RegisterCount > RMI4_PROFILE_MAX_REGISTERS ||
+        Header->MaxFingers == 0 ||
+        Header->MaxFingers > RMI4_MAX_TOUCHES)
+    {
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    RmiSimDefaultLayout(&layout, Header->MaxFingers);
+
+    layout.DataCount = Header->RegisterCount;
+
+    for (i = 0; i < Header->RegisterCount; i++)
+    {
+        layout.Data[i].Register = Registers[i].Register;
+        layout.Data[i].RegisterSize = Registers[i].RegisterSize;
+        layout.Data[i].NumSubPackets = Registers[i].NumSubPackets;
+    }
+
+    status = RmiSimHostStart(Host, &layout);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) Host->Controller;
+
+    if (controller->PacketSize != Header->PacketSize ||
+        controller->Data1Offset != Header->Data1Offset ||
+        controller->MaxFingers != Header->MaxFingers)
+    {
+        RmiSimHostStop(Host);
+        return STATUS_NOT_SUPPORTED;
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+RmiReplaySegment(
+    IN const RMI_TRACE_SEGMENT_HEADER *Header,
+    IN const RMI_TRACE_REGISTER *Registers,
+    IN const BYTE *Records,
+    IN ULONG Timing,
+    IN PRMI_REPLAY_REPORT_CALLBACK Callback,
+    IN PVOID Context,
+    IN OUT RMI_REPLAY_STATISTICS *Statistics
+    )
+{
+    const RMI_TRACE_RECORD* record;
+    const RMI4_F01_DATA_REGISTERS* f01;
+    RMI_SIM_FRAME event;
+    RMI_SIM_HOST host;
+    ULONG64* clock;
+    ULONG64 first;
+    ULONG64 base;
+    ULONG64 wallStart;
+    ULONG64 elapsed;
+    ULONG offset;
+    ULONG i;
+    BOOLEAN service;
+    NTSTATUS status;
+
+    status = RmiReplayStart(&host, Header, Registers);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    clock = RmiSimGetClock(host.Device);
+    base = *clock;
+    first = 0;
+    elapsed = 0;
+    wallStart = RmiReplayNow();
+
+    RtlZeroMemory(&event, sizeof(event));
+
+    for (offset = 0;
+         offset + sizeof(RMI_TRACE_RECORD) <= Header->RecordBytes;
+         offset += sizeof(RMI_TRACE_RECORD) + RMI_TRACE_ALIGN(record->Length))
+    {
+        record = (const RMI_TRACE_RECORD*) (Records + offset);
+
+        if (offset + sizeof(RMI_TRACE_RECORD) + record->Length > Header->RecordBytes)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (offset == 0)
+        {
+            first = record->Timestamp;
+        }
+
+        //
+        // The controller clock, and the wall clock if asked, move to the
+        // record's time. Bus transactions may have carried the controller
+        // clock past it already.
+        //
+        if (record->Timestamp > first)
+        {
+            elapsed = record->Timestamp - first;
+        }
+
+        if (*clock < base + elapsed)
+        {
+            RmiSimAdvanceClock(host.Device, base + elapsed - *clock);
+        }
+
+        if (Timing == RMI_REPLAY_RECORDED_TIMING)
+        {
+            RmiReplayWait(wallStart + elapsed * 100);
+        }
+
+        service = FALSE;
+
+        switch (record->Type)
+        {
+        case RMI_TRACE_RECORD_F12_PACKET:
+        {
+            RmiSimPostPacket(host.Device, (const BYTE*) (record + 1), record->Length);
+            Statistics->Packets++;
+            service = TRUE;
+            break;
+        }
+        case RMI_TRACE_RECORD_F01_STATUS:
+        {
+            Statistics->StatusRecords++;
+
+            if (record->Length < sizeof(RMI4_F01_DATA_REGISTERS))
+            {
+                break;
+            }
+
+            f01 = (const RMI4_F01_DATA_REGISTERS*) (record + 1);
+
+            if (f01->DeviceStatus.Status == RMI4_F01_DATA_STATUS_RESET_OCCURRED)
+            {
+                event.Event = RMI_SIM_EVENT_RESET;
+            }
+            else if (f01->DeviceStatus.Unconfigured)
+            {
+                event.Event = RMI_SIM_EVENT_UNCONFIGURED;
+            }
+            else
+            {
+                break;
+            }
+
+            RmiSimPostFrame(host.Device, &event);
+            service = TRUE;
+            break;
+        }
+        default:
+        {
+            //
+            // Record types added later are skipped
+            //
+            break;
+        }
+        }
+
+        if (!service)
+        {
+            continue;
+        }
+
+        host.ReportCount = 0;
+        status = RmiSimHostService(&host);
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        Statistics->Reports += host.ReportCount;
+
+        if (Callback != NULL)
+        {
+            for (i = 0; i < host.ReportCount; i++)
+            {
+                Callback(Context, record->Timestamp, &host.Reports[i]);
+            }
+        }
+    }
+
+    Statistics->RecordedTime += elapsed;
+    Statistics->ReplayTime += RmiReplayNow() - wallStart;
+    Statistics->ElidedFrames +=
+        ((RMI4_CONTROLLER_CONTEXT*) host.Controller)->Counters.ElidedFrames;
+
+    RmiSimHostStop(&host);
+
+    return status;
+}
+
+NTSTATUS
+RmiReplayTrace(
+    IN const char *Path,
+    IN ULONG Timing,
+    IN PRMI_REPLAY_REPORT_CALLBACK Callback,
+    IN PVOID Context,
+    OUT RMI_REPLAY_STATISTICS *Statistics
+    )
+/*++
+
+Routine Description:
+
+    Replays every segment of a touch trace. Segments whose layout the
+    simulator cannot reproduce are skipped and counted.
+
+Arguments:
+
+    Path - Trace file
+    Timing - RMI_REPLAY_MAX_SPEED or RMI_REPLAY_RECORDED_TIMING
+    Callback - Called with every report the driver produced, and the
+        time of the record that produced it. May be NULL.
+    Context - Passed to Callback
+    Statistics - Receives the replay totals
+
+Return Value:
+
+    STATUS_OBJECT_NAME_NOT_FOUND if the file cannot be opened,
+    STATUS_INVALID_PARAMETER if it is not a touch trace or is cut short,
+    or the error that stopped the replay of a segment
+
+--*/
+{
+    RMI_TRACE_SEGMENT_HEADER header;
+    BYTE* registers;
+    BYTE* records;
+    FILE* file;
+    ULONG tableSize;
+    NTSTATUS status;
+
+    RtlZeroMemory(Statistics, sizeof(*Statistics));
+
+    registers = NULL;
+    records = NULL;
+    status = STATUS_SUCCESS;
+
+    file = fopen(Path, "rb");
+
+    if (file == NULL)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    while (fread(&header, sizeof(header), 1, file) == 1)
+    {
+        if (header.Magic != RMI_TRACE_MAGIC ||
+            header.Version != RMI_TRACE_VERSION ||
+            header.HeaderSize < sizeof(header) + header.RegisterCount * sizeof(RMI_TRACE_REGISTER))
+        {
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        tableSize = header.HeaderSize - sizeof(header);
+
+        registers = malloc(tableSize + 1);
+        records = malloc(header.RecordBytes + 1);
+
+        if (registers == NULL || records == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        if (fread(registers, 1, tableSize, file) != tableSize ||
+            fread(records, 1, header.RecordBytes, file) != header.RecordBytes)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        Statistics->Segments++;
+        Statistics->RecordsDropped += header.RecordsDropped;
+
+        status = RmiReplaySegment(
+            &header,
+            (const RMI_TRACE_REGISTER*) registers,
+            records,
+            Timing,
+            Callback,
+            Context,
+            Statistics);
+
+        if (status == STATUS_NOT_SUPPORTED)
+        {
+            Statistics->SegmentsSkipped++;
+            status = STATUS_SUCCESS;
+        }
+
+        free(registers);
+        free(records);
+        registers = NULL;
+        records = NULL;
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+    }
+
+    free(registers);
+    free(records);
+    fclose(file);
+
+    return status;
+}
@@ -0,0 +1,2052 @@
+/*++
+    Module Name:
+
+        rmisim.c
+
+    Abstract:
+
+        Simulated RMI4 touch controller, see rmisim.h. Registers are laid
+        out from the firmware layout when the device is created: on each
+        page the page description table sits below 0xEF and the functions
+        take register addresses upward from 0 in PDT order, query, control,
+        data and command registers in turn.
+
+        The simulator allocates from the C heap, so its buffers do not
+        show up in RmiHostGetAllocations.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#define _GNU_SOURCE
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmiprofile.h>
+#include <rmisim.h>
+#include <spb.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+#define RMI_SIM_REGISTERS                   256
+#define RMI_SIM_MEMORY_SIZE                 (16 * 1024)
+#define RMI_SIM_PDT_ENTRY_SIZE              sizeof(RMI4_FUNCTION_DESCRIPTOR)
+#define RMI_SIM_F12_DESCRIPTORS             3
+#define RMI_SIM_HOST_MAX_PASSES             64
+
+//
+// Largest F12 structure register: per register a 7 byte size and a
+// subpacket map of up to 255 bits
+//
+#define RMI_SIM_MAX_STRUCTURE               (RMI4_PROFILE_MAX_REGISTERS * (7 + 37))
+
+typedef struct _RMI_SIM_REGISTER
+{
+    BYTE* Data;
+    ULONG Size;
+} RMI_SIM_REGISTER;
+
+//
+// Where a function ended up, and the interrupt bits it owns
+//
+typedef struct _RMI_SIM_PLACEMENT
+{
+    RMI4_FUNCTION_DESCRIPTOR Descriptor;
+    BYTE Page;
+    BYTE InterruptMask;
+} RMI_SIM_PLACEMENT;
+
+struct _RMI_SIM_DEVICE
+{
+    RMI_SIM_LAYOUT Layout;
+    RMI_HOST_TARGET Target;
+    RMI_LOCK Lock;
+
+    RMI_SIM_REGISTER Registers[RMI_SIM_MAX_PAGES][RMI_SIM_REGISTERS];
+    BYTE* Memory;
+    ULONG MemoryUsed;
+
+    RMI_SIM_PLACEMENT Functions[RMI4_MAX_FUNCTIONS];
+
+    //
+    // Register pointer of the I2C interface: page, register and byte
+    // within the register
+    //
+    BYTE Page;
+    BYTE Pointer;
+    ULONG Offset;
+
+    //
+    // F01 and F12 registers with side effects, and F12 data layout
+    //
+    RMI_SIM_PLACEMENT* F01;
+    RMI_SIM_PLACEMENT* F12;
+    BYTE F01ControlDefaults[sizeof(RMI4_F01_CTRL_REGISTERS)];
+    BYTE* F12ControlDefaults;
+    ULONG F12ControlSize;
+    BYTE Data1Register;
+    BYTE Data15Register;
+    BOOLEAN HasData15;
+    BYTE MaxObjects;
+    BOOLEAN Touching;
+
+    ULONG64 Clock;
+    RMI_SIM_STATISTICS Statistics;
+    PRMI_SIM_TRANSACTION_CALLBACK Callback;
+    PVOID CallbackContext;
+};
+
+static
+NTSTATUS
+RmiSimWrite(
+    IN PVOID Context,
+    IN OUT PUCHAR Data,
+    IN ULONG Length,
+    OUT ULONG *Transferred
+    );
+
+static
+NTSTATUS
+RmiSimRead(
+    IN PVOID Context,
+    IN OUT PUCHAR Data,
+    IN ULONG Length,
+    OUT ULONG *Transferred
+    );
+
+VOID
+RmiSimDefaultLayout(
+    OUT RMI_SIM_LAYOUT *Layout,
+    IN BYTE MaxFingers
+    )
+/*++
+
+Routine Description:
+
+    Fills in a layout modeled on S3320 class firmware: F34, F01, F12 and
+    F1A on page 0 and F54 on page 1, F12 reporting MaxFingers objects in
+    Data1 followed by the Data15 object attention bitmap.
+
+Arguments:
+
+    Layout - Receives the layout
+    MaxFingers - Object slots of F12 Data1, at most RMI4_MAX_TOUCHES
+
+Return Value:
+
+    None.
+
+--*/
+{
+    static const RMI_SIM_FUNCTION functions[] =
+    {
+        { RMI4_F34_FLASH_MEMORY_MANAGEMENT, 0, 1 },
+        { RMI4_F01_RMI_DEVICE_CONTROL, 0, 1 },
+        { RMI4_F12_2D_TOUCHPAD_SENSOR, 0, 2 },
+        { RMI4_F1A_0D_CAP_BUTTON_SENSOR, 0, 1 },
+        { RMI4_F54_TEST_REPORTING, 1, 1 },
+    };
+    static const RMI4_PROFILE_REGISTER control[] =
+    {
+        { 8, 14, 1 },
+        { 9, 3, 1 },
+        { F12_2D_CTRL20, 3, 1 },
+        { 23, 5, 1 },
+        { 28, 1, 1 },
+    };
+
+    RtlZeroMemory(Layout, sizeof(*Layout));
+
+    if (MaxFingers > RMI4_MAX_TOUCHES)
+    {
+        MaxFingers = RMI4_MAX_TOUCHES;
+    }
+
+    strcpy(Layout->ProductId, "SIM-S3320");
+
+    Layout->FunctionCount = RTL_NUMBER_OF(functions);
+    RtlCopyMemory(Layout->Functions, functions, sizeof(functions));
+
+    Layout->HasDribble = TRUE;
+
+    Layout->QueryCount = 1;
+    Layout->Query[0].Register = 5;
+    Layout->Query[0].RegisterSize = 4;
+    Layout->Query[0].NumSubPackets = 1;
+
+    Layout->ControlCount = RTL_NUMBER_OF(control);
+    RtlCopyMemory(Layout->Control, control, sizeof(control));
+
+    Layout->DataCount = 2;
+    Layout->Data[0].Register = 1;
+    Layout->Data[0].RegisterSize = MaxFingers * F12_DATA1_BYTES_PER_OBJ;
+    Layout->Data[0].NumSubPackets = MaxFingers;
+    Layout->Data[1].Register = 15;
+    Layout->Data[1].RegisterSize = (MaxFingers + 7) / 8;
+    Layout->Data[1].NumSubPackets = 1;
+
+    Layout->BusSpeed = SPB_BUS_SPEED_FAST;
+    Layout->ClockStretch = 0;
+}
+
+static
+BYTE*
+RmiSimAllocateRegister(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN ULONG Address,
+    IN ULONG Size
+    )
+/*++
+
+Routine Description:
+
+    Maps a zeroed register of Size bytes at Address on Page.
+
+Return Value:
+
+    The register contents, NULL if the address is taken or out of range,
+    or the register memory is used up
+
+--*/
+{
+    RMI_SIM_REGISTER* reg;
+
+    if (Page >= RMI_SIM_MAX_PAGES ||
+        Address >= RMI4_PAGE_SELECT_ADDRESS ||
+        Size == 0 ||
+        Device->MemoryUsed + Size > RMI_SIM_MEMORY_SIZE)
+    {
+        return NULL;
+    }
+
+    reg = &Device->Registers[Page][Address];
+
+    if (reg->Data != NULL)
+    {
+        return NULL;
+    }
+
+    reg->Data = &Device->Memory[Device->MemoryUsed];
+    reg->Size = Size;
+    Device->MemoryUsed += Size;
+
+    return reg->Data;
+}
+
+static
+ULONG
+RmiSimEncodeDescriptor(
+    IN const RMI4_PROFILE_REGISTER *Registers,
+    IN UINT8 Count,
+    OUT BYTE *Presence,
+    OUT ULONG *PresenceSize,
+    OUT BYTE *Structure
+    )
+/*++
+
+Routine Description:
+
+    Encodes an F12 register descriptor: the presence register, a size
+    and a bitmap of the registers that exist, and the structure register,
+    the size and subpacket map of each of them.
+
+Arguments:
+
+    Registers - Registers in register order
+    Count - Number of registers
+    Presence - Receives the presence register, 35 bytes
+    PresenceSize - Receives the presence register size
+    Structure - Receives the structure register, RMI_SIM_MAX_STRUCTURE
+        bytes
+
+Return Value:
+
+    Structure register size
+
+--*/
+{
+    ULONG structSize;
+    ULONG size;
+    ULONG bit;
+    ULONG b;
+    ULONG presenceBytes;
+    int i;
+
+    structSize = 0;
+    presenceBytes = 0;
+
+    for (i = 0; i < Count; i++)
+    {
+        size = Registers[i].RegisterSize;
+
+        if (size < 0x100)
+        {
+            Structure[structSize++] = (BYTE) size;
+        }
+        else if (size < 0x10000)
+        {
+            Structure[structSize++] = 0;
+            Structure[structSize++] = (BYTE) size;
+            Structure[structSize++] = (BYTE) (size >> 8);
+        }
+        else
+        {
+            Structure[structSize++] = 0;
+            Structure[structSize++] = 0;
+            Structure[structSize++] = 0;
+            Structure[structSize++] = (BYTE) size;
+            Structure[structSize++] = (BYTE) (size >> 8);
+            Structure[structSize++] = (BYTE) (size >> 16);
+            Structure[structSize++] = (BYTE) (size >> 24);
+        }
+
+        //
+        // Subpacket map, 7 bits per byte with bit 7 continuing it
+        //
+        bit = 0;
+
+        do
+        {
+            Structure[structSize] = 0;
+
+            for (b = 0; b < 7 && bit < Registers[i].NumSubPackets; b++, bit++)
+            {
+                Structure[structSize] |= (BYTE) (1 << b);
+            }
+
+            if (bit < Registers[i].NumSubPackets)
+            {
+                Structure[structSize] |= 0x80;
+            }
+
+            structSize++;
+
+        } while (bit < Registers[i].NumSubPackets);
+
+        if (Registers[i].Register / 8 + 1 > presenceBytes)
+        {
+            presenceBytes = Registers[i].Register / 8 + 1;
+        }
+    }
+
+    RtlZeroMemory(Presence, 35);
+
+    //
+    // The structure size goes in the first byte, or in the two after it
+    // when it does not fit
+    //
+    if (structSize < 0x100)
+    {
+        Presence[0] = (BYTE) structSize;
+        *PresenceSize = 1 + presenceBytes;
+        Presence++;
+    }
+    else
+    {
+        Presence[1] = (BYTE) structSize;
+        Presence[2] = (BYTE) (structSize >> 8);
+        *PresenceSize = 3 + presenceBytes;
+        Presence += 3;
+    }
+
+    for (i = 0; i < Count; i++)
+    {
+        Presence[Registers[i].Register / 8] |=
+            (BYTE) (1 << (Registers[i].Register % 8));
+    }
+
+    return structSize;
+}
+
+static
+NTSTATUS
+RmiSimPlaceRegisters(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN OUT ULONG *Address,
+    IN const RMI4_PROFILE_REGISTER *Registers,
+    IN UINT8 Count,
+    OUT BYTE **First
+    )
+{
+    BYTE* data;
+    int i;
+
+    for (i = 0; i < Count; i++)
+    {
+        data = RmiSimAllocateRegister(
+            Device,
+            Page,
+            (*Address)++,
+            Registers[i].RegisterSize);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        if (i == 0 && First != NULL)
+        {
+            *First = data;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+RmiSimPlaceF12(
+    IN RMI_SIM_DEVICE *Device,
+    IN RMI_SIM_PLACEMENT *Function,
+    IN OUT ULONG *Address
+    )
+/*++
+
+Routine Description:
+
+    Maps the F12 query registers, the three register descriptors among
+    them, and the control and data registers of the layout.
+
+--*/
+{
+    const RMI4_PROFILE_REGISTER* registers[RMI_SIM_F12_DESCRIPTORS];
+    UINT8 counts[RMI_SIM_F12_DESCRIPTORS];
+    BYTE presence[35];
+    BYTE structure[RMI_SIM_MAX_STRUCTURE];
+    ULONG presenceSize;
+    ULONG structSize;
+    RMI_SIM_LAYOUT* layout;
+    BYTE* data;
+    BYTE page;
+    ULONG objects;
+    int i;
+
+    layout = &Device->Layout;
+    page = Function->Page;
+
+    registers[0] = layout->Query;
+    counts[0] = layout->QueryCount;
+    registers[1] = layout->Control;
+    counts[1] = layout->ControlCount;
+    registers[2] = layout->Data;
+    counts[2] = layout->DataCount;
+
+    Function->Descriptor.QueryBase = (BYTE) *Address;
+
+    //
+    // Query 0: register descriptors present, and dribble
+    //
+    data = RmiSimAllocateRegister(Device, page, (*Address)++, 1);
+
+    if (data == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    data[0] = (BYTE) (BIT(0) | (layout->HasDribble ? BIT(3) : 0));
+
+    for (i = 0; i < RMI_SIM_F12_DESCRIPTORS; i++)
+    {
+        if (counts[i] > RMI4_PROFILE_MAX_REGISTERS)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        structSize = RmiSimEncodeDescriptor(
+            registers[i],
+            counts[i],
+            presence,
+            &presenceSize,
+            structure);
+
+        if (presenceSize > sizeof(presence) || structSize == 0)
+        {
+            return STATUS_INVALID_PARAMETER;
+        }
+
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, 1);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        data[0] = (BYTE) presenceSize;
+
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, presenceSize);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlCopyMemory(data, presence, presenceSize);
+
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, structSize);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        RtlCopyMemory(data, structure, structSize);
+    }
+
+    if (!NT_SUCCESS(RmiSimPlaceRegisters(
+            Device, page, Address, layout->Query, layout->QueryCount, NULL)))
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    //
+    // Control registers, with their power-on contents kept for resets
+    //
+    Function->Descriptor.ControlBase = (BYTE) *Address;
+
+    if (!NT_SUCCESS(RmiSimPlaceRegisters(
+            Device, page, Address, layout->Control, layout->ControlCount, NULL)))
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Device->F12ControlDefaults =
+        Device->Registers[page][Function->Descriptor.ControlBase].Data;
+    Device->F12ControlSize = 0;
+
+    for (i = 0; i < layout->ControlCount; i++)
+    {
+        Device->F12ControlSize += layout->Control[i].RegisterSize;
+    }
+
+    //
+    // Data registers, Data1 holds the objects
+    //
+    Function->Descriptor.DataBase = (BYTE) *Address;
+
+    if (!NT_SUCCESS(RmiSimPlaceRegisters(
+            Device, page, Address, layout->Data, layout->DataCount, NULL)))
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    Device->MaxObjects = 0;
+    Device->HasData15 = FALSE;
+
+    for (i = 0; i < layout->DataCount; i++)
+    {
+        if (layout->Data[i].Register == 1)
+        {
+            Device->Data1Register = (BYTE) (Function->Descriptor.DataBase + i);
+
+            objects = min(
+                (ULONG) layout->Data[i].NumSubPackets,
+                layout->Data[i].RegisterSize / F12_DATA1_BYTES_PER_OBJ);
+
+            Device->MaxObjects = (BYTE) min(objects, (ULONG) RMI_SIM_MAX_FRAME_OBJECTS);
+        }
+        else if (layout->Data[i].Register == 15)
+        {
+            Device->Data15Register = (BYTE) (Function->Descriptor.DataBase + i);
+            Device->HasData15 = TRUE;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+RmiSimPlaceF01(
+    IN RMI_SIM_DEVICE *Device,
+    IN RMI_SIM_PLACEMENT *Function,
+    IN OUT ULONG *Address
+    )
+/*++
+
+Routine Description:
+
+    Maps the F01 query, control and data registers, one byte each, with
+    the product ID in the query registers and the controller starting
+    out unconfigured after a power-on reset.
+
+--*/
+{
+    RMI4_F01_QUERY_REGISTERS query;
+    RMI4_F01_CTRL_REGISTERS control;
+    BYTE* data;
+    BYTE page;
+    ULONG i;
+
+    page = Function->Page;
+
+    RtlZeroMemory(&query, sizeof(query));
+    query.ManufacturerID = 1;
+    RtlCopyMemory(
+        &query.ProductID1,
+        Device->Layout.ProductId,
+        strnlen(Device->Layout.ProductId, RMI4_PRODUCT_ID_LENGTH));
+
+    RtlZeroMemory(&control, sizeof(control));
+    control.DeviceControl.NoSleep = 1;
+    control.InterruptEnable = 0xFF;
+
+    RtlCopyMemory(Device->F01ControlDefaults, &control, sizeof(control));
+
+    Function->Descriptor.QueryBase = (BYTE) *Address;
+
+    for (i = 0; i < sizeof(query); i++)
+    {
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, 1);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        data[0] = ((BYTE*) &query)[i];
+    }
+
+    Function->Descriptor.ControlBase = (BYTE) *Address;
+
+    for (i = 0; i < sizeof(control); i++)
+    {
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, 1);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+
+        data[0] = ((BYTE*) &control)[i];
+    }
+
+    Function->Descriptor.DataBase = (BYTE) *Address;
+
+    for (i = 0; i < sizeof(RMI4_F01_DATA_REGISTERS); i++)
+    {
+        data = RmiSimAllocateRegister(Device, page, (*Address)++, 1);
+
+        if (data == NULL)
+        {
+            return STATUS_INSUFFICIENT_RESOURCES;
+        }
+    }
+
+    return STATUS_SUCCESS;
+}
+
+static
+RMI_SIM_REGISTER*
+RmiSimF01Register(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Base,
+    IN ULONG Offset
+    )
+{
+    return &Device->Registers[Device->F01->Page][Base + Offset];
+}
+
+#define RMI_SIM_F01_STATUS(Device) \
+    (RmiSimF01Register((Device), (Device)->F01->Descriptor.DataBase, 0)->Data)
+#define RMI_SIM_F01_INTERRUPT_STATUS(Device) \
+    (RmiSimF01Register((Device), (Device)->F01->Descriptor.DataBase, 1)->Data)
+#define RMI_SIM_F01_DEVICE_CONTROL(Device) \
+    (RmiSimF01Register((Device), (Device)->F01->Descriptor.ControlBase, 0)->Data)
+#define RMI_SIM_F01_INTERRUPT_ENABLE(Device) \
+    (RmiSimF01Register((Device), (Device)->F01->Descriptor.ControlBase, 1)->Data)
+
+static
+VOID
+RmiSimReset(
+    IN RMI_SIM_DEVICE *Device,
+    IN BOOLEAN PowerOn
+    )
+/*++
+
+Routine Description:
+
+    Resets the controller: control registers go back to their power-on
+    contents, page 0 is selected, the device reports itself unconfigured
+    and, unless this is
+    the power-on reset, raises its F01 interrupt with a reset status.
+
+--*/
+{
+    RMI4_F01_DATA_REGISTERS status;
+    ULONG i;
+
+    for (i = 0; i < sizeof(RMI4_F01_CTRL_REGISTERS); i++)
+    {
+        *RmiSimF01Register(Device, Device->F01->Descriptor.ControlBase, i)->Data =
+            Device->F01ControlDefaults[i];
+    }
+
+    RtlZeroMemory(&status, sizeof(status));
+    status.DeviceStatus.Unconfigured = 1;
+
+    if (!PowerOn)
+    {
+        status.DeviceStatus.Status = RMI4_F01_DATA_STATUS_RESET_OCCURRED;
+        status.InterruptStatus[0] = Device->F01->InterruptMask;
+    }
+
+    *RMI_SIM_F01_STATUS(Device) = status.DeviceStatus.All;
+    *RMI_SIM_F01_INTERRUPT_STATUS(Device) = status.InterruptStatus[0];
+
+    Device->Page = 0;
+}
+
+NTSTATUS
+RmiSimCreate(
+    IN const RMI_SIM_LAYOUT *Layout,
+    OUT RMI_SIM_DEVICE **Device
+    )
+/*++
+
+Routine Description:
+
+    Creates a simulated controller with the given firmware layout. It
+    comes up from a power-on reset, unconfigured and with all interrupt
+    sources enabled.
+
+Arguments:
+
+    Layout - Firmware layout, copied
+    Device - Receives the device
+
+Return Value:
+
+    NTSTATUS indicating success or failure, STATUS_INVALID_PARAMETER for
+    a layout without F01 or F12, or one that does not fit the register
+    map
+
+--*/
+{
+    RMI_SIM_DEVICE* device;
+    RMI_SIM_PLACEMENT* function;
+    ULONG address[RMI_SIM_MAX_PAGES];
+    ULONG pdt[RMI_SIM_MAX_PAGES];
+    ULONG irqBit;
+    BYTE* entry;
+    NTSTATUS status;
+    int i;
+
+    *Device = NULL;
+
+    if (Layout->FunctionCount <= 0 ||
+        Layout->FunctionCount > RMI4_MAX_FUNCTIONS ||
+        Layout->BusSpeed == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    device = calloc(1, sizeof(*device));
+
+    if (device == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    device->Memory = calloc(1, RMI_SIM_MEMORY_SIZE);
+    status = RmiLockCreate(&device->Lock);
+
+    if (device->Memory == NULL || !NT_SUCCESS(status))
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    RtlCopyMemory(&device->Layout, Layout, sizeof(*Layout));
+
+    device->Target.Context = device;
+    device->Target.Write = RmiSimWrite;
+    device->Target.Read = RmiSimRead;
+
+    RtlZeroMemory(address, sizeof(address));
+
+    for (i = 0; i < RMI_SIM_MAX_PAGES; i++)
+    {
+        pdt[i] = RMI4_FIRST_FUNCTION_ADDRESS;
+    }
+
+    irqBit = 0;
+    status = STATUS_SUCCESS;
+
+    for (i = 0; i < Layout->FunctionCount && NT_SUCCESS(status); i++)
+    {
+        function = &device->Functions[i];
+        function->Page = Layout->Functions[i].Page;
+        function->Descriptor.Number = Layout->Functions[i].Number;
+        function->Descriptor.VersionIrq.IrqCount = Layout->Functions[i].IrqCount & 7;
+
+        if (function->Page >= RMI_SIM_MAX_PAGES)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            break;
+        }
+
+        if (irqBit + function->Descriptor.VersionIrq.IrqCount <= 8)
+        {
+            function->InterruptMask = (BYTE)
+                (((1U << function->Descriptor.VersionIrq.IrqCount) - 1) << irqBit);
+        }
+
+        irqBit += function->Descriptor.VersionIrq.IrqCount;
+
+        switch (function->Descriptor.Number)
+        {
+        case RMI4_F01_RMI_DEVICE_CONTROL:
+            device->F01 = function;
+            status = RmiSimPlaceF01(device, function, &address[function->Page]);
+            break;
+        case RMI4_F12_2D_TOUCHPAD_SENSOR:
+            device->F12 = function;
+            status = RmiSimPlaceF12(device, function, &address[function->Page]);
+            break;
+        default:
+            //
+            // Placeholder registers for functions the driver only lists
+            //
+            function->Descriptor.QueryBase = (BYTE) address[function->Page];
+            function->Descriptor.ControlBase = (BYTE) (address[function->Page] + 1);
+            function->Descriptor.DataBase = (BYTE) (address[function->Page] + 2);
+
+            if (RmiSimAllocateRegister(device, function->Page, address[function->Page]++, 1) == NULL ||
+                RmiSimAllocateRegister(device, function->Page, address[function->Page]++, 1) == NULL ||
+                RmiSimAllocateRegister(device, function->Page, address[function->Page]++, 1) == NULL)
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+            }
+            break;
+        }
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        //
+        // Command register, F01 takes resets through it
+        //
+        function->Descriptor.CommandBase = (BYTE) address[function->Page];
+
+        if (RmiSimAllocateRegister(device, function->Page, address[function->Page]++, 1) == NULL)
+        {
+            status = STATUS_INSUFFICIENT_RESOURCES;
+            break;
+        }
+
+        //
+        // Page description table entry, one register per byte
+        //
+        pdt[function->Page] -= RMI_SIM_PDT_ENTRY_SIZE;
+    }
+
+    if (!NT_SUCCESS(status) || device->F01 == NULL || device->F12 == NULL)
+    {
+        status = NT_SUCCESS(status) ? STATUS_INVALID_PARAMETER : status;
+        goto exit;
+    }
+
+    //
+    // The PDT grows down from 0xE9, with a terminating empty entry under
+    // the last function, and must stay clear of the function registers
+    //
+    for (i = 0; i < RMI_SIM_MAX_PAGES; i++)
+    {
+        if (address[i] > pdt[i])
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        pdt[i] = RMI4_FIRST_FUNCTION_ADDRESS;
+    }
+
+    for (i = 0; i < Layout->FunctionCount; i++)
+    {
+        function = &device->Functions[i];
+
+        for (irqBit = 0; irqBit < RMI_SIM_PDT_ENTRY_SIZE; irqBit++)
+        {
+            entry = RmiSimAllocateRegister(device, function->Page, pdt[function->Page] + irqBit, 1);
+
+            if (entry == NULL)
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                goto exit;
+            }
+
+            *entry = ((BYTE*) &function->Descriptor)[irqBit];
+        }
+
+        pdt[function->Page] -= RMI_SIM_PDT_ENTRY_SIZE;
+    }
+
+    RmiSimReset(device, TRUE);
+
+    *Device = device;
+    device = NULL;
+
+exit:
+
+    if (device != NULL)
+    {
+        RmiSimDestroy(device);
+    }
+
+    return status;
+}
+
+VOID
+RmiSimDestroy(
+    IN RMI_SIM_DEVICE *Device
+    )
+{
+    if (Device->Lock != NULL)
+    {
+        RmiLockDelete(Device->Lock);
+    }
+
+    free(Device->Memory);
+    free(Device);
+}
+
+static
+VOID
+RmiSimRegisterWritten(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN BYTE Address
+    )
+/*++
+
+Routine Description:
+
+    Applies the side effects of writing a register: setting Configured
+    in F01 device control clears the unconfigured status, and the F01
+    reset command resets the controller.
+
+--*/
+{
+    RMI4_F01_CTRL_REGISTERS control;
+    RMI4_F01_DATA_REGISTERS status;
+
+    if (Page != Device->F01->Page)
+    {
+        return;
+    }
+
+    if (Address == Device->F01->Descriptor.ControlBase)
+    {
+        control.DeviceControl.All = *RMI_SIM_F01_DEVICE_CONTROL(Device);
+        status.DeviceStatus.All = *RMI_SIM_F01_STATUS(Device);
+
+        if (control.DeviceControl.Configured)
+        {
+            status.DeviceStatus.Unconfigured = 0;
+            *RMI_SIM_F01_STATUS(Device) = status.DeviceStatus.All;
+        }
+    }
+    else if (Address == Device->F01->Descriptor.CommandBase)
+    {
+        if (Device->Registers[Page][Address].Data[0] & BIT(0))
+        {
+            Device->Registers[Page][Address].Data[0] = 0;
+            RmiSimReset(Device, FALSE);
+        }
+    }
+}
+
+static
+VOID
+RmiSimRegisterRead(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN BYTE Address
+    )
+/*++
+
+Routine Description:
+
+    Applies the side effects of reading a register: the F01 status code
+    and interrupt status clear once read.
+
+--*/
+{
+    RMI4_F01_DATA_REGISTERS status;
+
+    if (Page != Device->F01->Page)
+    {
+        return;
+    }
+
+    if (Address == Device->F01->Descriptor.DataBase)
+    {
+        status.DeviceStatus.All = *RMI_SIM_F01_STATUS(Device);
+        status.DeviceStatus.Status = RMI4_F01_DATA_STATUS_NO_ERROR;
+        *RMI_SIM_F01_STATUS(Device) = status.DeviceStatus.All;
+    }
+    else if (Address == Device->F01->Descriptor.DataBase + 1)
+    {
+        *RMI_SIM_F01_INTERRUPT_STATUS(Device) = 0;
+    }
+}
+
+static
+VOID
+RmiSimAccount(
+    IN RMI_SIM_DEVICE *Device,
+    IN BOOLEAN Write,
+    IN BYTE Page,
+    IN BYTE Address,
+    IN ULONG Length
+    )
+{
+    ULONG64 time;
+
+    time = SpbModelTransferTime(
+        Device->Layout.BusSpeed,
+        Device->Layout.ClockStretch,
+        1,
+        Length);
+
+    if (Write)
+    {
+        Device->Statistics.WriteTransactions++;
+        Device->Statistics.BytesWritten += Length;
+    }
+    else
+    {
+        Device->Statistics.ReadTransactions++;
+        Device->Statistics.BytesRead += Length;
+    }
+
+    Device->Statistics.ModeledTime += time;
+    Device->Clock += time / 100;
+
+    if (Device->Callback != NULL)
+    {
+        Device->Callback(Device->CallbackContext, Write, Page, Address, Length, time);
+    }
+}
+
+static
+NTSTATUS
+RmiSimWrite(
+    IN PVOID Context,
+    IN OUT PUCHAR Data,
+    IN ULONG Length,
+    OUT ULONG *Transferred
+    )
+/*++
+
+Routine Description:
+
+    I2C write transaction: the first byte sets the register pointer, the
+    rest is written from there on. A write to 0xFF selects the page.
+
+--*/
+{
+    RMI_SIM_DEVICE* device;
+    RMI_SIM_REGISTER* reg;
+    BYTE page;
+    BYTE address;
+    ULONG i;
+
+    device = (RMI_SIM_DEVICE*) Context;
+    *Transferred = 0;
+
+    if (Length == 0)
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+
+    RmiLockAcquire(device->Lock);
+
+    page = device->Page;
+    address = Data[0];
+    device->Pointer = Data[0];
+    device->Offset = 0;
+
+    if (address == RMI4_PAGE_SELECT_ADDRESS)
+    {
+        if (Length > 1)
+        {
+            device->Page = Data[Length - 1];
+        }
+    }
+    else
+    {
+        for (i = 1; i < Length; i++)
+        {
+            reg = (device->Page < RMI_SIM_MAX_PAGES) ?
+                &device->Registers[device->Page][device->Pointer] : NULL;
+
+            if (reg == NULL || reg->Data == NULL)
+            {
+                device->Pointer++;
+                continue;
+            }
+
+            reg->Data[device->Offset++] = Data[i];
+
+            if (device->Offset == reg->Size || i == Length - 1)
+            {
+                RmiSimRegisterWritten(device, device->Page, device->Pointer);
+            }
+
+            if (device->Offset == reg->Size)
+            {
+                device->Pointer++;
+                device->Offset = 0;
+            }
+        }
+    }
+
+    RmiSimAccount(device, TRUE, page, address, Length);
+
+    RmiLockRelease(device->Lock);
+
+    *Transferred = Length;
+
+    return STATUS_SUCCESS;
+}
+
+static
+NTSTATUS
+RmiSimRead(
+    IN PVOID Context,
+    IN OUT PUCHAR Data,
+    IN ULONG Length,
+    OUT ULONG *Transferred
+    )
+/*++
+
+Routine Description:
+
+    I2C read transaction from the register pointer on. Unmapped
+    registers read as a single zero byte.
+
+--*/
+{
+    RMI_SIM_DEVICE* device;
+    RMI_SIM_REGISTER* reg;
+    BYTE address;
+    ULONG i;
+
+    device = (RMI_SIM_DEVICE*) Context;
+
+    RmiLockAcquire(device->Lock);
+
+    address = device->Pointer;
+
+    for (i = 0; i < Length; i++)
+    {
+        reg = (device->Page < RMI_SIM_MAX_PAGES) ?
+            &device->Registers[device->Page][device->Pointer] : NULL;
+
+        if (reg == NULL || reg->Data == NULL)
+        {
+            Data[i] = 0;
+            device->Pointer++;
+            continue;
+        }
+
+        Data[i] = reg->Data[device->Offset++];
+
+        if (device->Offset == reg->Size || i == Length - 1)
+        {
+            RmiSimRegisterRead(device, device->Page, device->Pointer);
+        }
+
+        if (device->Offset == reg->Size)
+        {
+            device->Pointer++;
+            device->Offset = 0;
+        }
+    }
+
+    RmiSimAccount(device, FALSE, device->Page, address, Length);
+
+    RmiLockRelease(device->Lock);
+
+    *Transferred = Length;
+
+    return STATUS_SUCCESS;
+}
+
+RMI_HOST_TARGET*
+RmiSimGetTarget(
+    IN RMI_SIM_DEVICE *Device
+    )
+{
+    return &Device->Target;
+}
+
+ULONG64*
+RmiSimGetClock(
+    IN RMI_SIM_DEVICE *Device
+    )
+/*++
+
+Routine Description:
+
+    Returns the device's clock, in 100ns units, for RmiHostUseVirtualClock.
+    It moves forward by the modeled time of every transaction and by
+    RmiSimAdvanceClock.
+
+--*/
+{
+    return &Device->Clock;
+}
+
+VOID
+RmiSimAdvanceClock(
+    IN RMI_SIM_DEVICE *Device,
+    IN ULONG64 Time
+    )
+{
+    Device->Clock += Time;
+}
+
+BOOLEAN
+RmiSimAttention(
+    IN RMI_SIM_DEVICE *Device
+    )
+/*++
+
+Routine Description:
+
+    Returns the level of the attention line, asserted while an enabled
+    interrupt source is pending.
+
+--*/
+{
+    BOOLEAN attention;
+
+    RmiLockAcquire(Device->Lock);
+
+    attention = (*RMI_SIM_F01_INTERRUPT_STATUS(Device) &
+        *RMI_SIM_F01_INTERRUPT_ENABLE(Device)) != 0;
+
+    RmiLockRelease(Device->Lock);
+
+    return attention;
+}
+
+VOID
+RmiSimPostFrame(
+    IN RMI_SIM_DEVICE *Device,
+    IN const RMI_SIM_FRAME *Frame
+    )
+/*++
+
+Routine Description:
+
+    Makes the controller scan a frame: touch frames replace the F12
+    objects and raise the F12 interrupt, reset and unconfigure events
+    raise the F01 interrupt. A frame the driver has not read yet is
+    overwritten, like on the controller.
+
+Arguments:
+
+    Device - Simulated controller
+    Frame - Scenario frame, Time is ignored
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_F01_DATA_REGISTERS status;
+    const RMI_SIM_OBJECT* object;
+    BYTE* data1;
+    BYTE* data15;
+    ULONG i;
+
+    RmiLockAcquire(Device->Lock);
+
+    switch (Frame->Event)
+    {
+    case RMI_SIM_EVENT_RESET:
+        RmiSimReset(Device, FALSE);
+        break;
+
+    case RMI_SIM_EVENT_UNCONFIGURED:
+        *RMI_SIM_F01_DEVICE_CONTROL(Device) &= (BYTE) ~0x80;
+        status.DeviceStatus.All = *RMI_SIM_F01_STATUS(Device);
+        status.DeviceStatus.Unconfigured = 1;
+        *RMI_SIM_F01_STATUS(Device) = status.DeviceStatus.All;
+        *RMI_SIM_F01_INTERRUPT_STATUS(Device) |= Device->F01->InterruptMask;
+        break;
+
+    default:
+        data1 = Device->Registers[Device->F12->Page][Device->Data1Register].Data;
+        data15 = Device->HasData15 ?
+            Device->Registers[Device->F12->Page][Device->Data15Register].Data :
+            NULL;
+
+        if (data15 != NULL)
+        {
+            RtlZeroMemory(
+                data15,
+                Device->Registers[Device->F12->Page][Device->Data15Register].Size);
+        }
+
+        Device->Touching = FALSE;
+
+        for (i = 0; i < Device->MaxObjects; i++)
+        {
+            object = &Frame->Objects[i];
+
+            data1[0] = object->Type;
+            data1[1] = (BYTE) object->X;
+            data1[2] = (BYTE) (object->X >> 8);
+            data1[3] = (BYTE) object->Y;
+            data1[4] = (BYTE) (object->Y >> 8);
+            data1[5] = object->Z;
+            data1[6] = object->wX;
+            data1[7] = object->wY;
+
+            if (data15 != NULL && object->Type != RMI_F12_OBJECT_NONE)
+            {
+                data15[i / 8] |= (BYTE) (1 << (i % 8));
+            }
+
+            if (object->Type != RMI_F12_OBJECT_NONE &&
+                object->Type != RMI_F12_OBJECT_HOVERING_FINGER)
+            {
+                Device->Touching = TRUE;
+            }
+
+            data1 += F12_DATA1_BYTES_PER_OBJ;
+        }
+
+        *RMI_SIM_F01_INTERRUPT_STATUS(Device) |= Device->F12->InterruptMask;
+        break;
+    }
+
+    RmiLockRelease(Device->Lock);
+}
+
+VOID
+RmiSimPostPacket(
+    IN RMI_SIM_DEVICE *Device,
+    IN const BYTE *Packet,
+    IN ULONG Length
+    )
+/*++
+
+Routine Description:
+
+    Makes the controller scan a frame given as a raw F12 data packet, the
+    data registers in register order as the driver reads them, and raises
+    the F12 interrupt. Used to replay captured packets. Bytes beyond the
+    data registers are ignored, registers beyond the packet keep their
+    contents.
+
+Arguments:
+
+    Device - Simulated controller
+    Packet - F12 data packet
+    Length - Packet length in bytes
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI_SIM_REGISTER* reg;
+    BYTE* data1;
+    BYTE type;
+    ULONG copy;
+    int i;
+
+    RmiLockAcquire(Device->Lock);
+
+    for (i = 0; i < Device->Layout.DataCount && Length != 0; i++)
+    {
+        reg = &Device->Registers[Device->F12->Page][Device->F12->Descriptor.DataBase + i];
+        copy = min(Length, reg->Size);
+
+        RtlCopyMemory(reg->Data, Packet, copy);
+
+        Packet += copy;
+        Length -= copy;
+    }
+
+    data1 = Device->Registers[Device->F12->Page][Device->Data1Register].Data;
+    Device->Touching = FALSE;
+
+    for (i = 0; i < Device->MaxObjects; i++)
+    {
+        type = data1[i * F12_DATA1_BYTES_PER_OBJ];
+
+        if (type != RMI_F12_OBJECT_NONE &&
+            type != RMI_F12_OBJECT_HOVERING_FINGER)
+        {
+            Device->Touching = TRUE;
+        }
+    }
+
+    *RMI_SIM_F01_INTERRUPT_STATUS(Device) |= Device->F12->InterruptMask;
+
+    RmiLockRelease(Device->Lock);
+}
+
+ULONG64
+RmiSimScanPeriod(
+    IN RMI_SIM_DEVICE *Device
+    )
+/*++
+
+Routine Description:
+
+    Returns the time from one scan of the controller to the next, from
+    F01 device control and the last frame posted: with NoSleep clear and
+    nothing but hover on the panel the controller dozes, scanning once
+    every DozeInterval, otherwise it scans at the standard or the high
+    report rate. Doze holdoff is not modeled, the controller dozes as
+    soon as the last object lifts.
+
+Arguments:
+
+    Device - Simulated controller
+
+Return Value:
+
+    Scan period in 100ns units
+
+--*/
+{
+    RMI4_F01_CTRL_REGISTERS control;
+    ULONG64 period;
+
+    RmiLockAcquire(Device->Lock);
+
+    control.DeviceControl.All = *RMI_SIM_F01_DEVICE_CONTROL(Device);
+    control.DozeInterval =
+        *RmiSimF01Register(Device, Device->F01->Descriptor.ControlBase, 2)->Data;
+
+    if (!control.DeviceControl.NoSleep &&
+        !Device->Touching &&
+        control.DozeInterval != 0)
+    {
+        period = (ULONG64) control.DozeInterval * RMI_SIM_DOZE_INTERVAL_UNIT;
+    }
+    else if (control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH)
+    {
+        period = RMI_SIM_SCAN_PERIOD_HIGH;
+    }
+    else
+    {
+        period = RMI_SIM_SCAN_PERIOD_STANDARD;
+    }
+
+    RmiLockRelease(Device->Lock);
+
+    return period;
+}
+
+VOID
+RmiSimGetStatistics(
+    IN RMI_SIM_DEVICE *Device,
+    OUT RMI_SIM_STATISTICS *Statistics
+    )
+{
+    RmiLockAcquire(Device->Lock);
+    RtlCopyMemory(Statistics, &Device->Statistics, sizeof(*Statistics));
+    RmiLockRelease(Device->Lock);
+}
+
+VOID
+RmiSimSetTransactionCallback(
+    IN RMI_SIM_DEVICE *Device,
+    IN PRMI_SIM_TRANSACTION_CALLBACK Callback,
+    IN PVOID Context
+    )
+/*++
+
+Routine Description:
+
+    Sets a routine called after every transaction with its direction,
+    the page and register it started at, its length and modeled time.
+    It is called with the device lock held and must not access the
+    device.
+
+--*/
+{
+    RmiLockAcquire(Device->Lock);
+    Device->Callback = Callback;
+    Device->CallbackContext = Context;
+    RmiLockRelease(Device->Lock);
+}
+
+BOOLEAN
+RmiSimReadRegister(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Page,
+    IN BYTE Address,
+    OUT PUCHAR Data,
+    IN ULONG Length
+    )
+/*++
+
+Routine Description:
+
+    Reads register contents directly, without a transaction or side
+    effects.
+
+Return Value:
+
+    FALSE if the register is not mapped or shorter than Length
+
+--*/
+{
+    RMI_SIM_REGISTER* reg;
+    BOOLEAN found;
+
+    if (Page >= RMI_SIM_MAX_PAGES)
+    {
+        return FALSE;
+    }
+
+    RmiLockAcquire(Device->Lock);
+
+    reg = &Device->Registers[Page][Address];
+    found = (reg->Data != NULL && reg->Size >= Length);
+
+    if (found)
+    {
+        RtlCopyMemory(Data, reg->Data, Length);
+    }
+
+    RmiLockRelease(Device->Lock);
+
+    return found;
+}
+
+BYTE
+RmiSimFindFunction(
+    IN RMI_SIM_DEVICE *Device,
+    IN BYTE Number,
+    OUT RMI4_FUNCTION_DESCRIPTOR *Descriptor
+    )
+/*++
+
+Routine Description:
+
+    Looks up where a function was placed.
+
+Return Value:
+
+    The register page of the function, 0xFF if it does not exist
+
+--*/
+{
+    int i;
+
+    for (i = 0; i < Device->Layout.FunctionCount; i++)
+    {
+        if (Device->Functions[i].Descriptor.Number == Number)
+        {
+            RtlCopyMemory(
+                Descriptor,
+                &Device->Functions[i].Descriptor,
+                sizeof(*Descriptor));
+
+            return Device->Functions[i].Page;
+        }
+    }
+
+    return 0xFF;
+}
+
+static
+BOOLEAN
+RmiSimParseObject(
+    IN const char *Token,
+    IN OUT RMI_SIM_FRAME *Frame
+    )
+/*++
+
+Routine Description:
+
+    Parses slot:x,y[,type[,z[,wx,wy]]] into a frame object. Objects are
+    fingers pressing with a contact width of 4 unless said otherwise.
+
+--*/
+{
+    unsigned int slot, x, y, type, z, wx, wy;
+    int fields;
+
+    type = RMI_F12_OBJECT_FINGER;
+    z = 40;
+    wx = 4;
+    wy = 4;
+
+    fields = sscanf(Token, "%u:%u,%u,%u,%u,%u,%u", &slot, &x, &y, &type, &z, &wx, &wy);
+
+    if (fields < 3 || slot >= RMI_SIM_MAX_FRAME_OBJECTS ||
+        x > MAXUSHORT || y > MAXUSHORT || type > 0xFF ||
+        z > 0xFF || wx > 0xFF || wy > 0xFF)
+    {
+        return FALSE;
+    }
+
+    Frame->Objects[slot].Type = (BYTE) type;
+    Frame->Objects[slot].X = (USHORT) x;
+    Frame->Objects[slot].Y = (USHORT) y;
+    Frame->Objects[slot].Z = (BYTE) z;
+    Frame->Objects[slot].wX = (BYTE) wx;
+    Frame->Objects[slot].wY = (BYTE) wy;
+
+    return TRUE;
+}
+
+NTSTATUS
+RmiSimLoadScript(
+    IN const char *Path,
+    OUT RMI_SIM_FRAME **Frames,
+    OUT ULONG *FrameCount
+    )
+/*++
+
+Routine Description:
+
+    Loads a touch scenario script. Each line is one frame, starting with
+    its time in milliseconds, followed by an event:
+
+        <ms> touch [slot:x,y[,type[,z[,wx,wy]]]]...
+        <ms> reset
+        <ms> unconfigure
+
+    A touch frame lists every object down in that scan, slots it leaves
+    out are empty, so "touch" alone lifts everything. Blank lines and
+    lines starting with # are skipped.
+
+Arguments:
+
+    Path - Script file
+    Frames - Receives the frames, to be released with free()
+    FrameCount - Receives the number of frames
+
+Return Value:
+
+    NTSTATUS indicating success or failure, STATUS_INVALID_PARAMETER for
+    a malformed line
+
+--*/
+{
+    RMI_SIM_FRAME* frames;
+    RMI_SIM_FRAME* grown;
+    RMI_SIM_FRAME* frame;
+    ULONG count;
+    ULONG capacity;
+    char line[1024];
+    char* token;
+    char* next;
+    double ms;
+    FILE* file;
+    NTSTATUS status;
+
+    *Frames = NULL;
+    *FrameCount = 0;
+
+    file = fopen(Path, "r");
+
+    if (file == NULL)
+    {
+        return STATUS_OBJECT_NAME_NOT_FOUND;
+    }
+
+    frames = NULL;
+    count = 0;
+    capacity = 0;
+    status = STATUS_SUCCESS;
+
+    while (fgets(line, sizeof(line), file) != NULL)
+    {
+        token = strtok_r(line, " \t\r\n", &next);
+
+        if (token == NULL || token[0] == '#')
+        {
+            continue;
+        }
+
+        if (count == capacity)
+        {
+            capacity = max(capacity * 2, 64U);
+            grown = realloc(frames, capacity * sizeof(RMI_SIM_FRAME));
+
+            if (grown == NULL)
+            {
+                status = STATUS_INSUFFICIENT_RESOURCES;
+                goto exit;
+            }
+
+            frames = grown;
+        }
+
+        frame = &frames[count];
+        RtlZeroMemory(frame, sizeof(*frame));
+
+        if (sscanf(token, "%lf", &ms) != 1 || ms < 0)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        frame->Time = (ULONG64) (ms * 10000);
+
+        token = strtok_r(NULL, " \t\r\n", &next);
+
+        if (token == NULL)
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        if (strcmp(token, "reset") == 0)
+        {
+            frame->Event = RMI_SIM_EVENT_RESET;
+        }
+        else if (strcmp(token, "unconfigure") == 0)
+        {
+            frame->Event = RMI_SIM_EVENT_UNCONFIGURED;
+        }
+        else if (strcmp(token, "touch") == 0)
+        {
+            frame->Event = RMI_SIM_EVENT_TOUCH;
+
+            while ((token = strtok_r(NULL, " \t\r\n", &next)) != NULL)
+            {
+                if (!RmiSimParseObject(token, frame))
+                {
+                    status = STATUS_INVALID_PARAMETER;
+                    goto exit;
+                }
+            }
+        }
+        else
+        {
+            status = STATUS_INVALID_PARAMETER;
+            goto exit;
+        }
+
+        count++;
+    }
+
+exit:
+
+    fclose(file);
+
+    if (!NT_SUCCESS(status))
+    {
+        free(frames);
+        return status;
+    }
+
+    *Frames = frames;
+    *FrameCount = count;
+
+    return status;
+}
+
+VOID
+RmiSimSwipeScenario(
+    IN ULONG Contacts,
+    IN ULONG FrameCount,
+    IN ULONG64 Period,
+    OUT RMI_SIM_FRAME *Frames
+    )
+/*++
+
+Routine Description:
+
+    Builds a scenario of Contacts fingers swiping right side by side,
+    one frame every Period, the last of FrameCount frames lifting them
+    all.
+
+Arguments:
+
+    Contacts - Fingers down, at most RMI_SIM_MAX_FRAME_OBJECTS
+    FrameCount - Frames to build
+    Period - Time between frames, in 100ns units
+    Frames - Receives FrameCount frames
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI_SIM_OBJECT* object;
+    ULONG frame;
+    ULONG slot;
+
+    Contacts = min(Contacts, (ULONG) RMI_SIM_MAX_FRAME_OBJECTS);
+
+    for (frame = 0; frame < FrameCount; frame++)
+    {
+        RtlZeroMemory(&Frames[frame], sizeof(RMI_SIM_FRAME));
+        Frames[frame].Time = frame * Period;
+        Frames[frame].Event = RMI_SIM_EVENT_TOUCH;
+
+        if (frame == FrameCount - 1)
+        {
+            continue;
+        }
+
+        for (slot = 0; slot < Contacts; slot++)
+        {
+            object = &Frames[frame].Objects[slot];
+            object->Type = RMI_F12_OBJECT_FINGER;
+            object->X = (USHORT) (100 + frame * 8);
+            object->Y = (USHORT) (100 + slot * 60);
+            object->Z = 40;
+            object->wX = 4;
+            object->wY = 4;
+        }
+    }
+}
+
+static
+PPTP_REPORT
+RmiSimHostNextReportBuffer(
+    IN VOID *BufferContext,
+    IN ULONG ReportIndex
+    )
+{
+    RMI_SIM_HOST* host;
+
+    host = (RMI_SIM_HOST*) BufferContext;
+
+    if (!host->ReaderWaiting ||
+        host->ReportCount + ReportIndex >= RTL_NUMBER_OF(host->Reports))
+    {
+        return NULL;
+    }
+
+    host->BuffersTaken++;
+
+    return &host->Reports[host->ReportCount + ReportIndex];
+}
+
+NTSTATUS
+RmiSimHostStart(
+    IN RMI_SIM_HOST *Host,
+    IN const RMI_SIM_LAYOUT *Layout
+    )
+/*++
+
+Routine Description:
+
+    Creates a simulated controller and starts a controller context on
+    it, with settings from RmiHostSetSetting. RmiQueryTime on the calling
+    thread follows the device clock from here on, services must be
+    called from the same thread.
+
+Arguments:
+
+    Host - Harness to start, a reader is waiting for reports
+    Layout - Firmware layout of the simulated controller
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+
+    RtlZeroMemory(Host, sizeof(*Host));
+    Host->ReaderWaiting = TRUE;
+
+    status = RmiSimCreate(Layout, &Host->Device);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    RmiHostUseVirtualClock(RmiSimGetClock(Host->Device));
+
+    status = RmiHostSpbInitialize(&Host->Spb, RmiSimGetTarget(Host->Device));
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = TchAllocateContext(&Host->Controller, NULL);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = TchRegistryGetControllerSettings(Host->Controller, NULL);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = TchStartDevice(Host->Controller, &Host->Spb);
+
+exit:
+
+    if (!NT_SUCCESS(status))
+    {
+        RmiSimHostStop(Host);
+    }
+
+    return status;
+}
+
+static
+NTSTATUS
+RmiSimHostServicePasses(
+    IN RMI_SIM_HOST *Host,
+    IN BOOLEAN Interrupt
+    )
+/*++
+
+Routine Description:
+
+    Services the controller the way the ISR does for as long as the
+    attention line is asserted, once at least if Interrupt is set.
+
+--*/
+{
+    BOOLEAN complete;
+    ULONG filled;
+    ULONG pass;
+    NTSTATUS status;
+
+    complete = !Interrupt;
+
+    for (pass = 0; pass < RMI_SIM_HOST_MAX_PASSES; pass++)
+    {
+        //
+        // The driver services on interrupts, and on read requests while
+        // a frame is held for a reader
+        //
+        if (complete &&
+            !RmiSimAttention(Host->Device) &&
+            !(Host->ReaderWaiting && TchHasHeldFrame(Host->Controller)))
+        {
+            return STATUS_SUCCESS;
+        }
+
+        status = TchServiceInterrupts(
+            Host->Controller,
+            &Host->Spb,
+            Host->ReaderWaiting,
+            RmiSimHostNextReportBuffer,
+            Host,
+            TCH_MAX_REPORTS_PER_FRAME,
+            MODE_MULTI_TOUCH,
+            &filled,
+            &complete);
+
+        Host->ReportCount += filled;
+
+        if (!NT_SUCCESS(status))
+        {
+            return status;
+        }
+    }
+
+    return STATUS_TIMEOUT;
+}
+
+NTSTATUS
+RmiSimHostService(
+    IN RMI_SIM_HOST *Host
+    )
+/*++
+
+Routine Description:
+
+    Services the controller the way the ISR does for as long as the
+    attention line is asserted. Reports go to Host->Reports after the
+    ReportCount already there; the caller resets ReportCount once it has
+    consumed them.
+
+Arguments:
+
+    Host - Started harness
+
+Return Value:
+
+    STATUS_SUCCESS, the error of a pass that failed to service the
+    controller, or STATUS_TIMEOUT if servicing did not complete within
+    a bounded number of passes
+
+--*/
+{
+    return RmiSimHostServicePasses(Host, FALSE);
+}
+
+NTSTATUS
+RmiSimHostServiceSynthetic(
+    IN RMI_SIM_HOST *Host
+    )
+/*++
+
+Routine Description:
+
+    Raises a touch interrupt for the next frame of the configured
+    synthetic workload and services it, the way the synthetic frame
+    timer does. The frame comes from the synthetic source, not the
+    simulated controller. Reports are returned as by RmiSimHostService.
+
+Arguments:
+
+    Host - Harness started with SyntheticWorkload set
+
+Return Value:
+
+    As RmiSimHostService
+
+--*/
+{
+    TchQueueSyntheticFrame(Host->Controller);
+
+    return RmiSimHostServicePasses(Host, TRUE);
+}
+
+VOID
+RmiSimHostStop(
+    IN RMI_SIM_HOST *Host
+    )
+{
+    if (Host->Controller != NULL)
+    {
+        TchStopDevice(Host->Controller, &Host->Spb);
+        TchFreeContext(Host->Controller);
+        Host->Controller = NULL;
+    }
+
+    RmiHostSpbDeinitialize(&Host->Spb);
+    RmiHostUseVirtualClock(NULL);
+
+    if (Host->Device != NULL)
+    {
+        RmiSimDestroy(Host->Device);
+        Host->Device = NULL;
+    }
+}
@@ -0,0 +1,68 @@
+#
+# Flags writable globals in the RMI4 core. Every controller instance in
+# the system shares them, so state kept there would be shared between
+# digitizers and serialize them. Lists each one, and fails on any that is
+# not known to be only read.
+#
+#   cmake -DOBJDUMP=<objdump> -DLIBRARY=<core library> -P rmiglobals.cmake
+#
+
+cmake_minimum_required(VERSION 3.13)
+
+#
+# <object>:<symbol> only ever read, the registry query defaults, which
+# are not const only because RTL_QUERY_REGISTRY_TABLE.DefaultData is not
+#
+set(READ_ONLY_GLOBALS
+    registry.c.o:gDefaultConfiguration
+    resolutions.c.o:gDefaultProperties
+)
+
+#
+# The user-mode backend of compat.h, not part of the driver
+#
+set(HOST_OBJECTS
+    hostspb.c.o
+    rmihost.c.o
+)
+
+execute_process(
+    COMMAND ${OBJDUMP} -t ${LIBRARY}
+    OUTPUT_VARIABLE symbols
+    RESULT_VARIABLE result
+)
+
+if(NOT result EQUAL 0)
+    message(FATAL_ERROR "${OBJDUMP} -t ${LIBRARY} failed")
+endif()
+
+string(REPLACE "\n" ";" lines "${symbols}")
+
+set(object "")
+set(unexpected 0)
+
+foreach(line IN LISTS lines)
+    if(line MATCHES "^([^ ]+\\.o):[ \t]+file format")
+        set(object ${CMAKE_MATCH_1})
+    elseif(line MATCHES " O (\\.data|\\.bss|\\*COM\\*)\t[0-9a-f]+ (.+)$")
+        set(section ${CMAKE_MATCH_1})
+        set(symbol ${CMAKE_MATCH_2})
+
+        if(object IN_LIST HOST_OBJECTS)
+            continue()
+        endif()
+
+        if("${object}:${symbol}" IN_LIST READ_ONLY_GLOBALS)
+            message(STATUS "shared, read only: ${object} ${symbol} (${section})")
+        else()
+            message(STATUS "shared, writable: ${object} ${symbol} (${section})")
+            math(EXPR unexpected "${unexpected} + 1")
+        endif()
+    endif()
+endforeach()
+
+if(unexpected GREATER 0)
+    message(FATAL_ERROR
+        "${unexpected} writable globals in the core are shared between "
+        "controller instances, keep the state in the controller context")
+endif()
@@ -0,0 +1,164 @@
+/*++
+    Module Name:
+
+        rmiprofiletest.c
+
+    Abstract:
+
+        Starts the RMI4 core, built with the profile of the simulated
+        controller's default layout (simprofile.h), against controllers
+        sharing its product ID and checks that the layout is only taken
+        from the profile when the F12 register descriptors match.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static int gFailures;
+
+#define CHECK(e)                                                            \
+    do                                                                      \
+    {                                                                       \
+        if (!(e))                                                           \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n",                \
+                __FILE__, __LINE__, __func__, #e);                          \
+            gFailures++;                                                    \
+        }                                                                   \
+    } while (0)
+
+static
+VOID
+CheckTouch(
+    IN RMI_SIM_HOST *Host,
+    IN ULONG Contacts
+    )
+{
+    RMI_SIM_FRAME frames[2];
+    ULONG i;
+
+    RmiSimSwipeScenario(Contacts, 2, 0, frames);
+
+    Host->ReportCount = 0;
+    RmiSimPostFrame(Host->Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(Host)));
+    CHECK(Host->ReportCount == (Contacts + 4) / 5);
+    CHECK(Host->Reports[0].ContactCount == Contacts);
+
+    for (i = 0; i < Contacts && i < 5; i++)
+    {
+        CHECK(Host->Reports[0].Contacts[i].TipSwitch);
+        CHECK(Host->Reports[0].Contacts[i].X == frames[0].Objects[i].X);
+    }
+
+    Host->ReportCount = 0;
+    RmiSimPostFrame(Host->Device, &frames[1]);
+    CHECK(NT_SUCCESS(RmiSimHostService(Host)));
+    CHECK(Host->ReportCount == (Contacts + 4) / 5);
+    CHECK(!Host->Reports[0].Contacts[0].TipSwitch);
+}
+
+static
+VOID
+TestProfileMatch(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    RmiSimDefaultLayout(&layout, 10);
+
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(controller->LayoutFromProfile);
+    CHECK(controller->FunctionCount == 5);
+    CHECK(controller->PacketSize == 10 * F12_DATA1_BYTES_PER_OBJ + 2);
+    CHECK(controller->MaxFingers == 10);
+    CHECK(controller->ControlRegDesc.NumRegisters == 5);
+    CHECK(controller->DataRegDesc.NumRegisters == 2);
+
+    CheckTouch(&host, 7);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestProfileMismatch(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    //
+    // Same product ID and registers, five fingers in the data packet:
+    // only the data register structure differs
+    //
+    RmiSimDefaultLayout(&layout, 5);
+
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(!controller->LayoutFromProfile);
+    CHECK(controller->PacketSize == 5 * F12_DATA1_BYTES_PER_OBJ + 1);
+    CHECK(controller->MaxFingers == 5);
+
+    CheckTouch(&host, 5);
+
+    RmiSimHostStop(&host);
+
+    //
+    // Same product ID and packet, one control register less
+    //
+    RmiSimDefaultLayout(&layout, 10);
+    layout.ControlCount--;
+
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(!controller->LayoutFromProfile);
+    CHECK(controller->ControlRegDesc.NumRegisters == 4);
+    CHECK(controller->MaxFingers == 10);
+
+    CheckTouch(&host, 7);
+
+    RmiSimHostStop(&host);
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    TestProfileMatch();
+    TestProfileMismatch();
+
+    if (gFailures != 0)
+    {
+        fprintf(stderr, "%d checks failed\n", gFailures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,1716 @@
+/*++
+    Module Name:
+
+        rmisimtest.c
+
+    Abstract:
+
+        Starts the RMI4 core against the simulated controller and checks
+        discovery, touch reporting and recovery from controller resets,
+        and that captured touch traces replay to the same reports.
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+static int gFailures;
+
+#define CHECK(e)                                                            \
+    do                                                                      \
+    {                                                                       \
+        if (!(e))                                                           \
+        {                                                                   \
+            fprintf(stderr, "%s:%d: %s: check failed: %s\n",                \
+                __FILE__, __LINE__, __func__, #e);                          \
+            gFailures++;                                                    \
+        }                                                                   \
+    } while (0)
+
+static
+VOID
+Touch(
+    OUT RMI_SIM_FRAME *Frame,
+    IN ULONG Contacts
+    )
+{
+    ULONG i;
+
+    RmiSimSwipeScenario(Contacts, 2, 0, Frame);
+    for (i = 0; i < Contacts; i++)
+    {
+        Frame->Objects[i].X = (USHORT) (200 + i * 50);
+        Frame->Objects[i].Y = (USHORT) (300 + i * 50);
+    }
+}
+
+static ULONG gReportsTaken;
+
+static
+PPTP_REPORT
+TakeReport(
+    IN VOID *BufferContext,
+    IN ULONG ReportIndex
+    )
+{
+    UNREFERENCED_PARAMETER(ReportIndex);
+
+    gReportsTaken++;
+
+    return (PPTP_REPORT) BufferContext;
+}
+
+static
+ULONG
+CountContacts(
+    IN RMI_SIM_HOST *Host,
+    IN BOOLEAN TipSwitch
+    )
+{
+    ULONG contacts;
+    ULONG i, j;
+
+    contacts = 0;
+
+    for (i = 0; i < Host->ReportCount; i++)
+    {
+        for (j = 0; j < 5; j++)
+        {
+            if (i * 5 + j < Host->Reports[0].ContactCount &&
+                Host->Reports[i].Contacts[j].TipSwitch == TipSwitch)
+            {
+                contacts++;
+            }
+        }
+    }
+
+    return contacts;
+}
+
+static
+VOID
+TestDiscovery(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_FUNCTION_DESCRIPTOR f01;
+    RMI4_F01_DATA_REGISTERS status;
+    BYTE page;
+
+    RmiSimDefaultLayout(&layout, 10);
+
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(controller->FunctionCount == 5);
+    CHECK(controller->FunctionOnPage[4] == 1);
+    CHECK(controller->HasButtons);
+    CHECK(controller->HasDribble);
+    CHECK(!controller->LayoutFromProfile);
+    CHECK(controller->PacketSize == 10 * F12_DATA1_BYTES_PER_OBJ + 2);
+    CHECK(controller->Data1Offset == 0);
+    CHECK(controller->MaxFingers == 10);
+    CHECK(controller->ControlRegDesc.NumRegisters == 5);
+    CHECK(controller->DataRegDesc.NumRegisters == 2);
+    CHECK(controller->DataRegDesc.Registers[0].NumSubPackets == 10);
+    CHECK(controller->InterruptEnableMask == 0x0E);
+
+    //
+    // Configuring the controller clears its unconfigured status
+    //
+    page = RmiSimFindFunction(host.Device, RMI4_F01_RMI_DEVICE_CONTROL, &f01);
+    CHECK(RmiSimReadRegister(host.Device, page, f01.DataBase, &status.DeviceStatus.All, 1));
+    CHECK(status.DeviceStatus.Unconfigured == 0);
+
+    RmiSimHostStop(&host);
+
+    //
+    // Data0 in front of the objects moves them in the packet
+    //
+    RmiSimDefaultLayout(&layout, 32);
+    memmove(&layout.Data[1], &layout.Data[0], 2 * sizeof(layout.Data[0]));
+    layout.Data[0].Register = 0;
+    layout.Data[0].RegisterSize = 3;
+    layout.Data[0].NumSubPackets = 1;
+    layout.DataCount = 3;
+
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(controller->PacketSize == 3 + 32 * F12_DATA1_BYTES_PER_OBJ + 4);
+    CHECK(controller->Data1Offset == 3);
+    CHECK(controller->MaxFingers == 32);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestInterruptAssignment(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_FUNCTION_DESCRIPTOR f01;
+    BYTE interruptEnable;
+    BYTE page;
+
+    //
+    // F34, F01, F12 with two sources, F1A and F54 take bits 0 to 5 in
+    // PDT order, and only F01 and F12 are enabled
+    //
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F01_RMI_DEVICE_CONTROL) == 0x02);
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F12_2D_TOUCHPAD_SENSOR) == 0x0C);
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F1A_0D_CAP_BUTTON_SENSOR) == 0x10);
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F54_TEST_REPORTING) == 0x20);
+    CHECK(controller->InterruptEnableMask == 0x0E);
+
+    interruptEnable = 0;
+    page = RmiSimFindFunction(host.Device, RMI4_F01_RMI_DEVICE_CONTROL, &f01);
+    CHECK(RmiSimReadRegister(host.Device, page, f01.ControlBase + 1, &interruptEnable, 1));
+    CHECK(interruptEnable == 0x0E);
+
+    RmiSimHostStop(&host);
+
+    //
+    // Bits past the F01 status register are not handed out: F54 is left
+    // without interrupts, the functions the driver services still start
+    //
+    layout.Functions[0].IrqCount = 4;
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F12_2D_TOUCHPAD_SENSOR) == 0x60);
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F1A_0D_CAP_BUTTON_SENSOR) == 0x80);
+    CHECK(RmiGetFunctionInterruptMask(controller, RMI4_F54_TEST_REPORTING) == 0);
+    CHECK(controller->InterruptEnableMask == 0x70);
+
+    RmiSimHostStop(&host);
+
+    //
+    // Without a bit for F12 the controller does not start
+    //
+    layout.Functions[0].IrqCount = 7;
+    CHECK(!NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+}
+
+static
+VOID
+TestTouch(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_STATISTICS statistics;
+    ULONG contacts;
+
+    RmiSimDefaultLayout(&layout, 32);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+
+    for (contacts = 1; contacts <= 12; contacts += 11)
+    {
+        host.ReportCount = 0;
+        Touch(frames, contacts);
+        RmiSimPostFrame(host.Device, &frames[0]);
+        CHECK(RmiSimAttention(host.Device));
+
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+        CHECK(!RmiSimAttention(host.Device));
+        CHECK(host.ReportCount == (contacts + 4) / 5);
+        CHECK(host.Reports[0].ContactCount == contacts);
+        CHECK(CountContacts(&host, TRUE) == contacts);
+
+        //
+        // Lifting reports every contact once more, up
+        //
+        host.ReportCount = 0;
+        RmiSimPostFrame(host.Device, &frames[1]);
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+        CHECK(host.ReportCount == (contacts + 4) / 5);
+        CHECK(CountContacts(&host, FALSE) == contacts);
+    }
+
+    //
+    // The transport saw the same traffic the device did
+    //
+    RmiSimGetStatistics(host.Device, &statistics);
+    CHECK(statistics.ReadTransactions == host.Spb.Statistics.ReadTransactions);
+    CHECK(statistics.WriteTransactions == host.Spb.Statistics.WriteTransactions);
+    CHECK(statistics.BytesRead == host.Spb.Statistics.BytesRead);
+    CHECK(statistics.BytesWritten == host.Spb.Statistics.BytesWritten);
+    CHECK(statistics.ModeledTime != 0);
+    CHECK(host.Spb.Statistics.BusTime != 0 &&
+        host.Spb.Statistics.BusTime <= statistics.ModeledTime / 100);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestReset(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_FRAME event;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_FUNCTION_DESCRIPTOR f01;
+    RMI4_F01_DATA_REGISTERS status;
+    BYTE page;
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+    page = RmiSimFindFunction(host.Device, RMI4_F01_RMI_DEVICE_CONTROL, &f01);
+
+    RtlZeroMemory(&event, sizeof(event));
+    event.Event = RMI_SIM_EVENT_RESET;
+    RmiSimPostFrame(host.Device, &event);
+
+    CHECK(RmiSimReadRegister(host.Device, page, f01.DataBase, &status.DeviceStatus.All, 1));
+    CHECK(status.DeviceStatus.Unconfigured == 1);
+
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.BuffersTaken == 0);
+    CHECK(controller->ResetOccurred);
+    CHECK(controller->Faults.Faults[RMI4_FAULT_RESET] == 1);
+    CHECK(controller->Faults.Faults[RMI4_FAULT_UNCONFIGURED] == 1);
+
+    //
+    // The driver programmed the controller again
+    //
+    CHECK(RmiSimReadRegister(host.Device, page, f01.DataBase, &status.DeviceStatus.All, 1));
+    CHECK(status.DeviceStatus.Unconfigured == 0);
+
+    event.Event = RMI_SIM_EVENT_UNCONFIGURED;
+    RmiSimPostFrame(host.Device, &event);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(controller->Faults.Faults[RMI4_FAULT_UNCONFIGURED] == 2);
+
+    //
+    // Touch reporting carries on
+    //
+    host.ReportCount = 0;
+    Touch(frames, 2);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 1);
+    CHECK(host.BuffersTaken == 1);
+    CHECK(host.Reports[0].ContactCount == 2);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestHeldFrame(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[2];
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    //
+    // A frame dropped as stale, as on D0 entry, never reaches a reader
+    //
+    host.ReaderWaiting = FALSE;
+    Touch(frames, 2);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(TchHasHeldFrame(controller));
+
+    TchDropHeldFrame(controller);
+    CHECK(!TchHasHeldFrame(controller));
+
+    host.ReaderWaiting = TRUE;
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 0);
+
+    //
+    // A contact landing with nobody reading is held, and only the latest
+    // frame is kept
+    //
+    host.ReaderWaiting = FALSE;
+    Touch(frames, 1);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    Touch(frames, 3);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+
+    CHECK(host.ReportCount == 0);
+    CHECK(TchHasHeldFrame(controller));
+    CHECK(controller->Counters.HeldFrames == 3);
+
+    //
+    // A reader gets it without another interrupt
+    //
+    host.ReaderWaiting = TRUE;
+    CHECK(!RmiSimAttention(host.Device));
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+
+    CHECK(host.ReportCount == 1);
+    CHECK(host.Reports[0].ContactCount == 3);
+    CHECK(!TchHasHeldFrame(controller));
+    CHECK(controller->Counters.HeldFramesDelivered == 1);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestPacingFlush(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[4];
+    RMI4_CONTROLLER_CONTEXT* controller;
+    PTP_REPORT report;
+    BOOLEAN complete;
+    ULONG due;
+
+    RmiHostSetSetting(L"PacingRate", 100);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+    RmiSimSwipeScenario(1, 4, 20000, frames);
+
+    //
+    // The landing goes out, a move 2ms later is held back
+    //
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 1);
+
+    RmiSimAdvanceClock(host.Device, 20000);
+    RmiSimPostFrame(host.Device, &frames[1]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 1);
+    CHECK(controller->Counters.PacedFrames == 1);
+
+    due = TchGetLiftWatchdogDue(controller);
+    CHECK(due != 0 && due <= 10);
+
+    //
+    // With no frame following, the watchdog reports it once due
+    //
+    gReportsTaken = 0;
+    CHECK(TchServiceLiftWatchdog(controller, &host.Spb, TakeReport, &report, &complete) == STATUS_NO_DATA_DETECTED);
+    CHECK(gReportsTaken == 0);
+
+    RmiSimAdvanceClock(host.Device, (ULONG64) due * 10000);
+    CHECK(NT_SUCCESS(TchServiceLiftWatchdog(controller, &host.Spb, TakeReport, &report, &complete)));
+    CHECK(complete);
+    CHECK(report.ContactCount == 1);
+    CHECK(report.Contacts[0].TipSwitch == 1);
+    CHECK(report.Contacts[0].X != host.Reports[0].Contacts[0].X);
+    CHECK(controller->Counters.PacingFlushes == 1);
+    CHECK(controller->PacingHeldSince == 0);
+
+    RmiSimHostStop(&host);
+    RmiHostClearSettings();
+}
+
+static
+VOID
+TestSurfaceSwitch(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_FRAME frames[2];
+    PTP_REPORT report;
+    BOOLEAN complete;
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    Touch(frames, 2);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 2);
+
+    //
+    // Switching surface reporting off with contacts down leaves their
+    // lifts for the watchdog, which reports them right away
+    //
+    CHECK(NT_SUCCESS(TchSetReportingSwitches(controller, &host.Spb, FALSE, TRUE)));
+    CHECK(controller->Cache.FingerSlotValid == 0);
+    CHECK(TchGetLiftWatchdogDue(controller) == 1);
+
+    CHECK(NT_SUCCESS(TchServiceLiftWatchdog(controller, &host.Spb, TakeReport, &report, &complete)));
+    CHECK(complete);
+    CHECK(report.ContactCount == 2);
+    CHECK(report.Contacts[0].TipSwitch == 0);
+    CHECK(report.Contacts[1].TipSwitch == 0);
+    CHECK(TchGetLiftWatchdogDue(controller) == 0);
+
+    //
+    // No touch interrupt is raised while it is off
+    //
+    RmiSimPostFrame(host.Device, &frames[1]);
+    CHECK(!RmiSimAttention(host.Device));
+
+    //
+    // Back on, the next touch lands as a new contact
+    //
+    host.ReportCount = 0;
+    CHECK(NT_SUCCESS(TchSetReportingSwitches(controller, &host.Spb, TRUE, TRUE)));
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 2);
+    CHECK(controller->Counters.TouchFramesSkipped == 0);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+LiftWatchdog(
+    IN UCHAR ReportingMode
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_FRAME frames[2];
+    PTP_REPORT report;
+    BOOLEAN complete;
+
+    RmiHostSetSetting(L"LiftTimeout", 50);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    CHECK(NT_SUCCESS(RmiSetReportingMode(controller, &host.Spb, ReportingMode, NULL)));
+
+    Touch(frames, 1);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 1);
+    CHECK(TchGetLiftWatchdogDue(controller) == 50);
+
+    RmiSimAdvanceClock(host.Device, 500000);
+
+    //
+    // In reduced reporting mode a finger holding still is quiet as well,
+    // the watchdog finds it still reported and leaves it down
+    //
+    if (ReportingMode == RMI_F12_REPORTING_MODE_REDUCED)
+    {
+        gReportsTaken = 0;
+        CHECK(TchServiceLiftWatchdog(controller, &host.Spb, TakeReport, &report, &complete) ==
+            STATUS_NO_DATA_DETECTED);
+        CHECK(gReportsTaken == 0);
+        CHECK(controller->Cache.FingerSlotValid == 1);
+        CHECK(controller->Counters.WatchdogReads == 1);
+        CHECK(TchGetLiftWatchdogDue(controller) == 50);
+
+        RmiSimAdvanceClock(host.Device, 500000);
+    }
+
+    //
+    // The finger lifts, but the frame reporting it is never serviced
+    //
+    RtlZeroMemory(&frames[1], sizeof(frames[1]));
+    RmiSimPostFrame(host.Device, &frames[1]);
+
+    CHECK(NT_SUCCESS(TchServiceLiftWatchdog(controller, &host.Spb, TakeReport, &report, &complete)));
+    CHECK(complete);
+    CHECK(report.ContactCount == 1);
+    CHECK(report.Contacts[0].TipSwitch == 0);
+    CHECK(controller->Counters.WatchdogLifts == 1);
+    CHECK(controller->Counters.WatchdogReads ==
+        (ReportingMode == RMI_F12_REPORTING_MODE_REDUCED ? 2 : 0));
+    CHECK(TchGetLiftWatchdogDue(controller) == 0);
+
+    //
+    // The late frame does not lift the contact again
+    //
+    host.ReportCount = 0;
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 0) == 0);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestLiftWatchdog(
+    VOID
+    )
+{
+    LiftWatchdog(RMI_F12_REPORTING_MODE_CONTINUOUS);
+    LiftWatchdog(RMI_F12_REPORTING_MODE_REDUCED);
+}
+
+static
+BYTE
+ReadDeviceControl(
+    IN RMI_SIM_HOST *Host
+    )
+{
+    RMI4_FUNCTION_DESCRIPTOR f01;
+    BYTE deviceControl;
+    BYTE page;
+
+    deviceControl = 0;
+    page = RmiSimFindFunction(Host->Device, RMI4_F01_RMI_DEVICE_CONTROL, &f01);
+    CHECK(RmiSimReadRegister(Host->Device, page, f01.ControlBase, &deviceControl, 1));
+
+    return deviceControl;
+}
+
+static
+VOID
+TestDeviceControl(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[4];
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_F01_CTRL_REGISTERS control;
+    ULONG i;
+
+    RmiHostSetSetting(L"BurstReportRate", 1);
+    RmiHostSetSetting(L"BurstEnterVelocity", 1);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+    RmiSimSwipeScenario(1, 4, 80000, frames);
+
+    //
+    // Motion raises the rate, the write lands once delivery is done
+    //
+    for (i = 0; i < 3; i++)
+    {
+        RmiSimPostFrame(host.Device, &frames[i]);
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    }
+
+    control.DeviceControl.All = ReadDeviceControl(&host);
+    CHECK(controller->HighReportRate);
+    CHECK(control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH);
+    CHECK(controller->DeviceControlWrite.Pending == 0);
+
+    //
+    // It is dropped again in the frame the last contact lifts in, the
+    // controller does not interrupt after that
+    //
+    RmiSimPostFrame(host.Device, &frames[3]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(!RmiSimAttention(host.Device));
+
+    control.DeviceControl.All = ReadDeviceControl(&host);
+    CHECK(!controller->HighReportRate);
+    CHECK(control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+    RmiSimHostStop(&host);
+    RmiHostClearSettings();
+}
+
+#define PREWAKE_DOZE_INTERVAL               10          // 100ms
+#define PREWAKE_HOVER_START                 1000000     // 100ms
+#define PREWAKE_LANDING                     3000000     // 300ms
+#define PREWAKE_LANDINGS                    16
+#define PREWAKE_TIMEOUT                     10000000    // 1s
+
+static
+ULONG64
+FirstContactLatency(
+    IN BOOLEAN PreWake,
+    IN ULONG64 Landing,
+    OUT BYTE *DeviceControl
+    )
+/*++
+
+Routine Description:
+
+    Plays a finger hovering over a dozing controller from 100ms on and
+    landing at Landing, servicing every scan the controller makes, and
+    returns the time from the landing to the scan that reports the
+    contact, in 100ns units. DeviceControl receives F01 device control
+    as the finger lands.
+
+--*/
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME hover;
+    RMI_SIM_FRAME touch[2];
+    ULONG64 period;
+    ULONG64 scan;
+    ULONG64 latency;
+    BOOLEAN landed;
+
+    RmiHostSetSetting(L"NoSleep", 0);
+    RmiHostSetSetting(L"DozeInterval", PREWAKE_DOZE_INTERVAL);
+    RmiHostSetSetting(L"HoverPreWake", PreWake);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+
+    Touch(touch, 1);
+    hover = touch[0];
+    hover.Objects[0].Type = RMI_F12_OBJECT_HOVERING_FINGER;
+    hover.Objects[0].Z = 0;
+
+    latency = PREWAKE_TIMEOUT;
+    landed = FALSE;
+    scan = 0;
+
+    while (scan < Landing + PREWAKE_TIMEOUT)
+    {
+        period = RmiSimScanPeriod(host.Device);
+        scan += period;
+        RmiSimAdvanceClock(host.Device, period);
+
+        if (scan < PREWAKE_HOVER_START)
+        {
+            continue;
+        }
+
+        if (scan >= Landing && !landed)
+        {
+            *DeviceControl = ReadDeviceControl(&host);
+            landed = TRUE;
+        }
+
+        host.ReportCount = 0;
+        RmiSimPostFrame(host.Device, landed ? &touch[0] : &hover);
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+
+        if (landed && CountContacts(&host, TRUE) != 0)
+        {
+            latency = scan - Landing;
+            break;
+        }
+    }
+
+    RmiSimHostStop(&host);
+
+    return latency;
+}
+
+static
+VOID
+TestHoverPreWake(
+    VOID
+    )
+{
+    RMI4_F01_CTRL_REGISTERS control;
+    ULONG64 landing;
+    ULONG64 dozing;
+    ULONG64 woken;
+    ULONG64 dozingTotal;
+    ULONG64 wokenTotal;
+    ULONG i;
+
+    dozingTotal = 0;
+    wokenTotal = 0;
+
+    //
+    // Landings spread over one doze interval, so every phase of the
+    // doze scans is covered
+    //
+    for (i = 0; i < PREWAKE_LANDINGS; i++)
+    {
+        landing = PREWAKE_LANDING +
+            i * PREWAKE_DOZE_INTERVAL * RMI_SIM_DOZE_INTERVAL_UNIT / PREWAKE_LANDINGS;
+
+        dozing = FirstContactLatency(FALSE, landing, &control.DeviceControl.All);
+        CHECK(!control.DeviceControl.NoSleep);
+        CHECK(dozing < PREWAKE_DOZE_INTERVAL * RMI_SIM_DOZE_INTERVAL_UNIT);
+
+        //
+        // The hover takes the controller out of doze at the high rate
+        // before the finger lands
+        //
+        woken = FirstContactLatency(TRUE, landing, &control.DeviceControl.All);
+        CHECK(control.DeviceControl.NoSleep);
+        CHECK(control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH);
+        CHECK(woken < RMI_SIM_SCAN_PERIOD_HIGH);
+
+        dozingTotal += dozing;
+        wokenTotal += woken;
+    }
+
+    CHECK(wokenTotal < dozingTotal);
+
+    printf("first contact latency: %llu us dozing, %llu us pre-woken, mean of %u landings\n",
+        (unsigned long long) (dozingTotal / PREWAKE_LANDINGS / 10),
+        (unsigned long long) (wokenTotal / PREWAKE_LANDINGS / 10),
+        PREWAKE_LANDINGS);
+}
+
+static
+VOID
+TestHoverPreWakeRelease(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_F01_CTRL_REGISTERS control;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_FRAME empty;
+
+    RmiHostSetSetting(L"NoSleep", 0);
+    RmiHostSetSetting(L"HoverPreWake", 1);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    Touch(frames, 1);
+    frames[1] = frames[0];
+    frames[1].Objects[0].Type = RMI_F12_OBJECT_HOVERING_FINGER;
+    frames[1].Objects[0].Z = 0;
+    RtlZeroMemory(&empty, sizeof(empty));
+
+    RmiSimPostFrame(host.Device, &frames[1]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(controller->PreWakeActive);
+
+    //
+    // The finger landing and lifting keeps the controller awake until
+    // the lift, which is the last frame it reports
+    //
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(controller->PreWakeActive);
+
+    RmiSimPostFrame(host.Device, &empty);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(!RmiSimAttention(host.Device));
+    CHECK(!controller->PreWakeActive);
+
+    control.DeviceControl.All = ReadDeviceControl(&host);
+    CHECK(!control.DeviceControl.NoSleep);
+    CHECK(control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+    //
+    // A hover that leaves without landing is released the same way
+    //
+    RmiSimPostFrame(host.Device, &frames[1]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    control.DeviceControl.All = ReadDeviceControl(&host);
+    CHECK(control.DeviceControl.NoSleep);
+
+    RmiSimPostFrame(host.Device, &empty);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    control.DeviceControl.All = ReadDeviceControl(&host);
+    CHECK(!control.DeviceControl.NoSleep);
+    CHECK(control.DeviceControl.ReportRate == RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestCoverSuspend(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_FRAME cover;
+    RMI_SIM_FRAME empty;
+
+    RmiHostSetSetting(L"CoverSuspend", 1);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    Touch(frames, 2);
+    RtlZeroMemory(&empty, sizeof(empty));
+    RtlZeroMemory(&cover, sizeof(cover));
+    cover.Objects[2].Type = RMI_F12_OBJECT_COVER;
+
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 2);
+
+    //
+    // A cover lifts every contact and moves the controller to reduced
+    // reporting
+    //
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &cover);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 0) == 2);
+    CHECK(controller->CoverSuspended);
+    CHECK(controller->CoverSlot == 2);
+    CHECK(controller->ReportingMode == RMI_F12_REPORTING_MODE_REDUCED);
+
+    //
+    // While covered, only the objects up to the cover are read and
+    // touches underneath are not reported
+    //
+    frames[1] = cover;
+    frames[1].Objects[0] = frames[0].Objects[0];
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frames[1]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 0);
+    CHECK(controller->CoverSuspended);
+    CHECK(controller->Counters.CoverFrames == 1);
+    CHECK(controller->Counters.CoverBytesSaved ==
+        controller->PacketSize - 3 * F12_DATA1_BYTES_PER_OBJ);
+
+    //
+    // Taking the cover off resumes continuous reporting, and the next
+    // touch is reported
+    //
+    RmiSimPostFrame(host.Device, &empty);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(!controller->CoverSuspended);
+    CHECK(controller->ReportingMode == RMI_F12_REPORTING_MODE_CONTINUOUS);
+    CHECK(controller->Counters.CoverFrames == 2);
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 2);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+SetObject(
+    OUT RMI_SIM_OBJECT *Object,
+    IN BYTE Type,
+    IN USHORT X,
+    IN USHORT Y,
+    IN BYTE Width
+    )
+{
+    Object->Type = Type;
+    Object->X = X;
+    Object->Y = Y;
+    Object->Z = 50;
+    Object->wX = Width;
+    Object->wY = Width;
+}
+
+static
+VOID
+TestPalmRejection(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_FRAME frame;
+
+    RmiHostSetSetting(L"PalmRejection", 1);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    //
+    // A palm alone never produces a report
+    //
+    RtlZeroMemory(&frame, sizeof(frame));
+    SetObject(&frame.Objects[1], RMI_F12_OBJECT_PALM, 200, 300, 4);
+
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 0);
+    CHECK(controller->Counters.PalmFrames == 1);
+
+    //
+    // A finger next to the palm is dropped, one clear of it is kept. An
+    // F12 palm object is not a contact, only the finger is marked rejected.
+    //
+    SetObject(&frame.Objects[0], RMI_F12_OBJECT_FINGER, 1000, 1000, 4);
+    SetObject(&frame.Objects[2], RMI_F12_OBJECT_FINGER, 250, 350, 4);
+
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 1);
+    CHECK(host.Reports[0].ContactCount == 1);
+    CHECK(host.Reports[0].Contacts[0].X == 1000);
+    CHECK(controller->PalmRejectedSlots == 0x04);
+
+    //
+    // A finger wider than the threshold counts as a palm as well, and
+    // the finger it took out stays rejected after the palm leaves
+    //
+    frame.Objects[1].Type = RMI_F12_OBJECT_FINGER;
+    frame.Objects[1].wX = 12;
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.Reports[0].ContactCount == 1);
+
+    RtlZeroMemory(&frame.Objects[1], sizeof(frame.Objects[1]));
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.Reports[0].ContactCount == 1);
+    CHECK(host.Reports[0].Contacts[0].X == 1000);
+    CHECK(controller->PalmRejectedSlots == 0x04);
+    CHECK(controller->Counters.PalmContactsRejected == 4);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestEdgeRejection(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI_SIM_FRAME frame;
+
+    RmiHostSetSetting(L"TouchEdgeRejectLeft", 50);
+    RmiHostSetSetting(L"TouchEdgeRejectRight", 50);
+    RmiHostSetSetting(L"TouchEdgeSwipeDistance", 100);
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiHostClearSettings();
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    //
+    // Grip contacts landing in the left and right bands are held back
+    //
+    RtlZeroMemory(&frame, sizeof(frame));
+    SetObject(&frame.Objects[0], RMI_F12_OBJECT_FINGER, 20, 1000, 4);
+    SetObject(&frame.Objects[2], RMI_F12_OBJECT_FINGER, TOUCH_DEFAULT_RESOLUTION_X - 20, 1200, 4);
+
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 0);
+    CHECK(controller->EdgeHeldSlots == 0x05);
+
+    //
+    // A contact landing in the active area is reported, and stays
+    // reported when it moves into a band
+    //
+    SetObject(&frame.Objects[1], RMI_F12_OBJECT_FINGER, 700, 1000, 4);
+
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(host.ReportCount == 1);
+    CHECK(host.Reports[0].ContactCount == 1);
+
+    frame.Objects[1].X = 10;
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 1);
+    CHECK(controller->EdgeHeldSlots == 0x05);
+
+    //
+    // A held contact moving inward short of the swipe distance stays
+    // held, past it the swipe is promoted
+    //
+    frame.Objects[0].X = 100;
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 1);
+    CHECK(controller->Counters.EdgeSwipesPromoted == 0);
+
+    frame.Objects[0].X = 130;
+
+    host.ReportCount = 0;
+    RmiSimPostFrame(host.Device, &frame);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(CountContacts(&host, 1) == 2);
+    CHECK(controller->EdgeHeldSlots == 0x04);
+    CHECK(controller->Counters.EdgeSwipesPromoted == 1);
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestFaults(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_FRAME event;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    NTSTATUS status;
+    ULONG i;
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+    Touch(frames, 2);
+
+    //
+    // A reset is only recovered from once a touch frame was read
+    //
+    RtlZeroMemory(&event, sizeof(event));
+    event.Event = RMI_SIM_EVENT_RESET;
+    RmiSimPostFrame(host.Device, &event);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(controller->Faults.Recoveries[RMI4_FAULT_RESET] == 0);
+
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(controller->Faults.Recoveries[RMI4_FAULT_RESET] == 1);
+
+    //
+    // Short reads lose frames, and recovery follows a good one
+    //
+    host.Spb.FaultInjection.ShortReadRate = 3;
+
+    for (i = 0; i < 100; i++)
+    {
+        RmiSimPostFrame(host.Device, &frames[i % 2]);
+        status = RmiSimHostService(&host);
+        CHECK(status != STATUS_TIMEOUT);
+        host.ReportCount = 0;
+    }
+
+    CHECK(host.Spb.FaultInjection.Injected != 0);
+    CHECK(controller->Faults.Faults[RMI4_FAULT_BUS] != 0);
+    CHECK(controller->Faults.Recoveries[RMI4_FAULT_BUS] != 0);
+    CHECK(controller->Faults.Recoveries[RMI4_FAULT_BUS] <=
+        controller->Faults.Faults[RMI4_FAULT_BUS]);
+
+    //
+    // With the bus gone servicing gives up instead of spinning
+    //
+    host.Spb.FaultInjection.ShortReadRate = 0;
+    host.Spb.FaultInjection.NackRate = 1;
+
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(RmiSimHostService(&host) == STATUS_NO_SUCH_DEVICE);
+    CHECK(RmiSimAttention(host.Device));
+
+    host.Spb.FaultInjection.NackRate = 0;
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    CHECK(!RmiSimAttention(host.Device));
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestBusModel(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[2];
+    RMI_SIM_STATISTICS before;
+    RMI_SIM_STATISTICS after;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_BUS_COST cost;
+    RMI4_BUS_COST single;
+    BYTE dataBase;
+    int f01, f12;
+
+    RmiSimDefaultLayout(&layout, 10);
+    layout.ClockStretch = 3000;
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    //
+    // The current path is what the core reads for a frame
+    //
+    Touch(frames, 3);
+    RmiSimGetStatistics(host.Device, &before);
+    RmiSimPostFrame(host.Device, &frames[0]);
+    CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    RmiSimGetStatistics(host.Device, &after);
+
+    CHECK(NT_SUCCESS(RmiModelFrameBusCost(
+        controller, RMI4_BUS_PATH_CURRENT, 3, SPB_BUS_SPEED_FAST, 3000, &cost)));
+    CHECK(cost.Transactions ==
+        after.ReadTransactions + after.WriteTransactions -
+        before.ReadTransactions - before.WriteTransactions);
+    CHECK(cost.Bytes ==
+        after.BytesRead + after.BytesWritten - before.BytesRead - before.BytesWritten);
+    CHECK(cost.Time == after.ModeledTime - before.ModeledTime);
+    CHECK(cost.StretchTime == cost.Transactions * 3000);
+
+    //
+    // Bitmap limited reads grow with the contacts, and are cheaper than
+    // the full packet until most slots are in use
+    //
+    CHECK(NT_SUCCESS(RmiModelFrameBusCost(
+        controller, RMI4_BUS_PATH_BITMAP, 1, SPB_BUS_SPEED_FAST, 3000, &single)));
+    CHECK(single.Bytes == (1 + 2) + (1 + 2) + (1 + F12_DATA1_BYTES_PER_OBJ));
+    CHECK(single.Time < cost.Time);
+    CHECK(NT_SUCCESS(RmiModelFrameBusCost(
+        controller, RMI4_BUS_PATH_BITMAP, 10, SPB_BUS_SPEED_FAST, 3000, &single)));
+    CHECK(single.Time > cost.Time);
+
+    //
+    // F01 and F12 data registers are apart in this layout, a fused read
+    // is only modeled where F12 data follows F01 data
+    //
+    CHECK(RmiModelFrameBusCost(
+        controller, RMI4_BUS_PATH_FUSED, 3, SPB_BUS_SPEED_FAST, 3000, &cost) ==
+        STATUS_NOT_SUPPORTED);
+
+    f01 = RmiGetFunctionIndex(controller->Descriptors, controller->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+    f12 = RmiGetFunctionIndex(controller->Descriptors, controller->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+    dataBase = controller->Descriptors[f12].DataBase;
+    controller->Descriptors[f12].DataBase =
+        (BYTE) (controller->Descriptors[f01].DataBase + sizeof(RMI4_F01_DATA_REGISTERS));
+
+    CHECK(NT_SUCCESS(RmiModelFrameBusCost(
+        controller, RMI4_BUS_PATH_FUSED, 3, SPB_BUS_SPEED_FAST, 3000, &cost)));
+    CHECK(cost.Transactions == 2);
+    CHECK(cost.Bytes == 1 + 2 + controller->PacketSize);
+
+    controller->Descriptors[f12].DataBase = dataBase;
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestLatencyHistogram(
+    VOID
+    )
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    ULONG64 latency;
+    ULONG percentile;
+
+    controller = calloc(1, sizeof(*controller));
+    CHECK(controller != NULL);
+
+    if (controller == NULL)
+    {
+        return;
+    }
+
+    //
+    // Short passes are counted exactly
+    //
+    RmiNoteServiceLatency(controller, 5);
+    CHECK(RmiServiceLatencyPercentile(controller, 50) == 5);
+
+    //
+    // Longer ones within 1/8, enough to tell p50 from p99
+    //
+    RtlZeroMemory(&controller->Counters, sizeof(controller->Counters));
+
+    for (latency = 1; latency <= 1000; latency++)
+    {
+        RmiNoteServiceLatency(controller, latency);
+    }
+
+    for (percentile = 10; percentile <= 100; percentile += 10)
+    {
+        latency = RmiServiceLatencyPercentile(controller, percentile);
+        CHECK(latency >= percentile * 10);
+        CHECK(latency <= percentile * 10 + percentile * 10 / 8);
+    }
+
+    CHECK(RmiServiceLatencyPercentile(controller, 50) <
+        RmiServiceLatencyPercentile(controller, 99));
+
+    //
+    // Anything past the last bucket lands in it
+    //
+    RmiNoteServiceLatency(controller, ~0ULL);
+    CHECK(controller->Counters.ServiceLatency[RMI4_LATENCY_BUCKETS - 1] == 1);
+
+    free(controller);
+}
+
+#define TRACE_FRAMES                        16
+#define TRACE_CONTACTS                      6
+
+typedef struct _TRACE_REPORTS
+{
+    ULONG Count;
+    PTP_REPORT Reports[TRACE_FRAMES * 2];
+} TRACE_REPORTS;
+
+static
+VOID
+CollectReport(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    )
+{
+    TRACE_REPORTS* reports;
+
+    UNREFERENCED_PARAMETER(Timestamp);
+
+    reports = (TRACE_REPORTS*) Context;
+
+    if (reports->Count < RTL_NUMBER_OF(reports->Reports))
+    {
+        reports->Reports[reports->Count] = *Report;
+    }
+
+    reports->Count++;
+}
+
+static
+VOID
+CaptureSwipe(
+    OUT TRACE_REPORTS *Reports
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frames[TRACE_FRAMES];
+    ULONG i, j;
+
+    RtlZeroMemory(Reports, sizeof(*Reports));
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+    RmiSimSwipeScenario(TRACE_CONTACTS, TRACE_FRAMES, 80000, frames);
+
+    for (i = 0; i < TRACE_FRAMES; i++)
+    {
+        RmiSimAdvanceClock(host.Device, 80000);
+
+        host.ReportCount = 0;
+        RmiSimPostFrame(host.Device, &frames[i]);
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+
+        for (j = 0; j < host.ReportCount; j++)
+        {
+            CollectReport(Reports, 0, &host.Reports[j]);
+        }
+    }
+
+    //
+    // Stopping writes the capture out
+    //
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestTraceReplay(
+    VOID
+    )
+{
+    RMI_REPLAY_STATISTICS statistics;
+    static TRACE_REPORTS captured;
+    static TRACE_REPORTS replayed;
+    char path[64];
+    char oldPath[64];
+    ULONG i;
+
+    wcstombs(path, RMI_TRACE_FILE_PATH, sizeof(path));
+    wcstombs(oldPath, RMI_TRACE_OLD_FILE_PATH, sizeof(oldPath));
+    unlink(path);
+    unlink(oldPath);
+
+    RmiHostSetSetting(L"TouchTraceSize", 64);
+    CaptureSwipe(&captured);
+    RmiHostClearSettings();
+
+    //
+    // Replaying at full speed produces the reports the session did
+    //
+    RtlZeroMemory(&replayed, sizeof(replayed));
+    CHECK(NT_SUCCESS(RmiReplayTrace(
+        path,
+        RMI_REPLAY_MAX_SPEED,
+        CollectReport,
+        &replayed,
+        &statistics)));
+
+    CHECK(statistics.Segments == 1);
+    CHECK(statistics.SegmentsSkipped == 0);
+    CHECK(statistics.Packets == TRACE_FRAMES);
+    CHECK(statistics.StatusRecords >= TRACE_FRAMES);
+    CHECK(statistics.RecordsDropped == 0);
+    CHECK(statistics.RecordedTime >= (TRACE_FRAMES - 1) * 80000ULL);
+    CHECK(statistics.Reports == captured.Count);
+    CHECK(replayed.Count == captured.Count);
+
+    for (i = 0; i < replayed.Count && i < RTL_NUMBER_OF(replayed.Reports); i++)
+    {
+        CHECK(replayed.Reports[i].ContactCount == captured.Reports[i].ContactCount);
+        CHECK(memcmp(
+            replayed.Reports[i].Contacts,
+            captured.Reports[i].Contacts,
+            sizeof(replayed.Reports[i].Contacts)) == 0);
+    }
+
+    //
+    // At the recorded timing the replay takes as long as the session
+    //
+    CHECK(NT_SUCCESS(RmiReplayTrace(
+        path,
+        RMI_REPLAY_RECORDED_TIMING,
+        NULL,
+        NULL,
+        &statistics)));
+
+    CHECK(statistics.Reports == captured.Count);
+    CHECK(statistics.ReplayTime >= statistics.RecordedTime * 100);
+
+    //
+    // With a 1KB limit every session rotates the trace, the previous
+    // one is kept
+    //
+    RmiHostSetSetting(L"TouchTraceSize", 64);
+    RmiHostSetSetting(L"TouchTraceFileSize", 1);
+    CaptureSwipe(&captured);
+    CaptureSwipe(&captured);
+    RmiHostClearSettings();
+
+    CHECK(NT_SUCCESS(RmiReplayTrace(path, RMI_REPLAY_MAX_SPEED, NULL, NULL, &statistics)));
+    CHECK(statistics.Segments == 1);
+    CHECK(statistics.Packets == TRACE_FRAMES);
+
+    CHECK(NT_SUCCESS(RmiReplayTrace(oldPath, RMI_REPLAY_MAX_SPEED, NULL, NULL, &statistics)));
+    CHECK(statistics.Segments == 1);
+    CHECK(statistics.Packets == TRACE_FRAMES);
+
+    unlink(path);
+    unlink(oldPath);
+
+    CHECK(RmiReplayTrace(path, RMI_REPLAY_MAX_SPEED, NULL, NULL, &statistics) ==
+        STATUS_OBJECT_NAME_NOT_FOUND);
+}
+
+//
+// Finger A lands and holds, B lands next to it, A moves past the
+// deadband, A lifts and then B. Held contacts jitter by up to two
+// sensor units.
+//
+#define ELISION_FRAMES                      25
+#define ELISION_DEADBAND                    4
+#define ELISION_STATIONARY                  20
+
+typedef struct _ELISION_REPORTS
+{
+    ULONG Count;
+    ULONG64 Timestamp[ELISION_FRAMES * 2];
+    BYTE Tips[ELISION_FRAMES * 2];
+} ELISION_REPORTS;
+
+static
+VOID
+CollectTips(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    )
+{
+    ELISION_REPORTS* reports;
+    BYTE tips;
+    ULONG i;
+
+    reports = (ELISION_REPORTS*) Context;
+    tips = 0;
+
+    for (i = 0; i < Report->ContactCount && i < RTL_NUMBER_OF(Report->Contacts); i++)
+    {
+        if (Report->Contacts[i].TipSwitch)
+        {
+            tips |= (BYTE) (1 << Report->Contacts[i].ContactID);
+        }
+    }
+
+    if (reports->Count < RTL_NUMBER_OF(reports->Tips))
+    {
+        reports->Timestamp[reports->Count] = Timestamp;
+        reports->Tips[reports->Count] = tips;
+    }
+
+    reports->Count++;
+}
+
+static
+VOID
+CaptureHold(
+    VOID
+    )
+{
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI_SIM_FRAME frame;
+    RMI_SIM_OBJECT* object;
+    ULONG i;
+
+    RmiSimDefaultLayout(&layout, 10);
+    CHECK(NT_SUCCESS(RmiSimHostStart(&host, &layout)));
+
+    for (i = 0; i < ELISION_FRAMES; i++)
+    {
+        RtlZeroMemory(&frame, sizeof(frame));
+
+        if (i < 20)
+        {
+            object = &frame.Objects[0];
+            object->Type = RMI_F12_OBJECT_FINGER;
+            object->X = (USHORT) ((i < 15 ? 500 : 520) + (i * 7) % 3);
+            object->Y = (USHORT) (500 + (i * 5) % 3);
+            object->Z = 50;
+            object->wX = 4;
+            object->wY = 4;
+        }
+
+        if (i >= 8 && i < 24)
+        {
+            object = &frame.Objects[1];
+            object->Type = RMI_F12_OBJECT_FINGER;
+            object->X = (USHORT) (900 + (i * 5) % 3);
+            object->Y = (USHORT) (700 + (i * 7) % 3);
+            object->Z = 50;
+            object->wX = 4;
+            object->wY = 4;
+        }
+
+        RmiSimAdvanceClock(host.Device, 80000);
+        RmiSimPostFrame(host.Device, &frame);
+        CHECK(NT_SUCCESS(RmiSimHostService(&host)));
+    }
+
+    RmiSimHostStop(&host);
+}
+
+static
+VOID
+TestStationaryElision(
+    VOID
+    )
+{
+    RMI_REPLAY_STATISTICS statistics;
+    static ELISION_REPORTS baseline;
+    static ELISION_REPORTS elided;
+    char path[64];
+    ULONG i, j;
+
+    wcstombs(path, RMI_TRACE_FILE_PATH, sizeof(path));
+    unlink(path);
+
+    RmiHostSetSetting(L"TouchTraceSize", 64);
+    CaptureHold();
+    RmiHostClearSettings();
+
+    //
+    // Replayed as captured every frame is reported
+    //
+    RtlZeroMemory(&baseline, sizeof(baseline));
+    CHECK(NT_SUCCESS(RmiReplayTrace(
+        path,
+        RMI_REPLAY_MAX_SPEED,
+        CollectTips,
+        &baseline,
+        &statistics)));
+
+    CHECK(statistics.Packets == ELISION_FRAMES);
+    CHECK(statistics.ElidedFrames == 0);
+    CHECK(baseline.Count == ELISION_FRAMES);
+
+    //
+    // With the deadband and elision every frame in which the contacts
+    // only jittered is elided, and counted
+    //
+    RmiHostSetSetting(L"Deadband", ELISION_DEADBAND);
+    RmiHostSetSetting(L"ElideStationaryFrames", 1);
+
+    RtlZeroMemory(&elided, sizeof(elided));
+    CHECK(NT_SUCCESS(RmiReplayTrace(
+        path,
+        RMI_REPLAY_MAX_SPEED,
+        CollectTips,
+        &elided,
+        &statistics)));
+
+    RmiHostClearSettings();
+
+    CHECK(statistics.ElidedFrames == ELISION_STATIONARY);
+    CHECK(elided.Count + statistics.ElidedFrames == baseline.Count);
+
+    //
+    // Every tip switch transition goes out in the frame it was scanned
+    // in, with the same contacts down
+    //
+    for (i = 0; i < baseline.Count && i < RTL_NUMBER_OF(baseline.Tips); i++)
+    {
+        if (i != 0 && baseline.Tips[i] == baseline.Tips[i - 1])
+        {
+            continue;
+        }
+
+        for (j = 0; j < elided.Count && j < RTL_NUMBER_OF(elided.Tips); j++)
+        {
+            if (elided.Timestamp[j] == baseline.Timestamp[i])
+            {
+                break;
+            }
+        }
+
+        CHECK(j < elided.Count);
+        CHECK(j < elided.Count && elided.Tips[j] == baseline.Tips[i]);
+    }
+
+    unlink(path);
+}
+
+static
+VOID
+TestScript(
+    VOID
+    )
+{
+    static const char script[] =
+        "# two fingers land, one lifts, the controller resets\n"
+        "0 touch 0:100,200 3:400,500,2,60,5,6\n"
+        "\n"
+        "8.5 touch 3:410,510\n"
+        "17 reset\n"
+        "25 unconfigure\n"
+        "33 touch\n";
+    char path[] = "/tmp/rmisimtestXXXXXX";
+    RMI_SIM_FRAME* frames;
+    ULONG count;
+    FILE* file;
+    int fd;
+
+    fd = mkstemp(path);
+    CHECK(fd >= 0);
+    file = fdopen(fd, "w");
+    fputs(script, file);
+    fclose(file);
+
+    CHECK(NT_SUCCESS(RmiSimLoadScript(path, &frames, &count)));
+    CHECK(count == 5);
+
+    if (count == 5)
+    {
+        CHECK(frames[0].Objects[0].Type == RMI_F12_OBJECT_FINGER);
+        CHECK(frames[0].Objects[0].X == 100 && frames[0].Objects[0].Y == 200);
+        CHECK(frames[0].Objects[3].Type == RMI_F12_OBJECT_STYLUS);
+        CHECK(frames[0].Objects[3].Z == 60);
+        CHECK(frames[0].Objects[3].wX == 5 && frames[0].Objects[3].wY == 6);
+        CHECK(frames[1].Time == 85000);
+        CHECK(frames[1].Objects[0].Type == RMI_F12_OBJECT_NONE);
+        CHECK(frames[2].Event == RMI_SIM_EVENT_RESET);
+        CHECK(frames[3].Event == RMI_SIM_EVENT_UNCONFIGURED);
+        CHECK(frames[4].Event == RMI_SIM_EVENT_TOUCH);
+    }
+
+    free(frames);
+
+    file = fopen(path, "w");
+    fputs("0 tap 0:1,2\n", file);
+    fclose(file);
+
+    CHECK(RmiSimLoadScript(path, &frames, &count) == STATUS_INVALID_PARAMETER);
+
+    unlink(path);
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    UNREFERENCED_PARAMETER(argc);
+    UNREFERENCED_PARAMETER(argv);
+
+    TestDiscovery();
+    TestInterruptAssignment();
+    TestTouch();
+    TestReset();
+    TestHeldFrame();
+    TestPacingFlush();
+    TestLiftWatchdog();
+    TestSurfaceSwitch();
+    TestDeviceControl();
+    TestHoverPreWake();
+    TestHoverPreWakeRelease();
+    TestCoverSuspend();
+    TestPalmRejection();
+    TestEdgeRejection();
+    TestFaults();
+    TestBusModel();
+    TestLatencyHistogram();
+    TestTraceReplay();
+    TestStationaryElision();
+    TestScript();
+
+    if (gFailures != 0)
+    {
+        fprintf(stderr, "%d checks failed\n", gFailures);
+        return 1;
+    }
+
+    return 0;
+}
@@ -0,0 +1,65 @@
+//
+// Firmware profile of the simulated controller's default layout with ten
+// fingers (RmiSimDefaultLayout), as traced by RmiTraceFirmwareProfile
+//
+{ "SIM-S3320", 5, {
+        { 0x00, 0x03, 0x01, 0x02, { 0x01 }, 0x34 },
+        { 0x04, 0x2b, 0x24, 0x29, { 0x01 }, 0x01 },
+        { 0x2c, 0x3e, 0x37, 0x3c, { 0x02 }, 0x12 },
+        { 0x3f, 0x42, 0x40, 0x41, { 0x01 }, 0x1a },
+        { 0x00, 0x03, 0x01, 0x02, { 0x01 }, 0x54 },
+    }, {
+        0,
+        0,
+        0,
+        0,
+        1,
+    }, TRUE,
+    5, {
+        { 8, 14, 1 },
+        { 9, 3, 1 },
+        { 20, 3, 1 },
+        { 23, 5, 1 },
+        { 28, 1, 1 },
+    },
+    2, {
+        { 1, 80, 10 },
+        { 15, 2, 1 },
+    },
+    82, 0, 10,
+    {
+        5, {
+            0x0a,
+            0x00,
+            0x03,
+            0x90,
+            0x10,
+        },
+        10, {
+            0x0e,
+            0x01,
+            0x03,
+            0x01,
+            0x03,
+            0x01,
+            0x05,
+            0x01,
+            0x01,
+            0x01,
+        },
+    },
+    {
+        3, {
+            0x05,
+            0x02,
+            0x80,
+        },
+        5, {
+            0x50,
+            0xff,
+            0x07,
+            0x02,
+            0x01,
+        },
+    },
+},
@@ -0,0 +1,200 @@
+/*++
+    Module Name:
+
+        rmibusmodel.c
+
+    Abstract:
+
+        Reports the modeled I2C bus latency of one touch frame, per read
+        path and contact count, at standard, fast and fast plus mode
+        clocks, for the simulated controller's default layout:
+
+            rmibusmodel [max fingers [clock stretch ns per transaction]]
+
+        The layout is discovered by the RMI4 core as it would be on the
+        device, and the model comes from RmiModelFrameBusCost. Every
+        frame is also played through the simulator, and the bus time the
+        driver's reads took there is reported next to the current path,
+        so the model is checked against the traffic the core generates.
+
+        Output is comma separated, one line per clock, contact count and
+        path the register map allows:
+
+            hz,contacts,path,transactions,bytes,ns,stretch_ns,simulated_ns
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmiinternal.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <stdlib.h>
+
+static
+NTSTATUS
+RmiSimulateFrame(
+    IN RMI_SIM_HOST *Host,
+    IN ULONG Contacts,
+    OUT ULONG64 *ModeledTime
+    )
+{
+    RMI_SIM_STATISTICS before;
+    RMI_SIM_STATISTICS after;
+    RMI_SIM_FRAME frames[2];
+    NTSTATUS status;
+
+    RmiSimSwipeScenario(Contacts, 2, 0, frames);
+
+    RmiSimGetStatistics(Host->Device, &before);
+
+    Host->ReportCount = 0;
+    RmiSimPostFrame(Host->Device, Contacts != 0 ? &frames[0] : &frames[1]);
+    status = RmiSimHostService(Host);
+
+    RmiSimGetStatistics(Host->Device, &after);
+
+    *ModeledTime = after.ModeledTime - before.ModeledTime;
+
+    return status;
+}
+
+static
+NTSTATUS
+RmiReportBusSpeed(
+    IN BYTE MaxFingers,
+    IN ULONG BusSpeed,
+    IN ULONG StretchTime
+    )
+{
+    static const char* paths[RMI4_BUS_PATH_COUNT] =
+    {
+        "current",
+        "fused",
+        "bitmap"
+    };
+    RMI_SIM_LAYOUT layout;
+    RMI_SIM_HOST host;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_BUS_COST cost;
+    ULONG64 simulated;
+    NTSTATUS status;
+    ULONG contacts;
+    int path;
+
+    RmiSimDefaultLayout(&layout, MaxFingers);
+    layout.BusSpeed = BusSpeed;
+    layout.ClockStretch = StretchTime;
+
+    status = RmiSimHostStart(&host, &layout);
+
+    if (!NT_SUCCESS(status))
+    {
+        return status;
+    }
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) host.Controller;
+
+    for (contacts = 0; contacts <= controller->MaxFingers; contacts++)
+    {
+        status = RmiSimulateFrame(&host, contacts, &simulated);
+
+        if (!NT_SUCCESS(status))
+        {
+            break;
+        }
+
+        for (path = 0; path < RMI4_BUS_PATH_COUNT; path++)
+        {
+            if (!NT_SUCCESS(RmiModelFrameBusCost(
+                    controller,
+                    path,
+                    contacts,
+                    BusSpeed,
+                    StretchTime,
+                    &cost)))
+            {
+                continue;
+            }
+
+            printf("%u,%u,%s,%u,%u,%llu,%llu",
+                BusSpeed,
+                contacts,
+                paths[path],
+                cost.Transactions,
+                cost.Bytes,
+                (unsigned long long) cost.Time,
+                (unsigned long long) cost.StretchTime);
+
+            if (path == RMI4_BUS_PATH_CURRENT)
+            {
+                printf(",%llu\n", (unsigned long long) simulated);
+            }
+            else
+            {
+                printf(",\n");
+            }
+        }
+    }
+
+    RmiSimHostStop(&host);
+
+    return status;
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    static const ULONG busSpeeds[] =
+    {
+        SPB_BUS_SPEED_STANDARD,
+        SPB_BUS_SPEED_FAST,
+        SPB_BUS_SPEED_FAST_PLUS
+    };
+    ULONG maxFingers;
+    ULONG stretchTime;
+    ULONG i;
+
+    maxFingers = 10;
+    stretchTime = 0;
+
+    if (argc > 1)
+    {
+        maxFingers = strtoul(argv[1], NULL, 0);
+    }
+
+    if (argc > 2)
+    {
+        stretchTime = strtoul(argv[2], NULL, 0);
+    }
+
+    if (maxFingers == 0 || maxFingers > RMI4_MAX_TOUCHES)
+    {
+        fprintf(stderr, "usage: %s [max fingers (1-%u) [clock stretch ns]]\n",
+            argv[0], RMI4_MAX_TOUCHES);
+        return 2;
+    }
+
+    printf("hz,contacts,path,transactions,bytes,ns,stretch_ns,simulated_ns\n");
+
+    for (i = 0; i < RTL_NUMBER_OF(busSpeeds); i++)
+    {
+        if (!NT_SUCCESS(RmiReportBusSpeed((BYTE) maxFingers, busSpeeds[i], stretchTime)))
+        {
+            fprintf(stderr, "%s: simulation failed at %uHz\n", argv[0], busSpeeds[i]);
+            return 1;
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,117 @@
+/*++
+    Module Name:
+
+        rmireplay.c
+
+    Abstract:
+
+        Replays a touch trace captured with TouchTraceSize through the
+        report pipeline, see RmiReplayTrace:
+
+            rmireplay trace [max|recorded]
+
+        max replays the records back to back, recorded at the intervals
+        they were captured at. Settings are the driver defaults.
+
+        Output is comma separated, one line per contact of every report
+        the driver produced, then the replay totals:
+
+            contact,<time>,<scan time>,<id>,<tip>,<x>,<y>
+            replay,<segments>,<skipped>,<packets>,<reports>,<dropped>,<recorded ms>,<replay ms>,<packets/s>
+
+    Environment:
+
+        User mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <controller.h>
+#include <rmisim.h>
+
+#include <stdio.h>
+#include <string.h>
+
+static
+VOID
+RmiReplayPrintReport(
+    IN PVOID Context,
+    IN ULONG64 Timestamp,
+    IN const PTP_REPORT *Report
+    )
+{
+    const PTP_CONTACT* contact;
+    ULONG i;
+
+    UNREFERENCED_PARAMETER(Context);
+
+    for (i = 0; i < RTL_NUMBER_OF(Report->Contacts); i++)
+    {
+        contact = &Report->Contacts[i];
+
+        if (!contact->TipSwitch && contact->X == 0 && contact->Y == 0)
+        {
+            continue;
+        }
+
+        printf("contact,%llu,%u,%u,%u,%u,%u\n",
+            (unsigned long long) Timestamp,
+            Report->ScanTime,
+            contact->ContactID,
+            contact->TipSwitch,
+            contact->X,
+            contact->Y);
+    }
+}
+
+int
+main(
+    int argc,
+    char **argv
+    )
+{
+    RMI_REPLAY_STATISTICS statistics;
+    NTSTATUS status;
+    ULONG timing;
+
+    timing = RMI_REPLAY_MAX_SPEED;
+
+    if (argc > 2 && strcmp(argv[2], "recorded") == 0)
+    {
+        timing = RMI_REPLAY_RECORDED_TIMING;
+    }
+    else if (argc < 2 || argc > 3 || (argc == 3 && strcmp(argv[2], "max") != 0))
+    {
+        fprintf(stderr, "usage: %s trace [max|recorded]\n", argv[0]);
+        return 2;
+    }
+
+    status = RmiReplayTrace(
+        argv[1],
+        timing,
+        RmiReplayPrintReport,
+        NULL,
+        &statistics);
+
+    printf("replay,%u,%u,%llu,%llu,%llu,%llu,%llu,%.0f\n",
+        statistics.Segments,
+        statistics.SegmentsSkipped,
+        (unsigned long long) statistics.Packets,
+        (unsigned long long) statistics.Reports,
+        (unsigned long long) statistics.RecordsDropped,
+        (unsigned long long) statistics.RecordedTime / 10000,
+        (unsigned long long) statistics.ReplayTime / 1000000,
+        statistics.ReplayTime == 0 ? 0.0 :
+            (double) statistics.Packets * 1000000000.0 / (double) statistics.ReplayTime);
+
+    if (!NT_SUCCESS(status))
+    {
+        fprintf(stderr, "%s: could not replay %s - 0x%08x\n",
+            argv[0], argv[1], (unsigned int) status);
+        return 1;
+    }
+
+    return 0;
+}
@@ -3,5 +3,128 @@
 #ifndef __COMPAT_H__
 #define __COMPAT_H__
 
+//
+// Platform services used by the RMI4 core (init.c, report.c, power.c,
+// registry.c, resolutions.c, rmiprofile.c, rmisynth.c, rmitrace.c and
+// the bit helpers). The core reaches the OS only through these names:
+//
+//  Lock      - RMI_LOCK, a passive-level wait lock
+//  Allocator - nonpaged, tagged allocations
+//  Clock     - monotonic interrupt time in 100ns units
+//  Random    - RmiRandom, a seeded pseudo random sequence
+//  Bus       - register reads and writes through the SPB context
+//  Config    - RmiQueryDeviceSettings reads a registry query table from
+//              the device's Settings key, RmiQuerySettings from an
+//              absolute key
+//  File      - append-only output files for captures, rotated by
+//              renaming
+//
+// KMDF is the backend implemented here and in compat.c. Building with
+// RMI_HOST defined selects the user-mode backend in host/, which runs the
+// core against a simulated controller.
+//
 
-#endif
\ No newline at end of file
+#if defined(RMI_HOST)
+
+#include <rmihost.h>
+
+#else
+
+#include <wdm.h>
+#include <wdf.h>
+#include <hidport.h>
+#define RESHUB_USE_HELPER_ROUTINES
+#include <reshub.h>
+
+typedef WDFWAITLOCK RMI_LOCK;
+
+#define RmiLockCreate(Lock) \
+    WdfWaitLockCreate(WDF_NO_OBJECT_ATTRIBUTES, (Lock))
+#define RmiLockDelete(Lock)             WdfObjectDelete(Lock)
+#define RmiLockAcquire(Lock)            WdfWaitLockAcquire((Lock), NULL)
+#define RmiLockRelease(Lock)            WdfWaitLockRelease(Lock)
+
+#define RmiAllocate(Size, Tag) \
+    ExAllocatePoolWithTag(NonPagedPoolNx, (Size), (Tag))
+#define RmiFree(Buffer, Tag)            ExFreePoolWithTag((Buffer), (Tag))
+
+#define RmiQueryTime()                  KeQueryInterruptTime()
+
+__forceinline
+ULONG64
+RmiQueryTimePrecise(
+    VOID
+    )
+{
+    ULONG64 qpcTimeStamp;
+
+    return KeQueryInterruptTimePrecise(&qpcTimeStamp);
+}
+
+#define RmiRandom(Seed)                 RtlRandomEx(Seed)
+
+NTSTATUS
+RmiQueryDeviceSettings(
+    IN WDFDEVICE FxDevice,
+    IN PRTL_QUERY_REGISTRY_TABLE Table
+    );
+
+#define RmiQuerySettings(Path, Table) \
+    RtlQueryRegistryValues(RTL_REGISTRY_ABSOLUTE, (Path), (Table), NULL, NULL)
+
+typedef HANDLE RMI_FILE;
+
+#define RMI_TRACE_FILE_PATH     L"\\SystemRoot\\Temp\\SynapticsTouch.rmitrace"
+#define RMI_TRACE_OLD_FILE_PATH L"\\SystemRoot\\Temp\\SynapticsTouch.rmitrace.old"
+
+NTSTATUS
+RmiFileOpenAppend(
+    IN PCWSTR Path,
+    OUT RMI_FILE *File
+    );
+
+NTSTATUS
+RmiFileWrite(
+    IN RMI_FILE File,
+    IN PVOID Data,
+    IN ULONG Length
+    );
+
+NTSTATUS
+RmiFileQuerySize(
+    IN RMI_FILE File,
+    OUT ULONG64 *Size
+    );
+
+VOID
+RmiFileClose(
+    IN RMI_FILE File
+    );
+
+NTSTATUS
+RmiFileRename(
+    IN PCWSTR Path,
+    IN PCWSTR NewPath
+    );
+
+#endif
+
+//
+// Both backends implement the SPB transport entry points of spb.h.
+// Checked builds put the fault injection wrapper in spbfault.c in front
+// of them.
+//
+
+#if DBG
+#define RmiBusRead(Bus, Address, Data, Length) \
+    SpbFaultReadData((Bus), (Address), (Data), (Length))
+#define RmiBusWrite(Bus, Address, Data, Length) \
+    SpbFaultWriteData((Bus), (Address), (Data), (Length))
+#else
+#define RmiBusRead(Bus, Address, Data, Length) \
+    SpbReadDataSynchronously((Bus), (Address), (Data), (Length))
+#define RmiBusWrite(Bus, Address, Data, Length) \
+    SpbWriteDataSynchronously((Bus), (Address), (Data), (Length))
+#endif
+
+#endif
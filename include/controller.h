@@ -3,11 +3,7 @@
 
 #pragma once
 
-#include <wdm.h>
-#include <wdf.h>
-#include <hidport.h>
-#define RESHUB_USE_HELPER_ROUTINES
-#include <reshub.h>
+#include "compat.h"
 #include "trace.h"
 #include "spb.h"
 
@@ -95,12 +91,75 @@ TchRegistryGetControllerSettings(
     IN WDFDEVICE FxDevice
     );
    
+//
+// Most reports a single frame can take, 32 contacts at 5 per report
+//
+#define TCH_MAX_REPORTS_PER_FRAME   7
+
+//
+// Supplies the buffer for the next report built by TchServiceInterrupts
+// or TchServiceLiftWatchdog, or NULL if no reader is waiting. Only called
+// once a report is ready to be filled.
+//
+typedef PPTP_REPORT (*PTCH_NEXT_REPORT_BUFFER)(
+    IN VOID *BufferContext,
+    IN ULONG ReportIndex
+    );
+
 NTSTATUS
 TchServiceInterrupts(
     IN VOID *ControllerContext,
     IN SPB_CONTEXT *SpbContext,
-    IN PPTP_REPORT HidReport,
+    IN BOOLEAN ReaderWaiting,
+    IN PTCH_NEXT_REPORT_BUFFER NextReportBuffer,
+    IN VOID *BufferContext,
+    IN ULONG MaxReports,
     IN UCHAR InputMode,
+    OUT ULONG *ReportsFilled,
     OUT BOOLEAN *ServicingComplete
     );
 
+NTSTATUS
+TchServiceLiftWatchdog(
+    IN VOID *ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN PTCH_NEXT_REPORT_BUFFER NextReportBuffer,
+    IN VOID *BufferContext,
+    OUT BOOLEAN *ServicingComplete
+    );
+
+ULONG
+TchGetLiftWatchdogDue(
+    IN VOID *ControllerContext
+    );
+
+BOOLEAN
+TchHasHeldFrame(
+    IN VOID *ControllerContext
+    );
+
+VOID
+TchDropHeldFrame(
+    IN VOID *ControllerContext
+    );
+
+#if DBG
+ULONG
+TchGetSyntheticFramePeriod(
+    IN VOID *ControllerContext
+    );
+
+VOID
+TchQueueSyntheticFrame(
+    IN VOID *ControllerContext
+    );
+#endif
+
+NTSTATUS
+TchSetReportingSwitches(
+    IN VOID *ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN SurfaceReport,
+    IN BOOLEAN ButtonReport
+    );
+
@@ -27,6 +27,17 @@ EVT_WDF_DEVICE_D0_EXIT OnD0Exit;
 
 EVT_WDF_INTERRUPT_ISR OnInterruptIsr;
 
+EVT_WDF_TIMER OnLiftWatchdogTimer;
+
+VOID
+TchArmLiftWatchdog(
+    IN PDEVICE_EXTENSION DevContext
+    );
+
+#if DBG
+EVT_WDF_TIMER OnSyntheticFrameTimer;
+#endif
+
 EVT_WDF_DEVICE_PREPARE_HARDWARE OnPrepareHardware;
 
 EVT_WDF_DEVICE_RELEASE_HARDWARE OnReleaseHardware;
\ No newline at end of file
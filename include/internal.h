@@ -28,6 +28,11 @@ typedef struct _DEVICE_EXTENSION
     //
     WDFINTERRUPT InterruptObject;
     BOOLEAN ServiceInterruptsAfterD0Entry;
+    WDFTIMER LiftWatchdogTimer;
+#if DBG
+    WDFTIMER SyntheticTimer;
+    BOOLEAN SyntheticActive;
+#endif
     
     //
     // Spb (I2C) related members used for the lifetime of the device
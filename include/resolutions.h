@@ -38,6 +38,11 @@ typedef struct _TOUCH_SCREEN_PROPERTIES
     ULONG TouchPillarBoxWidthRight;
     ULONG TouchLetterBoxHeightTop;
     ULONG TouchLetterBoxHeightBottom;
+    ULONG TouchEdgeRejectLeft;
+    ULONG TouchEdgeRejectRight;
+    ULONG TouchEdgeRejectTop;
+    ULONG TouchEdgeRejectBottom;
+    ULONG TouchEdgeSwipeDistance;
     ULONG TouchAdjustedWidth;
     ULONG TouchAdjustedHeight;
     ULONG DisplayPhysicalWidth;
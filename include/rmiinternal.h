@@ -21,8 +21,7 @@
 
 #pragma once
 
-#include <wdm.h>
-#include <wdf.h>
+#include "compat.h"
 #include "controller.h"
 #include "resolutions.h"
 #include "bitops.h"
@@ -155,6 +154,9 @@ typedef struct _RMI4_F01_CTRL_REGISTERS
 #define RMI4_F01_DEVICE_CONTROL_SLEEP_MODE_OPERATING  0
 #define RMI4_F01_DEVICE_CONTROL_SLEEP_MODE_SLEEPING   1
 
+#define RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD  0
+#define RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH      1
+
 //
 // Logical structure for getting registry config settings
 //
@@ -188,8 +190,12 @@ typedef struct _RMI4_F01_DATA_REGISTERS
     BYTE InterruptStatus[1];
 } RMI4_F01_DATA_REGISTERS;
 
-#define RMI4_INTERRUPT_BIT_2D_TOUCH               0x04
-#define RMI4_INTERRUPT_BIT_0D_CAP_BUTTON          0x20
+//
+// Interrupt status bits the driver reads from F01, and so the most it
+// can hand out to functions
+//
+#define RMI4_F01_INTERRUPT_BITS \
+    ((int) (8 * RTL_FIELD_SIZE(RMI4_F01_DATA_REGISTERS, InterruptStatus)))
 
 #define RMI4_F01_DATA_STATUS_NO_ERROR             0
 #define RMI4_F01_DATA_STATUS_RESET_OCCURRED       1
@@ -282,10 +288,23 @@ typedef struct _RMI4_F11_DATA_REGISTERS_STATUS_BLOCK
     };
 } RMI4_F11_DATA_REGISTERS_STATUS_BLOCK;
 
+//
+// Per-object F12 classification and size, kept alongside the position
+//
+typedef struct _RMI4_F12_OBJECT_DATA
+{
+    BYTE Type;
+    BYTE Z;
+    BYTE wX;
+    BYTE wY;
+} RMI4_F12_OBJECT_DATA;
+
 typedef struct _RMI4_F11_DATA_REGISTERS
 {
-    RMI4_F11_DATA_REGISTERS_STATUS_BLOCK Status;
+    BYTE FingerState[RMI4_MAX_TOUCHES];
     RMI4_F11_DATA_POSITION Finger[RMI4_MAX_TOUCHES];
+    RMI4_F12_OBJECT_DATA Object[RMI4_MAX_TOUCHES];
+    int HoverCount;
 } RMI4_F11_DATA_REGISTERS;
 
 #define RMI4_FINGER_STATE_NOT_PRESENT                  0
@@ -303,6 +322,7 @@ typedef enum _RMI4_F12_OBJECT_TYPE {
 	RMI_F12_OBJECT_STYLUS = 0x02,
 	RMI_F12_OBJECT_PALM = 0x03,
 	RMI_F12_OBJECT_UNCLASSIFIED = 0x04,
+	RMI_F12_OBJECT_HOVERING_FINGER = 0x05,
 	RMI_F12_OBJECT_GLOVED_FINGER = 0x06,
 	RMI_F12_OBJECT_NARROW_OBJECT = 0x07,
 	RMI_F12_OBJECT_HAND_EDGE = 0x08,
@@ -313,6 +333,17 @@ typedef enum _RMI4_F12_OBJECT_TYPE {
 } RMI4_F12_OBJECT_TYPE;
 
 #define F12_DATA1_BYTES_PER_OBJ			8
+
+//
+// Synthetic workload motion models, checked builds only
+//
+#define RMI4_SYNTHETIC_OFF                0
+#define RMI4_SYNTHETIC_TAP                1
+#define RMI4_SYNTHETIC_FLING              2
+#define RMI4_SYNTHETIC_PINCH              3
+#define RMI4_SYNTHETIC_DRUM               4     // Ten-finger drum roll
+#define RMI4_SYNTHETIC_PALM               5     // Stationary palms
+#define RMI4_SYNTHETIC_EDGE               6     // Edge grip
 #define RMI_REG_DESC_PRESENSE_BITS	(32 * BITS_PER_BYTE)
 #define RMI_REG_DESC_SUBPACKET_BITS	(37 * BITS_PER_BYTE)
 
@@ -327,7 +358,7 @@ typedef struct _RMI_REGISTER_DESC_ITEM {
 	USHORT Register;
 	ULONG RegisterSize;
 	BYTE NumSubPackets;
-	ULONG SubPacketMap[BITS_TO_LONGS(RMI_REG_DESC_SUBPACKET_BITS)];
+	unsigned long SubPacketMap[BITS_TO_LONGS(RMI_REG_DESC_SUBPACKET_BITS)];
 } RMI_REGISTER_DESC_ITEM, *PRMI_REGISTER_DESC_ITEM;
 
 /*
@@ -336,7 +367,7 @@ typedef struct _RMI_REGISTER_DESC_ITEM {
 */
 typedef struct _RMI_REGISTER_DESCRIPTOR {
 	ULONG StructSize;
-	ULONG PresenceMap[BITS_TO_LONGS(RMI_REG_DESC_PRESENSE_BITS)];
+	unsigned long PresenceMap[BITS_TO_LONGS(RMI_REG_DESC_PRESENSE_BITS)];
 	UINT8 NumRegisters;
 	RMI_REGISTER_DESC_ITEM *Registers;
 } RMI_REGISTER_DESCRIPTOR, *PRMI_REGISTER_DESCRIPTOR;
@@ -445,11 +476,102 @@ typedef struct _RMI4_F1A_DATA_REGISTERS
 // Driver structures
 //
 
+//
+// Logical structure for getting dynamic report rate settings. Velocities
+// are in sensor units per frame.
+//
+typedef struct _RMI4_REPORT_RATE_SETTINGS_LOGICAL
+{
+    UINT32 BurstEnable;
+    UINT32 BurstEnterVelocity;
+    UINT32 BurstExitVelocity;
+    UINT32 BurstExitFrames;
+} RMI4_REPORT_RATE_SETTINGS_LOGICAL;
+
+//
+// Logical structure for getting hover pre-wake settings. The pre-wake
+// state is released by the first frame with neither hover nor contacts,
+// since a controller with nothing on it stops reporting frames.
+//
+typedef struct _RMI4_PREWAKE_SETTINGS_LOGICAL
+{
+    UINT32 HoverPreWake;
+} RMI4_PREWAKE_SETTINGS_LOGICAL;
+
+//
+// Logical structure for getting palm rejection settings. A contact wider
+// than PalmWidthThreshold (in F12 width units) is treated as a palm, and
+// contacts within PalmRejectRadius sensor units of a palm are suppressed.
+//
+typedef struct _RMI4_PALM_SETTINGS_LOGICAL
+{
+    UINT32 PalmRejection;
+    UINT32 PalmWidthThreshold;
+    UINT32 PalmRejectRadius;
+} RMI4_PALM_SETTINGS_LOGICAL;
+
+//
+// Logical structure for getting jitter suppression settings. Deadband is
+// in sensor units. With ElideStationaryFrames set, frames in which no
+// contact landed, lifted or left its deadband produce no report.
+//
+typedef struct _RMI4_JITTER_SETTINGS_LOGICAL
+{
+    UINT32 Deadband;
+    UINT32 ElideStationaryFrames;
+} RMI4_JITTER_SETTINGS_LOGICAL;
+
+//
+// Logical structure for getting 1-euro filter settings. Cutoffs are in
+// mHz, Beta is in mHz of added cutoff per sensor unit/s of speed.
+//
+typedef struct _RMI4_FILTER_SETTINGS_LOGICAL
+{
+    UINT32 OneEuroFilter;
+    UINT32 MinCutoff;
+    UINT32 Beta;
+    UINT32 DerivativeCutoff;
+} RMI4_FILTER_SETTINGS_LOGICAL;
+
+//
+// Logical structure for getting motion prediction settings. The horizon
+// is in milliseconds (0 disables prediction), the maximum distance a
+// contact is moved ahead is in sensor units.
+//
+typedef struct _RMI4_PREDICTION_SETTINGS_LOGICAL
+{
+    UINT32 PredictionHorizon;
+    UINT32 PredictionMaxDistance;
+} RMI4_PREDICTION_SETTINGS_LOGICAL;
+
 typedef struct _RMI4_CONFIGURATION
 {
     RMI4_F01_CTRL_REGISTERS_LOGICAL DeviceSettings;
     RMI4_F11_CTRL_REGISTERS_LOGICAL TouchSettings;
     UINT32 PepRemovesVoltageInD3;
+    RMI4_REPORT_RATE_SETTINGS_LOGICAL ReportRateSettings;
+    RMI4_PREWAKE_SETTINGS_LOGICAL PreWakeSettings;
+    UINT32 CoverSuspend;
+    RMI4_PALM_SETTINGS_LOGICAL PalmSettings;
+    RMI4_JITTER_SETTINGS_LOGICAL JitterSettings;
+    RMI4_FILTER_SETTINGS_LOGICAL FilterSettings;
+    RMI4_PREDICTION_SETTINGS_LOGICAL PredictionSettings;
+    UINT32 LiftTimeout;
+    UINT32 PacingRate;
+    UINT32 TouchTraceSize;
+    UINT32 TouchTraceFileSize;
+    UINT32 HotPathProfile;
+    UINT32 BusStretchTime;
+#if DBG
+    UINT32 FaultNackRate;
+    UINT32 FaultShortReadRate;
+    UINT32 FaultResetRate;
+    UINT32 FaultUnconfiguredRate;
+    UINT32 SyntheticWorkload;
+    UINT32 SyntheticContacts;
+    UINT32 SyntheticRate;
+    UINT32 SyntheticObjectMix;
+#endif
 } RMI4_CONFIGURATION;
 
 typedef struct _RMI4_FINGER_INFO
@@ -459,20 +581,182 @@ typedef struct _RMI4_FINGER_INFO
     UCHAR fingerStatus;
 } RMI4_FINGER_INFO;
 
+//
+// Recent positions of a contact, newest first, used for prediction
+//
+#define RMI4_FINGER_HISTORY_DEPTH   3
+
+typedef struct _RMI4_FINGER_HISTORY
+{
+    int x[RMI4_FINGER_HISTORY_DEPTH];
+    int y[RMI4_FINGER_HISTORY_DEPTH];
+    ULONG64 ScanTime[RMI4_FINGER_HISTORY_DEPTH];
+    int Count;
+} RMI4_FINGER_HISTORY;
+
 typedef struct _RMI4_FINGER_CACHE
 {
     RMI4_FINGER_INFO FingerSlot[RMI4_MAX_TOUCHES];
+    RMI4_FINGER_HISTORY History[RMI4_MAX_TOUCHES];
     UINT32 FingerSlotValid;
     UINT32 FingerSlotDirty;
     int FingerDownOrder[RMI4_MAX_TOUCHES];
     int FingerDownCount;
+    int FrameMotion;
+    BOOLEAN FrameChanged;
+    BOOLEAN FrameTipChanged;
     ULONG64 ScanTime;
 } RMI4_FINGER_CACHE;
 
+//
+// Per-slot 1-euro filter state. Positions are in 24.8 fixed point,
+// speeds in sensor units per second and times in 100us units.
+//
+typedef struct _RMI4_FILTER_AXIS
+{
+    int Position;
+    int Speed;
+} RMI4_FILTER_AXIS;
+
+typedef struct _RMI4_FILTER_SLOT
+{
+    RMI4_FILTER_AXIS X;
+    RMI4_FILTER_AXIS Y;
+    ULONG64 LastScanTime;
+} RMI4_FILTER_SLOT;
+
+typedef struct _RMI4_FILTER_CACHE
+{
+    RMI4_FILTER_SLOT Slot[RMI4_MAX_TOUCHES];
+    UINT32 SlotValid;
+} RMI4_FILTER_CACHE;
+
+//
+// Raw F12 packet read by the acquisition stage of the touch pipeline.
+// Empty frames carry no object data, every contact is reported lifted.
+//
+typedef struct _RMI4_TOUCH_FRAME
+{
+    BYTE* Packet;
+    BOOLEAN Empty;
+} RMI4_TOUCH_FRAME;
+
+//
+// F01 device control changes decided while delivering a frame. They are
+// written to the controller after ControllerLock is released.
+//
+#define RMI4_DEVICE_CONTROL_NO_SLEEP      0x01
+#define RMI4_DEVICE_CONTROL_REPORT_RATE   0x02
+
+typedef struct _RMI4_DEVICE_CONTROL_WRITE
+{
+    BYTE Pending;                       // RMI4_DEVICE_CONTROL_XXX
+    BOOLEAN NoSleep;
+    UCHAR ReportRate;
+} RMI4_DEVICE_CONTROL_WRITE;
+
+//
+// Interrupt servicing statistics, times are in 100ns units. Service
+// latencies are kept in a log-linear histogram: passes shorter than
+// 2^RMI4_LATENCY_SUB_BITS units are counted exactly, and every power of
+// two above that is split into 2^RMI4_LATENCY_SUB_BITS linear buckets,
+// so no bucket is wider than 1/8 of the latencies it counts.
+//
+#define RMI4_LATENCY_SUB_BITS             3
+#define RMI4_LATENCY_OCTAVES              24
+#define RMI4_LATENCY_BUCKETS              ((RMI4_LATENCY_OCTAVES + 1) << RMI4_LATENCY_SUB_BITS)
+
+typedef struct _RMI4_SERVICE_COUNTERS
+{
+    ULONG64 ServiceCalls;
+    ULONG64 ServiceTime;
+    ULONG64 ServiceLockHolds;
+    ULONG64 ReportsFilled;
+    ULONG64 TouchFramesRead;
+    ULONG64 TouchBytesRead;
+    ULONG64 TouchFramesSkipped;         // Touch interrupts pending when surface reporting went off
+    ULONG64 TouchBytesSkipped;
+    ULONG64 HeldFrames;
+    ULONG64 HeldFramesDelivered;
+    ULONG64 SurfaceOffTime;
+    ULONG64 SurfaceOffSince;
+    ULONG64 CoverFrames;
+    ULONG64 CoverBytesSaved;
+    ULONG64 PalmFrames;
+    ULONG64 PalmContactsRejected;
+    ULONG64 PalmFramesSuppressed;
+    ULONG64 EdgeContactsHeld;
+    ULONG64 EdgeSwipesPromoted;
+    ULONG64 ElidedFrames;
+    ULONG64 WatchdogLifts;
+    ULONG64 WatchdogReads;
+    ULONG64 PacedFrames;
+    ULONG64 PacingLatency;
+    ULONG64 PacingFlushes;
+    ULONG64 ServiceLatency[RMI4_LATENCY_BUCKETS];
+} RMI4_SERVICE_COUNTERS;
+
+//
+// Touch report hot path stages timed when HotPathProfile is set
+//
+#define RMI4_STAGE_DECODE                 0     // F12 object decode
+#define RMI4_STAGE_REJECT                 1     // Palm, edge and smoothing filters
+#define RMI4_STAGE_CACHE                  2     // RmiUpdateLocalFingerCache
+#define RMI4_STAGE_FILL                   3     // HID report fill and translation
+#define RMI4_STAGE_COUNT                  4
+
+//
+// Frames and time spent in each stage, bucketed by the number of contacts
+// down in the frame. Times are in 100ns units.
+//
+typedef struct _RMI4_HOT_PATH_PROFILE
+{
+    ULONG64 Frames[RMI4_STAGE_COUNT][RMI4_MAX_TOUCHES + 1];
+    ULONG64 Time[RMI4_STAGE_COUNT][RMI4_MAX_TOUCHES + 1];
+} RMI4_HOT_PATH_PROFILE;
+
+//
+// Touch frame read paths modeled by RmiModelFrameBusCost
+//
+#define RMI4_BUS_PATH_CURRENT             0     // F01 status, then the full F12 packet
+#define RMI4_BUS_PATH_FUSED               1     // F01 status and F12 packet in one read
+#define RMI4_BUS_PATH_BITMAP              2     // F01 status, Data15, present objects
+#define RMI4_BUS_PATH_COUNT               3
+
+//
+// Modeled bus traffic and time of one touch frame. Bytes include the
+// register addresses written, times are in ns.
+//
+typedef struct _RMI4_BUS_COST
+{
+    ULONG Transactions;
+    ULONG Bytes;
+    ULONG64 Time;
+    ULONG64 StretchTime;
+} RMI4_BUS_COST;
+
+//
+// Fault classes tracked through recovery. A fault is recovered once an
+// acquisition pass reads the interrupt status, and any touch frame it
+// raised, without error. Frames lost counts passes that failed meanwhile.
+//
+#define RMI4_FAULT_BUS                    0     // Failed or short bus transfer
+#define RMI4_FAULT_RESET                  1     // Spontaneous controller reset
+#define RMI4_FAULT_UNCONFIGURED           2     // Controller lost its configuration
+#define RMI4_FAULT_COUNT                  3
+
+typedef struct _RMI4_FAULT_COUNTERS
+{
+    ULONG64 Faults[RMI4_FAULT_COUNT];
+    ULONG64 Recoveries[RMI4_FAULT_COUNT];
+    ULONG64 FramesLost[RMI4_FAULT_COUNT];
+    ULONG64 RecoveryTime[RMI4_FAULT_COUNT];
+} RMI4_FAULT_COUNTERS;
+
 typedef struct _RMI4_CONTROLLER_CONTEXT
 {
     WDFDEVICE FxDevice;    
-    WDFWAITLOCK ControllerLock;
+    RMI_LOCK ControllerLock;
 
     //
     // Controller state
@@ -483,6 +767,14 @@ typedef struct _RMI4_CONTROLLER_CONTEXT
     int CurrentPage;
 
     ULONG InterruptStatus;
+
+    //
+    // Interrupt sources owned by each function, assigned in PDT order,
+    // and the subset the driver has handlers enabled for
+    //
+    BYTE FunctionInterruptMask[RMI4_MAX_FUNCTIONS];
+    BYTE InterruptEnableMask;
+
     BOOLEAN HasButtons;
     BOOLEAN ResetOccurred;
     BOOLEAN InvalidConfiguration;
@@ -502,18 +794,120 @@ typedef struct _RMI4_CONTROLLER_CONTEXT
     TOUCH_SCREEN_PROPERTIES Props;
     RMI4_CONFIGURATION Config;
 
+    //
+    // Dynamic report rate state
+    //
+    BOOLEAN HighReportRate;
+    int BurstQuietFrames;
+
+    //
+    // Hover pre-wake state
+    //
+    BOOLEAN PreWakeActive;
+    ULONG64 PreWakeSince;
+
+    //
+    // Cover suspend state, CoverSlot is the object index reporting the cover
+    //
+    BOOLEAN CoverSuspended;
+    int CoverSlot;
+
+    //
+    // Slots suppressed by palm rejection, held until the object lifts
+    //
+    UINT32 PalmRejectedSlots;
+
+    //
+    // Slots that landed in an edge rejection band, held back until they
+    // lift or swipe inward, and where each of them landed
+    //
+    UINT32 EdgeHeldSlots;
+    RMI4_F11_DATA_POSITION EdgeStart[RMI4_MAX_TOUCHES];
+
+    //
+    // Frame pacing state, when the last report went out and since when
+    // frames have been coalesced into the cache without being reported
+    //
+    ULONG64 PacingLastReport;
+    ULONG64 PacingHeldSince;
+
+    //
+    // When the lift watchdog last found contacts in the cache still
+    // reported by the controller
+    //
+    ULONG64 LiftConfirmedTime;
+
+    //
+    // PTP selective reporting switches requested by the host
+    //
+    BOOLEAN SurfaceReportingOn;
+    BOOLEAN ButtonReportingOn;
+
+    //
+    // F12 reporting mode last read from or programmed to the controller
+    //
+    UCHAR ReportingMode;
+
+    RMI4_SERVICE_COUNTERS Counters;
+    RMI4_HOT_PATH_PROFILE Profile;
+
+    //
+    // Fault recovery state, FaultSince is 0 for classes not recovering
+    //
+    RMI4_FAULT_COUNTERS Faults;
+    ULONG64 FaultSince[RMI4_FAULT_COUNT];
+#if DBG
+    ULONG FaultSeed;
+    ULONG SyntheticFrame;
+#endif
+
     //
     // Current touch state
     //
     int TouchesReported;
     int TouchesTotal;
     RMI4_FINGER_CACHE Cache;
+    RMI4_FILTER_CACHE Filter;
+
+    //
+    // Touch frame pipeline. The acquisition stage reads the next packet
+    // into Frame without holding ControllerLock, the delivery stage
+    // decodes it under ControllerLock. FramePacketSize is the size the
+    // packet buffer was allocated with.
+    //
+    // Acquisition does not look at state owned by ControllerLock. The
+    // delivery stage leaves it what it needs: ContactsDown, whether any
+    // contact is in the cache. Acquisition in turn only flags a lost
+    // configuration, ReconfigurePending, which delivery acts on, and
+    // delivery queues F01 device control changes in DeviceControlWrite
+    // for the bus to be written once ControllerLock is released.
+    //
+    // A frame read while no reader is waiting and no contact is down is
+    // held, FrameHeld, and decoded once a reader shows up. A newer frame
+    // replaces it meanwhile.
+    //
+    RMI4_TOUCH_FRAME Frame;
+    size_t FramePacketSize;
+    BOOLEAN FrameReady;
+    BOOLEAN FrameHeld;
+    BOOLEAN ContactsDown;
+    BOOLEAN ReconfigurePending;
+    RMI4_DEVICE_CONTROL_WRITE DeviceControlWrite;
+
+    //
+    // Binary touch trace capture, see rmitrace.h
+    //
+    BYTE* TraceBuffer;
+    ULONG TraceBufferSize;
+    ULONG TraceUsed;
+    ULONG TraceDropped;
 
 	//
 	// RMI4 F12 state
 	//
 
 	BOOLEAN HasDribble;
+	BOOLEAN LayoutFromProfile;
 	RMI_REGISTER_DESCRIPTOR QueryRegDesc;
 	RMI_REGISTER_DESCRIPTOR ControlRegDesc;
 	RMI_REGISTER_DESCRIPTOR DataRegDesc;
@@ -540,6 +934,156 @@ RmiSetReportingMode(
     OUT OPTIONAL UCHAR *OldMode
     );
 
+NTSTATUS
+RmiDecodeTouchFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS *Data
+    );
+
+VOID
+RmiFilterContacts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS* Data
+    );
+
+VOID
+RmiUpdateLocalFingerCache(
+    IN RMI4_F11_DATA_REGISTERS *Data,
+    IN RMI4_FINGER_CACHE *Cache,
+    IN int Deadband
+    );
+
+VOID
+RmiFillNextHidReportFromCache(
+    IN PPTP_REPORT HidReport,
+    IN RMI4_FINGER_CACHE *Cache,
+    IN PTOUCH_SCREEN_PROPERTIES Props,
+    IN RMI4_PREDICTION_SETTINGS_LOGICAL *Prediction,
+    IN int *TouchesReported,
+    IN int TouchesTotal
+    );
+
+VOID
+RmiTraceServiceCounters(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    );
+
+VOID
+RmiNoteServiceLatency(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG64 Latency
+    );
+
+ULONG64
+RmiServiceLatencyPercentile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG Percentile
+    );
+
+VOID
+RmiNoteFault(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Fault
+    );
+
+#if DBG
+BOOLEAN
+RmiInjectFault(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG Rate
+    );
+
+VOID
+RmiSynthesizeTouchFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    OUT BYTE* Packet
+    );
+#endif
+
+VOID
+RmiTraceCaptureStart(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    );
+
+VOID
+RmiTraceCaptureRecord(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN USHORT Type,
+    IN PVOID Data,
+    IN ULONG Length
+    );
+
+VOID
+RmiTraceCaptureFlush(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    );
+
+NTSTATUS
+RmiModelFrameBusCost(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Path,
+    IN ULONG Contacts,
+    IN ULONG BusSpeed,
+    IN ULONG StretchTime,
+    OUT RMI4_BUS_COST* Cost
+    );
+
+VOID
+RmiTraceBusModel(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    );
+
+NTSTATUS
+RmiApplyFirmwareProfile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+    );
+
+VOID
+RmiTraceFirmwareProfile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+    );
+
+NTSTATUS
+RmiAssignFunctionInterrupts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    );
+
+NTSTATUS
+RmiEnableFunctionInterrupts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN int FunctionNumber,
+    IN BOOLEAN Enable
+    );
+
+BYTE
+RmiGetFunctionInterruptMask(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int FunctionNumber
+    );
+
+NTSTATUS
+RmiConfigureFunctions(
+    IN RMI4_CONTROLLER_CONTEXT *ControllerContext,
+    IN SPB_CONTEXT *SpbContext
+    );
+
+NTSTATUS
+RmiSetReportRate(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR ReportRate
+    );
+
+NTSTATUS
+RmiSetNoSleep(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN NoSleep
+    );
+
 int
 RmiGetFunctionIndex(
     IN RMI4_FUNCTION_DESCRIPTOR* FunctionDescriptors,
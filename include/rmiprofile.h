@@ -0,0 +1,101 @@
+/*++
+    Module Name:
+
+        rmiprofile.h
+
+    Abstract:
+
+        Compile-time register layout profiles for known controller
+        firmware. A profile holds the page description table and the
+        F12 control and data register layout the driver would otherwise
+        discover from the controller at start, keyed by the F01 product
+        ID.
+
+        Profiles are only compiled in when RMI4_FIRMWARE_PROFILES names
+        a header of RMI4_FIRMWARE_PROFILE initializers, e.g.
+
+            /DRMI4_FIRMWARE_PROFILES=\"s3320.h\"
+
+        Entries for that header are generated from a checked-in device:
+        after runtime discovery the driver traces the layout it found as
+        an initializer (TRACE_INIT, verbose). At start the driver reads
+        the product ID once and looks for a profile with the same ID.
+        Firmware builds sharing a product ID can lay F12 out differently,
+        so the F12 control and data register descriptors (which registers
+        exist, their sizes and subpackets) are read as well and have to
+        match the profile byte for byte. If no profile matches, or the
+        matching one does not hold together, it falls back to runtime
+        discovery.
+
+    Environment:
+
+        Kernel mode
+
+    Revision History:
+
+--*/
+
+#pragma once
+
+#define RMI4_PRODUCT_ID_LENGTH              10
+#define RMI4_PROFILE_MAX_REGISTERS          32
+#define RMI4_PROFILE_MAX_PRESENCE           35
+#define RMI4_PROFILE_MAX_STRUCTURE          128
+
+//
+// One F12 register, in register order, as reported by the controller's
+// register descriptor
+//
+typedef struct _RMI4_PROFILE_REGISTER
+{
+    USHORT Register;
+    ULONG RegisterSize;
+    BYTE NumSubPackets;
+} RMI4_PROFILE_REGISTER;
+
+//
+// F12 register descriptor as the controller reports it: the presence
+// register (structure size and which registers exist) and the structure
+// register (register sizes and subpackets)
+//
+typedef struct _RMI4_PROFILE_DESCRIPTOR
+{
+    BYTE PresenceSize;
+    BYTE Presence[RMI4_PROFILE_MAX_PRESENCE];
+    USHORT StructureSize;
+    BYTE Structure[RMI4_PROFILE_MAX_STRUCTURE];
+} RMI4_PROFILE_DESCRIPTOR;
+
+typedef struct _RMI4_FIRMWARE_PROFILE
+{
+    CHAR ProductId[RMI4_PRODUCT_ID_LENGTH + 1];
+
+    //
+    // Page description table, in discovery order
+    //
+    int FunctionCount;
+    RMI4_FUNCTION_DESCRIPTOR Descriptors[RMI4_MAX_FUNCTIONS];
+    int FunctionOnPage[RMI4_MAX_FUNCTIONS];
+
+    //
+    // F12 register layout
+    //
+    BOOLEAN HasDribble;
+    UINT8 ControlCount;
+    RMI4_PROFILE_REGISTER Control[RMI4_PROFILE_MAX_REGISTERS];
+    UINT8 DataCount;
+    RMI4_PROFILE_REGISTER Data[RMI4_PROFILE_MAX_REGISTERS];
+
+    //
+    // F12 data packet layout derived from the data registers
+    //
+    USHORT PacketSize;
+    USHORT Data1Offset;
+    BYTE MaxFingers;
+
+    //
+    // F12 control and data register descriptors the layout was taken from
+    //
+    RMI4_PROFILE_DESCRIPTOR ControlDescriptor;
+    RMI4_PROFILE_DESCRIPTOR DataDescriptor;
+} RMI4_FIRMWARE_PROFILE;
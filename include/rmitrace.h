@@ -0,0 +1,75 @@
+/*++
+    Module Name:
+
+        rmitrace.h
+
+    Abstract:
+
+        Binary touch trace format. A trace file is a sequence of
+        segments, one per flush of the capture buffer. Each segment
+        starts with a header describing the F12 data packet layout,
+        followed by the records captured since the previous flush.
+
+        Fields are little endian and every structure and record is
+        8 byte aligned, so a trace can be mapped and walked in place.
+        Readers skip HeaderSize bytes to reach the records and must
+        ignore record types they do not know, so fields and record
+        types can be added without bumping the version.
+
+    Environment:
+
+        Kernel mode, user mode
+
+    Revision History:
+
+--*/
+
+#pragma once
+
+#define RMI_TRACE_MAGIC                     0x34524D52  // "RMR4"
+#define RMI_TRACE_VERSION                   1
+
+#define RMI_TRACE_ALIGN(Length)             (((Length) + 7) & ~7)
+
+typedef struct _RMI_TRACE_SEGMENT_HEADER
+{
+    UINT32 Magic;
+    UINT16 Version;
+    UINT16 HeaderSize;          // Bytes, including the register table
+    UINT32 RecordBytes;         // Bytes of records following the header
+    UINT32 RecordsDropped;      // Records lost to a full capture buffer
+    UINT32 PacketSize;          // Size of an F12 data packet
+    UINT16 Data1Offset;         // Offset of the object data in a packet
+    UINT8 MaxFingers;           // Objects in the object data
+    UINT8 RegisterCount;        // RMI_TRACE_REGISTER entries that follow
+} RMI_TRACE_SEGMENT_HEADER;
+
+//
+// One F12 data register, in packet order, as described by the controller
+//
+typedef struct _RMI_TRACE_REGISTER
+{
+    UINT16 Register;
+    UINT8 NumSubPackets;
+    UINT8 Reserved;
+    UINT32 RegisterSize;
+} RMI_TRACE_REGISTER;
+
+//
+// F01 data registers (device status and interrupt status) as read when
+// an interrupt is checked
+//
+#define RMI_TRACE_RECORD_F01_STATUS         1
+
+//
+// Full F12 data packet as read from the controller
+//
+#define RMI_TRACE_RECORD_F12_PACKET         2
+
+typedef struct _RMI_TRACE_RECORD
+{
+    UINT64 Timestamp;           // Interrupt time, 100ns units
+    UINT16 Type;
+    UINT16 Length;              // Payload bytes following the record
+    UINT32 Reserved;
+} RMI_TRACE_RECORD;
@@ -20,11 +20,55 @@
 
 #pragma once
 
-#include <wdm.h>
-#include <wdf.h>
+#include "compat.h"
 
 #define DEFAULT_SPB_BUFFER_SIZE 64
 
+//
+// SPB (I2C) transaction statistics, BusTime is in 100ns units. A register
+// read takes two transactions, the address write and the data read.
+//
+
+typedef struct _SPB_STATISTICS
+{
+    ULONG64 WriteTransactions;
+    ULONG64 ReadTransactions;
+    ULONG64 BytesWritten;
+    ULONG64 BytesRead;
+    ULONG64 Errors;
+    ULONG64 BusTime;
+} SPB_STATISTICS;
+
+//
+// I2C timing model. Each transaction costs a start and a stop condition
+// and the address byte, every byte costs 8 data bits and an ACK, and the
+// target stretches the clock for a given time per transaction while it
+// fetches or latches register data. Stack overhead shows up as measured
+// BusTime beyond the model.
+//
+
+#define SPB_MODEL_TRANSACTION_BITS  (2 + 9)
+#define SPB_MODEL_BYTE_BITS         9
+
+#define SPB_BUS_SPEED_STANDARD      100000
+#define SPB_BUS_SPEED_FAST          400000
+#define SPB_BUS_SPEED_FAST_PLUS     1000000
+
+#if DBG
+//
+// SPB (I2C) fault injection, see spbfault.c. Rates are 1 in N transfers,
+// 0 disables.
+//
+
+typedef struct _SPB_FAULT_INJECTION
+{
+    ULONG NackRate;
+    ULONG ShortReadRate;
+    ULONG Seed;
+    ULONG64 Injected;
+} SPB_FAULT_INJECTION;
+#endif
+
 //
 // SPB (I2C) context
 //
@@ -36,8 +80,38 @@ typedef struct _SPB_CONTEXT
     WDFMEMORY WriteMemory;
     WDFMEMORY ReadMemory;
     WDFWAITLOCK SpbLock;
+    SPB_STATISTICS Statistics;
+#if DBG
+    SPB_FAULT_INJECTION FaultInjection;
+#endif
 } SPB_CONTEXT;
 
+#if DBG
+NTSTATUS
+SpbFaultReadData(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    );
+
+NTSTATUS
+SpbFaultWriteData(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    );
+#endif
+
+ULONG64
+SpbModelTransferTime(
+    IN ULONG BusSpeed,
+    IN ULONG StretchTime,
+    IN ULONG64 Transactions,
+    IN ULONG64 Bytes
+    );
+
 NTSTATUS 
 SpbReadDataSynchronously(
     _In_ SPB_CONTEXT *SpbContext,
@@ -58,6 +132,11 @@ SpbTargetInitialize(
     IN SPB_CONTEXT *SpbContext
     );
 
+VOID
+SpbTraceStatistics(
+    IN SPB_CONTEXT *SpbContext
+    );
+
 NTSTATUS
 SpbWriteDataSynchronously(
     IN SPB_CONTEXT *SpbContext,
@@ -1,6 +1,5 @@
 /* BitOps Linux Port */
-#include <wdm.h>
-#include <wdf.h>
+#include <compat.h>
 #include <bitops.h>
 #include <hweight.h>
 
@@ -41,11 +40,22 @@ int bitmap_weight(const unsigned long *bitmap, unsigned int bits)
 	return w;
 }
 
+/*
+* Index of the lowest set bit, word must not be 0. MSVC provides a bit scan
+* on every target (BSF/TZCNT on x86, RBIT+CLZ on ARM), other compilers fall
+* back to the shift cascade.
+*/
 static inline unsigned long __ffs(unsigned long word)
 {
+#if defined(_MSC_VER)
+	unsigned long num;
+
+	_BitScanForward(&num, word);
+	return num;
+#else
 	int num = 0;
 
-#if defined(ARM64) || defined(AMD64)
+#if defined(__SIZEOF_LONG__) && __SIZEOF_LONG__ == 8
 	if ((word & 0xffffffff) == 0) {
 		num += 32;
 		word >>= 32;
@@ -70,6 +80,7 @@ static inline unsigned long __ffs(unsigned long word)
 	if ((word & 0x1) == 0)
 		num += 1;
 	return num;
+#endif
 }
 
 unsigned long find_first_bit(const unsigned long *addr, unsigned long size)
@@ -127,3 +138,9 @@ unsigned long find_next_bit(const unsigned long *addr, unsigned long size,
 {
 	return _find_next_bit(addr, NULL, size, offset, 0UL);
 }
+
+unsigned long find_next_zero_bit(const unsigned long *addr, unsigned long size,
+	unsigned long offset)
+{
+	return _find_next_bit(addr, NULL, size, offset, ~0UL);
+}
@@ -0,0 +1,335 @@
+/*++
+    Module Name:
+
+        compat.c
+
+    Abstract:
+
+        KMDF backend of the platform services in compat.h that are too
+        large for a macro: registry settings and capture files.
+
+    Environment:
+
+        Kernel mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <trace.h>
+#include <compat.tmh>
+
+#define RMI_FILE_MAX_PATH               260
+
+NTSTATUS
+RmiQueryDeviceSettings(
+    IN WDFDEVICE FxDevice,
+    IN PRTL_QUERY_REGISTRY_TABLE Table
+    )
+/*++
+
+Routine Description:
+
+    Fills a registry query table from the Settings subkey of the
+    device's hardware key. Must be called at PASSIVE_LEVEL.
+
+Arguments:
+
+    FxDevice - a handle to the framework device object
+    Table - RtlQueryRegistryValues table, allocated from nonpaged pool
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    HANDLE hKey;
+    WDFKEY key;
+    NTSTATUS status;
+    WDFKEY subkey;
+    DECLARE_CONST_UNICODE_STRING(subkeyName, L"Settings");
+
+    key = NULL;
+    subkey = NULL;
+
+    //
+    // Obtain a WDM hkey for RtlQueryRegistryValues
+    //
+
+    status = WdfDeviceOpenRegistryKey(
+        FxDevice,
+        PLUGPLAY_REGKEY_DEVICE,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &key);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REGISTRY,
+            "Error opening device registry key - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+    status = WdfRegistryOpenKey(
+        key,
+        &subkeyName,
+        KEY_READ,
+        WDF_NO_OBJECT_ATTRIBUTES,
+        &subkey);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REGISTRY,
+            "Error opening device registry subkey - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+    hKey = WdfRegistryWdmGetHandle(subkey);
+
+    if (NULL == hKey)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REGISTRY,
+            "Error getting WDM handle to WDF subkey");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RtlQueryRegistryValues(
+        RTL_REGISTRY_HANDLE,
+        (PCWSTR) hKey,
+        Table,
+        NULL,
+        NULL);
+
+exit:
+
+    if (subkey != NULL)
+    {
+        WdfRegistryClose(subkey);
+    }
+
+    if (key != NULL)
+    {
+        WdfRegistryClose(key);
+    }
+
+    return status;
+}
+
+NTSTATUS
+RmiFileOpenAppend(
+    IN PCWSTR Path,
+    OUT RMI_FILE *File
+    )
+/*++
+
+Routine Description:
+
+    Opens a file for appending, creating it if it does not exist. Must
+    be called at PASSIVE_LEVEL.
+
+Arguments:
+
+    Path - NT path of the file
+    File - receives the file handle, for RmiFileWrite and RmiFileClose
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    UNICODE_STRING path;
+    OBJECT_ATTRIBUTES attributes;
+    IO_STATUS_BLOCK ioStatus;
+    NTSTATUS status;
+
+    RtlInitUnicodeString(&path, Path);
+    InitializeObjectAttributes(
+        &attributes,
+        &path,
+        OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+        NULL,
+        NULL);
+
+    status = ZwCreateFile(
+        File,
+        FILE_APPEND_DATA | SYNCHRONIZE,
+        &attributes,
+        &ioStatus,
+        NULL,
+        FILE_ATTRIBUTE_NORMAL,
+        FILE_SHARE_READ,
+        FILE_OPEN_IF,
+        FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+        NULL,
+        0);
+
+    if (!NT_SUCCESS(status))
+    {
+        *File = NULL;
+    }
+
+    return status;
+}
+
+NTSTATUS
+RmiFileWrite(
+    IN RMI_FILE File,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+{
+    IO_STATUS_BLOCK ioStatus;
+
+    return ZwWriteFile(
+        File,
+        NULL,
+        NULL,
+        NULL,
+        &ioStatus,
+        Data,
+        Length,
+        NULL,
+        NULL);
+}
+
+NTSTATUS
+RmiFileQuerySize(
+    IN RMI_FILE File,
+    OUT ULONG64 *Size
+    )
+{
+    FILE_STANDARD_INFORMATION information;
+    IO_STATUS_BLOCK ioStatus;
+    NTSTATUS status;
+
+    status = ZwQueryInformationFile(
+        File,
+        &ioStatus,
+        &information,
+        sizeof(information),
+        FileStandardInformation);
+
+    *Size = NT_SUCCESS(status) ? (ULONG64) information.EndOfFile.QuadPart : 0;
+
+    return status;
+}
+
+VOID
+RmiFileClose(
+    IN RMI_FILE File
+    )
+{
+    ZwClose(File);
+}
+
+NTSTATUS
+RmiFileRename(
+    IN PCWSTR Path,
+    IN PCWSTR NewPath
+    )
+/*++
+
+Routine Description:
+
+    Renames a file, replacing any file already at the new path. Must be
+    called at PASSIVE_LEVEL.
+
+Arguments:
+
+    Path - NT path of the file
+    NewPath - NT path to rename it to, on the same volume
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    struct
+    {
+        FILE_RENAME_INFORMATION Information;
+        WCHAR Name[RMI_FILE_MAX_PATH];
+    } rename;
+    UNICODE_STRING path;
+    UNICODE_STRING newPath;
+    OBJECT_ATTRIBUTES attributes;
+    IO_STATUS_BLOCK ioStatus;
+    HANDLE file;
+    ULONG size;
+    NTSTATUS status;
+
+    file = NULL;
+
+    RtlInitUnicodeString(&path, Path);
+    InitializeObjectAttributes(
+        &attributes,
+        &path,
+        OBJ_CASE_INSENSITIVE | OBJ_KERNEL_HANDLE,
+        NULL,
+        NULL);
+
+    status = ZwCreateFile(
+        &file,
+        DELETE | SYNCHRONIZE,
+        &attributes,
+        &ioStatus,
+        NULL,
+        FILE_ATTRIBUTE_NORMAL,
+        FILE_SHARE_READ,
+        FILE_OPEN,
+        FILE_SYNCHRONOUS_IO_NONALERT | FILE_NON_DIRECTORY_FILE,
+        NULL,
+        0);
+
+    if (!NT_SUCCESS(status))
+    {
+        file = NULL;
+        goto exit;
+    }
+
+    RtlInitUnicodeString(&newPath, NewPath);
+    size = FIELD_OFFSET(FILE_RENAME_INFORMATION, FileName) + newPath.Length;
+
+    if (size > sizeof(rename))
+    {
+        status = STATUS_NAME_TOO_LONG;
+        goto exit;
+    }
+
+    RtlZeroMemory(&rename, sizeof(rename));
+    rename.Information.ReplaceIfExists = TRUE;
+    rename.Information.RootDirectory = NULL;
+    rename.Information.FileNameLength = newPath.Length;
+    RtlCopyMemory(rename.Information.FileName, newPath.Buffer, newPath.Length);
+
+    status = ZwSetInformationFile(
+        file,
+        &ioStatus,
+        &rename,
+        size,
+        FileRenameInformation);
+
+exit:
+
+    if (file != NULL)
+    {
+        ZwClose(file);
+    }
+
+    return status;
+}
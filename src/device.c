@@ -13,6 +13,278 @@
   #pragma alloc_text(PAGE, OnD0Exit)
 #endif
 
+//
+// HIDClass read requests handed out as report buffers while servicing
+// one batch of interrupts
+//
+typedef struct _TCH_REPORT_BATCH
+{
+    PDEVICE_EXTENSION DevContext;
+    ULONG Count;
+    WDFREQUEST Requests[TCH_MAX_REPORTS_PER_FRAME];
+} TCH_REPORT_BATCH;
+
+static
+BOOLEAN
+TchReaderWaiting(
+    IN PDEVICE_EXTENSION DevContext
+    )
+/*++
+
+  Routine Description:
+
+    Checks whether a HIDClass read request is pending, without taking it
+    off the read queue.
+
+  Arguments:
+
+    DevContext - device context
+
+  Return Value:
+
+    TRUE if a read request is queued
+
+--*/
+{
+    ULONG queueRequests;
+
+    queueRequests = 0;
+
+    (VOID) WdfIoQueueGetState(
+        DevContext->PingPongQueue,
+        &queueRequests,
+        NULL);
+
+    return (queueRequests != 0);
+}
+
+static
+PPTP_REPORT
+TchRetrieveHidReportBuffer(
+    IN PDEVICE_EXTENSION DevContext,
+    OUT WDFREQUEST *Request
+    )
+/*++
+
+  Routine Description:
+
+    Retrieves the next pending HIDClass read request, so a touch report
+    can be built directly in its output buffer. Requests without a usable
+    output buffer are failed and the next one is tried.
+
+  Arguments:
+
+    DevContext - device context
+    Request - receives the request, or NULL if none is pending
+
+  Return Value:
+
+    The request output buffer to fill, or NULL if no reader is waiting.
+
+--*/
+{
+    NTSTATUS status;
+    WDFREQUEST request;
+    PPTP_REPORT hidReportRequestBuffer;
+    size_t hidReportRequestBufferLength;
+
+    *Request = NULL;
+
+    for (;;)
+    {
+        status = WdfIoQueueRetrieveNextRequest(
+            DevContext->PingPongQueue,
+            &request);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_REPORTING,
+                "No request pending from HIDClass, deferring touch data - %!STATUS!",
+                status);
+
+            return NULL;
+        }
+
+        //
+        // Validate an output buffer was provided
+        //
+        status = WdfRequestRetrieveOutputBuffer(
+            request,
+            sizeof(PTP_REPORT),
+            &hidReportRequestBuffer,
+            &hidReportRequestBufferLength);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SAMPLES,
+                "Error retrieving HID read request output buffer - %!STATUS!",
+                status);
+        }
+        else if (hidReportRequestBufferLength < sizeof(PTP_REPORT))
+        {
+            //
+            // Validate the size of the output buffer
+            //
+            status = STATUS_BUFFER_TOO_SMALL;
+
+            Trace(
+                TRACE_LEVEL_VERBOSE,
+                TRACE_SAMPLES,
+                "Error HID read request buffer is too small (%I64x bytes) - %!STATUS!",
+                hidReportRequestBufferLength,
+                status);
+        }
+        else
+        {
+            *Request = request;
+            return hidReportRequestBuffer;
+        }
+
+        WdfRequestComplete(request, status);
+    }
+}
+
+static
+VOID
+TchCompleteHidReport(
+    IN WDFREQUEST Request,
+    IN NTSTATUS ReportStatus
+    )
+/*++
+
+  Routine Description:
+
+    Completes a HIDClass read request whose output buffer was filled
+    with a touch report. Requests are only retrieved once a report is
+    ready for them, should one still come back unused it goes back to
+    the read queue for the next report.
+
+  Arguments:
+
+    Request - request from TchRetrieveHidReportBuffer, may be NULL
+    ReportStatus - success if the request output buffer was filled
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    NTSTATUS status;
+
+    if (Request == NULL)
+    {
+        return;
+    }
+
+    if (NT_SUCCESS(ReportStatus))
+    {
+        WdfRequestSetInformation(Request, sizeof(PTP_REPORT));
+        WdfRequestComplete(Request, STATUS_SUCCESS);
+        return;
+    }
+
+    status = WdfRequestRequeue(Request);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REPORTING,
+            "Error requeueing HID read request - %!STATUS!",
+            status);
+
+        WdfRequestComplete(Request, status);
+    }
+}
+
+static
+PPTP_REPORT
+TchNextBatchReportBuffer(
+    IN VOID *BufferContext,
+    IN ULONG ReportIndex
+    )
+/*++
+
+  Routine Description:
+
+    Supplies the next report buffer of a batch from a pending HIDClass
+    read request, and remembers the request for completion. Only called
+    once a report is ready to be filled, so interrupts without anything
+    to report leave the read queue alone.
+
+  Arguments:
+
+    BufferContext - the TCH_REPORT_BATCH being filled
+    ReportIndex - index of the report the buffer is for
+
+  Return Value:
+
+    The request output buffer, or NULL if no reader is waiting.
+
+--*/
+{
+    TCH_REPORT_BATCH *batch;
+    WDFREQUEST request;
+    PPTP_REPORT hidReport;
+
+    batch = (TCH_REPORT_BATCH*) BufferContext;
+
+    UNREFERENCED_PARAMETER(ReportIndex);
+    NT_ASSERT(ReportIndex == batch->Count);
+
+    if (batch->Count == RTL_NUMBER_OF(batch->Requests))
+    {
+        return NULL;
+    }
+
+    hidReport = TchRetrieveHidReportBuffer(batch->DevContext, &request);
+
+    if (hidReport != NULL)
+    {
+        batch->Requests[batch->Count++] = request;
+    }
+
+    return hidReport;
+}
+
+VOID
+TchArmLiftWatchdog(
+    IN PDEVICE_EXTENSION DevContext
+    )
+/*++
+
+  Routine Description:
+
+    (Re)arms the lift watchdog for when the contacts currently down
+    go stale. Nothing is armed while no contact is down.
+
+  Arguments:
+
+    DevContext - device context
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    ULONG due;
+
+    due = TchGetLiftWatchdogDue(DevContext->TouchContext);
+
+    if (due != 0)
+    {
+        WdfTimerStart(
+            DevContext->LiftWatchdogTimer,
+            WDF_REL_TIMEOUT_IN_MS(due));
+    }
+}
+
 BOOLEAN
 OnInterruptIsr(
     IN WDFINTERRUPT Interrupt,
@@ -42,19 +314,16 @@ OnInterruptIsr(
 --*/
 {
     PDEVICE_EXTENSION devContext;
-    NTSTATUS status;
-    WDFREQUEST request;
+    TCH_REPORT_BATCH batch;
     BOOLEAN servicingComplete;
-    PTP_REPORT hidReportFromDriver;
-    PPTP_REPORT hidReportRequestBuffer;
-    size_t hidReportRequestBufferLength;
+    ULONG reportsFilled;
+    NTSTATUS status;
+    ULONG i;
 
     UNREFERENCED_PARAMETER(MessageID);
 
-    status = STATUS_SUCCESS;
     servicingComplete = FALSE;
     devContext = GetDeviceContext(WdfInterruptGetDevice(Interrupt));
-    request = NULL;
 
 
     //
@@ -72,94 +341,182 @@ OnInterruptIsr(
     //
     while (servicingComplete == FALSE)
     {
+        batch.DevContext = devContext;
+        batch.Count = 0;
+
         //
-        // Service touch interrupts. Success indicates we have a report
-        // to complete to Hid. ServicingComplete indicates another report
-        // is required to continue servicing this interrupt.
+        // Service touch interrupts. Reports are written straight into
+        // pending HIDClass requests, all reports of a frame under one
+        // hold of the controller lock. Without a request, only the
+        // interrupt is acknowledged and touch data is held for the next
+        // reader. ServicingComplete indicates more reports are required
+        // to continue servicing this interrupt.
         //
-        if (!NT_SUCCESS(TchServiceInterrupts(
+        status = TchServiceInterrupts(
             devContext->TouchContext,
             &devContext->I2CContext,
-            &hidReportFromDriver,
+            TchReaderWaiting(devContext),
+            TchNextBatchReportBuffer,
+            &batch,
+            TCH_MAX_REPORTS_PER_FRAME,
             devContext->InputMode,
-            &servicingComplete)))
+            &reportsFilled,
+            &servicingComplete);
+
+        //
+        // Complete the filled requests back-to-back, a request handed out
+        // but left unused goes back to the queue
+        //
+        for (i = 0; i < batch.Count; i++)
         {
-            //
-            // hidReportFromDriver was not filled
-            //
-            continue;
+            TchCompleteHidReport(
+                batch.Requests[i],
+                (i < reportsFilled) ? STATUS_SUCCESS : STATUS_NO_DATA_DETECTED);
         }
 
         //
-        // Complete a HIDClass request if one is available
+        // The controller could not be read, spinning on it here would
+        // only hold the interrupt. A level-triggered line that is still
+        // asserted brings us back.
         //
-        status = WdfIoQueueRetrieveNextRequest(
-            devContext->PingPongQueue,
-            &request);
-
         if (!NT_SUCCESS(status))
         {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_REPORTING,
-                "No request pending from HIDClass, ignoring report - %!STATUS!",
-                status);
+            break;
+        }
+    }
+
+    TchArmLiftWatchdog(devContext);
+
+exit:
+    return TRUE;
+}
 
+VOID
+OnLiftWatchdogTimer(
+    IN WDFTIMER Timer
+    )
+/*++
+ 
+  Routine Description:
 
+    Runs at PASSIVE_LEVEL when frames coalesced by pacing are due with
+    no newer frame to carry them, or when no touch frame has arrived for
+    the configured lift timeout while contacts are down. Completes the
+    held back reports, or synthesized lift reports. Bus I/O is only done
+    in reduced reporting mode, to check the contacts are really gone.
 
-            continue;
-        }
+  Arguments:
+
+    Timer - a handle to the lift watchdog timer
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    PDEVICE_EXTENSION devContext;
+    TCH_REPORT_BATCH batch;
+    NTSTATUS status;
+    BOOLEAN servicingComplete;
+
+    servicingComplete = FALSE;
+    devContext = GetDeviceContext(WdfTimerGetParentObject(Timer));
+
+    if (devContext->DiagnosticMode != FALSE)
+    {
+        goto exit;
+    }
+
+    //
+    // In reduced reporting mode the watchdog reads from the controller,
+    // the interrupt lock serializes that with the ISR
+    //
+    WdfInterruptAcquireLock(devContext->InterruptObject);
+
+    while (servicingComplete == FALSE)
+    {
+        batch.DevContext = devContext;
+        batch.Count = 0;
 
         //
-        // Validate an output buffer was provided
+        // A request is only taken from the read queue once the watchdog
+        // has a report for it, as for interrupts
         //
-        status = WdfRequestRetrieveOutputBuffer(
-            request,
-            sizeof(PTP_REPORT),
-            &hidReportRequestBuffer,
-            &hidReportRequestBufferLength);
+        status = TchServiceLiftWatchdog(
+            devContext->TouchContext,
+            &devContext->I2CContext,
+            TchNextBatchReportBuffer,
+            &batch,
+            &servicingComplete);
 
-        if (!NT_SUCCESS(status))
-        {
-            Trace(
-                TRACE_LEVEL_VERBOSE,
-                TRACE_SAMPLES,
-                "Error retrieving HID read request output buffer - %!STATUS!",
-                status);
-        }
-        else
+        if (batch.Count != 0)
         {
-            //
-            // Validate the size of the output buffer
-            //
-            if (hidReportRequestBufferLength < sizeof(PTP_REPORT))
-            {
-                status = STATUS_BUFFER_TOO_SMALL;
-    
-                Trace(
-                    TRACE_LEVEL_VERBOSE,
-                    TRACE_SAMPLES,
-                    "Error HID read request buffer is too small (%I64x bytes) - %!STATUS!",
-                    hidReportRequestBufferLength,
-                    status);
-            }
-            else
-            {
-                RtlCopyMemory(
-                    hidReportRequestBuffer,
-                    &hidReportFromDriver,
-                    sizeof(PTP_REPORT));
-
-                WdfRequestSetInformation(request, sizeof(PTP_REPORT));
-            }
+            TchCompleteHidReport(batch.Requests[0], status);
         }
+    }
 
-        WdfRequestComplete(request, status);
+    WdfInterruptReleaseLock(devContext->InterruptObject);
+
+    TchArmLiftWatchdog(devContext);
+
+exit:
+    return;
+}
+
+#if DBG
+VOID
+OnSyntheticFrameTimer(
+    IN WDFTIMER Timer
+    )
+/*++
+ 
+  Routine Description:
+
+    Runs at PASSIVE_LEVEL at the synthetic workload scan rate. Raises a
+    touch interrupt for the next synthetic frame and services it like
+    the ISR would, under the interrupt lock.
+
+  Arguments:
+
+    Timer - a handle to the synthetic frame timer
+
+  Return Value:
+
+    None.
+
+--*/
+{
+    PDEVICE_EXTENSION devContext;
+    ULONG period;
+
+    devContext = GetDeviceContext(WdfTimerGetParentObject(Timer));
+
+    if (devContext->SyntheticActive == FALSE)
+    {
+        goto exit;
+    }
+
+    WdfInterruptAcquireLock(devContext->InterruptObject);
+
+    TchQueueSyntheticFrame(devContext->TouchContext);
+    (VOID) OnInterruptIsr(devContext->InterruptObject, 0);
+
+    WdfInterruptReleaseLock(devContext->InterruptObject);
+
+    period = TchGetSyntheticFramePeriod(devContext->TouchContext);
+
+    if (devContext->SyntheticActive != FALSE && period != 0)
+    {
+        WdfTimerStart(
+            devContext->SyntheticTimer,
+            WDF_REL_TIMEOUT_IN_MS(period));
     }
 
 exit:
-    return TRUE;
+    return;
 }
+#endif
 
 NTSTATUS
 OnD0Entry(
@@ -208,6 +565,22 @@ Return Value:
     //
     devContext->ServiceInterruptsAfterD0Entry = TRUE;
 
+#if DBG
+    //
+    // Start feeding synthetic frames if a workload is configured
+    //
+    if (NT_SUCCESS(status) &&
+        TchGetSyntheticFramePeriod(devContext->TouchContext) != 0)
+    {
+        devContext->SyntheticActive = TRUE;
+
+        WdfTimerStart(
+            devContext->SyntheticTimer,
+            WDF_REL_TIMEOUT_IN_MS(
+                TchGetSyntheticFramePeriod(devContext->TouchContext)));
+    }
+#endif
+
     //
     // Complete any pending Idle IRPs
     //
@@ -248,6 +621,17 @@ Return Value:
     
     UNREFERENCED_PARAMETER(TargetState);    
 
+    //
+    // Contacts are invalidated on standby, so the watchdog has nothing
+    // left to lift
+    //
+    WdfTimerStop(devContext->LiftWatchdogTimer, TRUE);
+
+#if DBG
+    devContext->SyntheticActive = FALSE;
+    WdfTimerStop(devContext->SyntheticTimer, TRUE);
+#endif
+
     status = TchStandbyDevice(devContext->TouchContext, &devContext->I2CContext);
 
     if (!NT_SUCCESS(status))
@@ -129,6 +129,7 @@ Return Value:
     PDEVICE_EXTENSION devContext;
     WDFDEVICE fxDevice;
     WDF_INTERRUPT_CONFIG interruptConfig;  
+    WDF_TIMER_CONFIG timerConfig;
     WDF_PNPPOWER_EVENT_CALLBACKS pnpPowerCallbacks;
     WDF_IO_QUEUE_CONFIG queueConfig;
     NTSTATUS status;
@@ -180,6 +181,13 @@ Return Value:
     devContext = GetDeviceContext(fxDevice);
     devContext->FxDevice = fxDevice;
     devContext->InputMode = MODE_MULTI_TOUCH;
+
+    //
+    // Report surface contacts and buttons until HIDClass selects otherwise
+    //
+    devContext->PtpInputOn = TRUE;
+    devContext->PtpReportButton = TRUE;
+    devContext->PtpReportTouch = TRUE;
   
     //
     // Create a parallel dispatch queue to handle requests from HID Class
@@ -289,6 +297,60 @@ Return Value:
         goto exit;
     }
 
+    //
+    // Create a timer to lift contacts the controller stops reporting.
+    // It is only armed while contacts are down.
+    //
+    WDF_TIMER_CONFIG_INIT(&timerConfig, OnLiftWatchdogTimer);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = fxDevice;
+    attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+    status = WdfTimerCreate(
+        &timerConfig,
+        &attributes,
+        &devContext->LiftWatchdogTimer);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error creating lift watchdog timer - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+#if DBG
+    //
+    // Create a timer to feed synthetic touch frames, started in D0 when
+    // a synthetic workload is configured
+    //
+    WDF_TIMER_CONFIG_INIT(&timerConfig, OnSyntheticFrameTimer);
+
+    WDF_OBJECT_ATTRIBUTES_INIT(&attributes);
+    attributes.ParentObject = fxDevice;
+    attributes.ExecutionLevel = WdfExecutionLevelPassive;
+
+    status = WdfTimerCreate(
+        &timerConfig,
+        &attributes,
+        &devContext->SyntheticTimer);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error creating synthetic frame timer - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+#endif
+
 exit:
 
     return status;
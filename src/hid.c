@@ -4,6 +4,7 @@
 #include <compat.h>
 #include <internal.h>
 #include <controller.h>
+#include <device.h>
 #include <hid.h>
 #include <hid.tmh>
 
@@ -91,21 +92,55 @@ Return Value:
     //
     if (devContext->ServiceInterruptsAfterD0Entry == TRUE)
     {
-		PTP_REPORT ptpReport;
         BOOLEAN servicingComplete = FALSE;
+        ULONG reportsFilled;
+
+        //
+        // Stale reports are not wanted, acknowledge without report buffers.
+        // The interrupt lock keeps this serialized with the ISR.
+        //
+        WdfInterruptAcquireLock(devContext->InterruptObject);
 
         while (servicingComplete == FALSE)
         {
-            TchServiceInterrupts(
-                devContext->TouchContext,
-                &devContext->I2CContext,
-                &ptpReport,
-                devContext->InputMode,
-                &servicingComplete);
+            if (!NT_SUCCESS(TchServiceInterrupts(
+                    devContext->TouchContext,
+                    &devContext->I2CContext,
+                    FALSE,
+                    NULL,
+                    NULL,
+                    TCH_MAX_REPORTS_PER_FRAME,
+                    devContext->InputMode,
+                    &reportsFilled,
+                    &servicingComplete)))
+            {
+                break;
+            }
         }
 
+        //
+        // A frame read here without a reader was held for the next one,
+        // it is just as stale
+        //
+        TchDropHeldFrame(devContext->TouchContext);
+
+        WdfInterruptReleaseLock(devContext->InterruptObject);
+
         devContext->ServiceInterruptsAfterD0Entry = FALSE;
     }
+
+    //
+    // A touch frame that arrived while no request was pending is held by
+    // the controller context, deliver it to this request now
+    //
+    if (TchHasHeldFrame(devContext->TouchContext))
+    {
+        WdfInterruptAcquireLock(devContext->InterruptObject);
+
+        (VOID) OnInterruptIsr(devContext->InterruptObject, 0);
+
+        WdfInterruptReleaseLock(devContext->InterruptObject);
+    }
     
 exit:
 
@@ -513,6 +548,28 @@ Return Value:
 			}
 			}
 
+			//
+			// Failures are traced by the controller, the switches still
+			// take effect in the interrupt path. The interrupt lock keeps
+			// register access serialized with the ISR.
+			//
+			WdfInterruptAcquireLock(devContext->InterruptObject);
+
+			TchSetReportingSwitches(
+				devContext->TouchContext,
+				&devContext->I2CContext,
+				devContext->PtpInputOn && devContext->PtpReportTouch,
+				devContext->PtpInputOn && devContext->PtpReportButton
+			);
+
+			WdfInterruptReleaseLock(devContext->InterruptObject);
+
+			//
+			// Contacts down when surface reporting went off are lifted
+			// by the lift watchdog
+			//
+			TchArmLiftWatchdog(devContext);
+
 			Trace(
 				TRACE_LEVEL_INFORMATION,
 				TRACE_DRIVER,
@@ -540,6 +597,19 @@ Return Value:
 				InputSelection->SurfaceReport
 			);
 
+			WdfInterruptAcquireLock(devContext->InterruptObject);
+
+			TchSetReportingSwitches(
+				devContext->TouchContext,
+				&devContext->I2CContext,
+				devContext->PtpInputOn && devContext->PtpReportTouch,
+				devContext->PtpInputOn && devContext->PtpReportButton
+			);
+
+			WdfInterruptReleaseLock(devContext->InterruptObject);
+
+			TchArmLiftWatchdog(devContext);
+
 			Trace(
 				TRACE_LEVEL_INFORMATION,
 				TRACE_DRIVER,
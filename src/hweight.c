@@ -1,25 +1,110 @@
 /* HWeight Linux Port */
-#include <wdm.h>
-#include <wdf.h>
+#include <compat.h>
 #include <hweight.h>
 
 
+/*
+* Population counts use CNT on ARM and ARM64, and POPCNT on x86 and x64
+* where the processor has it, the SWAR fallback otherwise. POPCNT is not
+* baseline on x86 and x64, so unless the target guarantees it (AVX builds,
+* every AVX part has POPCNT) CPUID is checked at run time.
+*/
+#if defined(_M_ARM) || defined(_M_ARM64)
+#define HWEIGHT_COUNT_ONE_BITS
+#elif defined(_M_IX86) || defined(_M_AMD64)
+#define HWEIGHT_POPCNT
+#define hweight_popcnt32(w)		__popcnt(w)
+#if defined(_M_AMD64)
+#define HWEIGHT_POPCNT64
+#define hweight_popcnt64(w)		__popcnt64(w)
+#endif
+#elif defined(__i386__) || defined(__x86_64__)
+#define HWEIGHT_POPCNT
+
+static __attribute__((target("popcnt"))) unsigned int hweight_popcnt32(unsigned int w)
+{
+	return __builtin_popcount(w);
+}
+
+#if defined(__x86_64__)
+#define HWEIGHT_POPCNT64
+
+static __attribute__((target("popcnt"))) ULONGLONG hweight_popcnt64(ULONGLONG w)
+{
+	return __builtin_popcountll(w);
+}
+#endif
+#endif
+
+#if defined(HWEIGHT_POPCNT)
+#if defined(__AVX__) || defined(__POPCNT__)
+#define hweight_has_popcnt()	1
+#elif defined(__GNUC__)
+#define hweight_has_popcnt()	__builtin_cpu_supports("popcnt")
+#else
+/*
+* CPUID.01H:ECX bit 23, read once. Callers racing on the first use store
+* the same value.
+*/
+#define HWEIGHT_POPCNT_UNKNOWN	0
+#define HWEIGHT_POPCNT_ABSENT	1
+#define HWEIGHT_POPCNT_PRESENT	2
+
+static volatile LONG hweight_popcnt_state;
+
+static __forceinline int hweight_has_popcnt(void)
+{
+	int info[4];
+	LONG state = hweight_popcnt_state;
+
+	if (state == HWEIGHT_POPCNT_UNKNOWN) {
+		__cpuid(info, 1);
+		state = (info[2] & (1 << 23)) ?
+			HWEIGHT_POPCNT_PRESENT : HWEIGHT_POPCNT_ABSENT;
+		hweight_popcnt_state = state;
+	}
+
+	return state == HWEIGHT_POPCNT_PRESENT;
+}
+#endif
+#endif
+
 unsigned int hweight32(unsigned int w)
 {
-	unsigned int res = w - ((w >> 1) & 0x55555555);
+#if defined(HWEIGHT_COUNT_ONE_BITS)
+	return _CountOneBits(w);
+#else
+	unsigned int res;
+
+#if defined(HWEIGHT_POPCNT)
+	if (hweight_has_popcnt())
+		return hweight_popcnt32(w);
+#endif
+
+	res = w - ((w >> 1) & 0x55555555);
 	res = (res & 0x33333333) + ((res >> 2) & 0x33333333);
 	res = (res + (res >> 4)) & 0x0F0F0F0F;
 	res = res + (res >> 8);
 	return (res + (res >> 16)) & 0x000000FF;
+#endif
 }
 
 ULONGLONG hweight64(ULONGLONG w)
 {
-#if ARM || X86
+#if defined(HWEIGHT_COUNT_ONE_BITS)
+	return _CountOneBits64(w);
+#elif ARM || X86 || defined(__i386__)
 	return hweight32((unsigned int)(w >> 32)) +
 		hweight32((unsigned int)w);
 #else
-	ULONGLONG res = w - ((w >> 1) & 0x5555555555555555ul);
+	ULONGLONG res;
+
+#if defined(HWEIGHT_POPCNT64)
+	if (hweight_has_popcnt())
+		return hweight_popcnt64(w);
+#endif
+
+	res = w - ((w >> 1) & 0x5555555555555555ul);
 	res = (res & 0x3333333333333333ul) + ((res >> 2) & 0x3333333333333333ul);
 	res = (res + (res >> 4)) & 0x0F0F0F0F0F0F0F0Ful;
 	res = res + (res >> 8);
@@ -20,6 +20,7 @@
 
 #include <compat.h>
 #include <rmiinternal.h>
+#include <rmitrace.h>
 #include <spb.h>
 #include <init.tmh>
 
@@ -73,7 +74,7 @@ RmiChangePage(
     {
         page = (BYTE) DesiredPage;
 
-        status = SpbWriteDataSynchronously(
+        status = RmiBusWrite(
             SpbContext,
             RMI4_PAGE_SELECT_ADDRESS,
             &page,
@@ -203,7 +204,7 @@ RmiGetFirmwareVersion(
     // TODO: Fix transfer size when SPB can support larger I2C 
     //       transactions
     //
-    status = SpbReadDataSynchronously(
+    status = RmiBusRead(
         SpbContext,
         ControllerContext->Descriptors[index].QueryBase,
         &ControllerContext->F01QueryRegisters,
@@ -290,7 +291,7 @@ RmiReadRegisterDescriptor(
 	int i;
 	int b;
 
-	Status = SpbReadDataSynchronously(
+	Status = RmiBusRead(
 		Context,
 		Address,
 		&size_presence_reg,
@@ -318,7 +319,7 @@ RmiReadRegisterDescriptor(
 	* and a bitmap which identified which packet registers are present
 	* for this particular register type (ie query, control, or data).
 	*/
-	Status = SpbReadDataSynchronously(
+	Status = RmiBusRead(
 		Context,
 		Address,
 		buf,
@@ -337,6 +338,12 @@ RmiReadRegisterDescriptor(
 		Rdesc->StructSize = buf[0];
 	}
 
+	//
+	// Descriptors are read again when the controller is reconfigured,
+	// start from an empty presence map
+	//
+	RtlZeroMemory(Rdesc->PresenceMap, sizeof(Rdesc->PresenceMap));
+
 	for (i = presense_offset; i < size_presence_reg; i++) 
 	{
 		for (b = 0; b < 8; b++) 
@@ -347,8 +354,13 @@ RmiReadRegisterDescriptor(
 	}
 
 	Rdesc->NumRegisters = (UINT8) bitmap_weight(Rdesc->PresenceMap, RMI_REG_DESC_PRESENSE_BITS);
-	Rdesc->Registers = ExAllocatePoolWithTag(
-		NonPagedPoolNx,
+
+	if (Rdesc->Registers != NULL)
+	{
+		RmiFree(Rdesc->Registers, TOUCH_POOL_TAG_F12);
+	}
+
+	Rdesc->Registers = RmiAllocate(
 		Rdesc->NumRegisters * sizeof(RMI_REGISTER_DESC_ITEM),
 		TOUCH_POOL_TAG_F12
 	);
@@ -359,13 +371,19 @@ RmiReadRegisterDescriptor(
 		goto exit;
 	}
 
+	//
+	// Subpacket maps are built up bit by bit below
+	//
+	RtlZeroMemory(
+		Rdesc->Registers,
+		Rdesc->NumRegisters * sizeof(RMI_REGISTER_DESC_ITEM));
+
 	/*
 	* Allocate a temporary buffer to hold the register structure.
 	* I'm not using devm_kzalloc here since it will not be retained
 	* after exiting this function
 	*/
-	struct_buf = ExAllocatePoolWithTag(
-		NonPagedPoolNx,
+	struct_buf = RmiAllocate(
 		Rdesc->StructSize,
 		TOUCH_POOL_TAG_F12
 	);
@@ -382,7 +400,7 @@ RmiReadRegisterDescriptor(
 	* register and a bitmap of all subpackets contained in the packet
 	* register.
 	*/
-	Status = SpbReadDataSynchronously(
+	Status = RmiBusRead(
 		Context,
 		Address,
 		struct_buf,
@@ -391,10 +409,10 @@ RmiReadRegisterDescriptor(
 
 	if (!NT_SUCCESS(Status)) goto free_buffer;
 
-	reg = find_first_bit(Rdesc->PresenceMap, RMI_REG_DESC_PRESENSE_BITS);
-	for (i = 0; i < Rdesc->NumRegisters; i++)
+	i = 0;
+	for_each_set_bit(reg, Rdesc->PresenceMap, RMI_REG_DESC_PRESENSE_BITS)
 	{
-		PRMI_REGISTER_DESC_ITEM item = &Rdesc->Registers[i];
+		PRMI_REGISTER_DESC_ITEM item = &Rdesc->Registers[i++];
 		int reg_size = struct_buf[offset];
 
 		++offset;
@@ -436,12 +454,10 @@ RmiReadRegisterDescriptor(
 			__func__,
 			item->Register, item->RegisterSize, item->NumSubPackets
 		);
-
-		reg = find_next_bit(Rdesc->PresenceMap, RMI_REG_DESC_PRESENSE_BITS, reg + 1);
 	}
 
 free_buffer:
-	ExFreePoolWithTag(
+	RmiFree(
 		struct_buf,
 		TOUCH_POOL_TAG_F12
 	);
@@ -507,19 +523,20 @@ UINT8 RmiGetRegisterIndex(
 	return Rdesc->NumRegisters;
 }
 
+static
 NTSTATUS
-RmiConfigureFunctions(
+RmiDiscoverF12Layout(
     IN RMI4_CONTROLLER_CONTEXT *ControllerContext,
-    IN SPB_CONTEXT *SpbContext
+    IN SPB_CONTEXT *SpbContext,
+    IN int Index
     )
 /*++
  
   Routine Description:
 
-    RMI4 devices such as this Synaptics touch controller are organized
-    as collections of logical functions. Discovered functions must be
-    configured, which is done in this function (things like sleep 
-    timeouts, interrupt enables, report rates, etc.)
+    Reads the F12 register descriptors from the controller and derives
+    the data packet layout from them: PacketSize, Data1Offset and
+    MaxFingers.
 
   Arguments:
 
@@ -528,45 +545,25 @@ RmiConfigureFunctions(
     
     SpbContext - A pointer to the current i2c context
 
+    Index - Descriptor table index of F12
+
   Return Value:
 
     NTSTATUS indicating success or failure
 
 --*/
 {
-    int index;
     NTSTATUS status;
 
-    RMI4_F01_CTRL_REGISTERS controlF01 = {0};
-
 	BYTE queryF12Addr = 0;
 	char buf;
 	USHORT data_offset = 0;
 	PRMI_REGISTER_DESC_ITEM item;
 
-    //
-    // Find 2D touch sensor function and configure it
-    //
-    index = RmiGetFunctionIndex(
-        ControllerContext->Descriptors,
-        ControllerContext->FunctionCount,
-        RMI4_F12_2D_TOUCHPAD_SENSOR);
-
-    if (index == ControllerContext->FunctionCount)
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Unexpected - RMI Function 12 missing");
-
-        status = STATUS_INVALID_DEVICE_STATE;
-		goto exit;
-    }
-
     status = RmiChangePage(
         ControllerContext,
         SpbContext,
-        ControllerContext->FunctionOnPage[index]);
+        ControllerContext->FunctionOnPage[Index]);
 
     if (!NT_SUCCESS(status))
     {
@@ -579,8 +576,8 @@ RmiConfigureFunctions(
     }
 
 	// Retrieve base address for queries
-	queryF12Addr = ControllerContext->Descriptors[index].QueryBase;
-	status = SpbReadDataSynchronously(
+	queryF12Addr = ControllerContext->Descriptors[Index].QueryBase;
+	status = RmiBusRead(
 		SpbContext,
 		queryF12Addr,
 		&buf,
@@ -684,12 +681,17 @@ RmiConfigureFunctions(
 	{
 		ControllerContext->Data1Offset = data_offset;
 		ControllerContext->MaxFingers = item->NumSubPackets;
-		if ((ControllerContext->MaxFingers * F12_DATA1_BYTES_PER_OBJ) > 
-			(BYTE) (ControllerContext->PacketSize - ControllerContext->Data1Offset))
+		//
+		// Packets of more than 31 objects are over 255 bytes, keep the
+		// comparison in size_t
+		//
+		if ((size_t) ControllerContext->MaxFingers * F12_DATA1_BYTES_PER_OBJ > 
+			ControllerContext->PacketSize - ControllerContext->Data1Offset)
 		{
-			ControllerContext->MaxFingers = 
-				(BYTE) (ControllerContext->PacketSize - ControllerContext->Data1Offset) / 
-				F12_DATA1_BYTES_PER_OBJ;
+			ControllerContext->MaxFingers = (BYTE) min(
+				(ControllerContext->PacketSize - ControllerContext->Data1Offset) / 
+					F12_DATA1_BYTES_PER_OBJ,
+				RMI4_MAX_TOUCHES);
 		}
 
 		if (ControllerContext->MaxFingers > RMI4_MAX_TOUCHES)
@@ -703,6 +705,108 @@ RmiConfigureFunctions(
 		goto exit;
 	}
 
+exit:
+
+    return status;
+}
+
+NTSTATUS
+RmiConfigureFunctions(
+    IN RMI4_CONTROLLER_CONTEXT *ControllerContext,
+    IN SPB_CONTEXT *SpbContext
+    )
+/*++
+ 
+  Routine Description:
+
+    RMI4 devices such as this Synaptics touch controller are organized
+    as collections of logical functions. Discovered functions must be
+    configured, which is done in this function (things like sleep 
+    timeouts, interrupt enables, report rates, etc.)
+
+  Arguments:
+
+    ControllerContext - A pointer to the current touch controller
+    context
+    
+    SpbContext - A pointer to the current i2c context
+
+  Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    int index;
+    NTSTATUS status;
+
+    RMI4_F01_CTRL_REGISTERS controlF01 = {0};
+
+    //
+    // Find 2D touch sensor function and configure it
+    //
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    if (index == ControllerContext->FunctionCount)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Unexpected - RMI Function 12 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+		goto exit;
+    }
+
+	//
+	// The register layout is already known when it was taken from a
+	// firmware profile, see rmiprofile.h
+	//
+	if (!ControllerContext->LayoutFromProfile)
+	{
+		status = RmiDiscoverF12Layout(
+			ControllerContext,
+			SpbContext,
+			index);
+
+		if (!NT_SUCCESS(status))
+		{
+			goto exit;
+		}
+	}
+
+	//
+	// Allocate the packet buffer of the touch pipeline once, it is only
+	// replaced if the packet grew
+	//
+	if (ControllerContext->FramePacketSize < ControllerContext->PacketSize)
+	{
+		BYTE* packet;
+
+		packet = RmiAllocate(
+			ControllerContext->PacketSize,
+			TOUCH_POOL_TAG_F12);
+
+		if (packet == NULL)
+		{
+			status = STATUS_INSUFFICIENT_RESOURCES;
+			goto exit;
+		}
+
+		if (ControllerContext->Frame.Packet != NULL)
+		{
+			RmiFree(
+				ControllerContext->Frame.Packet,
+				TOUCH_POOL_TAG_F12);
+		}
+
+		ControllerContext->Frame.Packet = packet;
+		ControllerContext->FramePacketSize = ControllerContext->PacketSize;
+	}
+
     //
     // Find 0D capacitive button sensor function and configure it if it exists
     //
@@ -761,10 +865,15 @@ RmiConfigureFunctions(
         &ControllerContext->Config.DeviceSettings,
         &controlF01);	
 
+    //
+    // Only let the controller raise interrupts we have handlers for
+    //
+    controlF01.InterruptEnable &= ControllerContext->InterruptEnableMask;
+
     //
     // Write settings to controller
     //
-    status = SpbWriteDataSynchronously(
+    status = RmiBusWrite(
         SpbContext,
         ControllerContext->Descriptors[index].ControlBase,
         &controlF01,
@@ -782,12 +891,33 @@ RmiConfigureFunctions(
     }
 
     //
-    // Try to set continuous reporting mode during touch
+    // The controller starts out at the configured report rate, dynamic
+    // burst mode will raise it again once motion is detected
+    //
+    ControllerContext->HighReportRate = FALSE;
+    ControllerContext->BurstQuietFrames = 0;
+    ControllerContext->PreWakeActive = FALSE;
+    ControllerContext->CoverSuspended = FALSE;
+    ControllerContext->PalmRejectedSlots = 0;
+    ControllerContext->EdgeHeldSlots = 0;
+    ControllerContext->Filter.SlotValid = 0;
+    ControllerContext->PacingHeldSince = 0;
+    ControllerContext->LiftConfirmedTime = 0;
+    ControllerContext->FrameReady = FALSE;
+    ControllerContext->FrameHeld = FALSE;
+    ControllerContext->ReconfigurePending = FALSE;
+    ControllerContext->DeviceControlWrite.Pending = 0;
+
+    //
+    // Try to set continuous reporting mode during touch, the controller
+    // only needs to report changes while the host has surface input off
     //
     RmiSetReportingMode(
         ControllerContext,
         SpbContext,
-        RMI_F12_REPORTING_MODE_CONTINUOUS,
+        ControllerContext->SurfaceReportingOn ?
+            RMI_F12_REPORTING_MODE_CONTINUOUS :
+            RMI_F12_REPORTING_MODE_REDUCED,
         NULL);
 
     //
@@ -810,6 +940,120 @@ exit:
     return status;
 }
 
+NTSTATUS
+RmiAssignFunctionInterrupts(
+    IN RMI4_CONTROLLER_CONTEXT *ControllerContext
+    )
+/*++
+ 
+  Routine Description:
+
+    Works out the interrupt status bits owned by each function in the
+    table, and the subset of them the driver enables. Only the bits of
+    the F01 InterruptStatus register the driver reads can be assigned,
+    functions whose bits lie past them are left without interrupts.
+
+  Arguments:
+
+    ControllerContext - A pointer to the current touch controller context
+
+  Return Value:
+
+    NTSTATUS indicating success or failure, failure if F01 or F12 could
+    not be assigned their interrupt bits
+
+--*/
+{
+    int function;
+    int irqBit;
+    int irqCount;
+    NTSTATUS status;
+
+    //
+    // Interrupt status bits are handed out to functions in the order they
+    // appear in the PDT, each function owning IrqCount consecutive bits
+    //
+    irqBit = 0;
+
+    for (function = 0; function < ControllerContext->FunctionCount; function++)
+    {
+        irqCount = ControllerContext->Descriptors[function].VersionIrq.IrqCount;
+
+        if (irqBit + irqCount > RMI4_F01_INTERRUPT_BITS)
+        {
+            Trace(
+                TRACE_LEVEL_WARNING,
+                TRACE_INIT,
+                "Function $%x interrupt bits %d-%d are past the %d F01 "
+                "interrupt status bits, not serviced",
+                ControllerContext->Descriptors[function].Number,
+                irqBit,
+                irqBit + irqCount - 1,
+                RMI4_F01_INTERRUPT_BITS);
+
+            ControllerContext->FunctionInterruptMask[function] = 0;
+        }
+        else
+        {
+            ControllerContext->FunctionInterruptMask[function] =
+                (BYTE) (((1U << irqCount) - 1) << irqBit);
+        }
+
+        irqBit += irqCount;
+
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_INIT,
+            "Function $%x owns interrupt mask 0x%x",
+            ControllerContext->Descriptors[function].Number,
+            ControllerContext->FunctionInterruptMask[function]);
+    }
+
+    //
+    // Without their interrupts the driver cannot service the controller
+    //
+    if (RmiGetFunctionInterruptMask(
+            ControllerContext,
+            RMI4_F01_RMI_DEVICE_CONTROL) == 0 ||
+        RmiGetFunctionInterruptMask(
+            ControllerContext,
+            RMI4_F12_2D_TOUCHPAD_SENSOR) == 0)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error, F01 or F12 owns no interrupt status bit");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    //
+    // Enable interrupts only for functions the driver services: F01 for
+    // device status changes and F12 for touch data, unless the host has
+    // switched surface reporting off. F1A buttons have no handler and
+    // would only wake us up for nothing.
+    //
+    ControllerContext->InterruptEnableMask =
+        RmiGetFunctionInterruptMask(
+            ControllerContext,
+            RMI4_F01_RMI_DEVICE_CONTROL);
+
+    if (ControllerContext->SurfaceReportingOn)
+    {
+        ControllerContext->InterruptEnableMask |=
+            RmiGetFunctionInterruptMask(
+                ControllerContext,
+                RMI4_F12_2D_TOUCHPAD_SENSOR);
+    }
+
+    status = STATUS_SUCCESS;
+
+exit:
+
+    return status;
+}
+
 NTSTATUS
 RmiBuildFunctionsTable(
     IN RMI4_CONTROLLER_CONTEXT *ControllerContext,
@@ -841,7 +1085,6 @@ RmiBuildFunctionsTable(
     int page;
     NTSTATUS status;
 
-
     //
     // First function is at a fixed address 
     //
@@ -857,7 +1100,7 @@ RmiBuildFunctionsTable(
         //
         // Read function descriptor
         //
-        status = SpbReadDataSynchronously(
+        status = RmiBusRead(
             SpbContext,
             address,
             &ControllerContext->Descriptors[function],
@@ -962,6 +1205,13 @@ RmiBuildFunctionsTable(
     //
     ControllerContext->FunctionCount = function;
 
+    status = RmiAssignFunctionInterrupts(ControllerContext);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
     Trace(
         TRACE_LEVEL_VERBOSE,
         TRACE_INIT,
@@ -1045,7 +1295,7 @@ RmiCheckInterrupts(
     //
     // Read interrupt status registers
     //
-    status = SpbReadDataSynchronously(
+    status = RmiBusRead(
         SpbContext,
         ControllerContext->Descriptors[index].DataBase,
         &data,
@@ -1059,9 +1309,31 @@ RmiCheckInterrupts(
             "Error reading interrupt status - %!STATUS!",
             status);
 
+        RmiNoteFault(ControllerContext, RMI4_FAULT_BUS);
         goto exit;
     }
 
+#if DBG
+    //
+    // A spontaneous reset also drops the configuration
+    //
+    if (RmiInjectFault(ControllerContext, ControllerContext->Config.FaultResetRate))
+    {
+        data.DeviceStatus.Status = RMI4_F01_DATA_STATUS_RESET_OCCURRED;
+        data.DeviceStatus.Unconfigured = 1;
+    }
+    else if (RmiInjectFault(ControllerContext, ControllerContext->Config.FaultUnconfiguredRate))
+    {
+        data.DeviceStatus.Unconfigured = 1;
+    }
+#endif
+
+    RmiTraceCaptureRecord(
+        ControllerContext,
+        RMI_TRACE_RECORD_F01_STATUS,
+        &data,
+        sizeof(data));
+
     //
     // Check for catastrophic failures, simply store in context for
     // debugging should these errors occur.
@@ -1075,6 +1347,7 @@ RmiCheckInterrupts(
         case RMI4_F01_DATA_STATUS_RESET_OCCURRED:
         {
             ControllerContext->ResetOccurred = TRUE;
+            RmiNoteFault(ControllerContext, RMI4_FAULT_RESET);
             break;
         }
         case RMI4_F01_DATA_STATUS_INVALID_CONFIG:
@@ -1128,7 +1401,9 @@ RmiCheckInterrupts(
     }
 
     //
-    // If the chip has lost it's configuration, reconfigure
+    // If the chip has lost it's configuration, have it reconfigured. That
+    // resets touch state, so it is left to the delivery stage of interrupt
+    // servicing, which holds ControllerLock.
     //
     if (data.DeviceStatus.Unconfigured)
     {
@@ -1137,21 +1412,9 @@ RmiCheckInterrupts(
             TRACE_INTERRUPT,
             "Error, device status indicates chip is unconfigured");
 
-        status = RmiConfigureFunctions(
-            ControllerContext,
-            SpbContext);
-
-        if (!NT_SUCCESS(status))
-        {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_INTERRUPT,
-                "Could not reconfigure chip - %!STATUS!",
-                status);
-
-            goto exit;
-        }
+        RmiNoteFault(ControllerContext, RMI4_FAULT_UNCONFIGURED);
 
+        ControllerContext->ReconfigurePending = TRUE;
     }
 
     if (data.InterruptStatus[0])
@@ -1170,74 +1433,236 @@ exit:
     return status;
 }
 
-NTSTATUS
-RmiSetReportingMode(
+BYTE
+RmiGetFunctionInterruptMask(
     IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
-    IN SPB_CONTEXT *SpbContext,
-    IN UCHAR NewMode,
-    OUT UCHAR *OldMode
+    IN int FunctionNumber
 )
 /*++
 
 Routine Description:
 
-Changes the F12 Reporting Mode on the controller as specified
+Returns the interrupt status bits owned by an RMI function
 
 Arguments:
 
 ControllerContext - Touch controller context
 
-SpbContext - A pointer to the current i2c context
-
-NewMode - Either RMI_F12_REPORTING_MODE_CONTINUOUS
-          or RMI_F12_REPORTING_MODE_REDUCED
-
-OldMode - Old value of reporting mode
+FunctionNumber - The RMI function number, e.g. RMI4_F12_2D_TOUCHPAD_SENSOR
 
 Return Value:
 
-NTSTATUS indicating success or failure
+The interrupt mask, or 0 if the function is not present
 
 --*/
 {
-    UCHAR reportingControl[3];
     int index;
-    NTSTATUS status;
-    UINT8 indexCtrl20;
 
-    //
-    // Find RMI F12 function
-    //
     index = RmiGetFunctionIndex(
         ControllerContext->Descriptors,
         ControllerContext->FunctionCount,
-        RMI4_F12_2D_TOUCHPAD_SENSOR);
+        FunctionNumber);
 
     if (index == ControllerContext->FunctionCount)
     {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Set ReportingMode failure - RMI Function 12 missing");
-
-        status = STATUS_INVALID_DEVICE_STATE;
-        goto exit;
+        return 0;
     }
 
-    status = RmiChangePage(
-        ControllerContext,
-        SpbContext,
-        ControllerContext->FunctionOnPage[index]);
-
-    if (!NT_SUCCESS(status))
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Could not change register page");
-
-        goto exit;
-    }
+    return ControllerContext->FunctionInterruptMask[index];
+}
+
+NTSTATUS
+RmiEnableFunctionInterrupts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN int FunctionNumber,
+    IN BOOLEAN Enable
+)
+/*++
+
+Routine Description:
+
+Enables or disables the interrupt sources of an RMI function and
+reprograms the F01 InterruptEnable register accordingly
+
+Arguments:
+
+ControllerContext - Touch controller context
+
+SpbContext - A pointer to the current i2c context
+
+FunctionNumber - The RMI function whose handler is being enabled or disabled
+
+Enable - TRUE if the driver services interrupts from this function
+
+Return Value:
+
+NTSTATUS indicating success or failure
+
+--*/
+{
+    BYTE functionMask;
+    BYTE enableMask;
+    BYTE interruptEnable;
+    int index;
+    NTSTATUS status;
+
+    functionMask = RmiGetFunctionInterruptMask(
+        ControllerContext,
+        FunctionNumber);
+
+    if (Enable)
+    {
+        enableMask = (BYTE) (ControllerContext->InterruptEnableMask | functionMask);
+    }
+    else
+    {
+        enableMask = (BYTE) (ControllerContext->InterruptEnableMask & ~functionMask);
+    }
+
+    if (enableMask == ControllerContext->InterruptEnableMask)
+    {
+        status = STATUS_SUCCESS;
+        goto exit;
+    }
+
+    //
+    // Find RMI device control function housing the interrupt enable register
+    //
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    if (index == ControllerContext->FunctionCount)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Set InterruptEnable failure - RMI Function 01 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not change register page");
+
+        goto exit;
+    }
+
+    interruptEnable = (BYTE) (LOGICAL_TO_PHYSICAL(
+        ControllerContext->Config.DeviceSettings.InterruptEnable) & enableMask);
+
+    status = RmiBusWrite(
+        SpbContext,
+        ControllerContext->Descriptors[index].ControlBase +
+            FIELD_OFFSET(RMI4_F01_CTRL_REGISTERS, InterruptEnable),
+        &interruptEnable,
+        sizeof(interruptEnable)
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not write F01 InterruptEnable register - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+    ControllerContext->InterruptEnableMask = enableMask;
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "Programmed interrupt enable 0x%x",
+        interruptEnable);
+
+exit:
+
+    return status;
+}
+
+NTSTATUS
+RmiSetReportingMode(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR NewMode,
+    OUT UCHAR *OldMode
+)
+/*++
+
+Routine Description:
+
+Changes the F12 Reporting Mode on the controller as specified
+
+Arguments:
+
+ControllerContext - Touch controller context
+
+SpbContext - A pointer to the current i2c context
+
+NewMode - Either RMI_F12_REPORTING_MODE_CONTINUOUS
+          or RMI_F12_REPORTING_MODE_REDUCED
+
+OldMode - Old value of reporting mode
+
+Return Value:
+
+NTSTATUS indicating success or failure
+
+--*/
+{
+    UCHAR reportingControl[3];
+    int index;
+    NTSTATUS status;
+    UINT8 indexCtrl20;
+
+    //
+    // Find RMI F12 function
+    //
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    if (index == ControllerContext->FunctionCount)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Set ReportingMode failure - RMI Function 12 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not change register page");
+
+        goto exit;
+    }
 
     indexCtrl20 = RmiGetRegisterIndex(&ControllerContext->ControlRegDesc, F12_2D_CTRL20);
 
@@ -1266,7 +1691,7 @@ NTSTATUS indicating success or failure
     //
     // Read Device Control register
     //
-    status = SpbReadDataSynchronously(
+    status = RmiBusRead(
         SpbContext,
         ControllerContext->Descriptors[index].ControlBase + indexCtrl20,
         &reportingControl,
@@ -1284,9 +1709,12 @@ NTSTATUS indicating success or failure
         goto exit;
     }
 
+    ControllerContext->ReportingMode =
+        (UCHAR) (reportingControl[0] & RMI_F12_REPORTING_MODE_MASK);
+
     if (OldMode)
     {
-        *OldMode = reportingControl[0] & RMI_F12_REPORTING_MODE_MASK;
+        *OldMode = ControllerContext->ReportingMode;
     }
 
     //
@@ -1298,7 +1726,7 @@ NTSTATUS indicating success or failure
     //
     // Write setting back to the controller
     //
-    status = SpbWriteDataSynchronously(
+    status = RmiBusWrite(
         SpbContext,
         ControllerContext->Descriptors[index].ControlBase + indexCtrl20,
         &reportingControl,
@@ -1316,6 +1744,242 @@ NTSTATUS indicating success or failure
         goto exit;
     }
 
+    ControllerContext->ReportingMode = (UCHAR) (NewMode & RMI_F12_REPORTING_MODE_MASK);
+
+exit:
+
+    return status;
+}
+
+NTSTATUS
+RmiSetReportRate(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR ReportRate
+)
+/*++
+
+Routine Description:
+
+Changes the F01 ReportRate bit on the controller as specified
+
+Arguments:
+
+ControllerContext - Touch controller context
+
+SpbContext - A pointer to the current i2c context
+
+ReportRate - Either RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD
+             or RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH
+
+Return Value:
+
+NTSTATUS indicating success or failure
+
+--*/
+{
+    RMI4_F01_CTRL_REGISTERS controlF01;
+    int index;
+    NTSTATUS status;
+
+    //
+    // Find RMI device control function housing report rate settings
+    //
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    if (index == ControllerContext->FunctionCount)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Set ReportRate failure - RMI Function 01 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not change register page");
+
+        goto exit;
+    }
+
+    //
+    // Read Device Control register
+    //
+    status = RmiBusRead(
+        SpbContext,
+        ControllerContext->Descriptors[index].ControlBase,
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not read F01 device control register - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+    //
+    // Assign new report rate
+    //
+    controlF01.DeviceControl.ReportRate = ReportRate;
+
+    //
+    // Write setting back to the controller
+    //
+    status = RmiBusWrite(
+        SpbContext,
+        ControllerContext->Descriptors[index].ControlBase,
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not write F01 device control register - %X",
+            status);
+
+        goto exit;
+    }
+
+exit:
+
+    return status;
+}
+
+NTSTATUS
+RmiSetNoSleep(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN NoSleep
+)
+/*++
+
+Routine Description:
+
+Changes the F01 NoSleep bit on the controller as specified. Setting it
+keeps the controller from dozing between touches.
+
+Arguments:
+
+ControllerContext - Touch controller context
+
+SpbContext - A pointer to the current i2c context
+
+NoSleep - TRUE to disable doze, FALSE to allow it
+
+Return Value:
+
+NTSTATUS indicating success or failure
+
+--*/
+{
+    RMI4_F01_CTRL_REGISTERS controlF01;
+    int index;
+    NTSTATUS status;
+
+    //
+    // Find RMI device control function housing doze settings
+    //
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    if (index == ControllerContext->FunctionCount)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Set NoSleep failure - RMI Function 01 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not change register page");
+
+        goto exit;
+    }
+
+    //
+    // Read Device Control register
+    //
+    status = RmiBusRead(
+        SpbContext,
+        ControllerContext->Descriptors[index].ControlBase,
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not read F01 device control register - %!STATUS!",
+            status);
+
+        goto exit;
+    }
+
+    //
+    // Assign new doze setting
+    //
+    controlF01.DeviceControl.NoSleep = NoSleep ? 1 : 0;
+
+    //
+    // Write setting back to the controller
+    //
+    status = RmiBusWrite(
+        SpbContext,
+        ControllerContext->Descriptors[index].ControlBase,
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
+    );
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not write F01 device control register - %X",
+            status);
+
+        goto exit;
+    }
+
 exit:
 
     return status;
@@ -1354,21 +2018,39 @@ TchStartDevice(
     interruptStatus = 0;
     status = STATUS_SUCCESS;
 
+#if DBG
+    SpbContext->FaultInjection.NackRate = controller->Config.FaultNackRate;
+    SpbContext->FaultInjection.ShortReadRate = controller->Config.FaultShortReadRate;
+    SpbContext->FaultInjection.Seed = (ULONG) RmiQueryTime();
+    controller->FaultSeed = SpbContext->FaultInjection.Seed ^ TOUCH_POOL_TAG;
+#endif
+
     //
-    // Populate context with RMI function descriptors
+    // Take the function table and F12 register layout from a compiled-in
+    // firmware profile when the product ID matches one
     //
-    status = RmiBuildFunctionsTable(
+    status = RmiApplyFirmwareProfile(
         ControllerContext,
         SpbContext);
 
     if (!NT_SUCCESS(status))
     {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Could not build table of RMI functions - %!STATUS!",
-            status);
-        goto exit;
+        //
+        // Populate context with RMI function descriptors
+        //
+        status = RmiBuildFunctionsTable(
+            ControllerContext,
+            SpbContext);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INIT,
+                "Could not build table of RMI functions - %!STATUS!",
+                status);
+            goto exit;
+        }
     }
 
     //
@@ -1388,6 +2070,15 @@ TchStartDevice(
         goto exit;
     }
 
+    if (!controller->LayoutFromProfile)
+    {
+        RmiTraceFirmwareProfile(
+            ControllerContext,
+            SpbContext);
+    }
+
+    RmiTraceCaptureStart(ControllerContext);
+
     //
     // Read and store the firmware version
     //
@@ -1419,7 +2110,7 @@ TchStartDevice(
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_INIT,
-            "Could not get interrupt status - %!STATUS!%",
+            "Could not get interrupt status - %!STATUS!",
             status);
     }
 
@@ -1452,10 +2143,12 @@ Return Value:
 {
     RMI4_CONTROLLER_CONTEXT* controller;
 
-    UNREFERENCED_PARAMETER(SpbContext);
-
     controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
 
+    RmiTraceServiceCounters(controller);
+    SpbTraceStatistics(SpbContext);
+    RmiTraceCaptureFlush(controller);
+
     return STATUS_SUCCESS;
 }
 
@@ -1483,8 +2176,7 @@ Return Value:
     RMI4_CONTROLLER_CONTEXT* context;
     NTSTATUS status;
 
-    context = ExAllocatePoolWithTag(
-        NonPagedPoolNx,
+    context = RmiAllocate(
         sizeof(RMI4_CONTROLLER_CONTEXT),
         TOUCH_POOL_TAG);
 
@@ -1502,18 +2194,22 @@ Return Value:
     RtlZeroMemory(context, sizeof(RMI4_CONTROLLER_CONTEXT));
     context->FxDevice = FxDevice;
 
+    //
+    // Report everything until the host selects otherwise
+    //
+    context->SurfaceReportingOn = TRUE;
+    context->ButtonReportingOn = TRUE;
+
     //
     // Get screen properties and populate context
     //
     TchGetScreenProperties(&context->Props);
 
     //
-    // Allocate a WDFWAITLOCK for guarding access to the
+    // Allocate a lock for guarding access to the
     // controller HW and driver controller context
     //
-    status = WdfWaitLockCreate(
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &context->ControllerLock);
+    status = RmiLockCreate(&context->ControllerLock);
 
     if (!NT_SUCCESS(status))
     {
@@ -1563,10 +2259,35 @@ Return Value:
 
         if (controller->ControllerLock != NULL)
         {
-            WdfObjectDelete(controller->ControllerLock);
+            RmiLockDelete(controller->ControllerLock);
+        }
+
+        if (controller->Frame.Packet != NULL)
+        {
+            RmiFree(controller->Frame.Packet, TOUCH_POOL_TAG_F12);
+        }
+
+        if (controller->TraceBuffer != NULL)
+        {
+            RmiFree(controller->TraceBuffer, TOUCH_POOL_TAG);
+        }
+
+        if (controller->QueryRegDesc.Registers != NULL)
+        {
+            RmiFree(controller->QueryRegDesc.Registers, TOUCH_POOL_TAG_F12);
+        }
+
+        if (controller->ControlRegDesc.Registers != NULL)
+        {
+            RmiFree(controller->ControlRegDesc.Registers, TOUCH_POOL_TAG_F12);
+        }
+
+        if (controller->DataRegDesc.Registers != NULL)
+        {
+            RmiFree(controller->DataRegDesc.Registers, TOUCH_POOL_TAG_F12);
         }
 
-        ExFreePoolWithTag(controller, TOUCH_POOL_TAG);
+        RmiFree(controller, TOUCH_POOL_TAG);
     }
     
     return STATUS_SUCCESS;
@@ -51,13 +51,10 @@ Return Value:
 
 --*/
 {
-    RMI4_F01_CTRL_REGISTERS* controlF01;
-    UCHAR deviceControl;
+    RMI4_F01_CTRL_REGISTERS controlF01;
     int index;
     NTSTATUS status;
 
-    controlF01 = (RMI4_F01_CTRL_REGISTERS*) &deviceControl;
-
     //
     // Find RMI device control function housing sleep settings
     // 
@@ -95,11 +92,11 @@ Return Value:
     //
     // Read Device Control register
     //
-    status = SpbReadDataSynchronously(
+    status = RmiBusRead(
         SpbContext,
         ControllerContext->Descriptors[index].ControlBase,
-        &deviceControl,
-        sizeof(deviceControl)
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
         );
 
     if (!NT_SUCCESS(status))
@@ -116,16 +113,16 @@ Return Value:
     //
     // Assign new sleep state
     //
-    controlF01->DeviceControl.SleepMode = SleepState;
+    controlF01.DeviceControl.SleepMode = SleepState;
 
     //
     // Write setting back to the controller
     //
-    status = SpbWriteDataSynchronously(
+    status = RmiBusWrite(
         SpbContext,
         ControllerContext->Descriptors[index].ControlBase,
-        &deviceControl,
-        sizeof(deviceControl)
+        &controlF01.DeviceControl.All,
+        sizeof(controlF01.DeviceControl.All)
         );
 
     if (!NT_SUCCESS(status))
@@ -237,7 +234,7 @@ Return Value:
     // executing, so grab the controller lock to ensure ISR
     // is finished touching HW and controller state.
     //
-    WdfWaitLockAcquire(controller->ControllerLock, NULL);
+    RmiLockAcquire(controller->ControllerLock);
 
     //
     // Put the chip in sleep mode
@@ -266,8 +263,35 @@ Return Value:
     controller->Cache.FingerSlotValid = 0;
     controller->Cache.FingerSlotDirty = 0;
     controller->Cache.FingerDownCount = 0;
+    controller->PalmRejectedSlots = 0;
+    controller->EdgeHeldSlots = 0;
+    controller->Filter.SlotValid = 0;
+    controller->PacingHeldSince = 0;
+    controller->LiftConfirmedTime = 0;
+    controller->FrameReady = FALSE;
+    controller->FrameHeld = FALSE;
+    controller->ContactsDown = FALSE;
+    controller->DeviceControlWrite.Pending = 0;
+
+    //
+    // Drop a pending hover pre-wake so doze is back to its configured
+    // setting when the controller wakes up again
+    //
+    if (controller->PreWakeActive)
+    {
+        RmiSetNoSleep(
+            controller,
+            SpbContext,
+            controller->Config.DeviceSettings.NoSleep != 0);
+
+        controller->PreWakeActive = FALSE;
+        controller->PreWakeSince = 0;
+    }
+
+    RmiTraceServiceCounters(controller);
+    SpbTraceStatistics(SpbContext);
 
-    WdfWaitLockRelease(controller->ControllerLock);
+    RmiLockRelease(controller->ControllerLock);
 
     return STATUS_SUCCESS;
 }
\ No newline at end of file
@@ -28,6 +28,10 @@
 // Default RMI4 configuration values can be changed here. Please refer to the
 // RMI4 specification for a full description of the fields and value meanings
 //
+// The defaults and the registry table are shared by every controller
+// instance and must stay read-only. Each instance reads its settings into
+// its own RMI4_CONFIGURATION, through a private copy of the table.
+//
 
 static RMI4_CONFIGURATION gDefaultConfiguration =
 {
@@ -91,12 +95,82 @@ static RMI4_CONFIGURATION gDefaultConfiguration =
     //
     // Internal driver settings
     //
+    0x0,                                                // Controller stays powered in D3
+
+    //
+    // Dynamic report rate settings
+    //
+    {
+        0,                                              // Burst report rate disabled
+        40,                                             // Enter velocity (units/frame)
+        16,                                             // Exit velocity (units/frame)
+        30,                                             // Frames below exit velocity
+    },
+
+    //
+    // Hover pre-wake settings
+    //
     {
-        0x0,                                            // Controller stays powered in D3
+        0,                                              // Hover pre-wake disabled
     },
+
+    0,                                                  // Suspend reporting under a cover, disabled
+
+    //
+    // Palm rejection settings
+    //
+    {
+        0,                                              // Palm rejection disabled
+        10,                                             // Palm width threshold
+        200,                                            // Reject radius around palms
+    },
+
+    //
+    // Jitter suppression settings
+    //
+    {
+        0,                                              // Deadband (sensor units), disabled
+        0,                                              // Elide stationary frames
+    },
+
+    //
+    // 1-euro filter settings
+    //
+    {
+        0,                                              // Filter disabled
+        1000,                                           // Min cutoff (mHz)
+        7,                                              // Beta (mHz per unit/s)
+        1000,                                           // Derivative cutoff (mHz)
+    },
+
+    //
+    // Motion prediction settings
+    //
+    {
+        0,                                              // Horizon (ms), disabled
+        100,                                            // Max distance (sensor units)
+    },
+
+    0,                                                  // Lift timeout (ms), disabled
+    0,                                                  // Pacing rate (Hz), disabled
+    0,                                                  // Touch trace size (KB), disabled
+    16384,                                              // Touch trace file size (KB) before rotation
+    0,                                                  // Hot path profiling, disabled
+    0,                                                  // Modeled clock stretching (ns per transaction)
+
+#if DBG
+    0,                                                  // NACK injection rate (1 in N), disabled
+    0,                                                  // Short read injection rate (1 in N), disabled
+    0,                                                  // Reset injection rate (1 in N), disabled
+    0,                                                  // Unconfigured injection rate (1 in N), disabled
+    RMI4_SYNTHETIC_OFF,                                 // Synthetic workload model
+    10,                                                 // Synthetic contacts
+    120,                                                // Synthetic scan rate (Hz)
+    1 << RMI_F12_OBJECT_FINGER,                         // Synthetic object type mix
+#endif
 };
 
-RTL_QUERY_REGISTRY_TABLE gRegistryTable[] =
+static const RTL_QUERY_REGISTRY_TABLE gRegistryTable[] =
 {
     //
     // RMI4 F01 - Device control settings
@@ -527,6 +601,324 @@ RTL_QUERY_REGISTRY_TABLE gRegistryTable[] =
         sizeof(UINT32)
     },
 
+    //
+    // Dynamic report rate settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"BurstReportRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, ReportRateSettings) + 
+            FIELD_OFFSET(RMI4_REPORT_RATE_SETTINGS_LOGICAL, BurstEnable)),
+        REG_DWORD,
+        &gDefaultConfiguration.ReportRateSettings.BurstEnable,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"BurstEnterVelocity",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, ReportRateSettings) + 
+            FIELD_OFFSET(RMI4_REPORT_RATE_SETTINGS_LOGICAL, BurstEnterVelocity)),
+        REG_DWORD,
+        &gDefaultConfiguration.ReportRateSettings.BurstEnterVelocity,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"BurstExitVelocity",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, ReportRateSettings) + 
+            FIELD_OFFSET(RMI4_REPORT_RATE_SETTINGS_LOGICAL, BurstExitVelocity)),
+        REG_DWORD,
+        &gDefaultConfiguration.ReportRateSettings.BurstExitVelocity,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"BurstExitFrames",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, ReportRateSettings) + 
+            FIELD_OFFSET(RMI4_REPORT_RATE_SETTINGS_LOGICAL, BurstExitFrames)),
+        REG_DWORD,
+        &gDefaultConfiguration.ReportRateSettings.BurstExitFrames,
+        sizeof(UINT32)
+    },
+
+    //
+    // Hover pre-wake settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"HoverPreWake",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PreWakeSettings) + 
+            FIELD_OFFSET(RMI4_PREWAKE_SETTINGS_LOGICAL, HoverPreWake)),
+        REG_DWORD,
+        &gDefaultConfiguration.PreWakeSettings.HoverPreWake,
+        sizeof(UINT32)
+    },
+
+    //
+    // Cover suspend
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"CoverSuspend",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, CoverSuspend)),
+        REG_DWORD,
+        &gDefaultConfiguration.CoverSuspend,
+        sizeof(UINT32)
+    },
+
+    //
+    // Palm rejection settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmRejection",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PalmSettings) + 
+            FIELD_OFFSET(RMI4_PALM_SETTINGS_LOGICAL, PalmRejection)),
+        REG_DWORD,
+        &gDefaultConfiguration.PalmSettings.PalmRejection,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmWidthThreshold",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PalmSettings) + 
+            FIELD_OFFSET(RMI4_PALM_SETTINGS_LOGICAL, PalmWidthThreshold)),
+        REG_DWORD,
+        &gDefaultConfiguration.PalmSettings.PalmWidthThreshold,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PalmRejectRadius",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PalmSettings) + 
+            FIELD_OFFSET(RMI4_PALM_SETTINGS_LOGICAL, PalmRejectRadius)),
+        REG_DWORD,
+        &gDefaultConfiguration.PalmSettings.PalmRejectRadius,
+        sizeof(UINT32)
+    },
+
+    //
+    // Jitter suppression settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"Deadband",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, JitterSettings) + 
+            FIELD_OFFSET(RMI4_JITTER_SETTINGS_LOGICAL, Deadband)),
+        REG_DWORD,
+        &gDefaultConfiguration.JitterSettings.Deadband,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"ElideStationaryFrames",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, JitterSettings) + 
+            FIELD_OFFSET(RMI4_JITTER_SETTINGS_LOGICAL, ElideStationaryFrames)),
+        REG_DWORD,
+        &gDefaultConfiguration.JitterSettings.ElideStationaryFrames,
+        sizeof(UINT32)
+    },
+
+    //
+    // 1-euro filter settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"OneEuroFilter",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FilterSettings) + 
+            FIELD_OFFSET(RMI4_FILTER_SETTINGS_LOGICAL, OneEuroFilter)),
+        REG_DWORD,
+        &gDefaultConfiguration.FilterSettings.OneEuroFilter,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"OneEuroMinCutoff",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FilterSettings) + 
+            FIELD_OFFSET(RMI4_FILTER_SETTINGS_LOGICAL, MinCutoff)),
+        REG_DWORD,
+        &gDefaultConfiguration.FilterSettings.MinCutoff,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"OneEuroBeta",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FilterSettings) + 
+            FIELD_OFFSET(RMI4_FILTER_SETTINGS_LOGICAL, Beta)),
+        REG_DWORD,
+        &gDefaultConfiguration.FilterSettings.Beta,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"OneEuroDerivativeCutoff",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FilterSettings) + 
+            FIELD_OFFSET(RMI4_FILTER_SETTINGS_LOGICAL, DerivativeCutoff)),
+        REG_DWORD,
+        &gDefaultConfiguration.FilterSettings.DerivativeCutoff,
+        sizeof(UINT32)
+    },
+
+    //
+    // Motion prediction settings
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PredictionHorizon",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PredictionSettings) + 
+            FIELD_OFFSET(RMI4_PREDICTION_SETTINGS_LOGICAL, PredictionHorizon)),
+        REG_DWORD,
+        &gDefaultConfiguration.PredictionSettings.PredictionHorizon,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PredictionMaxDistance",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PredictionSettings) + 
+            FIELD_OFFSET(RMI4_PREDICTION_SETTINGS_LOGICAL, PredictionMaxDistance)),
+        REG_DWORD,
+        &gDefaultConfiguration.PredictionSettings.PredictionMaxDistance,
+        sizeof(UINT32)
+    },
+
+    //
+    // Lift watchdog
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"LiftTimeout",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, LiftTimeout)),
+        REG_DWORD,
+        &gDefaultConfiguration.LiftTimeout,
+        sizeof(UINT32)
+    },
+
+    //
+    // Frame pacing
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"PacingRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, PacingRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.PacingRate,
+        sizeof(UINT32)
+    },
+
+    //
+    // Touch trace capture
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchTraceSize",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, TouchTraceSize)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchTraceSize,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchTraceFileSize",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, TouchTraceFileSize)),
+        REG_DWORD,
+        &gDefaultConfiguration.TouchTraceFileSize,
+        sizeof(UINT32)
+    },
+
+    //
+    // Hot path profiling
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"HotPathProfile",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, HotPathProfile)),
+        REG_DWORD,
+        &gDefaultConfiguration.HotPathProfile,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"BusStretchTime",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, BusStretchTime)),
+        REG_DWORD,
+        &gDefaultConfiguration.BusStretchTime,
+        sizeof(UINT32)
+    },
+
+#if DBG
+    //
+    // Fault injection
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"FaultNackRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FaultNackRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.FaultNackRate,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"FaultShortReadRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FaultShortReadRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.FaultShortReadRate,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"FaultResetRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FaultResetRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.FaultResetRate,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"FaultUnconfiguredRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, FaultUnconfiguredRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.FaultUnconfiguredRate,
+        sizeof(UINT32)
+    },
+
+    //
+    // Synthetic workload
+    //
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"SyntheticWorkload",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, SyntheticWorkload)),
+        REG_DWORD,
+        &gDefaultConfiguration.SyntheticWorkload,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"SyntheticContacts",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, SyntheticContacts)),
+        REG_DWORD,
+        &gDefaultConfiguration.SyntheticContacts,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"SyntheticRate",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, SyntheticRate)),
+        REG_DWORD,
+        &gDefaultConfiguration.SyntheticRate,
+        sizeof(UINT32)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"SyntheticObjectMix",
+        (PVOID) (FIELD_OFFSET(RMI4_CONFIGURATION, SyntheticObjectMix)),
+        REG_DWORD,
+        &gDefaultConfiguration.SyntheticObjectMix,
+        sizeof(UINT32)
+    },
+#endif
+
     //
     // List Terminator
     //
@@ -568,81 +960,30 @@ TchRegistryGetControllerSettings(
 --*/
 {
     RMI4_CONTROLLER_CONTEXT* controller;
-    HANDLE hKey;
     ULONG i;
-    WDFKEY key;
     PRTL_QUERY_REGISTRY_TABLE regTable;
     NTSTATUS status;
-    WDFKEY subkey;
-    DECLARE_CONST_UNICODE_STRING(subkeyName, L"Settings");
 
     controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
 
-    hKey = NULL;
-    key = NULL;
     regTable = NULL;
-    subkey = NULL;
 
     //
-    // Obtain a WDM hkey for RtlQueryRegistryValues
+    // RtlQueryRegistryValues table must be allocated from NonPagedPoolNx
     //
 
-    status = WdfDeviceOpenRegistryKey(
-        FxDevice,
-        PLUGPLAY_REGKEY_DEVICE,
-        KEY_READ,
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &key);
-  
-    if (!NT_SUCCESS(status))
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_REGISTRY,
-            "Error opening device registry key - %!STATUS!",
-            status);
-
-        goto exit;
-    }
-
-    status = WdfRegistryOpenKey(
-        key,
-        &subkeyName,
-        KEY_READ,
-        WDF_NO_OBJECT_ATTRIBUTES,
-        &subkey);
-
-    if (!NT_SUCCESS(status))
-    {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_REGISTRY,
-            "Error opening device registry subkey - %!STATUS!",
-            status);
+    regTable = RmiAllocate(gcbRegistryTable, TOUCH_POOL_TAG);
 
-        goto exit;
-    }
-
-    hKey = WdfRegistryWdmGetHandle(subkey);
-
-    if (NULL == hKey)
+    if (NULL == regTable)
     {
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_REGISTRY,
-            "Error getting WDM handle to WDF subkey");
+            "Error allocating registry query table");
 
+        status = STATUS_INSUFFICIENT_RESOURCES;
         goto exit;
     }
-    
-    //
-    // RtlQueryRegistryValues table must be allocated from NonPagedPoolNx
-    //
-
-    regTable = ExAllocatePoolWithTag(
-        NonPagedPoolNx,
-        gcbRegistryTable,
-        TOUCH_POOL_TAG);
 
     RtlCopyMemory(
         regTable,
@@ -662,14 +1003,10 @@ TchRegistryGetControllerSettings(
 
     //
     // Populate device context with registry or default configurations
+    // from the device's Settings key
     //
 
-    status = RtlQueryRegistryValues(
-        RTL_REGISTRY_HANDLE,
-        (PCWSTR) hKey,
-        regTable,
-        NULL,
-        NULL);
+    status = RmiQueryDeviceSettings(FxDevice, regTable);
 
     if (!NT_SUCCESS(status))
     {
@@ -704,19 +1041,9 @@ exit:
         status = STATUS_SUCCESS;
     }
 
-    if (subkey != NULL)
-    {
-        WdfRegistryClose(subkey);
-    }
-
-    if (key != NULL)
-    {
-        WdfRegistryClose(key);
-    }
-
     if (regTable != NULL)
     {
-        ExFreePoolWithTag(regTable, TOUCH_POOL_TAG);
+        RmiFree(regTable, TOUCH_POOL_TAG);
     }
 
     return status;
@@ -4,6 +4,7 @@
 #include <compat.h>
 #include <controller.h>
 #include <rmiinternal.h>
+#include <rmitrace.h>
 #include <HidCommon.h>
 #include <spb.h>
 #include <report.tmh>
@@ -17,693 +18,3428 @@ const PWSTR gpwstrProductID = L"3400";
 const PWSTR gpwstrSerialNumber = L"4";
 
 NTSTATUS
-RmiGetTouchesFromController(
-    IN VOID *ControllerContext,
-    IN SPB_CONTEXT *SpbContext,
-    IN RMI4_F11_DATA_REGISTERS *Data
+RmiReadCoverObject(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN int FunctionIndex,
+    OUT BOOLEAN* Covered
     )
 /*++
 
 Routine Description:
 
-    This routine reads raw touch messages from hardware. If there is
-    no touch data available (if a non-touch interrupt fired), the 
-    function will not return success and no touch data was transferred.
+    While reporting is suspended by a cover, reads only the F12 object
+    data up to the slot that reported the cover, instead of the full packet,
+    to find out whether the cover is still present.
 
 Arguments:
 
     ControllerContext - Touch controller context
     SpbContext - A pointer to the current i2c context
-    Data - A pointer to any returned F11 touch data
+    FunctionIndex - Index of F12 in the function descriptor table, with
+        the register page already selected
+    Covered - Set to TRUE if the cover object is still reported
 
 Return Value:
 
-    NTSTATUS, where only success indicates data was returned
+    NTSTATUS indicating success or failure
 
 --*/
 {
+    BYTE objects[RMI4_MAX_TOUCHES * F12_DATA1_BYTES_PER_OBJ];
+    ULONG length;
+    UINT8 indexData1;
     NTSTATUS status;
-    RMI4_CONTROLLER_CONTEXT* controller;
 
-    int index, i, x, y, fingers;
+    *Covered = FALSE;
 
-	BYTE fingerStatus[RMI4_MAX_TOUCHES] = { 0 };
-	BYTE* data1;
-	BYTE* controllerData;
-
-    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
-
-    //
-    // Locate RMI data base address of 2D touch function
-    //
-    index = RmiGetFunctionIndex(
-        controller->Descriptors,
-        controller->FunctionCount,
-        RMI4_F12_2D_TOUCHPAD_SENSOR);
+    indexData1 = RmiGetRegisterIndex(&ControllerContext->DataRegDesc, 1);
 
-    if (index == controller->FunctionCount)
+    if (indexData1 == ControllerContext->DataRegDesc.NumRegisters)
     {
-        Trace(
-            TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Unexpected - RMI Function 12 missing");
-
         status = STATUS_INVALID_DEVICE_STATE;
         goto exit;
     }
 
-    status = RmiChangePage(
-        ControllerContext,
+    length = (ControllerContext->CoverSlot + 1) * F12_DATA1_BYTES_PER_OBJ;
+
+    status = RmiBusRead(
         SpbContext,
-        controller->FunctionOnPage[index]);
+        ControllerContext->Descriptors[FunctionIndex].DataBase + indexData1,
+        objects,
+        length);
 
     if (!NT_SUCCESS(status))
     {
         Trace(
             TRACE_LEVEL_ERROR,
-            TRACE_INIT,
-            "Could not change register page");
+            TRACE_INTERRUPT,
+            "Error reading cover object data - %!STATUS!",
+            status);
 
         goto exit;
     }
 
-	controllerData = ExAllocatePoolWithTag(
-		NonPagedPoolNx,
-		controller->PacketSize,
-		TOUCH_POOL_TAG_F12
-	);
-
-	if (controllerData == NULL)
-	{
-		status = STATUS_INSUFFICIENT_RESOURCES;
-		goto exit;
-	}
-
-	// 
-	// Packets we need is determined by context
-	//
-	status = SpbReadDataSynchronously(
-		SpbContext,
-		controller->Descriptors[index].DataBase,
-		controllerData,
-		(ULONG) controller->PacketSize
-	);
-
-	if (!NT_SUCCESS(status))
-	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_INTERRUPT,
-			"Error reading finger status data - %!STATUS!",
-			status);
-
-		goto free_buffer;
-	}
-
-	data1 = &controllerData[controller->Data1Offset];
-	fingers = 0;
-
-	if (data1 != NULL)
-	{
-		for (i = 0; i < controller->MaxFingers; i++)
-		{
-			switch (data1[0]) 
-			{
-			case RMI_F12_OBJECT_FINGER:
-			case RMI_F12_OBJECT_STYLUS:
-				fingerStatus[i] = RMI4_FINGER_STATE_PRESENT_WITH_ACCURATE_POS;
-				fingers++;
-				break;
-			default:
-				fingerStatus[i] = RMI4_FINGER_STATE_NOT_PRESENT;
-				break;
-			}
-
-			x = (data1[2] << 8) | data1[1];
-			y = (data1[4] << 8) | data1[3];
-
-			Data->Finger[i].X = x;
-			Data->Finger[i].Y = y;
-
-			data1 += F12_DATA1_BYTES_PER_OBJ;
-		}
-	}
-	else
-	{
-		Trace(
-			TRACE_LEVEL_ERROR,
-			TRACE_INTERRUPT,
-			"Error reading finger status data - empty buffer"
-		);
-
-		goto free_buffer;
-	}
-
-	// Synchronize status back
-	Data->Status.FingerState0 = fingerStatus[0];
-	Data->Status.FingerState1 = fingerStatus[1];
-	Data->Status.FingerState2 = fingerStatus[2];
-	Data->Status.FingerState3 = fingerStatus[3];
-	Data->Status.FingerState4 = fingerStatus[4];
-	Data->Status.FingerState5 = fingerStatus[5];
-	Data->Status.FingerState6 = fingerStatus[6];
-	Data->Status.FingerState7 = fingerStatus[7];
-	Data->Status.FingerState8 = fingerStatus[8];
-	Data->Status.FingerState9 = fingerStatus[9];
-
-free_buffer:
-	ExFreePoolWithTag(
-		controllerData,
-		TOUCH_POOL_TAG_F12
-	);
+    ControllerContext->Counters.CoverFrames++;
+    ControllerContext->Counters.CoverBytesSaved +=
+        ControllerContext->PacketSize - length;
+
+    *Covered = (objects[ControllerContext->CoverSlot * F12_DATA1_BYTES_PER_OBJ] ==
+        RMI_F12_OBJECT_COVER);
 
 exit:
+
     return status;
 }
 
-VOID
-RmiUpdateLocalFingerCache(
-    IN RMI4_F11_DATA_REGISTERS *Data,
-    IN RMI4_FINGER_CACHE *Cache
+NTSTATUS
+RmiReadContactObjects(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    OUT UINT32* Present
     )
 /*++
 
 Routine Description:
 
-    This routine takes raw data reported by the Synaptics hardware and
-    parses it to update a local cache of finger states. This routine manages
-    removing lifted touches from the cache, and manages a map between the
-    order of reported touches in hardware, and the order the driver should
-    use in reporting.
+    Reads only the F12 object data up to the highest slot in the finger
+    cache, instead of the full packet, to find out which of the cached
+    contacts the controller still reports.
 
 Arguments:
 
-    Data - A pointer to the new data returned from hardware
-    Cache - A data structure holding various current finger state info
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Present - Set to the cached slots that still report an object
 
 Return Value:
 
-    None.
+    NTSTATUS indicating success or failure
 
 --*/
 {
-    int fingerStatus[RMI4_MAX_TOUCHES] = {0};        
-    int i, j;
+    BYTE objects[RMI4_MAX_TOUCHES * F12_DATA1_BYTES_PER_OBJ];
+    UINT32 slots;
+    ULONG length;
+    UINT8 indexData1;
+    int index, i;
+    NTSTATUS status;
 
-    //
-    // Unpack the finger statuses into an array to ease dealing with each
-    // finger uniformly in loops
-    //
-    fingerStatus[0] = Data->Status.FingerState0;
-    fingerStatus[1] = Data->Status.FingerState1;
-    fingerStatus[2] = Data->Status.FingerState2;
-    fingerStatus[3] = Data->Status.FingerState3;
-    fingerStatus[4] = Data->Status.FingerState4;
-    fingerStatus[5] = Data->Status.FingerState5;
-    fingerStatus[6] = Data->Status.FingerState6;
-    fingerStatus[7] = Data->Status.FingerState7;
-    fingerStatus[8] = Data->Status.FingerState8;
-    fingerStatus[9] = Data->Status.FingerState9;
+    *Present = 0;
+    slots = ControllerContext->Cache.FingerSlotValid;
 
-    //
-    // When hardware was last read, if any slots reported as lifted, we
-    // must clean out the slot and old touch info. There may be new
-    // finger data using the slot.
-    //
-    for (i=0; i<RMI4_MAX_TOUCHES; i++)
-    {
-        //
-        // Sweep for a slot that needs to be cleaned
-        //
-        if (!(Cache->FingerSlotDirty & (1 << i)))
-        {
-            continue;
-        }
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
 
-        NT_ASSERT(Cache->FingerDownCount > 0);
+    indexData1 = RmiGetRegisterIndex(&ControllerContext->DataRegDesc, 1);
 
-        //
-        // Find the slot in the reporting list 
-        //
-        for (j=0; j<RMI4_MAX_TOUCHES; j++)
-        {
-            if (Cache->FingerDownOrder[j] == i)
-            {
-                break;
-            }
-        }
+    if (index == ControllerContext->FunctionCount ||
+        indexData1 == ControllerContext->DataRegDesc.NumRegisters)
+    {
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
 
-        NT_ASSERT(j != RMI4_MAX_TOUCHES);
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
 
-        //
-        // Remove the slot. If the finger lifted was the last in the list,
-        // we just decrement the list total by one. If it was not last, we
-        // shift the trailing list items up by one.
-        //
-        for (; (j<Cache->FingerDownCount-1) && (j<RMI4_MAX_TOUCHES-1); j++)
-        {
-            Cache->FingerDownOrder[j] = Cache->FingerDownOrder[j+1];
-        }
-        Cache->FingerDownCount--;
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
 
-        //
-        // Finished, clobber the dirty bit
-        //
-        Cache->FingerSlotDirty &= ~(1 << i);
+    i = RMI4_MAX_TOUCHES - 1;
+
+    while (i > 0 && !(slots & (1UL << i)))
+    {
+        i--;
     }
 
-    //
-    // Cache the new set of finger data reported by hardware
-    //
-    for (i=0; i<RMI4_MAX_TOUCHES; i++)
+    length = (i + 1) * F12_DATA1_BYTES_PER_OBJ;
+
+    status = RmiBusRead(
+        SpbContext,
+        ControllerContext->Descriptors[index].DataBase + indexData1,
+        objects,
+        length);
+
+    if (!NT_SUCCESS(status))
     {
-        //
-        // Take actions when a new contact is first reported as down
-        //
-        if ((fingerStatus[i] != RMI4_FINGER_STATE_NOT_PRESENT) &&
-            ((Cache->FingerSlotValid & (1 << i)) == 0) &&
-            (Cache->FingerDownCount < RMI4_MAX_TOUCHES))
-        {
-            Cache->FingerSlotValid |= (1 << i);
-            Cache->FingerDownOrder[Cache->FingerDownCount++] = i;
-        }
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Error reading contact object data - %!STATUS!",
+            status);
 
-        //
-        // Ignore slots with no new information
-        //
-        if (!(Cache->FingerSlotValid & (1 << i)))
-        {
-            continue;   
-        }
+        goto exit;
+    }
 
-        //
-        // When finger is down, update local cache with new information from
-        // the controller. When finger is up, we'll use last cached value
-        //
-        Cache->FingerSlot[i].fingerStatus = (UCHAR) fingerStatus[i];
-        if (Cache->FingerSlot[i].fingerStatus)
-        {
-            Cache->FingerSlot[i].x = Data->Finger[i].X;
-            Cache->FingerSlot[i].y = Data->Finger[i].Y;
-        }
+    ControllerContext->Counters.WatchdogReads++;
 
-        //
-        // If a finger lifted, note the slot is now inactive so that any
-        // cached data is cleaned out before we read hardware again.
-        //
-        if (Cache->FingerSlot[i].fingerStatus == RMI4_FINGER_STATE_NOT_PRESENT)
+    for (; i >= 0; i--)
+    {
+        if ((slots & (1UL << i)) &&
+            objects[i * F12_DATA1_BYTES_PER_OBJ] != RMI_F12_OBJECT_NONE)
         {
-            Cache->FingerSlotDirty |= (1 << i);
-            Cache->FingerSlotValid &= ~(1 << i);
+            *Present |= (1UL << i);
         }
     }
 
-    //
-    // Get current scan time (in 100us units)
-    //
-    ULONG64 QpcTimeStamp;
-    Cache->ScanTime = KeQueryInterruptTimePrecise(&QpcTimeStamp) / 1000;
+exit:
+
+    return status;
 }
 
-VOID
-RmiFillNextHidReportFromCache(
-    IN PPTP_REPORT HidReport,
-    IN RMI4_FINGER_CACHE *Cache,
-    IN PTOUCH_SCREEN_PROPERTIES Props,
-    IN int *TouchesReported,
-    IN int TouchesTotal
+NTSTATUS
+RmiAcquireTouchFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext
     )
 /*++
 
 Routine Description:
 
-    This routine fills a HID report with the next touch entries in
-    the local device finger cache. 
+    Acquisition stage of the touch pipeline. Reads the next raw F12
+    packet from hardware into the frame, where it waits for the delivery
+    stage to decode it. A cover detected in the packet suspends
+    reporting, and the frame is then marked empty so every contact lifts.
 
-    The routine also adjusts X/Y coordinates to match the desired display
-    coordinates.
+    This runs without ControllerLock, it is serialized with every other
+    bus user by the interrupt lock and only touches acquisition state.
 
 Arguments:
 
-    HidReport - pointer to the HID report structure to fill
-    Cache - pointer to the local device finger cache
-    Props - information on how to adjust X/Y coordinates to match the display
-    TouchesReported - On entry, the number of touches (against total) that
-        have already been reported. As touches are transferred from the local
-        device cache to a HID report, this number is incremented.
-    TouchesTotal - total number of touches in the touch cache
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
 
 Return Value:
 
-    None.
+    NTSTATUS, where only success indicates a frame is ready
 
 --*/
 {
-    int currentFingerIndex;
-	int fingersToReport = min(TouchesTotal - *TouchesReported, 5);
-	USHORT SctatchX = 0, ScratchY = 0;
-
-    HidReport->ReportID = REPORTID_MULTITOUCH;
+    NTSTATUS status;
+    RMI4_TOUCH_FRAME* frame;
+    int index, i;
+    int coverSlot;
+    BOOLEAN covered;
+    BYTE* data1;
 
     //
-    // There are only 16-bits for ScanTime, truncate it
+    // The frame is still waiting to be decoded
     //
-	HidReport->ScanTime = Cache->ScanTime & 0xFFFF;
+    if (ControllerContext->FrameReady)
+    {
+        status = STATUS_SUCCESS;
+        goto exit;
+    }
 
-	//
-	// No button in our context
-	// 
-	HidReport->IsButtonClicked = FALSE;
+    frame = &ControllerContext->Frame;
 
     //
-    // Report the count
-    // We're sending touches using hybrid mode with 5 fingers in our
-    // report descriptor. The first report must indicate the
-    // total count of touch fingers detected by the digitizer.
-    // The remaining reports must indicate 0 for the count.
-    // The first report will have the TouchesReported integer set to 0
-    // The others will have it set to something else.
+    // Locate RMI data base address of 2D touch function
     //
-    if (*TouchesReported == 0)
-    {
-        HidReport->ContactCount = (UCHAR)TouchesTotal;
-    }
-    else
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    if (index == ControllerContext->FunctionCount || frame->Packet == NULL)
     {
-        HidReport->ContactCount = 0;
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Unexpected - RMI Function 12 missing");
+
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
     }
 
-	//
-	// Only five fingers supported yet
-	//
-	for (currentFingerIndex = 0; currentFingerIndex < fingersToReport; currentFingerIndex++)
-	{
-        int currentlyReporting = Cache->FingerDownOrder[*TouchesReported];
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        ControllerContext->FunctionOnPage[index]);
 
-		HidReport->Contacts[currentFingerIndex].ContactID = (UCHAR)currentlyReporting;
-		SctatchX = (USHORT)Cache->FingerSlot[currentlyReporting].x;
-		ScratchY = (USHORT)Cache->FingerSlot[currentlyReporting].y;
-		HidReport->Contacts[currentFingerIndex].Confidence = 1;
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Could not change register page");
 
-		//
-		// Perform per-platform x/y adjustments to controller coordinates
-		//
-		TchTranslateToDisplayCoordinates(
-			&SctatchX,
-			&ScratchY,
-			Props);
+        goto exit;
+    }
 
-		HidReport->Contacts[currentFingerIndex].X = SctatchX;
-		HidReport->Contacts[currentFingerIndex].Y = ScratchY;
+    //
+    // While a cover is present only poll its object slot. All contacts were
+    // released when the cover arrived, so an empty frame is what we report.
+    //
+    if (ControllerContext->CoverSuspended)
+    {
+        status = RmiReadCoverObject(
+            ControllerContext,
+            SpbContext,
+            index,
+            &covered);
 
-		if (Cache->FingerSlot[currentlyReporting].fingerStatus)
-		{
-			HidReport->Contacts[currentFingerIndex].TipSwitch = FINGER_STATUS;
-		}
+        if (!NT_SUCCESS(status))
+        {
+            goto exit;
+        }
 
-        (*TouchesReported)++;
-	}
-}
+        if (covered)
+        {
+            frame->Empty = TRUE;
+            ControllerContext->FrameReady = TRUE;
+            goto exit;
+        }
 
-NTSTATUS
-RmiServiceTouchDataInterrupt(
-    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
-    IN SPB_CONTEXT* SpbContext,
-    IN PPTP_REPORT HidReport,
-    IN UCHAR InputMode,
-    OUT BOOLEAN* PendingTouches
-    )
-/*++
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_REPORTING,
+            "Cover removed, resuming touch reporting");
 
-Routine Description:
+        ControllerContext->CoverSuspended = FALSE;
 
-    Called when a touch interrupt needs service.
+        if (ControllerContext->SurfaceReportingOn)
+        {
+            RmiSetReportingMode(
+                ControllerContext,
+                SpbContext,
+                RMI_F12_REPORTING_MODE_CONTINUOUS,
+                NULL);
+        }
+    }
 
-Arguments:
+    // 
+    // Packets we need is determined by context
+    //
+#if DBG
+    if (ControllerContext->Config.SyntheticWorkload != RMI4_SYNTHETIC_OFF)
+    {
+        RmiSynthesizeTouchFrame(ControllerContext, frame->Packet);
+        status = STATUS_SUCCESS;
+    }
+    else
+#endif
+    status = RmiBusRead(
+        SpbContext,
+        ControllerContext->Descriptors[index].DataBase,
+        frame->Packet,
+        (ULONG) ControllerContext->PacketSize
+    );
 
-    ControllerContext - Touch controller context
-    SpbContext - A pointer to the current SPB context (I2C, etc)
-    HidReport- Buffer to fill with a hid report if touch data is available
-    InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
-    PendingTouches - Notifies caller if there are more touches to report, to 
-        complete reporting the full state of fingers on the screen
-
-Return Value:
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Error reading finger status data - %!STATUS!",
+            status);
 
-    NTSTATUS indicating whether or not the current hid report buffer was filled
+        goto exit;
+    }
 
-    PendingTouches also indicates whether the caller should expect more than
-        one request to be completed to indicate the full state of fingers on 
-        the screen
---*/
-{
-    RMI4_F11_DATA_REGISTERS data;
-    NTSTATUS status;
+    ControllerContext->Counters.TouchFramesRead++;
+    ControllerContext->Counters.TouchBytesRead += ControllerContext->PacketSize;
 
-	UNREFERENCED_PARAMETER(InputMode);
+    RmiTraceCaptureRecord(
+        ControllerContext,
+        RMI_TRACE_RECORD_F12_PACKET,
+        frame->Packet,
+        (ULONG) ControllerContext->PacketSize);
 
-    status = STATUS_SUCCESS;
-    RtlZeroMemory(&data, sizeof(data));
-    NT_ASSERT(PendingTouches != NULL);
-    *PendingTouches = FALSE;
+    frame->Empty = FALSE;
+    ControllerContext->FrameReady = TRUE;
 
     //
-    // If no touches are unreported in our cache, read the next set of touches
-    // from hardware.
+    // A cover releases every contact and suspends reporting until it is
+    // removed, the controller only needs to raise interrupts on change
     //
-    if (ControllerContext->TouchesReported == ControllerContext->TouchesTotal)
+    if (!ControllerContext->Config.CoverSuspend)
     {
-        //
-        // See if new touch data is available
-        //
-        status = RmiGetTouchesFromController(
-            ControllerContext,
-            SpbContext,
-            &data
-            );
+        goto exit;
+    }
 
-        if (!NT_SUCCESS(status))
-        {
-            Trace(
-               TRACE_LEVEL_VERBOSE,
-                TRACE_SAMPLES,
-                "No touch data to report - %!STATUS!",
-                status);
+    data1 = &frame->Packet[ControllerContext->Data1Offset];
+    coverSlot = -1;
 
-            goto exit;
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
+    {
+        if (data1[i * F12_DATA1_BYTES_PER_OBJ] == RMI_F12_OBJECT_COVER)
+        {
+            coverSlot = i;
+            break;
         }
+    }
 
-        //
-        // Process the new touch data by updating our cached state
-        //
-        //
-        RmiUpdateLocalFingerCache(
-            &data,
-            &ControllerContext->Cache);
+    if (coverSlot >= 0)
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_REPORTING,
+            "Cover detected in slot %d, suspending touch reporting",
+            coverSlot);
 
-        //
-        // Prepare to report touches via HID reports
-        //
-        ControllerContext->TouchesReported = 0;
-        ControllerContext->TouchesTotal = 
-            ControllerContext->Cache.FingerDownCount;
+        frame->Empty = TRUE;
 
-        //
-        // If no touches are present return that no data needed to be reported
-        //
-        if (ControllerContext->TouchesTotal == 0)
-        {
-            status = STATUS_NO_DATA_DETECTED;
-            goto exit;
-        }
+        ControllerContext->CoverSuspended = TRUE;
+        ControllerContext->CoverSlot = coverSlot;
+
+        RmiSetReportingMode(
+            ControllerContext,
+            SpbContext,
+            RMI_F12_REPORTING_MODE_REDUCED,
+            NULL);
     }
 
-    RtlZeroMemory(HidReport, sizeof(PTP_REPORT));
+exit:
+    return status;
+}
 
-    //
-    // Fill report with the next cached touches
-    //
-    RmiFillNextHidReportFromCache(
-        HidReport,
-        &ControllerContext->Cache,
-        &ControllerContext->Props,
-        &ControllerContext->TouchesReported,
-        ControllerContext->TouchesTotal);
+NTSTATUS
+RmiDecodeTouchFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS *Data
+    )
+/*++
+
+Routine Description:
+
+    Delivery stage of the touch pipeline. Takes the frame left by the
+    acquisition stage and decodes its raw touch messages, which frees it
+    for the next packet. No bus I/O is done here.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Data - A pointer to any returned F11 touch data
+
+Return Value:
+
+    NTSTATUS, where only success indicates data was returned
+
+--*/
+{
+    RMI4_TOUCH_FRAME* frame;
+    int i, x, y;
+    BYTE* data1;
+
+    if (!ControllerContext->FrameReady)
+    {
+        return STATUS_NO_DATA_DETECTED;
+    }
+
+    frame = &ControllerContext->Frame;
+    ControllerContext->FrameReady = FALSE;
 
     //
-    // Update the caller if we still have outstanding touches to report
+    // Empty frames report every object as not present
     //
-    if (ControllerContext->TouchesReported < ControllerContext->TouchesTotal)
+    if (frame->Empty)
     {
-        *PendingTouches = TRUE;
+        return STATUS_SUCCESS;
     }
-    else
+
+    data1 = &frame->Packet[ControllerContext->Data1Offset];
+
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
     {
-        *PendingTouches = FALSE;
+        switch (data1[0]) 
+        {
+        case RMI_F12_OBJECT_FINGER:
+        case RMI_F12_OBJECT_STYLUS:
+            Data->FingerState[i] = RMI4_FINGER_STATE_PRESENT_WITH_ACCURATE_POS;
+            break;
+        case RMI_F12_OBJECT_HOVERING_FINGER:
+            //
+            // Not a contact, but a hint one is about to land
+            //
+            Data->FingerState[i] = RMI4_FINGER_STATE_NOT_PRESENT;
+            Data->HoverCount++;
+            break;
+        default:
+            Data->FingerState[i] = RMI4_FINGER_STATE_NOT_PRESENT;
+            break;
+        }
+
+        Data->Object[i].Type = data1[0];
+        Data->Object[i].Z = data1[5];
+        Data->Object[i].wX = data1[6];
+        Data->Object[i].wY = data1[7];
+
+        x = (data1[2] << 8) | data1[1];
+        y = (data1[4] << 8) | data1[3];
+
+        Data->Finger[i].X = x;
+        Data->Finger[i].Y = y;
+
+        data1 += F12_DATA1_BYTES_PER_OBJ;
     }
 
-exit:
-    
-    return status;
+    return STATUS_SUCCESS;
 }
 
-
-NTSTATUS
-TchServiceInterrupts(
-    IN VOID *ControllerContext,
-    IN SPB_CONTEXT *SpbContext,
-    IN PPTP_REPORT HidReport,
-    IN UCHAR InputMode,
-    IN BOOLEAN *ServicingComplete
+VOID
+RmiRejectPalms(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS* Data
     )
 /*++
 
 Routine Description:
 
-    This routine is called in response to an interrupt. The driver will
-    service chip interrupts, and if data is available to report to HID,
-    fill the Request object buffer with a HID report.
+    Suppresses contacts that belong to, or sit next to, a palm before they
+    reach the finger cache. Palms are objects classified as such by F12 or
+    contacts wider than the configured threshold. Contacts within the
+    reject radius of a palm are suppressed as well, and stay suppressed
+    until they lift. A suppressed contact that was already being tracked
+    is reported as lifted.
 
 Arguments:
 
     ControllerContext - Touch controller context
-    SpbContext - A pointer to the current i2c context
-    HidReport - Pointer to a HID_INPUT_REPORT structure to report to the OS
-    InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
-    ServicingComplete - Notifies caller if there are more reports needed to 
-        complete servicing interrupts coming from the hardware.
+    Data - The touch data just read from the controller, updated in place
 
 Return Value:
 
-    NTSTATUS indicating whether or not the current HidReport has been filled
+    None.
 
-    ServicingComplete indicates whether or not a new report buffer is required
-        to complete interrupt processing.
 --*/
 {
-    NTSTATUS status = STATUS_NO_DATA_DETECTED;
-    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_PALM_SETTINGS_LOGICAL* settings;
+    RMI4_F12_OBJECT_DATA* object;
+    int palmSlots[RMI4_MAX_TOUCHES];
+    int palmCount;
+    int present;
+    int rejected;
+    int i, j;
+    LONG64 dx, dy, radius;
+    BOOLEAN reject;
 
-    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+    settings = &ControllerContext->Config.PalmSettings;
 
-    NT_ASSERT(ServicingComplete != NULL);
+    if (!settings->PalmRejection)
+    {
+        return;
+    }
 
-    //
-    // Grab a waitlock to ensure the ISR executes serially and is 
-    // protected against power state transitions
-    //
-    WdfWaitLockAcquire(controller->ControllerLock, NULL);
+    palmCount = 0;
+    radius = settings->PalmRejectRadius;
 
     //
-    // Check the interrupt source if no interrupts are pending processing
+    // Find palms, and forget about suppressed slots whose object went away
     //
-    if (controller->InterruptStatus == 0)
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
     {
-        status = RmiCheckInterrupts(
-            controller,
-            SpbContext, 
-            &controller->InterruptStatus);
+        object = &Data->Object[i];
 
-        if (!NT_SUCCESS(status))
+        if (Data->FingerState[i] == RMI4_FINGER_STATE_NOT_PRESENT)
         {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_INTERRUPT,
-                "Error servicing interrupts - %!STATUS!",
-                status);
+            ControllerContext->PalmRejectedSlots &= ~(1UL << i);
+        }
 
-            *ServicingComplete = FALSE;
-            goto exit;
+        if (object->Type == RMI_F12_OBJECT_PALM ||
+            (Data->FingerState[i] != RMI4_FINGER_STATE_NOT_PRESENT &&
+            settings->PalmWidthThreshold != 0 &&
+            (object->wX >= settings->PalmWidthThreshold ||
+            object->wY >= settings->PalmWidthThreshold)))
+        {
+            palmSlots[palmCount++] = i;
         }
     }
 
-    //
-    // Driver only services 0D cap button and 2D touch messages currently
-    //
-    if (controller->InterruptStatus & 
-        ~(RMI4_INTERRUPT_BIT_0D_CAP_BUTTON | RMI4_INTERRUPT_BIT_2D_TOUCH))
+    if (palmCount == 0 && ControllerContext->PalmRejectedSlots == 0)
     {
-        Trace(
-            TRACE_LEVEL_WARNING,
-            TRACE_INTERRUPT,
-            "Ignoring following interrupt flags - %!STATUS!",
-            controller->InterruptStatus & 
-                ~(RMI4_INTERRUPT_BIT_0D_CAP_BUTTON | 
-                RMI4_INTERRUPT_BIT_2D_TOUCH));
+        return;
+    }
 
-        //
-        // Mask away flags we don't service
-        //
-        controller->InterruptStatus &=
-            (RMI4_INTERRUPT_BIT_0D_CAP_BUTTON | 
-            RMI4_INTERRUPT_BIT_2D_TOUCH);
+    if (palmCount != 0)
+    {
+        ControllerContext->Counters.PalmFrames++;
     }
 
-    //
-    // RmiServiceXXX routine will change status to STATUS_SUCCESS if there
-    // is a HID report to process.
-    //
-    status = STATUS_UNSUCCESSFUL;
+    present = 0;
+    rejected = 0;
 
-    //
-    // Service a touch data event if indicated by hardware 
-    //
-    if (controller->InterruptStatus & RMI4_INTERRUPT_BIT_2D_TOUCH)
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
     {
-        BOOLEAN pendingTouches = FALSE;
+        if (Data->FingerState[i] == RMI4_FINGER_STATE_NOT_PRESENT)
+        {
+            continue;
+        }
 
-        status = RmiServiceTouchDataInterrupt(
-			ControllerContext,
-            SpbContext,
-			HidReport,
-			InputMode,
-			&pendingTouches);
+        reject = (ControllerContext->PalmRejectedSlots & (1UL << i)) != 0;
 
-        //
-        // If there are more touches to report, servicing is incomplete
-        //
-        if (pendingTouches == FALSE)
+        for (j = 0; j < palmCount && !reject; j++)
         {
-            controller->InterruptStatus &= ~RMI4_INTERRUPT_BIT_2D_TOUCH;
+            if (palmSlots[j] == i)
+            {
+                reject = TRUE;
+                break;
+            }
+
+            dx = Data->Finger[i].X - Data->Finger[palmSlots[j]].X;
+            dy = Data->Finger[i].Y - Data->Finger[palmSlots[j]].Y;
+
+            if (dx * dx + dy * dy <= radius * radius)
+            {
+                reject = TRUE;
+            }
         }
 
-        //
-        // Success indicates the report is ready to be sent, otherwise,
-        // continue to service interrupts.
-        //
-        if (NT_SUCCESS(status))
+        if (reject)
         {
-            goto exit;
+            Data->FingerState[i] = RMI4_FINGER_STATE_NOT_PRESENT;
+            ControllerContext->PalmRejectedSlots |= (1UL << i);
+            ControllerContext->Counters.PalmContactsRejected++;
+            rejected++;
         }
         else
         {
-            Trace(
-                TRACE_LEVEL_ERROR,
-                TRACE_INTERRUPT,
-                "Error processing touch event - %!STATUS!",
-                status);
+            present++;
         }
     }
 
-    //
-    // Add servicing for additional touch interrupts here
-    //
+    if (rejected != 0 && present == 0)
+    {
+        ControllerContext->Counters.PalmFramesSuppressed++;
+    }
+}
 
-exit:
+VOID
+RmiRejectEdges(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS* Data
+    )
+/*++
 
-    //
-    // Indicate whether or not we're done servicing interrupts
-    //
-    if (controller->InterruptStatus == 0)
+Routine Description:
+
+    Holds back new contacts that land in one of the edge rejection bands,
+    typically the fingers of a hand gripping the device. A held contact is
+    released into the finger cache once it has moved inward from where it
+    landed by at least the edge swipe distance, so swipes starting at the
+    edge still work. Contacts that land in the active area are never held,
+    even if they later move into a band.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Data - The touch data just read from the controller, updated in place
+
+Return Value:
+
+    None.
+
+--*/
+{
+    PTOUCH_SCREEN_PROPERTIES props;
+    RMI4_F11_DATA_POSITION* start;
+    int sensorWidth, sensorHeight;
+    int inward, distance;
+    int x, y;
+    int i;
+
+    props = &ControllerContext->Props;
+
+    if (props->TouchEdgeRejectLeft == 0 &&
+        props->TouchEdgeRejectRight == 0 &&
+        props->TouchEdgeRejectTop == 0 &&
+        props->TouchEdgeRejectBottom == 0)
     {
-        *ServicingComplete = TRUE;
+        return;
+    }
+
+    if (props->TouchSwapAxes)
+    {
+        sensorWidth = props->TouchPhysicalHeight;
+        sensorHeight = props->TouchPhysicalWidth;
     }
     else
     {
-        *ServicingComplete = FALSE;
+        sensorWidth = props->TouchPhysicalWidth;
+        sensorHeight = props->TouchPhysicalHeight;
     }
 
-    WdfWaitLockRelease(controller->ControllerLock);
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
+    {
+        if (Data->FingerState[i] == RMI4_FINGER_STATE_NOT_PRESENT)
+        {
+            ControllerContext->EdgeHeldSlots &= ~(1UL << i);
+            continue;
+        }
 
-    return status;
+        x = Data->Finger[i].X;
+        y = Data->Finger[i].Y;
+        start = &ControllerContext->EdgeStart[i];
+
+        if (!(ControllerContext->EdgeHeldSlots & (1UL << i)))
+        {
+            //
+            // Contacts already being reported are left alone
+            //
+            if (ControllerContext->Cache.FingerSlotValid & (1UL << i))
+            {
+                continue;
+            }
+
+            if (x >= (int) props->TouchEdgeRejectLeft &&
+                x < sensorWidth - (int) props->TouchEdgeRejectRight &&
+                y >= (int) props->TouchEdgeRejectTop &&
+                y < sensorHeight - (int) props->TouchEdgeRejectBottom)
+            {
+                continue;
+            }
+
+            ControllerContext->EdgeHeldSlots |= (1UL << i);
+            start->X = x;
+            start->Y = y;
+        }
+
+        //
+        // Measure how far the contact moved away from the band(s) it
+        // landed in
+        //
+        distance = 0;
+
+        if (start->X < (int) props->TouchEdgeRejectLeft)
+        {
+            inward = x - start->X;
+            distance = max(distance, inward);
+        }
+        if (start->X >= sensorWidth - (int) props->TouchEdgeRejectRight)
+        {
+            inward = start->X - x;
+            distance = max(distance, inward);
+        }
+        if (start->Y < (int) props->TouchEdgeRejectTop)
+        {
+            inward = y - start->Y;
+            distance = max(distance, inward);
+        }
+        if (start->Y >= sensorHeight - (int) props->TouchEdgeRejectBottom)
+        {
+            inward = start->Y - y;
+            distance = max(distance, inward);
+        }
+
+        if (distance >= (int) props->TouchEdgeSwipeDistance)
+        {
+            ControllerContext->EdgeHeldSlots &= ~(1UL << i);
+            ControllerContext->Counters.EdgeSwipesPromoted++;
+            continue;
+        }
+
+        Data->FingerState[i] = RMI4_FINGER_STATE_NOT_PRESENT;
+        ControllerContext->Counters.EdgeContactsHeld++;
+    }
+}
+
+//
+// 2 * pi in 16.16 fixed point
+//
+#define RMI4_FILTER_TWO_PI_Q16      411775
+#define RMI4_FILTER_MAX_CUTOFF      1000000     // 1kHz, in mHz
+#define RMI4_FILTER_MAX_PERIOD      1000        // 100ms, in 100us units
+
+static LONG64
+RmiFilterAlpha(
+    IN LONG64 Cutoff,
+    IN LONG64 Period
+    )
+/*++
+
+Routine Description:
+
+    Computes the smoothing factor of a first order low-pass filter,
+    alpha = 1 / (1 + 1 / (2 * pi * cutoff * period)).
+
+Arguments:
+
+    Cutoff - Cutoff frequency in mHz
+    Period - Sampling period in 100us units
+
+Return Value:
+
+    Alpha in 16.16 fixed point
+
+--*/
+{
+    LONG64 r;
+
+    Cutoff = min(Cutoff, RMI4_FILTER_MAX_CUTOFF);
+
+    //
+    // r = 2 * pi * cutoff * period, mHz * 100us = 1e-7
+    //
+    r = RMI4_FILTER_TWO_PI_Q16 * Cutoff * Period / 10000000;
+
+    return (r << 16) / (r + (1 << 16));
+}
+
+static int
+RmiFilterAxis(
+    IN RMI4_FILTER_AXIS* Axis,
+    IN int Raw,
+    IN LONG64 Period,
+    IN RMI4_FILTER_SETTINGS_LOGICAL* Settings
+    )
+/*++
+
+Routine Description:
+
+    Runs one 1-euro filter step on a single axis: the speed is low-pass
+    filtered with a fixed cutoff, and the position is low-pass filtered
+    with a cutoff that grows with speed, so slow motion is smoothed while
+    fast motion keeps up.
+
+Arguments:
+
+    Axis - Filter state for this axis
+    Raw - New raw coordinate
+    Period - Time since the previous sample in 100us units
+    Settings - Filter parameters
+
+Return Value:
+
+    The filtered coordinate
+
+--*/
+{
+    LONG64 raw;
+    LONG64 speed;
+    LONG64 alpha;
+    LONG64 cutoff;
+
+    raw = (LONG64) Raw << 8;
+
+    //
+    // Speed in sensor units per second, relative to the filtered position
+    //
+    speed = ((raw - Axis->Position) * 10000 / Period) >> 8;
+    alpha = RmiFilterAlpha(Settings->DerivativeCutoff, Period);
+    Axis->Speed += (int) (((speed - Axis->Speed) * alpha) >> 16);
+
+    cutoff = (LONG64) Settings->MinCutoff +
+        (LONG64) Settings->Beta * (Axis->Speed < 0 ? -Axis->Speed : Axis->Speed);
+    alpha = RmiFilterAlpha(cutoff, Period);
+    Axis->Position += (int) (((raw - Axis->Position) * alpha) >> 16);
+
+    return (Axis->Position + (1 << 7)) >> 8;
+}
+
+VOID
+RmiFilterContacts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS* Data
+    )
+/*++
+
+Routine Description:
+
+    Applies a per-contact 1-euro filter to the positions reported by
+    hardware. The filter state of a slot is reset when its contact lifts,
+    so a new contact always starts at its raw position.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Data - The touch data just read from the controller, updated in place
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_FILTER_SETTINGS_LOGICAL* settings;
+    RMI4_FILTER_CACHE* filter;
+    RMI4_FILTER_SLOT* slot;
+    ULONG64 now;
+    LONG64 period;
+    int i;
+
+    settings = &ControllerContext->Config.FilterSettings;
+    filter = &ControllerContext->Filter;
+
+    if (!settings->OneEuroFilter)
+    {
+        return;
+    }
+
+    now = RmiQueryTime() / 1000;
+
+    for (i = 0; i < ControllerContext->MaxFingers; i++)
+    {
+        slot = &filter->Slot[i];
+
+        if (Data->FingerState[i] == RMI4_FINGER_STATE_NOT_PRESENT)
+        {
+            filter->SlotValid &= ~(1UL << i);
+            continue;
+        }
+
+        if (!(filter->SlotValid & (1UL << i)))
+        {
+            slot->X.Position = Data->Finger[i].X << 8;
+            slot->X.Speed = 0;
+            slot->Y.Position = Data->Finger[i].Y << 8;
+            slot->Y.Speed = 0;
+            slot->LastScanTime = now;
+            filter->SlotValid |= (1UL << i);
+            continue;
+        }
+
+        period = (LONG64) (now - slot->LastScanTime);
+        period = max(period, 1);
+        period = min(period, RMI4_FILTER_MAX_PERIOD);
+        slot->LastScanTime = now;
+
+        Data->Finger[i].X = RmiFilterAxis(&slot->X, Data->Finger[i].X, period, settings);
+        Data->Finger[i].Y = RmiFilterAxis(&slot->Y, Data->Finger[i].Y, period, settings);
+    }
+}
+
+VOID
+RmiUpdateLocalFingerCache(
+    IN RMI4_F11_DATA_REGISTERS *Data,
+    IN RMI4_FINGER_CACHE *Cache,
+    IN int Deadband
+    )
+/*++
+
+Routine Description:
+
+    This routine takes raw data reported by the Synaptics hardware and
+    parses it to update a local cache of finger states. This routine manages
+    removing lifted touches from the cache, and manages a map between the
+    order of reported touches in hardware, and the order the driver should
+    use in reporting.
+
+    Contacts that moved no more than Deadband sensor units on either axis
+    from their cached position keep that position. FrameChanged notes
+    whether any contact landed, lifted or moved past its deadband, and
+    FrameTipChanged whether any contact landed or lifted.
+
+Arguments:
+
+    Data - A pointer to the new data returned from hardware
+    Cache - A data structure holding various current finger state info
+    Deadband - Per-axis jitter tolerance in sensor units
+
+Return Value:
+
+    None.
+
+--*/
+{
+    BYTE* fingerStatus;
+    unsigned long slots;
+    int i, j;
+    int dx, dy;
+    BOOLEAN newContact;
+
+    C_ASSERT(RMI4_MAX_TOUCHES <= sizeof(slots) * BITS_PER_BYTE);
+
+    fingerStatus = Data->FingerState;
+
+    //
+    // When hardware was last read, if any slots reported as lifted, we
+    // must clean out the slot and old touch info. There may be new
+    // finger data using the slot.
+    //
+    slots = Cache->FingerSlotDirty;
+
+    for_each_set_bit(i, &slots, RMI4_MAX_TOUCHES)
+    {
+        NT_ASSERT(Cache->FingerDownCount > 0);
+
+        //
+        // Find the slot in the reporting list 
+        //
+        for (j=0; j<RMI4_MAX_TOUCHES; j++)
+        {
+            if (Cache->FingerDownOrder[j] == i)
+            {
+                break;
+            }
+        }
+
+        NT_ASSERT(j != RMI4_MAX_TOUCHES);
+
+        //
+        // Remove the slot. If the finger lifted was the last in the list,
+        // we just decrement the list total by one. If it was not last, we
+        // shift the trailing list items up by one.
+        //
+        for (; (j<Cache->FingerDownCount-1) && (j<RMI4_MAX_TOUCHES-1); j++)
+        {
+            Cache->FingerDownOrder[j] = Cache->FingerDownOrder[j+1];
+        }
+        Cache->FingerDownCount--;
+
+        //
+        // Finished, clobber the dirty bit
+        //
+        Cache->FingerSlotDirty &= ~(1 << i);
+    }
+
+    //
+    // Cache the new set of finger data reported by hardware, and track the
+    // largest per-axis movement of any continuing contact in this frame
+    //
+    Cache->FrameMotion = 0;
+    Cache->FrameChanged = FALSE;
+    Cache->FrameTipChanged = FALSE;
+
+    for (i=0; i<RMI4_MAX_TOUCHES; i++)
+    {
+        newContact = FALSE;
+
+        //
+        // Take actions when a new contact is first reported as down
+        //
+        if ((fingerStatus[i] != RMI4_FINGER_STATE_NOT_PRESENT) &&
+            ((Cache->FingerSlotValid & (1 << i)) == 0) &&
+            (Cache->FingerDownCount < RMI4_MAX_TOUCHES))
+        {
+            Cache->FingerSlotValid |= (1 << i);
+            Cache->FingerDownOrder[Cache->FingerDownCount++] = i;
+            Cache->History[i].Count = 0;
+            newContact = TRUE;
+            Cache->FrameChanged = TRUE;
+            Cache->FrameTipChanged = TRUE;
+        }
+
+        //
+        // Ignore slots with no new information
+        //
+        if (!(Cache->FingerSlotValid & (1 << i)))
+        {
+            continue;   
+        }
+
+        //
+        // When finger is down, update local cache with new information from
+        // the controller. When finger is up, we'll use last cached value
+        //
+        Cache->FingerSlot[i].fingerStatus = fingerStatus[i];
+        if (Cache->FingerSlot[i].fingerStatus)
+        {
+            if (!newContact)
+            {
+                dx = Data->Finger[i].X - Cache->FingerSlot[i].x;
+                dy = Data->Finger[i].Y - Cache->FingerSlot[i].y;
+                dx = (dx < 0) ? -dx : dx;
+                dy = (dy < 0) ? -dy : dy;
+
+                Cache->FrameMotion = max(Cache->FrameMotion, max(dx, dy));
+
+                //
+                // Hold stationary contacts at their cached position
+                //
+                if (max(dx, dy) <= Deadband)
+                {
+                    continue;
+                }
+
+                Cache->FrameChanged = TRUE;
+            }
+
+            Cache->FingerSlot[i].x = Data->Finger[i].X;
+            Cache->FingerSlot[i].y = Data->Finger[i].Y;
+        }
+
+        //
+        // If a finger lifted, note the slot is now inactive so that any
+        // cached data is cleaned out before we read hardware again.
+        //
+        if (Cache->FingerSlot[i].fingerStatus == RMI4_FINGER_STATE_NOT_PRESENT)
+        {
+            Cache->FingerSlotDirty |= (1 << i);
+            Cache->FingerSlotValid &= ~(1 << i);
+            Cache->FrameChanged = TRUE;
+            Cache->FrameTipChanged = TRUE;
+        }
+    }
+
+    //
+    // Get current scan time (in 100us units)
+    //
+    Cache->ScanTime = RmiQueryTimePrecise() / 1000;
+
+    //
+    // Record where each contact still down was seen at this scan time
+    //
+    slots = Cache->FingerSlotValid;
+
+    for_each_set_bit(i, &slots, RMI4_MAX_TOUCHES)
+    {
+        RtlMoveMemory(
+            &Cache->History[i].x[1],
+            &Cache->History[i].x[0],
+            sizeof(int) * (RMI4_FINGER_HISTORY_DEPTH - 1));
+        RtlMoveMemory(
+            &Cache->History[i].y[1],
+            &Cache->History[i].y[0],
+            sizeof(int) * (RMI4_FINGER_HISTORY_DEPTH - 1));
+        RtlMoveMemory(
+            &Cache->History[i].ScanTime[1],
+            &Cache->History[i].ScanTime[0],
+            sizeof(ULONG64) * (RMI4_FINGER_HISTORY_DEPTH - 1));
+
+        Cache->History[i].x[0] = Cache->FingerSlot[i].x;
+        Cache->History[i].y[0] = Cache->FingerSlot[i].y;
+        Cache->History[i].ScanTime[0] = Cache->ScanTime;
+
+        if (Cache->History[i].Count < RMI4_FINGER_HISTORY_DEPTH)
+        {
+            Cache->History[i].Count++;
+        }
+    }
+}
+
+VOID
+RmiQueueReportRate(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN UCHAR ReportRate
+    )
+/*++
+
+Routine Description:
+
+    Queues a change of the F01 ReportRate bit, to be written once the
+    delivery stage has released ControllerLock. Called with
+    ControllerLock held.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    ReportRate - Either RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD
+                 or RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ControllerContext->DeviceControlWrite.Pending |= RMI4_DEVICE_CONTROL_REPORT_RATE;
+    ControllerContext->DeviceControlWrite.ReportRate = ReportRate;
+}
+
+VOID
+RmiQueueNoSleep(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN BOOLEAN NoSleep
+    )
+/*++
+
+Routine Description:
+
+    Queues a change of the F01 NoSleep bit, to be written once the
+    delivery stage has released ControllerLock. Called with
+    ControllerLock held.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    NoSleep - TRUE to disable doze, FALSE to allow it
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ControllerContext->DeviceControlWrite.Pending |= RMI4_DEVICE_CONTROL_NO_SLEEP;
+    ControllerContext->DeviceControlWrite.NoSleep = NoSleep;
+}
+
+NTSTATUS
+RmiWriteDeviceControl(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN RMI4_DEVICE_CONTROL_WRITE* Write
+    )
+/*++
+
+Routine Description:
+
+    Writes F01 device control changes queued by the delivery stage, doze
+    first so a pre-wake leaves doze before the rate goes up. Called
+    without ControllerLock, under the interrupt lock. Changes that could
+    not be written are queued again, unless delivery queued a newer value
+    meanwhile, so they are retried after the next frame.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current SPB context (I2C, etc)
+    Write - Changes taken from the queue
+
+Return Value:
+
+    NTSTATUS indicating whether every change was written
+
+--*/
+{
+    NTSTATUS status;
+    BYTE failed;
+
+    status = STATUS_SUCCESS;
+    failed = 0;
+
+    if (Write->Pending & RMI4_DEVICE_CONTROL_NO_SLEEP)
+    {
+        status = RmiSetNoSleep(
+            ControllerContext,
+            SpbContext,
+            Write->NoSleep);
+
+        if (!NT_SUCCESS(status))
+        {
+            failed = Write->Pending;
+        }
+    }
+
+    if ((Write->Pending & RMI4_DEVICE_CONTROL_REPORT_RATE) && failed == 0)
+    {
+        status = RmiSetReportRate(
+            ControllerContext,
+            SpbContext,
+            Write->ReportRate);
+
+        if (!NT_SUCCESS(status))
+        {
+            failed = RMI4_DEVICE_CONTROL_REPORT_RATE;
+        }
+    }
+
+    if (failed != 0)
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REPORTING,
+            "Could not write F01 device control changes 0x%x - %!STATUS!",
+            failed,
+            status);
+
+        RmiLockAcquire(ControllerContext->ControllerLock);
+
+        failed &= ~ControllerContext->DeviceControlWrite.Pending;
+
+        if (failed & RMI4_DEVICE_CONTROL_NO_SLEEP)
+        {
+            RmiQueueNoSleep(ControllerContext, Write->NoSleep);
+        }
+
+        if (failed & RMI4_DEVICE_CONTROL_REPORT_RATE)
+        {
+            RmiQueueReportRate(ControllerContext, Write->ReportRate);
+        }
+
+        RmiLockRelease(ControllerContext->ControllerLock);
+    }
+
+    return status;
+}
+
+VOID
+RmiUpdateReportRate(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Raises the controller report rate while contacts are moving quickly and
+    drops it back once motion has settled. Entering burst mode happens as
+    soon as a frame moves at least BurstEnterVelocity; leaving it requires
+    BurstExitFrames consecutive frames below BurstExitVelocity, or all
+    contacts lifting. The rate is dropped in the frame the last contact
+    lifts in, since a controller with nothing on it may not interrupt
+    again. The rate change is queued, see RmiWriteDeviceControl.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_REPORT_RATE_SETTINGS_LOGICAL* settings;
+    RMI4_FINGER_CACHE* cache;
+
+    settings = &ControllerContext->Config.ReportRateSettings;
+    cache = &ControllerContext->Cache;
+
+    //
+    // Nothing to do if burst mode is disabled, if the controller was
+    // statically configured to run at the high report rate, or while hover
+    // pre-wake is holding the high rate
+    //
+    if (!settings->BurstEnable ||
+        ControllerContext->Config.DeviceSettings.ReportRate ||
+        ControllerContext->PreWakeActive)
+    {
+        return;
+    }
+
+    if (!ControllerContext->HighReportRate)
+    {
+        if (cache->FingerSlotValid == 0 ||
+            (UINT32) cache->FrameMotion < settings->BurstEnterVelocity)
+        {
+            return;
+        }
+
+        RmiQueueReportRate(
+            ControllerContext,
+            RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH);
+
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_REPORTING,
+            "Entered burst report rate, motion %d",
+            cache->FrameMotion);
+
+        ControllerContext->HighReportRate = TRUE;
+        ControllerContext->BurstQuietFrames = 0;
+
+        return;
+    }
+
+    //
+    // Count consecutive quiet frames while in burst mode
+    //
+    if (cache->FingerSlotValid != 0 &&
+        (UINT32) cache->FrameMotion >= settings->BurstExitVelocity)
+    {
+        ControllerContext->BurstQuietFrames = 0;
+        return;
+    }
+
+    ControllerContext->BurstQuietFrames++;
+
+    if (cache->FingerSlotValid != 0 &&
+        (UINT32) ControllerContext->BurstQuietFrames < settings->BurstExitFrames)
+    {
+        return;
+    }
+
+    RmiQueueReportRate(
+        ControllerContext,
+        RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_REPORTING,
+        "Left burst report rate after %d quiet frames",
+        ControllerContext->BurstQuietFrames);
+
+    ControllerContext->HighReportRate = FALSE;
+    ControllerContext->BurstQuietFrames = 0;
+}
+
+VOID
+RmiUpdatePreWake(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN RMI4_F11_DATA_REGISTERS* Data
+    )
+/*++
+
+Routine Description:
+
+    When a hovering finger is reported with no contacts down, takes the
+    controller out of doze and into the high report rate so the first
+    contact is scanned at full rate. The pre-wake state is released by the
+    first frame with neither hover nor contacts, a controller with nothing
+    on it raises no more attention to count idle frames by. Doze and rate
+    changes are queued, see RmiWriteDeviceControl.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Data - The touch data just read from the controller
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_PREWAKE_SETTINGS_LOGICAL* settings;
+    RMI4_FINGER_CACHE* cache;
+
+    settings = &ControllerContext->Config.PreWakeSettings;
+    cache = &ControllerContext->Cache;
+
+    if (!settings->HoverPreWake)
+    {
+        return;
+    }
+
+    if (!ControllerContext->PreWakeActive)
+    {
+        if (Data->HoverCount == 0 || cache->FingerSlotValid != 0)
+        {
+            return;
+        }
+
+        RmiQueueNoSleep(
+            ControllerContext,
+            TRUE);
+
+        if (!ControllerContext->HighReportRate &&
+            !ControllerContext->Config.DeviceSettings.ReportRate)
+        {
+            RmiQueueReportRate(
+                ControllerContext,
+                RMI4_F01_DEVICE_CONTROL_REPORT_RATE_HIGH);
+
+            ControllerContext->HighReportRate = TRUE;
+            ControllerContext->BurstQuietFrames = 0;
+        }
+
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_REPORTING,
+            "Hover detected, controller pre-woken");
+
+        ControllerContext->PreWakeActive = TRUE;
+        ControllerContext->PreWakeSince = cache->ScanTime;
+        return;
+    }
+
+    //
+    // Note how far ahead of the first contact the pre-wake kicked in
+    //
+    if (ControllerContext->PreWakeSince != 0 && cache->FingerDownCount != 0)
+    {
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_REPORTING,
+            "First contact landed %I64u00us after hover pre-wake",
+            cache->ScanTime - ControllerContext->PreWakeSince);
+
+        ControllerContext->PreWakeSince = 0;
+    }
+
+    if (Data->HoverCount != 0 || cache->FingerSlotValid != 0)
+    {
+        return;
+    }
+
+    //
+    // Hover went away, restore the configured doze and report rate
+    //
+    RmiQueueNoSleep(
+        ControllerContext,
+        ControllerContext->Config.DeviceSettings.NoSleep != 0);
+
+    if (ControllerContext->HighReportRate)
+    {
+        RmiQueueReportRate(
+            ControllerContext,
+            RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+        ControllerContext->HighReportRate = FALSE;
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_REPORTING,
+        "Hover pre-wake released");
+
+    ControllerContext->PreWakeActive = FALSE;
+    ControllerContext->PreWakeSince = 0;
+}
+
+//
+// History older than this (in 100us units) is too stale to predict from,
+// and predicting further ahead than 100ms is never useful
+//
+#define RMI4_PREDICTION_MAX_INTERVAL    500
+#define RMI4_PREDICTION_MAX_HORIZON     1000
+
+static int
+RmiPredictAxis(
+    IN int* Position,
+    IN ULONG64* ScanTime,
+    IN int Count,
+    IN LONG64 Horizon,
+    IN LONG64 MaxDistance,
+    IN LONG64 Limit
+    )
+/*++
+
+Routine Description:
+
+    Extrapolates one axis of a contact Horizon ahead, using velocity over
+    the last two samples and, when three are available, acceleration.
+
+Arguments:
+
+    Position - Position history, newest first
+    ScanTime - Matching scan times in 100us units
+    Count - Number of valid history entries
+    Horizon - How far ahead to predict in 100us units
+    MaxDistance - Largest offset applied, in sensor units
+    Limit - Size of the sensor along this axis, in sensor units
+
+Return Value:
+
+    The predicted position, kept on the sensor
+
+--*/
+{
+    LONG64 dt01, dt12;
+    LONG64 d01, d12;
+    LONG64 offset;
+
+    dt01 = (LONG64) (ScanTime[0] - ScanTime[1]);
+    d01 = Position[0] - Position[1];
+
+    if (dt01 <= 0 || dt01 > RMI4_PREDICTION_MAX_INTERVAL)
+    {
+        return Position[0];
+    }
+
+    //
+    // p + v * h
+    //
+    offset = d01 * Horizon / dt01;
+
+    if (Count >= 3)
+    {
+        dt12 = (LONG64) (ScanTime[1] - ScanTime[2]);
+        d12 = Position[1] - Position[2];
+
+        //
+        // + a * h^2 / 2, with a = (v01 - v12) / ((dt01 + dt12) / 2)
+        //
+        if (dt12 > 0 && dt12 <= RMI4_PREDICTION_MAX_INTERVAL)
+        {
+            offset += (d01 * dt12 - d12 * dt01) * Horizon * Horizon /
+                (dt01 * dt12 * (dt01 + dt12));
+        }
+    }
+
+    offset = max(offset, -MaxDistance);
+    offset = min(offset, MaxDistance);
+
+    return (int) min(max(Position[0] + offset, 0), Limit - 1);
+}
+
+VOID
+RmiFillNextHidReportFromCache(
+    IN PPTP_REPORT HidReport,
+    IN RMI4_FINGER_CACHE *Cache,
+    IN PTOUCH_SCREEN_PROPERTIES Props,
+    IN RMI4_PREDICTION_SETTINGS_LOGICAL *Prediction,
+    IN int *TouchesReported,
+    IN int TouchesTotal
+    )
+/*++
+
+Routine Description:
+
+    This routine fills a HID report with the next touch entries in
+    the local device finger cache. Every byte of the report is written,
+    so the buffer does not need to be zeroed beforehand.
+
+    The routine also adjusts X/Y coordinates to match the desired display
+    coordinates, after optionally moving contacts that are still down
+    ahead along their recent motion.
+
+Arguments:
+
+    HidReport - pointer to the HID report structure to fill
+    Cache - pointer to the local device finger cache
+    Props - information on how to adjust X/Y coordinates to match the display
+    Prediction - how far ahead contact positions should be extrapolated
+    TouchesReported - On entry, the number of touches (against total) that
+        have already been reported. As touches are transferred from the local
+        device cache to a HID report, this number is incremented.
+    TouchesTotal - total number of touches in the touch cache
+
+Return Value:
+
+    None.
+
+--*/
+{
+    int currentFingerIndex;
+    int fingersToReport = min(TouchesTotal - *TouchesReported, 5);
+    USHORT SctatchX = 0, ScratchY = 0;
+    RMI4_FINGER_HISTORY* history;
+    LONG64 horizon = min((LONG64) Prediction->PredictionHorizon * 10, RMI4_PREDICTION_MAX_HORIZON);
+    LONG64 sensorWidth;
+    LONG64 sensorHeight;
+
+    //
+    // Predicted positions stay on the sensor. The sensor size is given
+    // after any axis swap, prediction works on controller coordinates.
+    //
+    sensorWidth = Props->TouchSwapAxes ?
+        Props->TouchPhysicalHeight : Props->TouchPhysicalWidth;
+    sensorHeight = Props->TouchSwapAxes ?
+        Props->TouchPhysicalWidth : Props->TouchPhysicalHeight;
+    sensorWidth = min(max(sensorWidth, 1), 0x10000);
+    sensorHeight = min(max(sensorHeight, 1), 0x10000);
+
+    HidReport->ReportID = REPORTID_MULTITOUCH;
+
+    //
+    // There are only 16-bits for ScanTime, truncate it
+    //
+    HidReport->ScanTime = Cache->ScanTime & 0xFFFF;
+
+    //
+    // No button in our context
+    // 
+    HidReport->IsButtonClicked = FALSE;
+
+    //
+    // Report the count
+    // We're sending touches using hybrid mode with 5 fingers in our
+    // report descriptor. The first report must indicate the
+    // total count of touch fingers detected by the digitizer.
+    // The remaining reports must indicate 0 for the count.
+    // The first report will have the TouchesReported integer set to 0
+    // The others will have it set to something else.
+    //
+    if (*TouchesReported == 0)
+    {
+        HidReport->ContactCount = (UCHAR)TouchesTotal;
+    }
+    else
+    {
+        HidReport->ContactCount = 0;
+    }
+
+    //
+    // Only five fingers supported yet
+    //
+    for (currentFingerIndex = 0; currentFingerIndex < fingersToReport; currentFingerIndex++)
+    {
+        int currentlyReporting = Cache->FingerDownOrder[*TouchesReported];
+
+        RtlZeroMemory(&HidReport->Contacts[currentFingerIndex], sizeof(PTP_CONTACT));
+        HidReport->Contacts[currentFingerIndex].ContactID = (UCHAR)currentlyReporting;
+        SctatchX = (USHORT)Cache->FingerSlot[currentlyReporting].x;
+        ScratchY = (USHORT)Cache->FingerSlot[currentlyReporting].y;
+        HidReport->Contacts[currentFingerIndex].Confidence = 1;
+
+        //
+        // Extrapolate contacts that are still down, never lifts
+        //
+        history = &Cache->History[currentlyReporting];
+
+        if (horizon != 0 &&
+            Cache->FingerSlot[currentlyReporting].fingerStatus &&
+            history->Count >= 2)
+        {
+            SctatchX = (USHORT) RmiPredictAxis(
+                history->x,
+                history->ScanTime,
+                history->Count,
+                horizon,
+                Prediction->PredictionMaxDistance,
+                sensorWidth);
+            ScratchY = (USHORT) RmiPredictAxis(
+                history->y,
+                history->ScanTime,
+                history->Count,
+                horizon,
+                Prediction->PredictionMaxDistance,
+                sensorHeight);
+        }
+
+        //
+        // Perform per-platform x/y adjustments to controller coordinates
+        //
+        TchTranslateToDisplayCoordinates(
+            &SctatchX,
+            &ScratchY,
+            Props);
+
+        HidReport->Contacts[currentFingerIndex].X = SctatchX;
+        HidReport->Contacts[currentFingerIndex].Y = ScratchY;
+
+        if (Cache->FingerSlot[currentlyReporting].fingerStatus)
+        {
+            HidReport->Contacts[currentFingerIndex].TipSwitch = FINGER_STATUS;
+        }
+
+        (*TouchesReported)++;
+    }
+
+    //
+    // Clear only the contacts left unused in this report
+    //
+    if (fingersToReport < (int) RTL_NUMBER_OF(HidReport->Contacts))
+    {
+        RtlZeroMemory(
+            &HidReport->Contacts[fingersToReport],
+            (RTL_NUMBER_OF(HidReport->Contacts) - (size_t) fingersToReport) * sizeof(PTP_CONTACT));
+    }
+}
+
+BOOLEAN
+RmiPaceFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Decides whether the frame just cached is reported or coalesced. With
+    pacing on, reports go out at most PacingRate times per second. Frames
+    in between only update the cache, so the next report carries the
+    latest state of every contact. Frames where a contact landed or lifted
+    always pass through.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    TRUE if the frame should be reported, FALSE if it was coalesced
+
+--*/
+{
+    ULONG64 now;
+    ULONG64 interval;
+
+    if (ControllerContext->Config.PacingRate == 0)
+    {
+        return TRUE;
+    }
+
+    //
+    // Pacing interval in 100us units, like the cache scan time
+    //
+    now = ControllerContext->Cache.ScanTime;
+    interval = 10000 / ControllerContext->Config.PacingRate;
+
+    if (!ControllerContext->Cache.FrameTipChanged &&
+        now - ControllerContext->PacingLastReport < interval)
+    {
+        if (ControllerContext->PacingHeldSince == 0)
+        {
+            ControllerContext->PacingHeldSince = now;
+        }
+
+        ControllerContext->Counters.PacedFrames++;
+        return FALSE;
+    }
+
+    //
+    // Account for how long the oldest coalesced frame waited
+    //
+    if (ControllerContext->PacingHeldSince != 0)
+    {
+        ControllerContext->Counters.PacingLatency +=
+            now - ControllerContext->PacingHeldSince;
+        ControllerContext->PacingHeldSince = 0;
+    }
+
+    ControllerContext->PacingLastReport = now;
+
+    return TRUE;
+}
+
+ULONG64
+RmiPacingFlushDue(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Returns when frames coalesced by pacing are due to be reported. If
+    no frame arrives by then, the lift watchdog reports them from the
+    cache, so the last state of a contact that stopped moving is not
+    held back indefinitely.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    Due time in 100us units, like the cache scan time, or 0 if nothing
+    is held back
+
+--*/
+{
+    if (ControllerContext->Config.PacingRate == 0 ||
+        ControllerContext->PacingHeldSince == 0)
+    {
+        return 0;
+    }
+
+    return ControllerContext->PacingLastReport +
+        10000 / ControllerContext->Config.PacingRate;
+}
+
+VOID
+RmiProfileStage(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Stage,
+    IN int Contacts,
+    IN ULONG64 Start,
+    IN ULONG64 End
+    )
+/*++
+
+Routine Description:
+
+    Charges time spent in a hot path stage to the profile bucket for the
+    number of contacts down.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Stage - RMI4_STAGE_XXX
+    Contacts - Contacts down in the frame
+    Start - Time the stage was entered, from RmiQueryTimePrecise
+    End - Time the stage was left, from RmiQueryTimePrecise
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_HOT_PATH_PROFILE* profile;
+
+    profile = &ControllerContext->Profile;
+    Contacts = max(0, min(Contacts, RMI4_MAX_TOUCHES));
+
+    profile->Frames[Stage][Contacts]++;
+    profile->Time[Stage][Contacts] += End - Start;
+}
+
+NTSTATUS
+RmiServiceTouchDataInterrupt(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN PTCH_NEXT_REPORT_BUFFER NextReportBuffer,
+    IN VOID *BufferContext,
+    IN ULONG ReportIndex,
+    IN UCHAR InputMode,
+    OUT BOOLEAN* PendingTouches
+    )
+/*++
+
+Routine Description:
+
+    Called when a touch interrupt needs service. A report buffer is only
+    asked for once there is a report to fill.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    NextReportBuffer - Supplies the buffer to fill with a hid report, or
+        NULL if no reader is waiting. Touch data is then still decoded so
+        the cache sees lifts, and the report is dropped. May be NULL.
+    BufferContext - Passed to NextReportBuffer
+    ReportIndex - Passed to NextReportBuffer
+    InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
+    PendingTouches - Notifies caller if there are more touches to report, to 
+        complete reporting the full state of fingers on the screen
+
+Return Value:
+
+    NTSTATUS indicating whether or not the current hid report buffer was filled
+
+    PendingTouches also indicates whether the caller should expect more than
+        one request to be completed to indicate the full state of fingers on 
+        the screen
+--*/
+{
+    RMI4_F11_DATA_REGISTERS data;
+    ULONG64 stamp[RMI4_STAGE_COUNT];
+    PPTP_REPORT hidReport;
+    BOOLEAN profile;
+    NTSTATUS status;
+
+    UNREFERENCED_PARAMETER(InputMode);
+
+    status = STATUS_SUCCESS;
+    RtlZeroMemory(&data, sizeof(data));
+    NT_ASSERT(PendingTouches != NULL);
+    *PendingTouches = FALSE;
+    profile = (ControllerContext->Config.HotPathProfile != 0);
+
+    //
+    // If no touches are unreported in our cache, decode the next set of
+    // touches read from hardware.
+    //
+    if (ControllerContext->TouchesReported == ControllerContext->TouchesTotal)
+    {
+        if (profile)
+        {
+            stamp[RMI4_STAGE_DECODE] = RmiQueryTimePrecise();
+        }
+
+        //
+        // A frame held for the next reader stays where it is
+        //
+        if (ControllerContext->FrameHeld)
+        {
+            status = STATUS_NO_DATA_DETECTED;
+            goto exit;
+        }
+
+        //
+        // See if the acquisition stage left new touch data
+        //
+        status = RmiDecodeTouchFrame(
+            ControllerContext,
+            &data
+            );
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+               TRACE_LEVEL_VERBOSE,
+                TRACE_SAMPLES,
+                "No touch data to report - %!STATUS!",
+                status);
+
+            goto exit;
+        }
+
+        if (profile)
+        {
+            stamp[RMI4_STAGE_REJECT] = RmiQueryTimePrecise();
+        }
+
+        //
+        // Drop palms and the contacts around them before they are cached
+        //
+        RmiRejectPalms(
+            ControllerContext,
+            &data);
+
+        //
+        // Hold back contacts landing in the edge rejection bands
+        //
+        RmiRejectEdges(
+            ControllerContext,
+            &data);
+
+        //
+        // Smooth the positions of the remaining contacts
+        //
+        RmiFilterContacts(
+            ControllerContext,
+            &data);
+
+        if (profile)
+        {
+            stamp[RMI4_STAGE_CACHE] = RmiQueryTimePrecise();
+        }
+
+        //
+        // Process the new touch data by updating our cached state
+        //
+        //
+        RmiUpdateLocalFingerCache(
+            &data,
+            &ControllerContext->Cache,
+            (int) ControllerContext->Config.JitterSettings.Deadband);
+
+        if (profile)
+        {
+            stamp[RMI4_STAGE_FILL] = RmiQueryTimePrecise();
+
+            RmiProfileStage(
+                ControllerContext,
+                RMI4_STAGE_DECODE,
+                ControllerContext->Cache.FingerDownCount,
+                stamp[RMI4_STAGE_DECODE],
+                stamp[RMI4_STAGE_REJECT]);
+
+            RmiProfileStage(
+                ControllerContext,
+                RMI4_STAGE_REJECT,
+                ControllerContext->Cache.FingerDownCount,
+                stamp[RMI4_STAGE_REJECT],
+                stamp[RMI4_STAGE_CACHE]);
+
+            RmiProfileStage(
+                ControllerContext,
+                RMI4_STAGE_CACHE,
+                ControllerContext->Cache.FingerDownCount,
+                stamp[RMI4_STAGE_CACHE],
+                stamp[RMI4_STAGE_FILL]);
+        }
+
+        //
+        // Pre-wake on hover, then adjust the controller report rate to the
+        // observed motion
+        //
+        RmiUpdatePreWake(
+            ControllerContext,
+            &data);
+
+        RmiUpdateReportRate(
+            ControllerContext);
+
+        //
+        // Prepare to report touches via HID reports
+        //
+        ControllerContext->TouchesReported = 0;
+        ControllerContext->TouchesTotal = 
+            ControllerContext->Cache.FingerDownCount;
+
+        //
+        // If no touches are present return that no data needed to be reported
+        //
+        if (ControllerContext->TouchesTotal == 0)
+        {
+            status = STATUS_NO_DATA_DETECTED;
+            goto exit;
+        }
+
+        //
+        // When elision is on, a frame where nothing landed, lifted or moved
+        // past its deadband repeats the last report and is not sent at all.
+        // Frames coalesced by pacing still have to go out, so they are not
+        // elided.
+        //
+        if (ControllerContext->Config.JitterSettings.ElideStationaryFrames &&
+            !ControllerContext->Cache.FrameChanged &&
+            ControllerContext->PacingHeldSince == 0)
+        {
+            ControllerContext->TouchesReported = ControllerContext->TouchesTotal;
+            ControllerContext->Counters.ElidedFrames++;
+            status = STATUS_NO_DATA_DETECTED;
+            goto exit;
+        }
+
+        //
+        // Rate-limit reports to the pacing rate
+        //
+        if (!RmiPaceFrame(ControllerContext))
+        {
+            ControllerContext->TouchesReported = ControllerContext->TouchesTotal;
+            status = STATUS_NO_DATA_DETECTED;
+            goto exit;
+        }
+    }
+
+    //
+    // Without a reader the rest of this frame is dropped
+    //
+    hidReport = (NextReportBuffer != NULL) ?
+        NextReportBuffer(BufferContext, ReportIndex) : NULL;
+
+    if (hidReport == NULL)
+    {
+        ControllerContext->TouchesReported = ControllerContext->TouchesTotal;
+        status = STATUS_NO_DATA_DETECTED;
+        goto exit;
+    }
+
+    if (profile)
+    {
+        stamp[RMI4_STAGE_FILL] = RmiQueryTimePrecise();
+    }
+
+    //
+    // Fill report with the next cached touches
+    //
+    RmiFillNextHidReportFromCache(
+        hidReport,
+        &ControllerContext->Cache,
+        &ControllerContext->Props,
+        &ControllerContext->Config.PredictionSettings,
+        &ControllerContext->TouchesReported,
+        ControllerContext->TouchesTotal);
+
+    if (profile)
+    {
+        RmiProfileStage(
+            ControllerContext,
+            RMI4_STAGE_FILL,
+            ControllerContext->TouchesTotal,
+            stamp[RMI4_STAGE_FILL],
+            RmiQueryTimePrecise());
+    }
+
+    //
+    // Update the caller if we still have outstanding touches to report
+    //
+    if (ControllerContext->TouchesReported < ControllerContext->TouchesTotal)
+    {
+        *PendingTouches = TRUE;
+    }
+    else
+    {
+        *PendingTouches = FALSE;
+    }
+
+exit:
+    
+    return status;
+}
+
+
+VOID
+RmiNoteFault(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Fault
+    )
+/*++
+
+Routine Description:
+
+    Counts a fault and starts timing its recovery, unless a fault of the
+    same class is already recovering.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Fault - RMI4_FAULT_XXX
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ControllerContext->Faults.Faults[Fault]++;
+
+    if (ControllerContext->FaultSince[Fault] == 0)
+    {
+        ControllerContext->FaultSince[Fault] = RmiQueryTime();
+    }
+}
+
+VOID
+RmiNoteRecovery(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN BOOLEAN FrameLost
+    )
+/*++
+
+Routine Description:
+
+    Charges the outcome of a touch frame read to every fault class that
+    is recovering. A lost frame adds to the frames lost, a frame read
+    from the controller ends recovery. Passes that read no frame, like
+    ones only handling F01 status, leave recovery running.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    FrameLost - TRUE if the frame was lost
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_FAULT_COUNTERS* faults;
+    ULONG64 now;
+    int fault;
+
+    faults = &ControllerContext->Faults;
+    now = 0;
+
+    for (fault = 0; fault < RMI4_FAULT_COUNT; fault++)
+    {
+        if (ControllerContext->FaultSince[fault] == 0)
+        {
+            continue;
+        }
+
+        if (FrameLost)
+        {
+            faults->FramesLost[fault]++;
+            continue;
+        }
+
+        if (now == 0)
+        {
+            now = RmiQueryTime();
+        }
+
+        faults->Recoveries[fault]++;
+        faults->RecoveryTime[fault] += now - ControllerContext->FaultSince[fault];
+        ControllerContext->FaultSince[fault] = 0;
+    }
+}
+
+#if DBG
+BOOLEAN
+RmiInjectFault(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG Rate
+    )
+/*++
+
+Routine Description:
+
+    Decides whether to inject a controller fault into the current status
+    read.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Rate - Fault rate, 1 in Rate reads, 0 disables
+
+Return Value:
+
+    TRUE if the fault should be injected
+
+--*/
+{
+    if (Rate == 0)
+    {
+        return FALSE;
+    }
+
+    return (RmiRandom(&ControllerContext->FaultSeed) % Rate) == 0;
+}
+#endif
+
+NTSTATUS
+RmiAcquireInterrupts(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN ReaderWaiting
+    )
+/*++
+
+Routine Description:
+
+    Acquisition stage of interrupt servicing. Reads the interrupt status
+    and, if touch data is pending, the next touch frame, without holding
+    ControllerLock. The interrupt lock serializes it with other bus users.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    ReaderWaiting - FALSE if no HID read request is pending. A touch
+        frame read while no contact is down is then held for the next
+        reader.
+
+Return Value:
+
+    NTSTATUS indicating whether the interrupt status could be read
+
+--*/
+{
+    NTSTATUS status = STATUS_SUCCESS;
+    ULONG touchInterruptMask;
+    BOOLEAN frameLost;
+    BOOLEAN hold;
+
+    ControllerContext->Counters.ServiceCalls++;
+    frameLost = FALSE;
+
+    //
+    // A frame held while nobody was reading goes to the reader that showed
+    // up, ahead of anything newer from the controller
+    //
+    if (ControllerContext->FrameHeld && ReaderWaiting)
+    {
+        ControllerContext->FrameHeld = FALSE;
+        ControllerContext->Counters.HeldFramesDelivered++;
+    }
+
+    //
+    // Check the interrupt source if no interrupts are pending processing,
+    // and there is room to acquire another frame
+    //
+    if (ControllerContext->InterruptStatus == 0 &&
+        (!ControllerContext->FrameReady || ControllerContext->FrameHeld))
+    {
+        status = RmiCheckInterrupts(
+            ControllerContext,
+            SpbContext, 
+            &ControllerContext->InterruptStatus);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INTERRUPT,
+                "Error servicing interrupts - %!STATUS!",
+                status);
+
+            frameLost = TRUE;
+            goto exit;
+        }
+    }
+
+    touchInterruptMask = RmiGetFunctionInterruptMask(
+        ControllerContext,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    //
+    // Only functions with enabled handlers should be raising interrupts,
+    // anything else is left over from before the enable mask was programmed
+    //
+    if (ControllerContext->InterruptStatus & ~ControllerContext->InterruptEnableMask)
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INTERRUPT,
+            "Ignoring following interrupt flags - 0x%x",
+            ControllerContext->InterruptStatus & ~ControllerContext->InterruptEnableMask);
+
+        //
+        // Mask away flags we don't service
+        //
+        ControllerContext->InterruptStatus &= ControllerContext->InterruptEnableMask;
+    }
+
+    //
+    // F01 status changes were already handled while reading the status
+    //
+    ControllerContext->InterruptStatus &= ~RmiGetFunctionInterruptMask(
+        ControllerContext,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    //
+    // A controller that lost its configuration may report a different
+    // packet once reconfigured, its touch data is read after delivery has
+    // reconfigured it
+    //
+    if (!(ControllerContext->InterruptStatus & touchInterruptMask) ||
+        (ControllerContext->FrameReady && !ControllerContext->FrameHeld) ||
+        ControllerContext->ReconfigurePending)
+    {
+        goto exit;
+    }
+
+    //
+    // With surface reporting off, touch data raised before the interrupt
+    // was masked is dropped without reading it from the controller. The
+    // interrupt is masked while off, so frames the controller scans after
+    // that are never seen and not counted as skipped.
+    //
+    if (!ControllerContext->SurfaceReportingOn)
+    {
+        ControllerContext->Counters.TouchFramesSkipped++;
+        ControllerContext->Counters.TouchBytesSkipped += ControllerContext->PacketSize;
+        ControllerContext->InterruptStatus &= ~touchInterruptMask;
+        goto exit;
+    }
+
+    //
+    // When nobody would see the frame and no contact is down, it is held
+    // for the next reader instead. Only the latest such frame is kept.
+    //
+    hold = !ReaderWaiting && !ControllerContext->ContactsDown;
+
+    if (ControllerContext->FrameHeld)
+    {
+        ControllerContext->FrameHeld = FALSE;
+        ControllerContext->FrameReady = FALSE;
+    }
+
+    //
+    // Read the touch frame. The touch interrupt is serviced either way, a
+    // frame that could not be read is dropped.
+    //
+    if (!NT_SUCCESS(RmiAcquireTouchFrame(ControllerContext, SpbContext)))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INTERRUPT,
+            "Error acquiring touch frame");
+
+        RmiNoteFault(ControllerContext, RMI4_FAULT_BUS);
+        frameLost = TRUE;
+    }
+    else
+    {
+        RmiNoteRecovery(ControllerContext, FALSE);
+
+        if (hold)
+        {
+            ControllerContext->FrameHeld = TRUE;
+            ControllerContext->Counters.HeldFrames++;
+        }
+    }
+
+    ControllerContext->InterruptStatus &= ~touchInterruptMask;
+
+    //
+    // Add acquisition for additional touch interrupts here
+    //
+
+exit:
+
+    if (frameLost)
+    {
+        RmiNoteRecovery(ControllerContext, TRUE);
+    }
+
+    return status;
+}
+
+VOID
+RmiNoteServiceLatency(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG64 Latency
+    )
+/*++
+
+Routine Description:
+
+    Adds a servicing pass to the latency histogram of this controller,
+    see RMI4_LATENCY_BUCKETS.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Latency - Time the pass took, in 100ns units
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG64 linear;
+    int shift;
+    int bucket;
+
+    linear = 1ULL << RMI4_LATENCY_SUB_BITS;
+
+    if (Latency < linear)
+    {
+        bucket = (int) Latency;
+    }
+    else
+    {
+        //
+        // Scale the latency into [linear, 2 * linear), the shift picks the
+        // power of two and the scaled value the bucket within it
+        //
+        shift = 0;
+
+        while ((Latency >> shift) >= 2 * linear)
+        {
+            shift++;
+        }
+
+        bucket = ((shift + 1) << RMI4_LATENCY_SUB_BITS) +
+            (int) ((Latency >> shift) - linear);
+
+        if (bucket >= RMI4_LATENCY_BUCKETS)
+        {
+            bucket = RMI4_LATENCY_BUCKETS - 1;
+        }
+    }
+
+    ControllerContext->Counters.ServiceLatency[bucket]++;
+}
+
+NTSTATUS
+TchServiceInterrupts(
+    IN VOID *ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN ReaderWaiting,
+    IN PTCH_NEXT_REPORT_BUFFER NextReportBuffer,
+    IN VOID *BufferContext,
+    IN ULONG MaxReports,
+    IN UCHAR InputMode,
+    OUT ULONG *ReportsFilled,
+    OUT BOOLEAN *ServicingComplete
+    )
+/*++
+
+Routine Description:
+
+    This routine is called in response to an interrupt. Servicing is a
+    two-stage pipeline:
+
+    - Acquisition reads the interrupt status and the next touch frame,
+      without holding ControllerLock.
+    - Delivery, under a single hold of ControllerLock, reconfigures a
+      controller that lost its configuration, decodes the frame into the
+      finger cache and builds every HID report for it. Report rate and
+      doze changes decided on the way are written after ControllerLock is
+      released.
+
+    A frame acquired while reports of the previous one are still pending
+    waits until they are delivered. Report buffers are requested from the
+    caller one at a time, only once a report is ready to be filled, so
+    passes with nothing to report take no buffer at all and the caller
+    can complete every buffer back-to-back afterwards.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    ReaderWaiting - Whether a reader is waiting for reports, without
+        taking a buffer from it yet. Decides whether touch data arriving
+        while no contact is down is delivered or held.
+    NextReportBuffer - Supplies the buffer for each report. A NULL buffer
+        means no reader is waiting after all, touch data is then
+        acknowledged without producing a report. If NULL itself,
+        interrupts are serviced without any report buffer.
+    BufferContext - Passed to NextReportBuffer
+    MaxReports - Most reports to build before returning
+    InputMode - Specifies mouse, single-touch, or multi-touch reporting modes
+    ReportsFilled - Number of buffers supplied, each of which holds a
+        report
+    ServicingComplete - Notifies caller if there are more reports needed to 
+        complete servicing interrupts coming from the hardware.
+
+Return Value:
+
+    NTSTATUS indicating whether the controller could be serviced. On
+        failure servicing is not complete, but calling again right away
+        will not help, the caller should wait for the next interrupt.
+
+    ServicingComplete indicates whether or not servicing needs to be
+        continued with more report buffers.
+--*/
+{
+    NTSTATUS status;
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_DEVICE_CONTROL_WRITE deviceControl;
+    BOOLEAN pendingTouches;
+    ULONG64 serviceStart;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+
+    NT_ASSERT(ServicingComplete != NULL);
+    NT_ASSERT(ReportsFilled != NULL);
+
+    *ServicingComplete = FALSE;
+    *ReportsFilled = 0;
+
+    serviceStart = RmiQueryTimePrecise();
+
+    status = RmiAcquireInterrupts(
+        controller,
+        SpbContext,
+        ReaderWaiting && (NextReportBuffer != NULL));
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    //
+    // Grab a waitlock to ensure delivery is protected against the lift
+    // watchdog and power state transitions
+    //
+    RmiLockAcquire(controller->ControllerLock);
+
+    controller->Counters.ServiceLockHolds++;
+
+    //
+    // Reconfiguring resets the touch state delivery works on
+    //
+    if (controller->ReconfigurePending)
+    {
+        status = RmiConfigureFunctions(
+            controller,
+            SpbContext);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_ERROR,
+                TRACE_INTERRUPT,
+                "Could not reconfigure chip - %!STATUS!",
+                status);
+
+            goto release;
+        }
+    }
+
+    while (*ReportsFilled < MaxReports)
+    {
+        //
+        // Success indicates the report is ready to be sent, anything
+        // else that there is nothing (more) to report
+        //
+        if (!NT_SUCCESS(RmiServiceTouchDataInterrupt(
+                controller,
+                NextReportBuffer,
+                BufferContext,
+                *ReportsFilled,
+                InputMode,
+                &pendingTouches)))
+        {
+            break;
+        }
+
+        (*ReportsFilled)++;
+
+        if (pendingTouches == FALSE)
+        {
+            break;
+        }
+    }
+
+    //
+    // Indicate whether or not we're done servicing interrupts
+    //
+    *ServicingComplete =
+        (controller->InterruptStatus == 0) &&
+        (!controller->FrameReady || controller->FrameHeld) &&
+        (controller->TouchesReported == controller->TouchesTotal);
+
+    controller->Counters.ReportsFilled += *ReportsFilled;
+
+release:
+
+    //
+    // Leave acquisition what it needs to know of the cache, and take the
+    // device control changes to write
+    //
+    controller->ContactsDown = (controller->Cache.FingerSlotValid != 0);
+    deviceControl = controller->DeviceControlWrite;
+    controller->DeviceControlWrite.Pending = 0;
+
+    RmiLockRelease(controller->ControllerLock);
+
+    if (deviceControl.Pending != 0)
+    {
+        (VOID) RmiWriteDeviceControl(
+            controller,
+            SpbContext,
+            &deviceControl);
+    }
+
+exit:
+
+    serviceStart = RmiQueryTimePrecise() - serviceStart;
+    controller->Counters.ServiceTime += serviceStart;
+    RmiNoteServiceLatency(controller, serviceStart);
+
+    return status;
+}
+
+NTSTATUS
+TchServiceLiftWatchdog(
+    IN VOID *ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN PTCH_NEXT_REPORT_BUFFER NextReportBuffer,
+    IN VOID *BufferContext,
+    OUT BOOLEAN *ServicingComplete
+    )
+/*++
+
+Routine Description:
+
+    Called when the lift watchdog expires. Frames coalesced by pacing
+    that are due and were not followed by another frame are reported
+    from the cache. Otherwise, if no touch frame has arrived for
+    LiftTimeout while contacts are down, the controller is assumed to
+    have stopped reporting them, and lifts are synthesized for every
+    contact from the cache.
+
+    In reduced reporting mode the controller also goes quiet while
+    contacts hold still, so the F12 objects of the cached slots are read
+    first, and lifts are only synthesized once none of them is still
+    reported. Otherwise no bus I/O is done.
+
+    The caller holds the interrupt lock, so register access is serialized
+    with the acquisition stage of interrupt servicing.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    NextReportBuffer - Supplies the buffer for the report, only called
+        once there is one to fill. Without a buffer the lifts only update
+        the cache.
+    BufferContext - Passed to NextReportBuffer
+    ServicingComplete - Notifies caller if more reports are needed to
+        report every lifted contact
+
+Return Value:
+
+    NTSTATUS, where only success indicates a report buffer was filled
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_F11_DATA_REGISTERS data;
+    PPTP_REPORT hidReport;
+    NTSTATUS status;
+    ULONG64 now;
+    ULONG64 flushDue;
+    UINT32 present;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+    status = STATUS_NO_DATA_DETECTED;
+    *ServicingComplete = TRUE;
+
+    RmiLockAcquire(controller->ControllerLock);
+
+    //
+    // Start a new report only once the previous frame was fully reported
+    //
+    if (controller->TouchesReported == controller->TouchesTotal)
+    {
+        now = RmiQueryTime() / 1000;
+        flushDue = RmiPacingFlushDue(controller);
+
+        //
+        // Report what pacing held back, as if the next frame had arrived
+        //
+        if (flushDue != 0 && now >= flushDue)
+        {
+            controller->Counters.PacingLatency += now - controller->PacingHeldSince;
+            controller->Counters.PacingFlushes++;
+            controller->PacingHeldSince = 0;
+            controller->PacingLastReport = now;
+
+            controller->TouchesReported = 0;
+            controller->TouchesTotal = controller->Cache.FingerDownCount;
+
+            if (controller->TouchesTotal == 0)
+            {
+                goto exit;
+            }
+
+            goto fill;
+        }
+
+        if (controller->Config.LiftTimeout == 0 ||
+            controller->Cache.FingerSlotValid == 0 ||
+            now - max(controller->Cache.ScanTime, controller->LiftConfirmedTime) <
+                (ULONG64) controller->Config.LiftTimeout * 10)
+        {
+            goto exit;
+        }
+
+        //
+        // Contacts the controller still reports are left down, and
+        // checked again after another timeout
+        //
+        if (controller->ReportingMode != RMI_F12_REPORTING_MODE_CONTINUOUS)
+        {
+            if (!NT_SUCCESS(RmiReadContactObjects(
+                    controller,
+                    SpbContext,
+                    &present)) ||
+                present != 0)
+            {
+                controller->LiftConfirmedTime = now;
+                goto exit;
+            }
+        }
+
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_REPORTING,
+            "No touch data for %I64u00us, lifting contacts 0x%x",
+            now - controller->Cache.ScanTime,
+            controller->Cache.FingerSlotValid);
+
+        controller->Counters.WatchdogLifts++;
+
+        //
+        // An empty frame lifts every contact in the cache
+        //
+        RtlZeroMemory(&data, sizeof(data));
+
+        RmiUpdateLocalFingerCache(
+            &data,
+            &controller->Cache,
+            0);
+
+        controller->PalmRejectedSlots = 0;
+        controller->EdgeHeldSlots = 0;
+        controller->Filter.SlotValid = 0;
+
+        controller->TouchesReported = 0;
+        controller->TouchesTotal = controller->Cache.FingerDownCount;
+
+        if (controller->TouchesTotal == 0)
+        {
+            goto exit;
+        }
+    }
+
+fill:
+
+    hidReport = (NextReportBuffer != NULL) ?
+        NextReportBuffer(BufferContext, 0) : NULL;
+
+    if (hidReport == NULL)
+    {
+        controller->TouchesReported = controller->TouchesTotal;
+        goto exit;
+    }
+
+    RmiFillNextHidReportFromCache(
+        hidReport,
+        &controller->Cache,
+        &controller->Props,
+        &controller->Config.PredictionSettings,
+        &controller->TouchesReported,
+        controller->TouchesTotal);
+
+    *ServicingComplete =
+        (controller->TouchesReported == controller->TouchesTotal);
+    status = STATUS_SUCCESS;
+
+exit:
+
+    RmiLockRelease(controller->ControllerLock);
+
+    return status;
+}
+
+ULONG
+TchGetLiftWatchdogDue(
+    IN VOID *ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Returns when the lift watchdog should next run, so it is only armed
+    while contacts are down, pacing holds frames back, or lifts from
+    switching surface reporting off are still to be reported.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    Milliseconds until frames held back by pacing are due or the contacts
+    in the cache go stale, whichever comes first. 0 if neither applies.
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    ULONG64 now;
+    ULONG64 timeout;
+    ULONG64 elapsed;
+    ULONG64 flushDue;
+    ULONG due;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+    due = 0;
+
+    RmiLockAcquire(controller->ControllerLock);
+
+    now = RmiQueryTime() / 1000;
+
+    //
+    // Lifts left by switching surface reporting off are due right away
+    //
+    if (!controller->SurfaceReportingOn &&
+        controller->TouchesReported != controller->TouchesTotal)
+    {
+        due = 1;
+    }
+    else if (controller->Config.LiftTimeout != 0 &&
+        controller->Cache.FingerSlotValid != 0)
+    {
+        timeout = (ULONG64) controller->Config.LiftTimeout * 10;
+        elapsed = now - max(controller->Cache.ScanTime, controller->LiftConfirmedTime);
+
+        due = (elapsed >= timeout) ? 1 : (ULONG) ((timeout - elapsed + 9) / 10);
+    }
+
+    flushDue = RmiPacingFlushDue(controller);
+
+    if (flushDue != 0)
+    {
+        flushDue = (now >= flushDue) ? 1 : (flushDue - now + 9) / 10;
+
+        if (due == 0 || flushDue < due)
+        {
+            due = (ULONG) flushDue;
+        }
+    }
+
+    RmiLockRelease(controller->ControllerLock);
+
+    return due;
+}
+
+BOOLEAN
+TchHasHeldFrame(
+    IN VOID *ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Returns whether a touch frame read while no reader was waiting is
+    held for the next one. Servicing interrupts with a reader waiting
+    delivers it without bus I/O.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    TRUE if a frame is held
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+
+    return controller->FrameHeld;
+}
+
+VOID
+TchDropHeldFrame(
+    IN VOID *ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Drops a touch frame held for the next reader, for when it went stale
+    before a reader showed up. Called under the interrupt lock.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+
+    if (controller->FrameHeld)
+    {
+        controller->FrameHeld = FALSE;
+        controller->FrameReady = FALSE;
+    }
+}
+
+#if DBG
+ULONG
+TchGetSyntheticFramePeriod(
+    IN VOID *ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Returns the interval at which the synthetic workload raises touch
+    interrupts.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    Interval in ms, 0 if no synthetic workload is configured
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+
+    if (controller->Config.SyntheticWorkload == RMI4_SYNTHETIC_OFF ||
+        controller->Config.SyntheticRate == 0)
+    {
+        return 0;
+    }
+
+    return max(1000 / controller->Config.SyntheticRate, 1);
+}
+
+VOID
+TchQueueSyntheticFrame(
+    IN VOID *ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Raises a touch interrupt for the next synthetic frame, as if the
+    controller had reported one. Called under the interrupt lock.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+
+    controller->InterruptStatus |= RmiGetFunctionInterruptMask(
+        controller,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+}
+#endif
+
+NTSTATUS
+TchSetReportingSwitches(
+    IN VOID *ControllerContext,
+    IN SPB_CONTEXT *SpbContext,
+    IN BOOLEAN SurfaceReport,
+    IN BOOLEAN ButtonReport
+    )
+/*++
+
+Routine Description:
+
+    Applies the PTP selective reporting switches. While surface reporting
+    is off the F12 interrupt is masked and the controller is moved to
+    reduced reporting, so no touch data is read from the bus or turned
+    into reports until the host switches it back on. Contacts down when
+    it is switched off are lifted, and the lifts are left for the lift
+    watchdog to report (see TchGetLiftWatchdogDue).
+
+    The caller holds the interrupt lock, so register access is serialized
+    with the acquisition stage of interrupt servicing.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    SurfaceReport - TRUE if the host wants contact reports
+    ButtonReport - TRUE if the host wants button reports
+
+Return Value:
+
+    NTSTATUS indicating whether the controller was reprogrammed. The
+    switches take effect in the interrupt path regardless.
+
+--*/
+{
+    RMI4_CONTROLLER_CONTEXT* controller;
+    RMI4_F11_DATA_REGISTERS data;
+    NTSTATUS status;
+    ULONG64 now;
+
+    controller = (RMI4_CONTROLLER_CONTEXT*) ControllerContext;
+    status = STATUS_SUCCESS;
+
+    RmiLockAcquire(controller->ControllerLock);
+
+    controller->ButtonReportingOn = ButtonReport;
+
+    if (controller->SurfaceReportingOn == SurfaceReport)
+    {
+        goto exit;
+    }
+
+    controller->SurfaceReportingOn = SurfaceReport;
+    now = RmiQueryTime();
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REPORTING,
+        "Surface reporting switched %s",
+        SurfaceReport ? "on" : "off");
+
+    if (SurfaceReport)
+    {
+        controller->Counters.SurfaceOffTime +=
+            now - controller->Counters.SurfaceOffSince;
+
+        status = RmiSetReportingMode(
+            controller,
+            SpbContext,
+            controller->CoverSuspended ?
+                RMI_F12_REPORTING_MODE_REDUCED :
+                RMI_F12_REPORTING_MODE_CONTINUOUS,
+            NULL);
+
+        if (NT_SUCCESS(status))
+        {
+            status = RmiEnableFunctionInterrupts(
+                controller,
+                SpbContext,
+                RMI4_F12_2D_TOUCHPAD_SENSOR,
+                TRUE);
+        }
+    }
+    else
+    {
+        controller->Counters.SurfaceOffSince = now;
+
+        status = RmiEnableFunctionInterrupts(
+            controller,
+            SpbContext,
+            RMI4_F12_2D_TOUCHPAD_SENSOR,
+            FALSE);
+
+        if (NT_SUCCESS(status))
+        {
+            status = RmiSetReportingMode(
+                controller,
+                SpbContext,
+                RMI_F12_REPORTING_MODE_REDUCED,
+                NULL);
+        }
+
+        controller->DeviceControlWrite.Pending &= ~RMI4_DEVICE_CONTROL_REPORT_RATE;
+
+        if (controller->HighReportRate)
+        {
+            RmiSetReportRate(
+                controller,
+                SpbContext,
+                RMI4_F01_DEVICE_CONTROL_REPORT_RATE_STANDARD);
+
+            controller->HighReportRate = FALSE;
+            controller->BurstQuietFrames = 0;
+        }
+
+        //
+        // Forget any frame in flight, the host is no longer listening
+        //
+        controller->InterruptStatus &= ~RmiGetFunctionInterruptMask(
+            controller,
+            RMI4_F12_2D_TOUCHPAD_SENSOR);
+        controller->TouchesReported = 0;
+        controller->TouchesTotal = 0;
+        controller->PalmRejectedSlots = 0;
+        controller->EdgeHeldSlots = 0;
+        controller->Filter.SlotValid = 0;
+        controller->ContactsDown = FALSE;
+        controller->FrameReady = FALSE;
+        controller->FrameHeld = FALSE;
+
+        if (controller->Cache.FingerSlotValid == 0)
+        {
+            RtlZeroMemory(&controller->Cache, sizeof(controller->Cache));
+        }
+        else
+        {
+            //
+            // The host last saw these contacts down. An empty frame lifts
+            // them in the cache, and the lift watchdog reports the lifts
+            // since no touch frame will follow.
+            //
+            RtlZeroMemory(&data, sizeof(data));
+
+            RmiUpdateLocalFingerCache(
+                &data,
+                &controller->Cache,
+                0);
+
+            controller->TouchesTotal = controller->Cache.FingerDownCount;
+        }
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REPORTING,
+            "Could not reprogram controller for surface reporting - %!STATUS!",
+            status);
+    }
+
+exit:
+
+    RmiLockRelease(controller->ControllerLock);
+
+    return status;
+}
+
+VOID
+RmiTraceHotPathProfile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Dumps the hot path profile, one comma separated line per stage and
+    contact count that saw frames:
+
+        hotpath,<stage>,<contacts>,<frames>,<ns per frame>
+
+    so runs can be collected from the trace log and compared between
+    releases. Frames of the fill stage count reports filled. No stage
+    allocates, frames are decoded into buffers set up at start.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    static const char* stageNames[RMI4_STAGE_COUNT] =
+    {
+        "decode",
+        "reject",
+        "cache",
+        "fill"
+    };
+    RMI4_HOT_PATH_PROFILE* profile;
+    int stage;
+    int contacts;
+
+    profile = &ControllerContext->Profile;
+
+    for (stage = 0; stage < RMI4_STAGE_COUNT; stage++)
+    {
+        for (contacts = 0; contacts <= RMI4_MAX_TOUCHES; contacts++)
+        {
+            if (profile->Frames[stage][contacts] == 0)
+            {
+                continue;
+            }
+
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_REPORTING,
+                "hotpath,%s,%d,%I64u,%I64u",
+                stageNames[stage],
+                contacts,
+                profile->Frames[stage][contacts],
+                profile->Time[stage][contacts] * 100 /
+                    profile->Frames[stage][contacts]);
+        }
+    }
+}
+
+VOID
+RmiTraceFaultCounters(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Dumps fault recovery statistics, one comma separated line per fault
+    class that occurred:
+
+        fault,<class>,<faults>,<recoveries>,<frames lost>,<us to recover>
+
+    where the recovery time is the average over completed recoveries.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    static const char* faultNames[RMI4_FAULT_COUNT] =
+    {
+        "bus",
+        "reset",
+        "unconfigured"
+    };
+    RMI4_FAULT_COUNTERS* faults;
+    int fault;
+
+    faults = &ControllerContext->Faults;
+
+    for (fault = 0; fault < RMI4_FAULT_COUNT; fault++)
+    {
+        if (faults->Faults[fault] == 0)
+        {
+            continue;
+        }
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_REPORTING,
+            "fault,%s,%I64u,%I64u,%I64u,%I64u",
+            faultNames[fault],
+            faults->Faults[fault],
+            faults->Recoveries[fault],
+            faults->FramesLost[fault],
+            faults->Recoveries[fault] == 0 ? 0 :
+                faults->RecoveryTime[fault] / 10 / faults->Recoveries[fault]);
+    }
+}
+
+ULONG64
+RmiServiceLatencyPercentile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN ULONG Percentile
+    )
+/*++
+
+Routine Description:
+
+    Reads a percentile off the service latency histogram.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Percentile - Percentile, 1 to 100
+
+Return Value:
+
+    Longest latency the bucket holding the percentile counts, in 100ns
+    units, within 1/8 of the latencies it counts
+
+--*/
+{
+    RMI4_SERVICE_COUNTERS* counters;
+    ULONG64 total;
+    ULONG64 rank;
+    int bucket;
+
+    counters = &ControllerContext->Counters;
+    total = 0;
+
+    for (bucket = 0; bucket < RMI4_LATENCY_BUCKETS; bucket++)
+    {
+        total += counters->ServiceLatency[bucket];
+    }
+
+    rank = (total * Percentile + 99) / 100;
+
+    for (bucket = 0; bucket < RMI4_LATENCY_BUCKETS - 1; bucket++)
+    {
+        if (counters->ServiceLatency[bucket] >= rank)
+        {
+            break;
+        }
+
+        rank -= counters->ServiceLatency[bucket];
+    }
+
+    if (bucket < (1 << RMI4_LATENCY_SUB_BITS))
+    {
+        return bucket;
+    }
+
+    return ((ULONG64) ((1 << RMI4_LATENCY_SUB_BITS) +
+        (bucket & ((1 << RMI4_LATENCY_SUB_BITS) - 1)) + 1) <<
+        ((bucket >> RMI4_LATENCY_SUB_BITS) - 1)) - 1;
+}
+
+VOID
+RmiTraceServiceCounters(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Dumps interrupt servicing statistics, used to compare bus traffic and
+    CPU time with and without surface reporting enabled.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI4_SERVICE_COUNTERS* counters;
+    ULONG64 surfaceOffTime;
+
+    counters = &ControllerContext->Counters;
+    surfaceOffTime = counters->SurfaceOffTime;
+
+    if (!ControllerContext->SurfaceReportingOn)
+    {
+        surfaceOffTime += RmiQueryTime() - counters->SurfaceOffSince;
+    }
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REPORTING,
+        "Serviced %I64u interrupts in %I64u00ns over %I64u lock holds, "
+        "filled %I64u reports, read %I64u frames (%I64u bytes), "
+        "skipped %I64u frames (%I64u bytes), held %I64u frames for a reader "
+        "(%I64u delivered), surface off for %I64u00ns, "
+        "%I64u cover frames (%I64u bytes saved), %I64u palm frames, "
+        "%I64u palm contacts rejected, %I64u frames suppressed, "
+        "%I64u edge contacts held, %I64u edge swipes, %I64u frames elided, "
+        "%I64u watchdog lifts (%I64u object reads), %I64u frames paced (%I64u00us added latency, "
+        "%I64u flushed by the watchdog)",
+        counters->ServiceCalls,
+        counters->ServiceTime,
+        counters->ServiceLockHolds,
+        counters->ReportsFilled,
+        counters->TouchFramesRead,
+        counters->TouchBytesRead,
+        counters->TouchFramesSkipped,
+        counters->TouchBytesSkipped,
+        counters->HeldFrames,
+        counters->HeldFramesDelivered,
+        surfaceOffTime,
+        counters->CoverFrames,
+        counters->CoverBytesSaved,
+        counters->PalmFrames,
+        counters->PalmContactsRejected,
+        counters->PalmFramesSuppressed,
+        counters->EdgeContactsHeld,
+        counters->EdgeSwipesPromoted,
+        counters->ElidedFrames,
+        counters->WatchdogLifts,
+        counters->WatchdogReads,
+        counters->PacedFrames,
+        counters->PacingLatency,
+        counters->PacingFlushes);
+
+    RmiTraceFaultCounters(ControllerContext);
+
+    //
+    // latency,<device>,<p50 ns>,<p90 ns>,<p99 ns>, tagged with the device
+    // so instances can be told apart
+    //
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_REPORTING,
+        "latency,%p,%I64u,%I64u,%I64u",
+        ControllerContext->FxDevice,
+        RmiServiceLatencyPercentile(ControllerContext, 50) * 100,
+        RmiServiceLatencyPercentile(ControllerContext, 90) * 100,
+        RmiServiceLatencyPercentile(ControllerContext, 99) * 100);
+
+    if (ControllerContext->Config.HotPathProfile != 0)
+    {
+        RmiTraceHotPathProfile(ControllerContext);
+        RmiTraceBusModel(ControllerContext);
+    }
 }
@@ -33,7 +33,7 @@
 // aligned.
 //
 
-TOUCH_SCREEN_PROPERTIES gDefaultProperties =
+static TOUCH_SCREEN_PROPERTIES gDefaultProperties =
 {
     0,
     0,
@@ -47,6 +47,11 @@ TOUCH_SCREEN_PROPERTIES gDefaultProperties =
     0,
     0,
     0,
+    0,
+    0,
+    100,
+    0,
+    0,
     TOUCH_DEFAULT_RESOLUTION_X,
     TOUCH_DEFAULT_RESOLUTION_Y,
     0,
@@ -61,7 +66,7 @@ TOUCH_SCREEN_PROPERTIES gDefaultProperties =
 };
 
 
-RTL_QUERY_REGISTRY_TABLE gResParamsRegTable[] =
+static const RTL_QUERY_REGISTRY_TABLE gResParamsRegTable[] =
 {
     {
         NULL, RTL_QUERY_REGISTRY_DIRECT,
@@ -143,6 +148,46 @@ RTL_QUERY_REGISTRY_TABLE gResParamsRegTable[] =
         &gDefaultProperties.TouchLetterBoxHeightBottom,
         sizeof(ULONG)
     },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchEdgeRejectLeft",
+        (PVOID) FIELD_OFFSET(TOUCH_SCREEN_PROPERTIES, TouchEdgeRejectLeft),
+        REG_DWORD,
+        &gDefaultProperties.TouchEdgeRejectLeft,
+        sizeof(ULONG)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchEdgeRejectRight",
+        (PVOID) FIELD_OFFSET(TOUCH_SCREEN_PROPERTIES, TouchEdgeRejectRight),
+        REG_DWORD,
+        &gDefaultProperties.TouchEdgeRejectRight,
+        sizeof(ULONG)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchEdgeRejectTop",
+        (PVOID) FIELD_OFFSET(TOUCH_SCREEN_PROPERTIES, TouchEdgeRejectTop),
+        REG_DWORD,
+        &gDefaultProperties.TouchEdgeRejectTop,
+        sizeof(ULONG)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchEdgeRejectBottom",
+        (PVOID) FIELD_OFFSET(TOUCH_SCREEN_PROPERTIES, TouchEdgeRejectBottom),
+        REG_DWORD,
+        &gDefaultProperties.TouchEdgeRejectBottom,
+        sizeof(ULONG)
+    },
+    {
+        NULL, RTL_QUERY_REGISTRY_DIRECT,
+        L"TouchEdgeSwipeDistance",
+        (PVOID) FIELD_OFFSET(TOUCH_SCREEN_PROPERTIES, TouchEdgeSwipeDistance),
+        REG_DWORD,
+        &gDefaultProperties.TouchEdgeSwipeDistance,
+        sizeof(ULONG)
+    },
     {
         NULL, RTL_QUERY_REGISTRY_DIRECT,
         L"DisplayPhysicalWidth",
@@ -399,30 +444,6 @@ TchGetScreenProperties(
 
     regTable = NULL;
 
-    //
-    // Table passed to RtlQueryRegistryValues must be allocated 
-    // from NonPagedPoolNx
-    //
-    regTable = ExAllocatePoolWithTag(
-        NonPagedPoolNx,
-        gcbRegistryTable,
-        TOUCH_POOL_TAG);
-
-    RtlCopyMemory(
-        regTable,
-        gResParamsRegTable,
-        gcbRegistryTable);
-
-    //
-    // Update offset values with base pointer
-    // 
-    for (i=0; i < gcRegistryTable-1; i++)
-    {
-        regTable[i].EntryContext = (PVOID) (
-            ((SIZE_T) regTable[i].EntryContext) +
-            ((ULONG_PTR) Props));
-    }
-
     //
     // Start with default values
     //
@@ -432,22 +453,50 @@ TchGetScreenProperties(
         sizeof(TOUCH_SCREEN_PROPERTIES));
 
     //
-    // Populate device context with registry overrides (or defaults)
+    // Table passed to RtlQueryRegistryValues must be allocated 
+    // from NonPagedPoolNx
     //
-    status = RtlQueryRegistryValues(
-        RTL_REGISTRY_ABSOLUTE,
-        TOUCH_SCREEN_PROPERTIES_REG_KEY,
-        regTable,
-        NULL,
-        NULL);
+    regTable = RmiAllocate(gcbRegistryTable, TOUCH_POOL_TAG);
 
-    if (!NT_SUCCESS(status))
+    if (NULL == regTable)
     {
         Trace(
             TRACE_LEVEL_WARNING,
             TRACE_REGISTRY,
-            "Error retrieving registry configuration - %!STATUS!",
-            status);
+            "Error allocating registry query table, using defaults");
+    }
+    else
+    {
+        RtlCopyMemory(
+            regTable,
+            gResParamsRegTable,
+            gcbRegistryTable);
+
+        //
+        // Update offset values with base pointer
+        // 
+        for (i=0; i < gcRegistryTable-1; i++)
+        {
+            regTable[i].EntryContext = (PVOID) (
+                ((SIZE_T) regTable[i].EntryContext) +
+                ((ULONG_PTR) Props));
+        }
+
+        //
+        // Populate device context with registry overrides (or defaults)
+        //
+        status = RmiQuerySettings(
+            TOUCH_SCREEN_PROPERTIES_REG_KEY,
+            regTable);
+
+        if (!NT_SUCCESS(status))
+        {
+            Trace(
+                TRACE_LEVEL_WARNING,
+                TRACE_REGISTRY,
+                "Error retrieving registry configuration - %!STATUS!",
+                status);
+        }
     }
 
     //
@@ -491,6 +540,38 @@ TchGetScreenProperties(
             gDefaultProperties.TouchLetterBoxHeightBottom;
     }
 
+    //
+    // Edge rejection bands are in sensor coordinates, i.e. before any
+    // axis swap, and must leave some active area in the middle
+    //
+    if (Props->TouchEdgeRejectLeft + 
+        Props->TouchEdgeRejectRight >=
+        (Props->TouchSwapAxes ? 
+            Props->TouchPhysicalHeight : Props->TouchPhysicalWidth) ||
+        Props->TouchEdgeRejectTop + 
+        Props->TouchEdgeRejectBottom >=
+        (Props->TouchSwapAxes ? 
+            Props->TouchPhysicalWidth : Props->TouchPhysicalHeight))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REGISTRY,
+            "Invalid edge rejection bands provided (%d,%d,%d,%d)",
+            Props->TouchEdgeRejectLeft,
+            Props->TouchEdgeRejectRight,
+            Props->TouchEdgeRejectTop,
+            Props->TouchEdgeRejectBottom);
+
+        Props->TouchEdgeRejectLeft = 
+            gDefaultProperties.TouchEdgeRejectLeft;
+        Props->TouchEdgeRejectRight = 
+            gDefaultProperties.TouchEdgeRejectRight;
+        Props->TouchEdgeRejectTop = 
+            gDefaultProperties.TouchEdgeRejectTop;
+        Props->TouchEdgeRejectBottom = 
+            gDefaultProperties.TouchEdgeRejectBottom;
+    }
+
     //
     // Calculate a few parameters for later use
     //
@@ -522,6 +603,6 @@ TchGetScreenProperties(
 
     if (regTable != NULL)
     {
-        ExFreePoolWithTag(regTable, TOUCH_POOL_TAG);
+        RmiFree(regTable, TOUCH_POOL_TAG);
     }
 }
\ No newline at end of file
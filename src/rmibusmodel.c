@@ -0,0 +1,273 @@
+/*++
+    Module Name:
+
+        rmibusmodel.c
+
+    Abstract:
+
+        Models the I2C bus time of reading one touch frame for the
+        discovered register map, for the read sequence the driver uses
+        and for the alternatives it could use, see RMI4_BUS_PATH_XXX. The
+        model follows the SPB timing model in spbmodel.c, so the estimate
+        can be made for a layout and bus clock before hardware bring-up.
+
+    Environment:
+
+        Kernel mode, user mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <rmiinternal.h>
+#include <rmibusmodel.tmh>
+
+//
+// Register reads write the register address, then read the data. A page
+// change writes the page select register and the page.
+//
+#define RMI4_BUS_READ_TRANSACTIONS        2
+#define RMI4_BUS_PAGE_BYTES               2
+
+static
+VOID
+RmiModelRead(
+    IN OUT RMI4_BUS_COST* Cost,
+    IN ULONG Length
+    )
+{
+    Cost->Transactions += RMI4_BUS_READ_TRANSACTIONS;
+    Cost->Bytes += 1 + Length;
+}
+
+NTSTATUS
+RmiModelFrameBusCost(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Path,
+    IN ULONG Contacts,
+    IN ULONG BusSpeed,
+    IN ULONG StretchTime,
+    OUT RMI4_BUS_COST* Cost
+    )
+/*++
+
+Routine Description:
+
+    Models the bus traffic and time of one touch frame with Contacts
+    contacts down, in the lowest object slots, for a read path:
+
+    RMI4_BUS_PATH_CURRENT - F01 status read, then the full F12 data
+        packet read, with a page change before each when F01 and F12 are
+        on different pages. This is what the driver does.
+    RMI4_BUS_PATH_FUSED - a single read from the first of the F01 and F12
+        data registers through the last. Only possible where the register
+        map places them on one page, back to back.
+    RMI4_BUS_PATH_BITMAP - the current F01 status read, then the F12 Data15
+        object attention bitmap, then only the objects up to the last one
+        present. Needs Data15.
+
+Arguments:
+
+    ControllerContext - Touch controller context, discovered or profiled
+    Path - RMI4_BUS_PATH_XXX
+    Contacts - Contacts down, only used by RMI4_BUS_PATH_BITMAP
+    BusSpeed - I2C clock in Hz
+    StretchTime - Clock stretching per transaction in ns
+    Cost - Receives the modeled traffic and time
+
+Return Value:
+
+    STATUS_NOT_SUPPORTED if the register map does not allow the path,
+    STATUS_INVALID_DEVICE_STATE if the layout is not known
+
+--*/
+{
+    RMI4_FUNCTION_DESCRIPTOR* f01;
+    RMI4_FUNCTION_DESCRIPTOR* f12;
+    BOOLEAN samePage;
+    UINT8 index1;
+    UINT8 index15;
+    int f01Index;
+    int f12Index;
+
+    RtlZeroMemory(Cost, sizeof(*Cost));
+
+    f01Index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    f12Index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    if (f01Index == ControllerContext->FunctionCount ||
+        f12Index == ControllerContext->FunctionCount ||
+        ControllerContext->PacketSize == 0 ||
+        BusSpeed == 0)
+    {
+        return STATUS_INVALID_DEVICE_STATE;
+    }
+
+    f01 = &ControllerContext->Descriptors[f01Index];
+    f12 = &ControllerContext->Descriptors[f12Index];
+    samePage = (ControllerContext->FunctionOnPage[f01Index] ==
+        ControllerContext->FunctionOnPage[f12Index]);
+
+    switch (Path)
+    {
+    case RMI4_BUS_PATH_CURRENT:
+    {
+        RmiModelRead(Cost, sizeof(RMI4_F01_DATA_REGISTERS));
+        RmiModelRead(Cost, (ULONG) ControllerContext->PacketSize);
+        break;
+    }
+    case RMI4_BUS_PATH_FUSED:
+    {
+        //
+        // F01 data registers are one byte each, F12 data registers are
+        // one address each, so the reads only join when neither leaves
+        // an address gap to the other
+        //
+        if (!samePage ||
+            (f12->DataBase != f01->DataBase + sizeof(RMI4_F01_DATA_REGISTERS) &&
+             f01->DataBase != f12->DataBase + ControllerContext->DataRegDesc.NumRegisters))
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        RmiModelRead(
+            Cost,
+            sizeof(RMI4_F01_DATA_REGISTERS) + (ULONG) ControllerContext->PacketSize);
+        break;
+    }
+    case RMI4_BUS_PATH_BITMAP:
+    {
+        index1 = RmiGetRegisterIndex(&ControllerContext->DataRegDesc, 1);
+        index15 = RmiGetRegisterIndex(&ControllerContext->DataRegDesc, 15);
+
+        if (index1 == ControllerContext->DataRegDesc.NumRegisters ||
+            index15 == ControllerContext->DataRegDesc.NumRegisters)
+        {
+            return STATUS_NOT_SUPPORTED;
+        }
+
+        if (Contacts > ControllerContext->MaxFingers)
+        {
+            Contacts = ControllerContext->MaxFingers;
+        }
+
+        RmiModelRead(Cost, sizeof(RMI4_F01_DATA_REGISTERS));
+        RmiModelRead(
+            Cost,
+            ControllerContext->DataRegDesc.Registers[index15].RegisterSize);
+
+        if (Contacts != 0)
+        {
+            RmiModelRead(Cost, Contacts * F12_DATA1_BYTES_PER_OBJ);
+        }
+
+        break;
+    }
+    default:
+    {
+        return STATUS_INVALID_PARAMETER;
+    }
+    }
+
+    //
+    // Status is read on the F01 page and the frame on the F12 page, every
+    // path but the fused one switches back and forth
+    //
+    if (!samePage)
+    {
+        Cost->Transactions += 2;
+        Cost->Bytes += 2 * RMI4_BUS_PAGE_BYTES;
+    }
+
+    Cost->Time = SpbModelTransferTime(
+        BusSpeed,
+        StretchTime,
+        Cost->Transactions,
+        Cost->Bytes);
+
+    Cost->StretchTime = (ULONG64) Cost->Transactions * StretchTime;
+
+    return STATUS_SUCCESS;
+}
+
+VOID
+RmiTraceBusModel(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Dumps the modeled bus time of one touch frame for the current
+    register map, one comma separated line per read path and bus clock,
+    with one contact down and BusStretchTime of clock stretching per
+    transaction:
+
+        busmodel,<path>,<Hz>,<transactions>,<bytes>,<ns>,<stretch ns>
+
+    Paths the register map does not allow are left out, see
+    RmiModelFrameBusCost. host/tools/rmibusmodel.c sweeps contact counts
+    and layouts.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    static const ULONG busSpeeds[] =
+    {
+        SPB_BUS_SPEED_STANDARD,
+        SPB_BUS_SPEED_FAST,
+        SPB_BUS_SPEED_FAST_PLUS
+    };
+    static const char* paths[RMI4_BUS_PATH_COUNT] =
+    {
+        "current",
+        "fused",
+        "bitmap"
+    };
+    RMI4_BUS_COST cost;
+    ULONG i;
+    int path;
+
+    for (i = 0; i < RTL_NUMBER_OF(busSpeeds); i++)
+    {
+        for (path = 0; path < RMI4_BUS_PATH_COUNT; path++)
+        {
+            if (!NT_SUCCESS(RmiModelFrameBusCost(
+                    ControllerContext,
+                    path,
+                    1,
+                    busSpeeds[i],
+                    ControllerContext->Config.BusStretchTime,
+                    &cost)))
+            {
+                continue;
+            }
+
+            Trace(
+                TRACE_LEVEL_INFORMATION,
+                TRACE_REPORTING,
+                "busmodel,%s,%u,%u,%u,%I64u,%I64u",
+                paths[path],
+                busSpeeds[i],
+                cost.Transactions,
+                cost.Bytes,
+                cost.Time,
+                cost.StretchTime);
+        }
+    }
+}
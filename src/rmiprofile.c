@@ -0,0 +1,896 @@
+/*++
+    Module Name:
+
+        rmiprofile.c
+
+    Abstract:
+
+        Matches the controller against the compile-time firmware
+        profiles (see rmiprofile.h) by product ID and F12 register
+        descriptors, and on a match takes the function table and
+        F12 register layout from the profile instead of discovering them
+        over the bus. Also traces the discovered layout
+        in profile form so entries can be generated for new firmware.
+
+    Environment:
+
+        Kernel mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <rmiinternal.h>
+#include <rmiprofile.h>
+#include <rmiprofile.tmh>
+
+static
+NTSTATUS
+RmiReadProductId(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN int Page,
+    IN BYTE QueryBase,
+    OUT CHAR* ProductId
+    )
+/*++
+
+Routine Description:
+
+    Reads the F01 product ID query registers.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Page - Register page of F01
+    QueryBase - F01 query base address
+    ProductId - Receives the NUL terminated product ID, of
+        RMI4_PRODUCT_ID_LENGTH + 1 bytes
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+
+    RtlZeroMemory(ProductId, RMI4_PRODUCT_ID_LENGTH + 1);
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        Page);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = RmiBusRead(
+        SpbContext,
+        (UCHAR) (QueryBase + FIELD_OFFSET(RMI4_F01_QUERY_REGISTERS, ProductID1)),
+        ProductId,
+        RMI4_PRODUCT_ID_LENGTH);
+
+exit:
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error reading RMI F01 product ID - %!STATUS!",
+            status);
+    }
+
+    return status;
+}
+
+//
+// F12 register descriptors follow F12 query register 0, each taking a
+// presence size, a presence and a structure register
+//
+#define RMI4_F12_CONTROL_DESCRIPTOR         1
+#define RMI4_F12_DATA_DESCRIPTOR            2
+
+static
+NTSTATUS
+RmiReadF12Descriptor(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN int Page,
+    IN BYTE QueryBase,
+    IN int Descriptor,
+    OUT RMI4_PROFILE_DESCRIPTOR* ProfileDescriptor
+    )
+/*++
+
+Routine Description:
+
+    Reads an F12 register descriptor as it is kept in a profile: the
+    presence register, which holds the size of the register structure
+    and the map of registers present, and the register structure.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Page - Register page of F12
+    QueryBase - F12 query base address
+    Descriptor - RMI4_F12_XXX_DESCRIPTOR
+    ProfileDescriptor - Receives the register descriptor
+
+Return Value:
+
+    NTSTATUS indicating success or failure, STATUS_BUFFER_TOO_SMALL if the
+    descriptor is too large for a profile
+
+--*/
+{
+    NTSTATUS status;
+    BYTE address;
+
+    RtlZeroMemory(ProfileDescriptor, sizeof(*ProfileDescriptor));
+    address = (BYTE) (QueryBase + 1 + 3 * Descriptor);
+
+    status = RmiChangePage(
+        ControllerContext,
+        SpbContext,
+        Page);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = RmiBusRead(
+        SpbContext,
+        address,
+        &ProfileDescriptor->PresenceSize,
+        sizeof(BYTE));
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    if (ProfileDescriptor->PresenceSize == 0 ||
+        ProfileDescriptor->PresenceSize > RMI4_PROFILE_MAX_PRESENCE)
+    {
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    status = RmiBusRead(
+        SpbContext,
+        (BYTE) (address + 1),
+        ProfileDescriptor->Presence,
+        ProfileDescriptor->PresenceSize);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    //
+    // A zero first byte moves the structure size into the next two
+    //
+    if (ProfileDescriptor->Presence[0] != 0)
+    {
+        ProfileDescriptor->StructureSize = ProfileDescriptor->Presence[0];
+    }
+    else if (ProfileDescriptor->PresenceSize >= 3)
+    {
+        ProfileDescriptor->StructureSize = (USHORT) (
+            ProfileDescriptor->Presence[1] |
+            (ProfileDescriptor->Presence[2] << 8));
+    }
+
+    if (ProfileDescriptor->StructureSize == 0)
+    {
+        status = STATUS_INVALID_DEVICE_STATE;
+        goto exit;
+    }
+
+    if (ProfileDescriptor->StructureSize > RMI4_PROFILE_MAX_STRUCTURE)
+    {
+        status = STATUS_BUFFER_TOO_SMALL;
+        goto exit;
+    }
+
+    status = RmiBusRead(
+        SpbContext,
+        (BYTE) (address + 2),
+        ProfileDescriptor->Structure,
+        ProfileDescriptor->StructureSize);
+
+exit:
+
+    if (!NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_INIT,
+            "Error reading RMI F12 register descriptor %d for a profile - %!STATUS!",
+            Descriptor,
+            status);
+    }
+
+    return status;
+}
+
+#ifdef RMI4_FIRMWARE_PROFILES
+
+static const RMI4_FIRMWARE_PROFILE gFirmwareProfiles[] =
+{
+#include RMI4_FIRMWARE_PROFILES
+};
+
+static
+BOOLEAN
+RmiCheckFirmwareProfile(
+    IN const RMI4_FIRMWARE_PROFILE* Profile
+    )
+/*++
+
+Routine Description:
+
+    Checks that a profile holds together, so a bad table entry cannot
+    send the report path outside the packet buffer.
+
+Arguments:
+
+    Profile - Firmware profile
+
+Return Value:
+
+    TRUE if the profile can be used
+
+--*/
+{
+    RMI4_FUNCTION_DESCRIPTOR* descriptors;
+    const RMI4_PROFILE_REGISTER* data1;
+    ULONG packetSize;
+    ULONG data1Offset;
+    int i;
+
+    descriptors = (RMI4_FUNCTION_DESCRIPTOR*) Profile->Descriptors;
+
+    if (Profile->FunctionCount <= 0 ||
+        Profile->FunctionCount > RMI4_MAX_FUNCTIONS ||
+        Profile->ControlCount > RMI4_PROFILE_MAX_REGISTERS ||
+        Profile->DataCount > RMI4_PROFILE_MAX_REGISTERS ||
+        Profile->ControlDescriptor.PresenceSize == 0 ||
+        Profile->ControlDescriptor.PresenceSize > RMI4_PROFILE_MAX_PRESENCE ||
+        Profile->ControlDescriptor.StructureSize > RMI4_PROFILE_MAX_STRUCTURE ||
+        Profile->DataDescriptor.PresenceSize == 0 ||
+        Profile->DataDescriptor.PresenceSize > RMI4_PROFILE_MAX_PRESENCE ||
+        Profile->DataDescriptor.StructureSize > RMI4_PROFILE_MAX_STRUCTURE)
+    {
+        return FALSE;
+    }
+
+    if (RmiGetFunctionIndex(descriptors, Profile->FunctionCount,
+            RMI4_F01_RMI_DEVICE_CONTROL) == Profile->FunctionCount ||
+        RmiGetFunctionIndex(descriptors, Profile->FunctionCount,
+            RMI4_F12_2D_TOUCHPAD_SENSOR) == Profile->FunctionCount)
+    {
+        return FALSE;
+    }
+
+    packetSize = 0;
+    data1Offset = 0;
+    data1 = NULL;
+
+    for (i = 0; i < Profile->DataCount; i++)
+    {
+        if (Profile->Data[i].Register == 0)
+        {
+            data1Offset = Profile->Data[i].RegisterSize;
+        }
+        else if (Profile->Data[i].Register == 1)
+        {
+            data1 = &Profile->Data[i];
+        }
+
+        packetSize += Profile->Data[i].RegisterSize;
+    }
+
+    if (data1 == NULL ||
+        packetSize != (ULONG) Profile->PacketSize ||
+        data1Offset != (ULONG) Profile->Data1Offset ||
+        Profile->MaxFingers > data1->NumSubPackets ||
+        Profile->MaxFingers > RMI4_MAX_TOUCHES ||
+        (ULONG) Profile->MaxFingers * F12_DATA1_BYTES_PER_OBJ > packetSize - data1Offset)
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+static
+NTSTATUS
+RmiLoadProfileRegisters(
+    IN PRMI_REGISTER_DESCRIPTOR Rdesc,
+    IN const RMI4_PROFILE_REGISTER* Registers,
+    IN UINT8 Count
+    )
+/*++
+
+Routine Description:
+
+    Fills a register descriptor from a profile register list. Presence
+    and subpacket maps are only needed while parsing the controller's
+    descriptors and are left empty.
+
+Arguments:
+
+    Rdesc - Register descriptor to fill
+    Registers - Profile registers
+    Count - Number of profile registers
+
+Return Value:
+
+    NTSTATUS indicating success or failure
+
+--*/
+{
+    int i;
+
+    if (Rdesc->Registers != NULL)
+    {
+        RmiFree(Rdesc->Registers, TOUCH_POOL_TAG_F12);
+    }
+
+    RtlZeroMemory(Rdesc, sizeof(*Rdesc));
+
+    if (Count == 0)
+    {
+        return STATUS_SUCCESS;
+    }
+
+    Rdesc->Registers = RmiAllocate(
+        Count * sizeof(RMI_REGISTER_DESC_ITEM),
+        TOUCH_POOL_TAG_F12);
+
+    if (Rdesc->Registers == NULL)
+    {
+        return STATUS_INSUFFICIENT_RESOURCES;
+    }
+
+    RtlZeroMemory(Rdesc->Registers, Count * sizeof(RMI_REGISTER_DESC_ITEM));
+
+    for (i = 0; i < Count; i++)
+    {
+        Rdesc->Registers[i].Register = Registers[i].Register;
+        Rdesc->Registers[i].RegisterSize = Registers[i].RegisterSize;
+        Rdesc->Registers[i].NumSubPackets = Registers[i].NumSubPackets;
+    }
+
+    Rdesc->NumRegisters = Count;
+
+    return STATUS_SUCCESS;
+}
+
+static
+BOOLEAN
+RmiMatchProfileDescriptor(
+    IN const RMI4_PROFILE_DESCRIPTOR* Descriptor,
+    IN const RMI4_PROFILE_DESCRIPTOR* ProfileDescriptor
+    )
+{
+    return Descriptor->PresenceSize == ProfileDescriptor->PresenceSize &&
+        Descriptor->StructureSize == ProfileDescriptor->StructureSize &&
+        RtlEqualMemory(
+            Descriptor->Presence,
+            ProfileDescriptor->Presence,
+            Descriptor->PresenceSize) &&
+        RtlEqualMemory(
+            Descriptor->Structure,
+            ProfileDescriptor->Structure,
+            Descriptor->StructureSize);
+}
+
+static
+BOOLEAN
+RmiMatchF12Layout(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext,
+    IN const RMI4_FIRMWARE_PROFILE* Profile
+    )
+/*++
+
+Routine Description:
+
+    Checks that the controller reports the F12 control and data register
+    descriptors of the profile, so firmware sharing the product ID but
+    laying out F12 differently, down to the number of fingers in the
+    data packet, is not mistaken for the profiled one.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+    Profile - Firmware profile whose product ID matched
+
+Return Value:
+
+    TRUE if the controller reports the profiled register descriptors
+
+--*/
+{
+    RMI4_PROFILE_DESCRIPTOR descriptor;
+    int index;
+    int page;
+    BYTE queryBase;
+
+    index = RmiGetFunctionIndex(
+        (RMI4_FUNCTION_DESCRIPTOR*) Profile->Descriptors,
+        Profile->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    page = Profile->FunctionOnPage[index];
+    queryBase = Profile->Descriptors[index].QueryBase;
+
+    if (!NT_SUCCESS(RmiReadF12Descriptor(
+            ControllerContext,
+            SpbContext,
+            page,
+            queryBase,
+            RMI4_F12_CONTROL_DESCRIPTOR,
+            &descriptor)) ||
+        !RmiMatchProfileDescriptor(&descriptor, &Profile->ControlDescriptor))
+    {
+        return FALSE;
+    }
+
+    if (!NT_SUCCESS(RmiReadF12Descriptor(
+            ControllerContext,
+            SpbContext,
+            page,
+            queryBase,
+            RMI4_F12_DATA_DESCRIPTOR,
+            &descriptor)) ||
+        !RmiMatchProfileDescriptor(&descriptor, &Profile->DataDescriptor))
+    {
+        return FALSE;
+    }
+
+    return TRUE;
+}
+
+#endif
+
+NTSTATUS
+RmiApplyFirmwareProfile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+    )
+/*++
+
+Routine Description:
+
+    Looks the controller up in the compiled-in firmware profiles by its
+    product ID and, if one matches and the controller reports the same
+    F12 register descriptors, fills the function table and F12 register
+    layout from it. The product ID is read once, and again only for a
+    profile that places F01 elsewhere.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    STATUS_SUCCESS if the layout was taken from a profile, otherwise an
+    error and the caller must discover the layout from the controller
+
+--*/
+{
+#ifdef RMI4_FIRMWARE_PROFILES
+    const RMI4_FIRMWARE_PROFILE* profile;
+    CHAR productId[RMI4_PRODUCT_ID_LENGTH + 1];
+    int readQueryBase;
+    int readPage;
+    int index;
+    ULONG i;
+    NTSTATUS status;
+
+    ControllerContext->LayoutFromProfile = FALSE;
+
+    RtlZeroMemory(productId, sizeof(productId));
+    profile = NULL;
+    readQueryBase = -1;
+    readPage = -1;
+
+    for (i = 0; i < RTL_NUMBER_OF(gFirmwareProfiles); i++)
+    {
+        if (!RmiCheckFirmwareProfile(&gFirmwareProfiles[i]))
+        {
+            Trace(
+                TRACE_LEVEL_WARNING,
+                TRACE_INIT,
+                "Firmware profile %s is inconsistent, skipped",
+                gFirmwareProfiles[i].ProductId);
+
+            continue;
+        }
+
+        index = RmiGetFunctionIndex(
+            (RMI4_FUNCTION_DESCRIPTOR*) gFirmwareProfiles[i].Descriptors,
+            gFirmwareProfiles[i].FunctionCount,
+            RMI4_F01_RMI_DEVICE_CONTROL);
+
+        if (gFirmwareProfiles[i].Descriptors[index].QueryBase != readQueryBase ||
+            gFirmwareProfiles[i].FunctionOnPage[index] != readPage)
+        {
+            readQueryBase = gFirmwareProfiles[i].Descriptors[index].QueryBase;
+            readPage = gFirmwareProfiles[i].FunctionOnPage[index];
+
+            status = RmiReadProductId(
+                ControllerContext,
+                SpbContext,
+                readPage,
+                (BYTE) readQueryBase,
+                productId);
+
+            if (!NT_SUCCESS(status))
+            {
+                goto exit;
+            }
+        }
+
+        if (!RtlEqualMemory(
+                productId,
+                gFirmwareProfiles[i].ProductId,
+                RMI4_PRODUCT_ID_LENGTH))
+        {
+            continue;
+        }
+
+        if (!RmiMatchF12Layout(
+                ControllerContext,
+                SpbContext,
+                &gFirmwareProfiles[i]))
+        {
+            Trace(
+                TRACE_LEVEL_WARNING,
+                TRACE_INIT,
+                "Firmware profile %s does not match the F12 register "
+                "descriptors of the controller, skipped",
+                gFirmwareProfiles[i].ProductId);
+
+            continue;
+        }
+
+        profile = &gFirmwareProfiles[i];
+        break;
+    }
+
+    if (profile == NULL)
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_INIT,
+            "No firmware profile matches, discovering register layout");
+
+        status = STATUS_NOT_FOUND;
+        goto exit;
+    }
+
+    ControllerContext->FunctionCount = profile->FunctionCount;
+
+    RtlCopyMemory(
+        ControllerContext->Descriptors,
+        profile->Descriptors,
+        sizeof(ControllerContext->Descriptors));
+
+    RtlCopyMemory(
+        ControllerContext->FunctionOnPage,
+        profile->FunctionOnPage,
+        sizeof(ControllerContext->FunctionOnPage));
+
+    status = RmiAssignFunctionInterrupts(ControllerContext);
+
+    if (NT_SUCCESS(status))
+    {
+        status = RmiLoadProfileRegisters(
+            &ControllerContext->QueryRegDesc,
+            NULL,
+            0);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = RmiLoadProfileRegisters(
+            &ControllerContext->ControlRegDesc,
+            profile->Control,
+            profile->ControlCount);
+    }
+
+    if (NT_SUCCESS(status))
+    {
+        status = RmiLoadProfileRegisters(
+            &ControllerContext->DataRegDesc,
+            profile->Data,
+            profile->DataCount);
+    }
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    ControllerContext->HasDribble = profile->HasDribble;
+    ControllerContext->PacketSize = profile->PacketSize;
+    ControllerContext->Data1Offset = profile->Data1Offset;
+    ControllerContext->MaxFingers = profile->MaxFingers;
+    ControllerContext->LayoutFromProfile = TRUE;
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_INIT,
+        "Register layout taken from firmware profile %s",
+        profile->ProductId);
+
+exit:
+
+    return status;
+#else
+    UNREFERENCED_PARAMETER(SpbContext);
+
+    ControllerContext->LayoutFromProfile = FALSE;
+
+    return STATUS_NOT_FOUND;
+#endif
+}
+
+static
+VOID
+RmiTraceProfileRegisters(
+    IN PRMI_REGISTER_DESCRIPTOR Rdesc
+    )
+/*++
+
+Routine Description:
+
+    Traces a register descriptor as a profile count and register list.
+
+Arguments:
+
+    Rdesc - Register descriptor
+
+Return Value:
+
+    None.
+
+--*/
+{
+    int i;
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    %u, {",
+        Rdesc->NumRegisters);
+
+    for (i = 0; i < Rdesc->NumRegisters; i++)
+    {
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_INIT,
+            "        { %u, %u, %u },",
+            Rdesc->Registers[i].Register,
+            Rdesc->Registers[i].RegisterSize,
+            Rdesc->Registers[i].NumSubPackets);
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    },");
+}
+
+static
+VOID
+RmiTraceProfileBytes(
+    IN ULONG Size,
+    IN const BYTE* Bytes
+    )
+{
+    ULONG i;
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "        %u, {",
+        Size);
+
+    for (i = 0; i < Size; i++)
+    {
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_INIT,
+            "            0x%02x,",
+            Bytes[i]);
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "        },");
+}
+
+static
+VOID
+RmiTraceProfileDescriptor(
+    IN const RMI4_PROFILE_DESCRIPTOR* Descriptor
+    )
+/*++
+
+Routine Description:
+
+    Traces an F12 register descriptor as an RMI4_PROFILE_DESCRIPTOR
+    initializer.
+
+Arguments:
+
+    Descriptor - Register descriptor
+
+Return Value:
+
+    None.
+
+--*/
+{
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    {");
+
+    RmiTraceProfileBytes(Descriptor->PresenceSize, Descriptor->Presence);
+    RmiTraceProfileBytes(Descriptor->StructureSize, Descriptor->Structure);
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    },");
+}
+
+VOID
+RmiTraceFirmwareProfile(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN SPB_CONTEXT* SpbContext
+    )
+/*++
+
+Routine Description:
+
+    Traces the discovered function table and F12 register layout as an
+    RMI4_FIRMWARE_PROFILE initializer, one line per trace message.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    SpbContext - A pointer to the current i2c context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    CHAR productId[RMI4_PRODUCT_ID_LENGTH + 1];
+    RMI4_PROFILE_DESCRIPTOR control;
+    RMI4_PROFILE_DESCRIPTOR data;
+    RMI4_FUNCTION_DESCRIPTOR* descriptor;
+    int index;
+    int i;
+
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F01_RMI_DEVICE_CONTROL);
+
+    if (index == ControllerContext->FunctionCount ||
+        !NT_SUCCESS(RmiReadProductId(
+            ControllerContext,
+            SpbContext,
+            ControllerContext->FunctionOnPage[index],
+            ControllerContext->Descriptors[index].QueryBase,
+            productId)))
+    {
+        return;
+    }
+
+    index = RmiGetFunctionIndex(
+        ControllerContext->Descriptors,
+        ControllerContext->FunctionCount,
+        RMI4_F12_2D_TOUCHPAD_SENSOR);
+
+    if (index == ControllerContext->FunctionCount ||
+        !NT_SUCCESS(RmiReadF12Descriptor(
+            ControllerContext,
+            SpbContext,
+            ControllerContext->FunctionOnPage[index],
+            ControllerContext->Descriptors[index].QueryBase,
+            RMI4_F12_CONTROL_DESCRIPTOR,
+            &control)) ||
+        !NT_SUCCESS(RmiReadF12Descriptor(
+            ControllerContext,
+            SpbContext,
+            ControllerContext->FunctionOnPage[index],
+            ControllerContext->Descriptors[index].QueryBase,
+            RMI4_F12_DATA_DESCRIPTOR,
+            &data)))
+    {
+        return;
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "{ \"%s\", %d, {",
+        productId,
+        ControllerContext->FunctionCount);
+
+    for (i = 0; i < ControllerContext->FunctionCount; i++)
+    {
+        descriptor = &ControllerContext->Descriptors[i];
+
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_INIT,
+            "        { 0x%02x, 0x%02x, 0x%02x, 0x%02x, { 0x%02x }, 0x%02x },",
+            descriptor->QueryBase,
+            descriptor->CommandBase,
+            descriptor->ControlBase,
+            descriptor->DataBase,
+            descriptor->VersionIrq.All,
+            descriptor->Number);
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    }, {");
+
+    for (i = 0; i < ControllerContext->FunctionCount; i++)
+    {
+        Trace(
+            TRACE_LEVEL_VERBOSE,
+            TRACE_INIT,
+            "        %d,",
+            ControllerContext->FunctionOnPage[i]);
+    }
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    }, %s,",
+        ControllerContext->HasDribble ? "TRUE" : "FALSE");
+
+    RmiTraceProfileRegisters(&ControllerContext->ControlRegDesc);
+    RmiTraceProfileRegisters(&ControllerContext->DataRegDesc);
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "    %u, %u, %u,",
+        (ULONG) ControllerContext->PacketSize,
+        ControllerContext->Data1Offset,
+        ControllerContext->MaxFingers);
+
+    RmiTraceProfileDescriptor(&control);
+    RmiTraceProfileDescriptor(&data);
+
+    Trace(
+        TRACE_LEVEL_VERBOSE,
+        TRACE_INIT,
+        "},");
+}
@@ -0,0 +1,278 @@
+/*++
+    Module Name:
+
+        rmisynth.c
+
+    Abstract:
+
+        Synthetic F12 packet source for checked builds. When a workload is
+        configured, the acquisition stage takes its touch frames from a
+        parametric generator instead of the controller, and a timer raises
+        touch interrupts at the configured scan rate. Frames go through
+        the same decode, filtering and report path as real ones.
+
+        Every model repeats with a short period so contacts keep landing
+        and lifting, churning slots and crossing the five contact hybrid
+        report boundary as the contact count is swept.
+
+    Environment:
+
+        Kernel mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <rmiinternal.h>
+#include <rmisynth.tmh>
+
+#if DBG
+
+#define RMI4_SYNTHETIC_COLUMNS          4
+#define RMI4_SYNTHETIC_PERIOD           24      // Frames per gesture cycle
+
+static
+int
+RmiSyntheticTriangle(
+    IN ULONG Frame,
+    IN int Amplitude
+    )
+/*++
+
+Routine Description:
+
+    Triangle wave between 0 and Amplitude over one gesture cycle, used as
+    the motion profile of the continuous models.
+
+Arguments:
+
+    Frame - Synthetic frame number
+    Amplitude - Peak value
+
+Return Value:
+
+    Wave value for the frame
+
+--*/
+{
+    int phase;
+    int half;
+
+    half = RMI4_SYNTHETIC_PERIOD / 2;
+    phase = (int) (Frame % RMI4_SYNTHETIC_PERIOD);
+
+    if (phase >= half)
+    {
+        phase = RMI4_SYNTHETIC_PERIOD - phase;
+    }
+
+    return Amplitude * phase / half;
+}
+
+static
+BYTE
+RmiSyntheticObjectType(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN int Contact
+    )
+/*++
+
+Routine Description:
+
+    Picks the F12 object type of a contact from the configured object mix,
+    cycling through the types whose bit is set.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Contact - Contact index
+
+Return Value:
+
+    RMI4_F12_OBJECT_TYPE of the contact
+
+--*/
+{
+    ULONG mix;
+    int types;
+    int pick;
+    BYTE type;
+
+    mix = ControllerContext->Config.SyntheticObjectMix & 0xFFFE;
+
+    if (mix == 0)
+    {
+        return RMI_F12_OBJECT_FINGER;
+    }
+
+    types = 0;
+
+    for (type = 1; type < 16; type++)
+    {
+        if (mix & (1UL << type))
+        {
+            types++;
+        }
+    }
+
+    pick = Contact % types;
+
+    for (type = 1; type < 16; type++)
+    {
+        if ((mix & (1UL << type)) && pick-- == 0)
+        {
+            break;
+        }
+    }
+
+    return type;
+}
+
+VOID
+RmiSynthesizeTouchFrame(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    OUT BYTE* Packet
+    )
+/*++
+
+Routine Description:
+
+    Fills an F12 data packet with the next frame of the configured
+    synthetic workload. Contacts beyond the objects the controller
+    reports are not generated.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Packet - Packet buffer of PacketSize bytes
+
+Return Value:
+
+    None.
+
+--*/
+{
+    BYTE* data1;
+    ULONG frame;
+    int contacts;
+    int rows;
+    int width, height;
+    int i, x, y, w;
+    BOOLEAN down;
+    BYTE type;
+
+    RtlZeroMemory(Packet, ControllerContext->PacketSize);
+
+    frame = ControllerContext->SyntheticFrame++;
+    contacts = min(
+        (int) ControllerContext->Config.SyntheticContacts,
+        (int) ControllerContext->MaxFingers);
+
+    width = max((int) ControllerContext->Props.TouchPhysicalWidth, 1);
+    height = max((int) ControllerContext->Props.TouchPhysicalHeight, 1);
+    rows = (contacts + RMI4_SYNTHETIC_COLUMNS - 1) / RMI4_SYNTHETIC_COLUMNS;
+
+    data1 = &Packet[ControllerContext->Data1Offset];
+
+    for (i = 0; i < contacts; i++, data1 += F12_DATA1_BYTES_PER_OBJ)
+    {
+        //
+        // Contacts rest on a grid unless the model moves them
+        //
+        x = width * (i % RMI4_SYNTHETIC_COLUMNS + 1) / (RMI4_SYNTHETIC_COLUMNS + 1);
+        y = height * (i / RMI4_SYNTHETIC_COLUMNS + 1) / (rows + 1);
+        w = 4;
+        down = TRUE;
+        type = RmiSyntheticObjectType(ControllerContext, i);
+
+        switch (ControllerContext->Config.SyntheticWorkload)
+        {
+            case RMI4_SYNTHETIC_TAP:
+            {
+                //
+                // Short staggered taps
+                //
+                down = ((frame + i * 3) % 12) < 4;
+                break;
+            }
+            case RMI4_SYNTHETIC_FLING:
+            {
+                //
+                // Fast horizontal swipes, lifting at the far edge
+                //
+                down = ((frame + i) % RMI4_SYNTHETIC_PERIOD) < RMI4_SYNTHETIC_PERIOD - 2;
+                x = width * (int) ((frame + i) % RMI4_SYNTHETIC_PERIOD) / RMI4_SYNTHETIC_PERIOD;
+                break;
+            }
+            case RMI4_SYNTHETIC_PINCH:
+            {
+                //
+                // Contacts spread from and close to the centre along a row
+                //
+                x = width / 2 + (2 * i - contacts + 1) *
+                    RmiSyntheticTriangle(frame, width / 2) / max(contacts, 2);
+                y = height / 2;
+                break;
+            }
+            case RMI4_SYNTHETIC_DRUM:
+            {
+                //
+                // Fingers land in turn, about half of them down at a time
+                //
+                down = ((frame / 2 + i) % 4) < 2;
+                break;
+            }
+            case RMI4_SYNTHETIC_PALM:
+            {
+                //
+                // Wide stationary palms, with every fourth contact a
+                // finger tapping next to them
+                //
+                if (i % 4 == 3)
+                {
+                    down = (frame % 12) < 6;
+                }
+                else
+                {
+                    type = RMI_F12_OBJECT_PALM;
+                    w = 15;
+                }
+                break;
+            }
+            case RMI4_SYNTHETIC_EDGE:
+            {
+                //
+                // Stationary grip on the left and right edges
+                //
+                x = (i % 2) ? width - 1 : 0;
+                y = height * (i / 2 + 1) / (contacts / 2 + 2);
+                break;
+            }
+            default:
+            {
+                down = FALSE;
+                break;
+            }
+        }
+
+        if (!down)
+        {
+            continue;
+        }
+
+        x = min(max(x, 0), width - 1);
+        y = min(max(y, 0), height - 1);
+
+        data1[0] = type;
+        data1[1] = (BYTE) (x & 0xFF);
+        data1[2] = (BYTE) (x >> 8);
+        data1[3] = (BYTE) (y & 0xFF);
+        data1[4] = (BYTE) (y >> 8);
+        data1[5] = 50;
+        data1[6] = (BYTE) w;
+        data1[7] = (BYTE) w;
+    }
+}
+
+#endif
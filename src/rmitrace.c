@@ -0,0 +1,300 @@
+/*++
+    Module Name:
+
+        rmitrace.c
+
+    Abstract:
+
+        Captures raw F01 status and F12 data packets, with their
+        interrupt timestamps, into a binary touch trace (see rmitrace.h)
+        so field sessions can be replayed through the report pipeline.
+
+        Records are appended to a nonpaged buffer by the acquisition
+        stage of interrupt servicing and written out as one trace
+        segment when the device stops. Once the buffer is full further
+        records are counted as dropped. The trace file is rotated once it
+        reaches TouchTraceFileSize, so at most two files are kept.
+
+        host/src/rmireplay.c replays traces through the report pipeline.
+
+    Environment:
+
+        Kernel mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <rmiinternal.h>
+#include <rmitrace.h>
+#include <rmitrace.tmh>
+
+VOID
+RmiTraceCaptureStart(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Allocates the capture buffer if touch trace capture is configured.
+    Failing to do so only leaves capture off.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    ULONG size;
+
+    size = ControllerContext->Config.TouchTraceSize * 1024;
+
+    if (size == 0 || ControllerContext->TraceBuffer != NULL)
+    {
+        return;
+    }
+
+    ControllerContext->TraceBuffer = RmiAllocate(size, TOUCH_POOL_TAG);
+
+    if (ControllerContext->TraceBuffer == NULL)
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_INIT,
+            "Could not allocate %u bytes for touch trace capture",
+            size);
+
+        return;
+    }
+
+    ControllerContext->TraceBufferSize = size;
+    ControllerContext->TraceUsed = 0;
+    ControllerContext->TraceDropped = 0;
+}
+
+VOID
+RmiTraceCaptureRecord(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext,
+    IN USHORT Type,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+/*++
+
+Routine Description:
+
+    Appends a record to the capture buffer, if capture is on.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+    Type - RMI_TRACE_RECORD_XXX
+    Data - Record payload
+    Length - Payload length in bytes
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI_TRACE_RECORD* record;
+    ULONG needed;
+
+    if (ControllerContext->TraceBuffer == NULL)
+    {
+        return;
+    }
+
+    needed = sizeof(RMI_TRACE_RECORD) + RMI_TRACE_ALIGN(Length);
+
+    if (Length > MAXUSHORT ||
+        ControllerContext->TraceBufferSize - ControllerContext->TraceUsed < needed)
+    {
+        ControllerContext->TraceDropped++;
+        return;
+    }
+
+    record = (RMI_TRACE_RECORD*)
+        (ControllerContext->TraceBuffer + ControllerContext->TraceUsed);
+
+    record->Timestamp = RmiQueryTime();
+    record->Type = Type;
+    record->Length = (UINT16) Length;
+    record->Reserved = 0;
+
+    RtlCopyMemory(record + 1, Data, Length);
+    RtlZeroMemory(
+        (BYTE*) (record + 1) + Length,
+        RMI_TRACE_ALIGN(Length) - Length);
+
+    ControllerContext->TraceUsed += needed;
+}
+
+VOID
+RmiTraceCaptureFlush(
+    IN RMI4_CONTROLLER_CONTEXT* ControllerContext
+    )
+/*++
+
+Routine Description:
+
+    Appends the captured records, behind a header describing the F12
+    data packet layout, as a segment to the trace file and empties the
+    capture buffer. A trace file that would grow past TouchTraceFileSize
+    is renamed to RMI_TRACE_OLD_FILE_PATH first, replacing the previous
+    one. Must be called at PASSIVE_LEVEL.
+
+Arguments:
+
+    ControllerContext - Touch controller context
+
+Return Value:
+
+    None.
+
+--*/
+{
+    RMI_TRACE_SEGMENT_HEADER* header;
+    RMI_TRACE_REGISTER* registers;
+    RMI_FILE file;
+    ULONG headerSize;
+    ULONG64 fileSize;
+    ULONG64 limit;
+    NTSTATUS status;
+    int i;
+
+    if (ControllerContext->TraceBuffer == NULL ||
+        (ControllerContext->TraceUsed == 0 && ControllerContext->TraceDropped == 0))
+    {
+        return;
+    }
+
+    file = NULL;
+    headerSize = sizeof(RMI_TRACE_SEGMENT_HEADER) +
+        ControllerContext->DataRegDesc.NumRegisters * sizeof(RMI_TRACE_REGISTER);
+
+    header = RmiAllocate(headerSize, TOUCH_POOL_TAG);
+
+    if (header == NULL)
+    {
+        status = STATUS_INSUFFICIENT_RESOURCES;
+        goto exit;
+    }
+
+    header->Magic = RMI_TRACE_MAGIC;
+    header->Version = RMI_TRACE_VERSION;
+    header->HeaderSize = (UINT16) headerSize;
+    header->RecordBytes = ControllerContext->TraceUsed;
+    header->RecordsDropped = ControllerContext->TraceDropped;
+    header->PacketSize = (UINT32) ControllerContext->PacketSize;
+    header->Data1Offset = (UINT16) ControllerContext->Data1Offset;
+    header->MaxFingers = (UINT8) ControllerContext->MaxFingers;
+    header->RegisterCount = ControllerContext->DataRegDesc.NumRegisters;
+
+    registers = (RMI_TRACE_REGISTER*) (header + 1);
+
+    for (i = 0; i < ControllerContext->DataRegDesc.NumRegisters; i++)
+    {
+        registers[i].Register = ControllerContext->DataRegDesc.Registers[i].Register;
+        registers[i].NumSubPackets = ControllerContext->DataRegDesc.Registers[i].NumSubPackets;
+        registers[i].Reserved = 0;
+        registers[i].RegisterSize = ControllerContext->DataRegDesc.Registers[i].RegisterSize;
+    }
+
+    status = RmiFileOpenAppend(RMI_TRACE_FILE_PATH, &file);
+
+    if (!NT_SUCCESS(status))
+    {
+        file = NULL;
+        goto exit;
+    }
+
+    //
+    // Start a new file, keeping the last one, rather than grow the trace
+    // past TouchTraceFileSize. A segment larger than that still goes to
+    // a file of its own.
+    //
+    limit = (ULONG64) ControllerContext->Config.TouchTraceFileSize * 1024;
+
+    if (limit != 0 &&
+        NT_SUCCESS(RmiFileQuerySize(file, &fileSize)) &&
+        fileSize != 0 &&
+        fileSize + headerSize + ControllerContext->TraceUsed > limit)
+    {
+        RmiFileClose(file);
+        file = NULL;
+
+        status = RmiFileRename(RMI_TRACE_FILE_PATH, RMI_TRACE_OLD_FILE_PATH);
+
+        if (!NT_SUCCESS(status))
+        {
+            goto exit;
+        }
+
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_REPORTING,
+            "Touch trace reached %I64u bytes, rotated",
+            fileSize);
+
+        status = RmiFileOpenAppend(RMI_TRACE_FILE_PATH, &file);
+
+        if (!NT_SUCCESS(status))
+        {
+            file = NULL;
+            goto exit;
+        }
+    }
+
+    status = RmiFileWrite(file, header, headerSize);
+
+    if (!NT_SUCCESS(status))
+    {
+        goto exit;
+    }
+
+    status = RmiFileWrite(
+        file,
+        ControllerContext->TraceBuffer,
+        ControllerContext->TraceUsed);
+
+exit:
+
+    if (NT_SUCCESS(status))
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_REPORTING,
+            "Wrote %u bytes of touch trace, %u records dropped",
+            ControllerContext->TraceUsed,
+            ControllerContext->TraceDropped);
+    }
+    else
+    {
+        Trace(
+            TRACE_LEVEL_ERROR,
+            TRACE_REPORTING,
+            "Could not write touch trace - %!STATUS!",
+            status);
+    }
+
+    if (file != NULL)
+    {
+        RmiFileClose(file);
+    }
+
+    if (header != NULL)
+    {
+        RmiFree(header, TOUCH_POOL_TAG);
+    }
+
+    ControllerContext->TraceUsed = 0;
+    ControllerContext->TraceDropped = 0;
+}
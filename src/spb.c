@@ -55,6 +55,7 @@ SpbDoWriteDataSynchronously(
     WDFMEMORY memory;
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
     NTSTATUS status;
+    ULONG64 start;
 
     //
     // The address pointer and data buffer must be combined
@@ -108,6 +109,8 @@ SpbDoWriteDataSynchronously(
     //
     RtlCopyMemory((buffer+sizeof(Address)), Data, length-sizeof(Address));
 
+    start = RmiQueryTime();
+
     status = WdfIoTargetSendWriteSynchronously(
         SpbContext->SpbIoTarget,
         NULL,
@@ -116,8 +119,13 @@ SpbDoWriteDataSynchronously(
         NULL,
         NULL);
 
+    SpbContext->Statistics.BusTime += RmiQueryTime() - start;
+    SpbContext->Statistics.WriteTransactions++;
+
     if (!NT_SUCCESS(status))
     {
+        SpbContext->Statistics.Errors++;
+
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_SPB,
@@ -126,6 +134,8 @@ SpbDoWriteDataSynchronously(
         goto exit;
     }
 
+    SpbContext->Statistics.BytesWritten += length;
+
 exit:
 
     if (NULL != memory)
@@ -211,6 +221,7 @@ SpbReadDataSynchronously(
     WDF_MEMORY_DESCRIPTOR memoryDescriptor;
     NTSTATUS status;
     ULONG_PTR bytesRead;
+    ULONG64 start;
 
     WdfWaitLockAcquire(SpbContext->SpbLock, NULL);
 
@@ -273,6 +284,8 @@ SpbReadDataSynchronously(
     }
 
 
+    start = RmiQueryTime();
+
     status = WdfIoTargetSendReadSynchronously(
         SpbContext->SpbIoTarget,
         NULL,
@@ -281,9 +294,23 @@ SpbReadDataSynchronously(
         NULL,
         &bytesRead);
 
-    if (!NT_SUCCESS(status) || 
-        bytesRead != Length)
+    SpbContext->Statistics.BusTime += RmiQueryTime() - start;
+    SpbContext->Statistics.ReadTransactions++;
+    SpbContext->Statistics.BytesRead += bytesRead;
+
+    //
+    // A short read leaves the caller's buffer stale, fail it like any
+    // other transfer error
+    //
+    if (NT_SUCCESS(status) && bytesRead != Length)
+    {
+        status = STATUS_DEVICE_PROTOCOL_ERROR;
+    }
+
+    if (!NT_SUCCESS(status))
     {
+        SpbContext->Statistics.Errors++;
+
         Trace(
             TRACE_LEVEL_ERROR,
             TRACE_SPB,
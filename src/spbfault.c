@@ -0,0 +1,185 @@
+/*++
+    Module Name:
+
+        spbfault.c
+
+    Abstract:
+
+        SPB (I2C) fault injection for checked builds. RmiBusRead and
+        RmiBusWrite go through this wrapper instead of straight to the
+        transport, which fails a configurable share of the transfers the
+        way a misbehaving bus would: a NACK fails the transfer without
+        sending it, a short read returns an incomplete buffer. The
+        transports in spb.c and host/ stay free of test code.
+
+    Environment:
+
+        Kernel mode, user mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <spb.h>
+#include <trace.h>
+#include <spbfault.tmh>
+
+#if DBG
+static
+BOOLEAN
+SpbInjectFault(
+    IN SPB_CONTEXT *SpbContext,
+    IN ULONG Rate
+    )
+/*++
+ 
+  Routine Description:
+
+    This helper routine decides whether to inject a fault into the
+    current transfer.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context 
+    Rate       - Fault rate, 1 in Rate transfers, 0 disables
+
+  Return Value:
+
+    TRUE if the transfer should fail
+
+--*/
+{
+    BOOLEAN inject;
+
+    if (Rate == 0)
+    {
+        return FALSE;
+    }
+
+    //
+    // The seed is shared by every bus user
+    //
+    RmiLockAcquire(SpbContext->SpbLock);
+
+    inject = (RmiRandom(&SpbContext->FaultInjection.Seed) % Rate) == 0;
+
+    if (inject)
+    {
+        SpbContext->FaultInjection.Injected++;
+        SpbContext->Statistics.Errors++;
+    }
+
+    RmiLockRelease(SpbContext->SpbLock);
+
+    return inject;
+}
+
+NTSTATUS
+SpbFaultReadData(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+/*++
+ 
+  Routine Description:
+
+    Reads registers through the transport, unless an injected NACK
+    fails the read up front. A read that went through may still be cut
+    short, which the transport would report as a protocol error.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context 
+    Address    - The I2C register address to read from
+    Data       - A buffer to receive the data at at the above address
+    Length     - The amount of data to be read from the above address
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    NTSTATUS status;
+
+    if (SpbInjectFault(SpbContext, SpbContext->FaultInjection.NackRate))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_SPB,
+            "Injected NACK reading register 0x%x",
+            Address);
+
+        return STATUS_NO_SUCH_DEVICE;
+    }
+
+    status = SpbReadDataSynchronously(
+        SpbContext,
+        Address,
+        Data,
+        Length);
+
+    if (NT_SUCCESS(status) &&
+        SpbInjectFault(SpbContext, SpbContext->FaultInjection.ShortReadRate))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_SPB,
+            "Injected short read of register 0x%x",
+            Address);
+
+        RtlZeroMemory((PUCHAR) Data + Length / 2, Length - Length / 2);
+        status = STATUS_DEVICE_PROTOCOL_ERROR;
+    }
+
+    return status;
+}
+
+NTSTATUS
+SpbFaultWriteData(
+    IN SPB_CONTEXT *SpbContext,
+    IN UCHAR Address,
+    IN PVOID Data,
+    IN ULONG Length
+    )
+/*++
+ 
+  Routine Description:
+
+    Writes registers through the transport, unless an injected NACK
+    fails the write without sending it.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context 
+    Address    - The I2C register address to write to
+    Data       - The data to write
+    Length     - The amount of data to write
+
+  Return Value:
+
+    NTSTATUS Status indicating success or failure
+
+--*/
+{
+    if (SpbInjectFault(SpbContext, SpbContext->FaultInjection.NackRate))
+    {
+        Trace(
+            TRACE_LEVEL_WARNING,
+            TRACE_SPB,
+            "Injected NACK writing register 0x%x",
+            Address);
+
+        return STATUS_NO_SUCH_DEVICE;
+    }
+
+    return SpbWriteDataSynchronously(
+        SpbContext,
+        Address,
+        Data,
+        Length);
+}
+#endif
@@ -0,0 +1,128 @@
+/*++
+    Module Name:
+
+        spbmodel.c
+
+    Abstract:
+
+        I2C bus timing model and the transaction statistics trace,
+        shared by the KMDF transport in spb.c and the user-mode one in
+        host/.
+
+    Environment:
+
+        Kernel mode, user mode
+
+    Revision History:
+
+--*/
+
+#include <compat.h>
+#include <spb.h>
+#include <trace.h>
+#include <spbmodel.tmh>
+
+ULONG64
+SpbModelTransferTime(
+    IN ULONG BusSpeed,
+    IN ULONG StretchTime,
+    IN ULONG64 Transactions,
+    IN ULONG64 Bytes
+    )
+/*++
+ 
+  Routine Description:
+
+    This helper routine estimates the time a set of I2C transactions
+    occupies the bus at a given clock, see SPB_MODEL_XXX.
+
+  Arguments:
+
+    BusSpeed     - I2C clock in Hz
+    StretchTime  - Clock stretching per transaction in ns
+    Transactions - Number of transactions
+    Bytes        - Payload bytes over all transactions
+
+  Return Value:
+
+    Modeled bus time in ns
+
+--*/
+{
+    ULONG64 bits;
+
+    bits = Transactions * SPB_MODEL_TRANSACTION_BITS +
+        Bytes * SPB_MODEL_BYTE_BITS;
+
+    return bits * 1000000000ULL / BusSpeed + Transactions * StretchTime;
+}
+
+VOID
+SpbTraceStatistics(
+    IN SPB_CONTEXT *SpbContext
+    )
+/*++
+ 
+  Routine Description:
+
+    This helper routine traces the transaction statistics gathered on
+    the Spb I/O target, and the bus time the same traffic is modeled to
+    take at standard, fast and fast plus mode clocks without clock
+    stretching. Measured time beyond the model at the bus clock in use,
+    per transaction, is the clock stretching to model plus overhead.
+
+  Arguments:
+
+    SpbContext - Pointer to the current device context 
+
+  Return Value:
+
+    None
+
+--*/
+{
+    static const ULONG busSpeeds[] =
+    {
+        SPB_BUS_SPEED_STANDARD,
+        SPB_BUS_SPEED_FAST,
+        SPB_BUS_SPEED_FAST_PLUS
+    };
+    SPB_STATISTICS* statistics;
+    ULONG i;
+
+    statistics = &SpbContext->Statistics;
+
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_SPB,
+        "Spb: %I64u writes (%I64u bytes), %I64u reads (%I64u bytes), "
+        "%I64u errors, %I64u00ns on the bus",
+        statistics->WriteTransactions,
+        statistics->BytesWritten,
+        statistics->ReadTransactions,
+        statistics->BytesRead,
+        statistics->Errors,
+        statistics->BusTime);
+
+#if DBG
+    Trace(
+        TRACE_LEVEL_INFORMATION,
+        TRACE_SPB,
+        "Spb: %I64u of those errors were injected",
+        SpbContext->FaultInjection.Injected);
+#endif
+
+    for (i = 0; i < RTL_NUMBER_OF(busSpeeds); i++)
+    {
+        Trace(
+            TRACE_LEVEL_INFORMATION,
+            TRACE_SPB,
+            "Spb: %I64uns modeled on the bus at %uHz",
+            SpbModelTransferTime(
+                busSpeeds[i],
+                0,
+                statistics->WriteTransactions + statistics->ReadTransactions,
+                statistics->BytesWritten + statistics->BytesRead),
+            busSpeeds[i]);
+    }
+}